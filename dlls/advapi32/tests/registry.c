@@ -4132,6 +4132,52 @@ static void test_EnumDynamicTimeZoneInformation(void)
     RegCloseKey(key);
 }
 
+/* trace the longest registry request across a periodic save of a large hive */
+static void test_save_latency(void)
+{
+    char name[32], data[256];
+    DWORD start, now, elapsed, longest = 0, count = 0;
+    HKEY key, subkey;
+    int i, j;
+    LONG ret;
+
+    /* wineserver saves the registry every 30 seconds, so this takes a while */
+    if (!winetest_interactive) return;
+
+    ret = RegCreateKeyA( hkey_main, "Large", &key );
+    ok( !ret, "RegCreateKey failed, error %d\n", ret );
+    memset( data, 'x', sizeof(data) - 1 );
+    data[sizeof(data) - 1] = 0;
+    for (i = 0; i < 200; i++)
+    {
+        sprintf( name, "Key%u", i );
+        ret = RegCreateKeyA( key, name, &subkey );
+        ok( !ret, "RegCreateKey failed, error %d\n", ret );
+        for (j = 0; j < 100; j++)
+        {
+            sprintf( name, "Value%u", j );
+            RegSetValueExA( subkey, name, 0, REG_SZ, (const BYTE *)data, sizeof(data) );
+        }
+        RegCloseKey( subkey );
+    }
+
+    /* keep the hive dirty until a save has happened */
+    start = GetTickCount();
+    do
+    {
+        now = GetTickCount();
+        ret = RegSetValueExA( key, "Counter", 0, REG_DWORD, (const BYTE *)&count, sizeof(count) );
+        ok( !ret, "RegSetValueEx failed, error %d\n", ret );
+        elapsed = GetTickCount() - now;
+        if (elapsed > longest) longest = elapsed;
+        count++;
+    } while (now - start < 35000);
+    trace( "%u requests, longest %u ms\n", count, longest );
+
+    delete_key( key );
+    RegCloseKey( key );
+}
+
 START_TEST(registry)
 {
     /* Load pointers for functions that are not available in all Windows versions */
@@ -4170,6 +4216,7 @@ START_TEST(registry)
     test_RegQueryValueExPerformanceData();
     test_RegLoadMUIString();
     test_EnumDynamicTimeZoneInformation();
+    test_save_latency();
 
     /* cleanup */
     delete_key( hkey_main );
@@ -466,6 +466,210 @@ static int get_overlap( const dib_info *dst, const RECT *dst_rect,
     return ret;
 }
 
+/* Large blits can optionally be split into horizontal bands that are rendered
+ * in parallel on the thread pool.  Every band only touches its own destination
+ * rows, so the result is identical to the serial case as long as the source
+ * and destination don't overlap.  The calling thread renders bands too, and only
+ * waits for the bands that other threads have started; a pool callback that runs
+ * after the blit is done finds nothing left to render. */
+
+#define BAND_MIN_PIXELS     16384
+#define BAND_MAX_THREADS    64
+
+static struct
+{
+    DWORD threads;    /* maximum number of threads rendering a single blit, 0 if disabled */
+    DWORD threshold;  /* minimum number of destination pixels before a blit is split */
+} band_options = { 0, 512 * 512 };
+
+struct band_job
+{
+    void          (*func)( const struct band_job *job, const RECT *rect );
+    const dib_info *dst;
+    const RECT     *dst_rect;
+    const dib_info *src;
+    const RECT     *src_rect;
+    int             rop2;
+    DWORD           and;
+    DWORD           xor;
+    BLENDFUNCTION   blend;
+    RECT           *bands;
+    LONG            count;
+    LONG            next;       /* next band to render */
+    LONG            remaining;  /* bands not rendered yet */
+    LONG            refs;       /* the calling thread and the submitted callbacks */
+};
+
+static CRITICAL_SECTION band_section;
+static CRITICAL_SECTION_DEBUG band_critsect_debug =
+{
+    0, 0, &band_section,
+    { &band_critsect_debug.ProcessLocksList, &band_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": band_section") }
+};
+static CRITICAL_SECTION band_section = { &band_critsect_debug, -1, 0, 0, 0, 0 };
+static CONDITION_VARIABLE band_done = CONDITION_VARIABLE_INIT;
+
+static BOOL WINAPI init_band_options( INIT_ONCE *once, void *param, void **context )
+{
+    static const WCHAR blit_threadsW[] = {'B','l','i','t','T','h','r','e','a','d','s',0};
+    static const WCHAR blit_thresholdW[] = {'B','l','i','t','T','h','r','e','s','h','o','l','d',0};
+    SYSTEM_INFO info;
+    DWORD value;
+
+    if (get_dib_option( blit_threadsW, &value ))
+    {
+        GetSystemInfo( &info );
+        band_options.threads = min( min( value, info.dwNumberOfProcessors ), BAND_MAX_THREADS );
+        if (band_options.threads < 2) band_options.threads = 0;
+    }
+    if (get_dib_option( blit_thresholdW, &value ))
+        band_options.threshold = max( value, BAND_MIN_PIXELS );
+
+    if (band_options.threads)
+        TRACE( "using up to %u threads for blits of more than %u pixels\n",
+               band_options.threads, band_options.threshold );
+    return TRUE;
+}
+
+static void release_band_job( struct band_job *job )
+{
+    if (InterlockedDecrement( &job->refs )) return;
+    HeapFree( GetProcessHeap(), 0, job->bands );
+    HeapFree( GetProcessHeap(), 0, job );
+}
+
+static void run_bands( struct band_job *job )
+{
+    LONG i;
+
+    while ((i = InterlockedIncrement( &job->next ) - 1) < job->count)
+    {
+        job->func( job, &job->bands[i] );
+        if (InterlockedDecrement( &job->remaining )) continue;
+        EnterCriticalSection( &band_section );
+        WakeAllConditionVariable( &band_done );
+        LeaveCriticalSection( &band_section );
+    }
+}
+
+static void CALLBACK band_worker( TP_CALLBACK_INSTANCE *instance, void *context )
+{
+    struct band_job *job = context;
+
+    run_bands( job );
+    release_band_job( job );
+}
+
+/* split the rectangles into bands and render them in parallel; returns FALSE if the
+ * caller should render them itself */
+static BOOL render_bands( const struct band_job *params, const RECT *rects, int count )
+{
+    static INIT_ONCE init_once = INIT_ONCE_STATIC_INIT;
+    ULONGLONG total = 0, band_pixels, pixels;
+    int i, y, rows, height, width, pieces;
+    struct band_job *job;
+    DWORD threads;
+
+    InitOnceExecuteOnce( &init_once, init_band_options, NULL, NULL );
+    if (!band_options.threads) return FALSE;
+
+    for (i = 0; i < count; i++)
+        total += (ULONGLONG)(rects[i].right - rects[i].left) * (rects[i].bottom - rects[i].top);
+    if (total < band_options.threshold) return FALSE;
+
+    /* a few bands per thread to even out the load */
+    band_pixels = max( total / (band_options.threads * 4), BAND_MIN_PIXELS );
+    if (!(job = HeapAlloc( GetProcessHeap(), 0, sizeof(*job) ))) return FALSE;
+    *job = *params;
+    if (!(job->bands = HeapAlloc( GetProcessHeap(), 0, (count + total / band_pixels) * sizeof(RECT) )))
+    {
+        HeapFree( GetProcessHeap(), 0, job );
+        return FALSE;
+    }
+
+    job->count = 0;
+    for (i = 0; i < count; i++)
+    {
+        width  = rects[i].right - rects[i].left;
+        height = rects[i].bottom - rects[i].top;
+        if (width <= 0 || height <= 0) continue;
+        pixels = (ULONGLONG)width * height;
+        pieces = min( (pixels + band_pixels - 1) / band_pixels, height );
+        rows = (height + pieces - 1) / pieces;
+        for (y = rects[i].top; y < rects[i].bottom; y += rows)
+        {
+            job->bands[job->count] = rects[i];
+            job->bands[job->count].top = y;
+            job->bands[job->count].bottom = min( y + rows, rects[i].bottom );
+            job->count++;
+        }
+    }
+
+    threads = min( band_options.threads, job->count );
+    job->next = 0;
+    job->remaining = job->count;
+    job->refs = threads;
+    for (i = 1; i < threads; i++)
+        if (!TrySubmitThreadpoolCallback( band_worker, job, NULL )) release_band_job( job );
+
+    TRACE( "%u pixels in %d bands on %u threads\n", (DWORD)total, job->count, threads );
+
+    run_bands( job );
+    if (job->remaining)
+    {
+        EnterCriticalSection( &band_section );
+        while (job->remaining) SleepConditionVariableCS( &band_done, &band_section, INFINITE );
+        LeaveCriticalSection( &band_section );
+    }
+    release_band_job( job );
+    return TRUE;
+}
+
+static void solid_band( const struct band_job *job, const RECT *rect )
+{
+    job->dst->funcs->solid_rects( job->dst, 1, rect, job->and, job->xor );
+}
+
+static void copy_band( const struct band_job *job, const RECT *rect )
+{
+    POINT origin;
+
+    origin.x = job->src_rect->left + rect->left - job->dst_rect->left;
+    origin.y = job->src_rect->top  + rect->top  - job->dst_rect->top;
+    job->dst->funcs->copy_rect( job->dst, rect, job->src, &origin, job->rop2, 0 );
+}
+
+static void mask_band( const struct band_job *job, const RECT *rect )
+{
+    POINT origin;
+
+    origin.x = job->src_rect->left + rect->left - job->dst_rect->left;
+    origin.y = job->src_rect->top  + rect->top  - job->dst_rect->top;
+    job->dst->funcs->mask_rect( job->dst, rect, job->src, &origin, job->rop2 );
+}
+
+static void blend_band( const struct band_job *job, const RECT *rect )
+{
+    POINT origin;
+
+    origin.x = job->src_rect->left + rect->left - job->dst_rect->left;
+    origin.y = job->src_rect->top  + rect->top  - job->dst_rect->top;
+    job->dst->funcs->blend_rect( job->dst, rect, job->src, &origin, job->blend );
+}
+
+static void init_band_job( struct band_job *job, void (*func)( const struct band_job *, const RECT * ),
+                           const dib_info *dst, const RECT *dst_rect,
+                           const dib_info *src, const RECT *src_rect )
+{
+    memset( job, 0, sizeof(*job) );
+    job->func     = func;
+    job->dst      = dst;
+    job->dst_rect = dst_rect;
+    job->src      = src;
+    job->src_rect = src_rect;
+}
+
 static void copy_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src, const RECT *src_rect,
                         const struct clipped_rects *clipped_rects, INT rop2 )
 {
@@ -473,6 +677,7 @@ static void copy_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src,
     const RECT *rects;
     int i, count, start, end, overlap;
     DWORD and = 0, xor = 0;
+    struct band_job job;
 
     if (clipped_rects)
     {
@@ -492,13 +697,24 @@ static void copy_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src,
     case R2_WHITE: xor = ~0u;
         /* fall through */
     case R2_BLACK:
-        dst->funcs->solid_rects( dst, count, rects, and, xor );
+        init_band_job( &job, solid_band, dst, dst_rect, src, src_rect );
+        job.and = and;
+        job.xor = xor;
+        if (!render_bands( &job, rects, count ))
+            dst->funcs->solid_rects( dst, count, rects, and, xor );
         /* fall through */
     case R2_NOP:
         return;
     }
 
     overlap = get_overlap( dst, dst_rect, src, src_rect );
+    if (!overlap)
+    {
+        init_band_job( &job, copy_band, dst, dst_rect, src, src_rect );
+        job.rop2 = rop2;
+        if (render_bands( &job, rects, count )) return;
+    }
+
     if (overlap & OVERLAP_BELOW)
     {
         if (overlap & OVERLAP_RIGHT)  /* right to left, bottom to top */
@@ -558,6 +774,7 @@ static void mask_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src,
     POINT origin;
     const RECT *rects;
     int i, count;
+    struct band_job job;
 
     if (rop2 == R2_BLACK || rop2 == R2_NOT || rop2 == R2_NOP || rop2 == R2_WHITE)
         return copy_rect( dst, dst_rect, src, src_rect, clipped_rects, rop2 );
@@ -573,6 +790,10 @@ static void mask_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src,
         count = 1;
     }
 
+    init_band_job( &job, mask_band, dst, dst_rect, src, src_rect );
+    job.rop2 = rop2;
+    if (render_bands( &job, rects, count )) return;
+
     for (i = 0; i < count; i++)
     {
         origin.x = src_rect->left + rects[i].left - dst_rect->left;
@@ -586,14 +807,20 @@ static DWORD blend_rect( dib_info *dst, const RECT *dst_rect, const dib_info *sr
 {
     POINT origin;
     struct clipped_rects clipped_rects;
+    struct band_job job;
     int i;
 
     if (!get_clipped_rects( dst, dst_rect, clip, &clipped_rects )) return ERROR_SUCCESS;
-    for (i = 0; i < clipped_rects.count; i++)
+    init_band_job( &job, blend_band, dst, dst_rect, src, src_rect );
+    job.blend = blend;
+    if (!render_bands( &job, clipped_rects.rects, clipped_rects.count ))
     {
-        origin.x = src_rect->left + clipped_rects.rects[i].left - dst_rect->left;
-        origin.y = src_rect->top  + clipped_rects.rects[i].top  - dst_rect->top;
-        dst->funcs->blend_rect( dst, &clipped_rects.rects[i], src, &origin, blend );
+        for (i = 0; i < clipped_rects.count; i++)
+        {
+            origin.x = src_rect->left + clipped_rects.rects[i].left - dst_rect->left;
+            origin.y = src_rect->top  + clipped_rects.rects[i].top  - dst_rect->top;
+            dst->funcs->blend_rect( dst, &clipped_rects.rects[i], src, &origin, blend );
+        }
     }
     free_clipped_rects( &clipped_rects );
     return ERROR_SUCCESS;
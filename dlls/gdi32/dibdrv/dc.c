@@ -21,8 +21,10 @@
 #include <assert.h>
 
 #include "gdi_private.h"
+#include "winreg.h"
 #include "dibdrv.h"
 
+#include "wine/unicode.h"
 #include "wine/exception.h"
 #include "wine/debug.h"
 
@@ -314,6 +316,64 @@ void add_clipped_bounds( dibdrv_physdev *dev, const RECT *rect, HRGN clip )
     add_bounds_rect( dev->bounds, &rc );
 }
 
+static DWORD query_dib_option( HKEY key, const WCHAR *name, DWORD *value )
+{
+    WCHAR buf[12];
+    DWORD count = sizeof(buf), type, err;
+
+    err = RegQueryValueExW( key, name, NULL, &type, (BYTE *)buf, &count );
+    if (!err)
+    {
+        if (type == REG_DWORD) memcpy( value, buf, sizeof(*value) );
+        else if (type == REG_SZ) *value = atoiW( buf );
+        else err = ERROR_INVALID_DATA;
+    }
+    return err;
+}
+
+/***********************************************************************
+ *           get_dib_option
+ *
+ * Read a numeric option of the dib engine, with per-application
+ * settings taking precedence over the global ones.
+ */
+BOOL get_dib_option( const WCHAR *name, DWORD *value )
+{
+    static const WCHAR gdiW[] = {'S','o','f','t','w','a','r','e','\\','W','i','n','e','\\','G','d','i',0};
+    static const WCHAR app_defaultsW[] = {'S','o','f','t','w','a','r','e','\\','W','i','n','e','\\',
+                                          'A','p','p','D','e','f','a','u','l','t','s',0};
+    static const WCHAR gdi_subkeyW[] = {'\\','G','d','i',0};
+    WCHAR buffer[MAX_PATH + 8], *appname;
+    HKEY key, app_key;
+    DWORD len, err = ERROR_FILE_NOT_FOUND;
+
+    len = GetModuleFileNameW( 0, buffer, MAX_PATH );
+    if (len && len < MAX_PATH)
+    {
+        if ((appname = strrchrW( buffer, '\\' ))) appname++;
+        else appname = buffer;
+        strcatW( appname, gdi_subkeyW );
+        /* @@ Wine registry key: HKCU\Software\Wine\AppDefaults\app.exe\Gdi */
+        if (!RegOpenKeyW( HKEY_CURRENT_USER, app_defaultsW, &key ))
+        {
+            if (!RegOpenKeyW( key, appname, &app_key ))
+            {
+                err = query_dib_option( app_key, name, value );
+                RegCloseKey( app_key );
+            }
+            RegCloseKey( key );
+        }
+    }
+
+    /* @@ Wine registry key: HKCU\Software\Wine\Gdi */
+    if (err && !RegOpenKeyW( HKEY_CURRENT_USER, gdiW, &key ))
+    {
+        err = query_dib_option( key, name, value );
+        RegCloseKey( key );
+    }
+    return !err;
+}
+
 /**********************************************************************
  *	     dibdrv_CreateDC
  */
@@ -29,8 +29,15 @@ WINE_DEFAULT_DEBUG_CHANNEL(dib);
 
 struct cached_glyph
 {
-    GLYPHMETRICS metrics;
-    BYTE         bits[1];
+    struct list          entry;       /* entry in glyph_lru or retired_glyphs */
+    struct cached_font  *font;
+    UINT                 index;
+    BYTE                 type;
+    BOOL                 referenced;  /* used since the last eviction pass */
+    LONG                 epoch;       /* render epoch when the glyph was evicted */
+    DWORD                size;
+    GLYPHMETRICS         metrics;
+    BYTE                 bits[1];
 };
 
 enum glyph_type
@@ -54,8 +61,24 @@ struct cached_font
     struct cached_glyph **glyphs[GLYPH_NBTYPES][GLYPH_CACHE_PAGES];
 };
 
+#define MAX_UNUSED_FONTS          16
+#define DEFAULT_GLYPH_CACHE_SIZE  (4 * 1024 * 1024)
+
 static struct list font_cache = LIST_INIT( font_cache );
 
+/* All the cached glyphs share a single memory budget.  Glyphs are looked up
+ * without holding the lock, so an evicted glyph is only freed once every string
+ * that started rendering before its eviction is done.  Renders are counted per
+ * epoch; the epoch advances once all the renders of the previous one are done,
+ * so glyphs evicted two epochs ago can no longer be in use. */
+static struct list glyph_lru = LIST_INIT( glyph_lru );  /* most recently added or used first */
+static struct list retired_glyphs = LIST_INIT( retired_glyphs );  /* oldest eviction first */
+static SIZE_T glyph_cache_size;
+static SIZE_T glyph_cache_max;
+static LONG render_epoch;
+static LONG active_renders[2];  /* renders that started in an even or odd epoch */
+static LONG glyph_hits, glyph_misses, glyph_evictions;
+
 static CRITICAL_SECTION font_cache_cs;
 static CRITICAL_SECTION_DEBUG critsect_debug =
 {
@@ -554,6 +577,17 @@ static int font_cache_cmp( const struct cached_font *p1, const struct cached_fon
     return ret;
 }
 
+static void init_glyph_cache(void)
+{
+    static const WCHAR glyph_cache_sizeW[] = {'G','l','y','p','h','C','a','c','h','e','S','i','z','e',0};
+    DWORD size;
+
+    glyph_cache_max = DEFAULT_GLYPH_CACHE_SIZE;
+    if (get_dib_option( glyph_cache_sizeW, &size ) && size)  /* in kilobytes */
+        glyph_cache_max = max( (SIZE_T)size * 1024, 64 * 1024 );
+    TRACE( "glyph cache size %lu\n", glyph_cache_max );
+}
+
 static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
 {
     struct cached_font font, *ptr, *last_unused = NULL;
@@ -573,6 +607,7 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
     font.hash = font_cache_hash( &font );
 
     EnterCriticalSection( &font_cache_cs );
+    if (!glyph_cache_max) init_glyph_cache();
     LIST_FOR_EACH_ENTRY( ptr, &font_cache, struct cached_font, entry )
     {
         if (!font_cache_cmp( &font, ptr ))
@@ -588,7 +623,7 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
         }
     }
 
-    if (i > 5)  /* keep at least 5 of the most-recently used fonts around */
+    if (i > MAX_UNUSED_FONTS)  /* keep some of the most-recently used fonts around */
     {
         ptr = last_unused;
         for (i = 0; i < GLYPH_NBTYPES; i++)
@@ -597,7 +632,13 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
             {
                 if (!ptr->glyphs[i][j]) continue;
                 for (k = 0; k < GLYPH_CACHE_PAGE_SIZE; k++)
-                    HeapFree( GetProcessHeap(), 0, ptr->glyphs[i][j][k] );
+                {
+                    struct cached_glyph *glyph = ptr->glyphs[i][j][k];
+                    if (!glyph) continue;
+                    list_remove( &glyph->entry );
+                    glyph_cache_size -= glyph->size;
+                    HeapFree( GetProcessHeap(), 0, glyph );
+                }
                 HeapFree( GetProcessHeap(), 0, ptr->glyphs[i][j] );
             }
         }
@@ -624,6 +665,56 @@ void release_cached_font( struct cached_font *font )
     if (font) InterlockedDecrement( &font->ref );
 }
 
+/* free the evicted glyphs that no other thread can still be using */
+static void free_retired_glyphs(void)
+{
+    struct cached_glyph *glyph;
+    struct list *ptr;
+
+    while ((ptr = list_head( &retired_glyphs )))
+    {
+        glyph = LIST_ENTRY( ptr, struct cached_glyph, entry );
+        if (render_epoch - glyph->epoch < 2)
+        {
+            if (active_renders[(render_epoch - 1) & 1]) break;
+            InterlockedIncrement( &render_epoch );
+            continue;
+        }
+        list_remove( &glyph->entry );
+        HeapFree( GetProcessHeap(), 0, glyph );
+    }
+}
+
+/* evict the least recently used glyphs until the cache fits in its budget */
+static void evict_glyphs(void)
+{
+    struct cached_glyph *glyph;
+    struct list *ptr;
+    UINT count = 0;
+
+    while (glyph_cache_size > glyph_cache_max && (ptr = list_tail( &glyph_lru )))
+    {
+        glyph = LIST_ENTRY( ptr, struct cached_glyph, entry );
+        list_remove( &glyph->entry );
+        if (glyph->referenced)  /* give it a second chance */
+        {
+            glyph->referenced = FALSE;
+            list_add_head( &glyph_lru, &glyph->entry );
+            continue;
+        }
+        glyph->font->glyphs[glyph->type][glyph->index / GLYPH_CACHE_PAGE_SIZE]
+                           [glyph->index % GLYPH_CACHE_PAGE_SIZE] = NULL;
+        glyph_cache_size -= glyph->size;
+        glyph->epoch = render_epoch;
+        list_add_tail( &retired_glyphs, &glyph->entry );
+        count++;
+    }
+    glyph_evictions += count;
+
+    TRACE( "evicted %u glyphs, %lu bytes cached, %u hits %u misses %u evictions\n",
+           count, glyph_cache_size, glyph_hits, glyph_misses, glyph_evictions );
+}
+
 static struct cached_glyph *add_cached_glyph( struct cached_font *font, UINT index, UINT flags,
                                               struct cached_glyph *glyph )
 {
@@ -632,6 +723,12 @@ static struct cached_glyph *add_cached_glyph( struct cached_font *font, UINT ind
     UINT page = index / GLYPH_CACHE_PAGE_SIZE;
     UINT entry = index % GLYPH_CACHE_PAGE_SIZE;
 
+    glyph->font = font;
+    glyph->index = index;
+    glyph->type = type;
+    glyph->referenced = FALSE;
+
+    EnterCriticalSection( &font_cache_cs );
     if (!font->glyphs[type][page])
     {
         struct cached_glyph **ptr;
@@ -639,15 +736,23 @@ static struct cached_glyph *add_cached_glyph( struct cached_font *font, UINT ind
         ptr = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, GLYPH_CACHE_PAGE_SIZE * sizeof(*ptr) );
         if (!ptr)
         {
+            LeaveCriticalSection( &font_cache_cs );
             HeapFree( GetProcessHeap(), 0, glyph );
             return NULL;
         }
-        if (InterlockedCompareExchangePointer( (void **)&font->glyphs[type][page], ptr, NULL ))
-            HeapFree( GetProcessHeap(), 0, ptr );
+        InterlockedExchangePointer( (void **)&font->glyphs[type][page], ptr );
+    }
+    if (!(ret = font->glyphs[type][page][entry]))
+    {
+        /* lookups don't take the lock, make sure they see an initialized glyph */
+        InterlockedExchangePointer( (void **)&font->glyphs[type][page][entry], glyph );
+        ret = glyph;
+        glyph_cache_size += glyph->size;
+        if (glyph_cache_size > glyph_cache_max) evict_glyphs();
+        list_add_head( &glyph_lru, &glyph->entry );
     }
-    ret = InterlockedCompareExchangePointer( (void **)&font->glyphs[type][page][entry], glyph, NULL );
-    if (!ret) ret = glyph;
     else HeapFree( GetProcessHeap(), 0, glyph );
+    LeaveCriticalSection( &font_cache_cs );
     return ret;
 }
 
@@ -655,9 +760,39 @@ static struct cached_glyph *get_cached_glyph( struct cached_font *font, UINT ind
 {
     enum glyph_type type = (flags & ETO_GLYPH_INDEX) ? GLYPH_INDEX : GLYPH_WCHAR;
     UINT page = index / GLYPH_CACHE_PAGE_SIZE;
+    struct cached_glyph **ptr = font->glyphs[type][page];
+    struct cached_glyph *glyph;
 
-    if (!font->glyphs[type][page]) return NULL;
-    return font->glyphs[type][page][index % GLYPH_CACHE_PAGE_SIZE];
+    if (!ptr || !(glyph = ptr[index % GLYPH_CACHE_PAGE_SIZE])) return NULL;
+    if (!glyph->referenced) glyph->referenced = TRUE;
+    return glyph;
+}
+
+/* glyphs returned by the cache stay valid until end_render_glyphs() */
+static LONG begin_render_glyphs(void)
+{
+    LONG epoch;
+
+    for (;;)
+    {
+        epoch = render_epoch;
+        InterlockedIncrement( &active_renders[epoch & 1] );
+        /* the epoch may have advanced before we were counted */
+        if (render_epoch == epoch) return epoch;
+        InterlockedDecrement( &active_renders[epoch & 1] );
+    }
+}
+
+static void end_render_glyphs( LONG epoch, UINT hits, UINT misses )
+{
+    if (hits) InterlockedExchangeAdd( &glyph_hits, hits );
+    if (misses) InterlockedExchangeAdd( &glyph_misses, misses );
+    InterlockedDecrement( &active_renders[epoch & 1] );
+    if (list_empty( &retired_glyphs )) return;
+
+    EnterCriticalSection( &font_cache_cs );
+    free_retired_glyphs();
+    LeaveCriticalSection( &font_cache_cs );
 }
 
 /**********************************************************************
@@ -773,6 +908,7 @@ static struct cached_glyph *cache_glyph_bitmap( DC *dc, struct cached_font *font
     size = metrics.gmBlackBoxY * stride;
     glyph = HeapAlloc( GetProcessHeap(), 0, FIELD_OFFSET( struct cached_glyph, bits[size] ));
     if (!glyph) return NULL;
+    glyph->size = FIELD_OFFSET( struct cached_glyph, bits[size] );
     if (!size) goto done;  /* empty glyph */
 
     if (bit_count == 8) pad = padding[ metrics.gmBlackBoxX % 4 ];
@@ -812,8 +948,9 @@ static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT
                            UINT flags, const WCHAR *str, UINT count, const INT *dx,
                            const struct clipped_rects *clipped_rects, RECT *bounds )
 {
-    UINT i;
+    UINT i, hits = 0, misses = 0;
     struct cached_glyph *glyph;
+    LONG epoch;
     dib_info glyph_dib;
     DWORD text_color;
     struct font_intensities intensity;
@@ -831,10 +968,12 @@ static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT
     else
         get_aa_ranges( dib->funcs->pixel_to_colorref( dib, text_color ), intensity.ranges );
 
+    epoch = begin_render_glyphs();
     for (i = 0; i < count; i++)
     {
-        if (!(glyph = get_cached_glyph( font, str[i], flags )) &&
-            !(glyph = cache_glyph_bitmap( dc, font, str[i], flags ))) continue;
+        if ((glyph = get_cached_glyph( font, str[i], flags ))) hits++;
+        else if ((glyph = cache_glyph_bitmap( dc, font, str[i], flags ))) misses++;
+        else continue;
 
         glyph_dib.width       = glyph->metrics.gmBlackBoxX;
         glyph_dib.height      = glyph->metrics.gmBlackBoxY;
@@ -861,6 +1000,7 @@ static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT
             y += glyph->metrics.gmCellIncY;
         }
     }
+    end_render_glyphs( epoch, hits, misses );
 }
 
 BOOL render_aa_text_bitmapinfo( DC *dc, BITMAPINFO *info, struct gdi_image_bits *bits,
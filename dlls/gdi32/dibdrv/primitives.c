@@ -19,6 +19,14 @@
  */
 
 #include <assert.h>
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_SIMD_PRIMITIVES
+#include <cpuid.h>
+#include <immintrin.h>
+#define SSE2_FUNC __attribute__((target("sse2")))
+#define AVX2_FUNC __attribute__((target("avx2")))
+#endif
 
 #include "gdi_private.h"
 #include "dibdrv.h"
@@ -108,6 +116,119 @@ static const BYTE pixel_masks_4[2] = {0xf0, 0x0f};
 static const BYTE pixel_masks_1[8] = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
 static const BYTE edge_masks_1[8] = {0xff, 0x7f, 0x3f, 0x1f, 0x0f, 0x07, 0x03, 0x01};
 
+#ifdef HAVE_SIMD_PRIMITIVES
+
+enum simd_level
+{
+    SIMD_UNKNOWN,
+    SIMD_NONE,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+static enum simd_level simd_level;
+
+static enum simd_level get_simd_level(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    enum simd_level level = SIMD_NONE;
+
+    if (simd_level) return simd_level;
+
+    if (__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) && (edx & bit_SSE2))
+    {
+        level = SIMD_SSE2;
+        /* AVX2 also needs the OS to save the ymm registers */
+        if ((ecx & (bit_OSXSAVE | bit_AVX)) == (bit_OSXSAVE | bit_AVX) && __get_cpuid_max( 0, NULL ) >= 7)
+        {
+            __asm__( "xgetbv" : "=a" (eax), "=d" (edx) : "c" (0) );
+            if ((eax & 6) == 6)
+            {
+                __cpuid_count( 7, 0, eax, ebx, ecx, edx );
+                if (ebx & bit_AVX2) level = SIMD_AVX2;
+            }
+        }
+    }
+    TRACE( "simd level %u\n", level );
+    return simd_level = level;
+}
+
+static void SSE2_FUNC convert_row_555_to_8888_sse2( DWORD *dst, const WORD *src, int len )
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m128i val = _mm_loadu_si128( (const __m128i *)(src + x) );
+        __m128i lo = _mm_unpacklo_epi16( val, zero ), hi = _mm_unpackhi_epi16( val, zero );
+
+#define EXPAND_555(v) \
+        _mm_or_si128( _mm_or_si128( _mm_or_si128( \
+            _mm_and_si128( _mm_slli_epi32( v, 9 ), _mm_set1_epi32( 0xf80000 )), \
+            _mm_and_si128( _mm_slli_epi32( v, 4 ), _mm_set1_epi32( 0x070000 ))), \
+            _mm_or_si128( _mm_and_si128( _mm_slli_epi32( v, 6 ), _mm_set1_epi32( 0x00f800 )), \
+                          _mm_and_si128( _mm_slli_epi32( v, 1 ), _mm_set1_epi32( 0x000700 )))), \
+            _mm_or_si128( _mm_and_si128( _mm_slli_epi32( v, 3 ), _mm_set1_epi32( 0x0000f8 )), \
+                          _mm_and_si128( _mm_srli_epi32( v, 2 ), _mm_set1_epi32( 0x000007 ))))
+
+        _mm_storeu_si128( (__m128i *)(dst + x), EXPAND_555( lo ));
+        _mm_storeu_si128( (__m128i *)(dst + x + 4), EXPAND_555( hi ));
+#undef EXPAND_555
+    }
+    for ( ; x < len; x++)
+    {
+        DWORD src_val = src[x];
+        dst[x] = ((src_val << 9) & 0xf80000) | ((src_val << 4) & 0x070000) |
+                 ((src_val << 6) & 0x00f800) | ((src_val << 1) & 0x000700) |
+                 ((src_val << 3) & 0x0000f8) | ((src_val >> 2) & 0x000007);
+    }
+}
+
+static void SSE2_FUNC convert_row_8888_to_555_sse2( WORD *dst, const DWORD *src, int len )
+{
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m128i lo = _mm_loadu_si128( (const __m128i *)(src + x) );
+        __m128i hi = _mm_loadu_si128( (const __m128i *)(src + x + 4) );
+
+#define PACK_555(v) \
+        _mm_or_si128( _mm_or_si128( \
+            _mm_and_si128( _mm_srli_epi32( v, 9 ), _mm_set1_epi32( 0x7c00 )), \
+            _mm_and_si128( _mm_srli_epi32( v, 6 ), _mm_set1_epi32( 0x03e0 ))), \
+            _mm_and_si128( _mm_srli_epi32( v, 3 ), _mm_set1_epi32( 0x001f )))
+
+        /* values fit in 15 bits so the signed saturation doesn't change them */
+        _mm_storeu_si128( (__m128i *)(dst + x), _mm_packs_epi32( PACK_555( lo ), PACK_555( hi )));
+#undef PACK_555
+    }
+    for ( ; x < len; x++)
+        dst[x] = ((src[x] >> 9) & 0x7c00) | ((src[x] >> 6) & 0x03e0) | ((src[x] >> 3) & 0x001f);
+}
+
+enum glyph_run
+{
+    GLYPH_RUN_MIXED,
+    GLYPH_RUN_CLEAR,  /* all values <= 1, nothing to draw */
+    GLYPH_RUN_SOLID   /* all values >= 16, plain text color */
+};
+
+/* classify a run of 16 glyph pixels */
+static enum glyph_run SSE2_FUNC get_glyph_run_sse2( const BYTE *glyph )
+{
+    const __m128i one = _mm_set1_epi8( 1 ), sixteen = _mm_set1_epi8( 16 );
+    __m128i val = _mm_loadu_si128( (const __m128i *)glyph );
+
+    if (_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_max_epu8( val, one ), one )) == 0xffff)
+        return GLYPH_RUN_CLEAR;
+    if (_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_max_epu8( val, sixteen ), val )) == 0xffff)
+        return GLYPH_RUN_SOLID;
+    return GLYPH_RUN_MIXED;
+}
+#endif
+
 #define FILTER_DIBINDEX(rgbquad,other_val) \
     (HIWORD( *(DWORD *)(&rgbquad) ) == 0x10ff ? LOWORD( *(DWORD *)(&rgbquad) ) : (other_val))
 
@@ -2308,6 +2429,19 @@ static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_
         WORD *src_start = get_pixel_ptr_16(src, src_rect->left, src_rect->top), *src_pixel;
         if(src->funcs == &funcs_555)
         {
+#ifdef HAVE_SIMD_PRIMITIVES
+            if (get_simd_level() >= SIMD_SSE2)
+            {
+                for(y = src_rect->top; y < src_rect->bottom; y++)
+                {
+                    convert_row_555_to_8888_sse2( dst_start, src_start, src_rect->right - src_rect->left );
+                    if(pad_size) memset(dst_start + (src_rect->right - src_rect->left), 0, pad_size);
+                    dst_start += dst->stride / 4;
+                    src_start += src->stride / 2;
+                }
+                break;
+            }
+#endif
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
                 dst_pixel = dst_start;
@@ -2988,6 +3122,19 @@ static void convert_to_555(dib_info *dst, const dib_info *src, const RECT *src_r
 
         if(src->funcs == &funcs_8888)
         {
+#ifdef HAVE_SIMD_PRIMITIVES
+            if (get_simd_level() >= SIMD_SSE2)
+            {
+                for(y = src_rect->top; y < src_rect->bottom; y++)
+                {
+                    convert_row_8888_to_555_sse2( dst_start, src_start, src_rect->right - src_rect->left );
+                    if(pad_size) memset(dst_start + (src_rect->right - src_rect->left), 0, pad_size);
+                    dst_start += dst->stride / 2;
+                    src_start += src->stride / 4;
+                }
+                break;
+            }
+#endif
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
                 dst_pixel = dst_start;
@@ -4633,6 +4780,140 @@ static inline DWORD blend_argb_alpha( DWORD dst, DWORD src, DWORD alpha )
             (alpha + ((BYTE)(dst >> 24) * (255 - alpha) + 127) / 255) << 24);
 }
 
+#ifdef HAVE_SIMD_PRIMITIVES
+
+/* (x + 127) / 255 for each 16-bit value, valid up to 255 * 255 */
+static inline __m128i SSE2_FUNC div255_sse2( __m128i x )
+{
+    x = _mm_add_epi16( x, _mm_set1_epi16( 128 ));
+    return _mm_srli_epi16( _mm_add_epi16( x, _mm_srli_epi16( x, 8 )), 8 );
+}
+
+static inline __m256i AVX2_FUNC div255_avx2( __m256i x )
+{
+    x = _mm256_add_epi16( x, _mm256_set1_epi16( 128 ));
+    return _mm256_srli_epi16( _mm256_add_epi16( x, _mm256_srli_epi16( x, 8 )), 8 );
+}
+
+/* same as blend_argb_alpha(), or blend_argb() if alpha is 255 */
+static void SSE2_FUNC blend_row_argb_sse2( DWORD *dst, const DWORD *src, int len, DWORD alpha )
+{
+    const __m128i zero = _mm_setzero_si128(), max = _mm_set1_epi16( 255 );
+    const __m128i const_alpha = _mm_set1_epi16( alpha ), rgb_mask = _mm_set1_epi32( 0x00ffffff );
+    int i, x;
+
+    for (x = 0; x + 4 <= len; x += 4)
+    {
+        __m128i s = _mm_loadu_si128( (const __m128i *)(src + x) ), d;
+        __m128i s_lo, s_hi, d_lo, d_hi, a_lo, a_hi;
+
+        /* fully transparent source pixels leave the destination unchanged */
+        if (_mm_movemask_epi8( _mm_cmpeq_epi32( s, zero )) == 0xffff) continue;
+        if (alpha == 255 && _mm_movemask_epi8( _mm_cmpeq_epi32( _mm_or_si128( s, rgb_mask ),
+                                                                _mm_cmpeq_epi32( s, s ))) == 0xffff)
+        {
+            _mm_storeu_si128( (__m128i *)(dst + x), s );
+            continue;
+        }
+
+        s_lo = _mm_unpacklo_epi8( s, zero );
+        s_hi = _mm_unpackhi_epi8( s, zero );
+        if (alpha != 255)
+        {
+            s_lo = div255_sse2( _mm_mullo_epi16( s_lo, const_alpha ));
+            s_hi = div255_sse2( _mm_mullo_epi16( s_hi, const_alpha ));
+        }
+        a_lo = _mm_sub_epi16( max, _mm_shufflehi_epi16( _mm_shufflelo_epi16( s_lo, 0xff ), 0xff ));
+        a_hi = _mm_sub_epi16( max, _mm_shufflehi_epi16( _mm_shufflelo_epi16( s_hi, 0xff ), 0xff ));
+
+        d = _mm_loadu_si128( (const __m128i *)(dst + x) );
+        d_lo = _mm_add_epi16( s_lo, div255_sse2( _mm_mullo_epi16( _mm_unpacklo_epi8( d, zero ), a_lo )));
+        d_hi = _mm_add_epi16( s_hi, div255_sse2( _mm_mullo_epi16( _mm_unpackhi_epi8( d, zero ), a_hi )));
+
+        /* source values larger than their alpha overflow into the next component,
+         * leave that case to the generic code */
+        if (_mm_movemask_epi8( _mm_or_si128( _mm_cmpgt_epi16( d_lo, max ), _mm_cmpgt_epi16( d_hi, max ))))
+        {
+            for (i = x; i < x + 4; i++)
+                dst[i] = alpha == 255 ? blend_argb( dst[i], src[i] ) : blend_argb_alpha( dst[i], src[i], alpha );
+            continue;
+        }
+        _mm_storeu_si128( (__m128i *)(dst + x), _mm_packus_epi16( d_lo, d_hi ));
+    }
+    for ( ; x < len; x++)
+        dst[x] = alpha == 255 ? blend_argb( dst[x], src[x] ) : blend_argb_alpha( dst[x], src[x], alpha );
+}
+
+static void AVX2_FUNC blend_row_argb_avx2( DWORD *dst, const DWORD *src, int len, DWORD alpha )
+{
+    const __m256i zero = _mm256_setzero_si256(), max = _mm256_set1_epi16( 255 );
+    const __m256i const_alpha = _mm256_set1_epi16( alpha ), rgb_mask = _mm256_set1_epi32( 0x00ffffff );
+    int i, x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m256i s = _mm256_loadu_si256( (const __m256i *)(src + x) ), d;
+        __m256i s_lo, s_hi, d_lo, d_hi, a_lo, a_hi;
+
+        if (_mm256_movemask_epi8( _mm256_cmpeq_epi32( s, zero )) == -1) continue;
+        if (alpha == 255 && _mm256_movemask_epi8( _mm256_cmpeq_epi32( _mm256_or_si256( s, rgb_mask ),
+                                                                      _mm256_cmpeq_epi32( s, s ))) == -1)
+        {
+            _mm256_storeu_si256( (__m256i *)(dst + x), s );
+            continue;
+        }
+
+        s_lo = _mm256_unpacklo_epi8( s, zero );
+        s_hi = _mm256_unpackhi_epi8( s, zero );
+        if (alpha != 255)
+        {
+            s_lo = div255_avx2( _mm256_mullo_epi16( s_lo, const_alpha ));
+            s_hi = div255_avx2( _mm256_mullo_epi16( s_hi, const_alpha ));
+        }
+        a_lo = _mm256_sub_epi16( max, _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( s_lo, 0xff ), 0xff ));
+        a_hi = _mm256_sub_epi16( max, _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( s_hi, 0xff ), 0xff ));
+
+        d = _mm256_loadu_si256( (const __m256i *)(dst + x) );
+        d_lo = _mm256_add_epi16( s_lo, div255_avx2( _mm256_mullo_epi16( _mm256_unpacklo_epi8( d, zero ), a_lo )));
+        d_hi = _mm256_add_epi16( s_hi, div255_avx2( _mm256_mullo_epi16( _mm256_unpackhi_epi8( d, zero ), a_hi )));
+
+        if (_mm256_movemask_epi8( _mm256_or_si256( _mm256_cmpgt_epi16( d_lo, max ),
+                                                   _mm256_cmpgt_epi16( d_hi, max ))))
+        {
+            for (i = x; i < x + 8; i++)
+                dst[i] = alpha == 255 ? blend_argb( dst[i], src[i] ) : blend_argb_alpha( dst[i], src[i], alpha );
+            continue;
+        }
+        _mm256_storeu_si256( (__m256i *)(dst + x), _mm256_packus_epi16( d_lo, d_hi ));
+    }
+    for ( ; x < len; x++)
+        dst[x] = alpha == 255 ? blend_argb( dst[x], src[x] ) : blend_argb_alpha( dst[x], src[x], alpha );
+}
+
+/* same as blend_argb_constant_alpha(), with src_alpha or'ed into the source pixels */
+static void SSE2_FUNC blend_row_constant_alpha_sse2( DWORD *dst, const DWORD *src, int len,
+                                                     DWORD alpha, DWORD src_alpha )
+{
+    const __m128i zero = _mm_setzero_si128(), alpha_bits = _mm_set1_epi32( src_alpha );
+    const __m128i src_mul = _mm_set1_epi16( alpha ), dst_mul = _mm_set1_epi16( 255 - alpha );
+    int x;
+
+    for (x = 0; x + 4 <= len; x += 4)
+    {
+        __m128i s = _mm_or_si128( _mm_loadu_si128( (const __m128i *)(src + x) ), alpha_bits );
+        __m128i d = _mm_loadu_si128( (const __m128i *)(dst + x) );
+        __m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( s, zero ), src_mul ),
+                                    _mm_mullo_epi16( _mm_unpacklo_epi8( d, zero ), dst_mul ));
+        __m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( s, zero ), src_mul ),
+                                    _mm_mullo_epi16( _mm_unpackhi_epi8( d, zero ), dst_mul ));
+
+        _mm_storeu_si128( (__m128i *)(dst + x), _mm_packus_epi16( div255_sse2( lo ), div255_sse2( hi )));
+    }
+    for ( ; x < len; x++)
+        dst[x] = blend_argb_constant_alpha( dst[x], src[x] | src_alpha, alpha );
+}
+#endif
+
 static inline DWORD blend_rgb( BYTE dst_r, BYTE dst_g, BYTE dst_b, DWORD src, BLENDFUNCTION blend )
 {
     if (blend.AlphaFormat & AC_SRC_ALPHA)
@@ -4657,6 +4938,24 @@ static void blend_rect_8888(const dib_info *dst, const RECT *rc,
     DWORD *src_ptr = get_pixel_ptr_32( src, origin->x, origin->y );
     DWORD *dst_ptr = get_pixel_ptr_32( dst, rc->left, rc->top );
     int x, y;
+#ifdef HAVE_SIMD_PRIMITIVES
+    enum simd_level level = get_simd_level();
+
+    if (level >= SIMD_SSE2)
+    {
+        for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
+        {
+            if (!(blend.AlphaFormat & AC_SRC_ALPHA))
+                blend_row_constant_alpha_sse2( dst_ptr, src_ptr, rc->right - rc->left, blend.SourceConstantAlpha,
+                                               src->compression == BI_RGB ? 0 : 0xff000000 );
+            else if (level >= SIMD_AVX2)
+                blend_row_argb_avx2( dst_ptr, src_ptr, rc->right - rc->left, blend.SourceConstantAlpha );
+            else
+                blend_row_argb_sse2( dst_ptr, src_ptr, rc->right - rc->left, blend.SourceConstantAlpha );
+        }
+        return;
+    }
+#endif
 
     if (blend.AlphaFormat & AC_SRC_ALPHA)
     {
@@ -6072,11 +6371,23 @@ static void draw_glyph_8888( const dib_info *dib, const RECT *rect, const dib_in
     DWORD *dst_ptr = get_pixel_ptr_32( dib, rect->left, rect->top );
     const BYTE *glyph_ptr = get_pixel_ptr_8( glyph, origin->x, origin->y );
     int x, y;
+#ifdef HAVE_SIMD_PRIMITIVES
+    BOOL sse2 = get_simd_level() >= SIMD_SSE2;
+#endif
 
     for (y = rect->top; y < rect->bottom; y++)
     {
         for (x = 0; x < rect->right - rect->left; x++)
         {
+#ifdef HAVE_SIMD_PRIMITIVES
+            /* skip or fill runs of 16 pixels at once */
+            if (sse2 && !(x & 15) && x + 16 <= rect->right - rect->left)
+            {
+                enum glyph_run run = get_glyph_run_sse2( glyph_ptr + x );
+                if (run == GLYPH_RUN_CLEAR) { x += 15; continue; }
+                if (run == GLYPH_RUN_SOLID) { memset_32( dst_ptr + x, text_pixel, 16 ); x += 15; continue; }
+            }
+#endif
             if (glyph_ptr[x] <= 1) continue;
             if (glyph_ptr[x] >= 16) { dst_ptr[x] = text_pixel; continue; }
             dst_ptr[x] = aa_rgb( dst_ptr[x] >> 16, dst_ptr[x] >> 8, dst_ptr[x], text_pixel, ranges + glyph_ptr[x] );
@@ -6149,6 +6460,9 @@ static void draw_glyph_555( const dib_info *dib, const RECT *rect, const dib_inf
     const BYTE *glyph_ptr = get_pixel_ptr_8( glyph, origin->x, origin->y );
     int x, y;
     DWORD text, val;
+#ifdef HAVE_SIMD_PRIMITIVES
+    BOOL sse2 = get_simd_level() >= SIMD_SSE2;
+#endif
 
     text = ((text_pixel << 9) & 0xf80000) | ((text_pixel << 4) & 0x070000) |
            ((text_pixel << 6) & 0x00f800) | ((text_pixel << 1) & 0x000700) |
@@ -6158,6 +6472,14 @@ static void draw_glyph_555( const dib_info *dib, const RECT *rect, const dib_inf
     {
         for (x = 0; x < rect->right - rect->left; x++)
         {
+#ifdef HAVE_SIMD_PRIMITIVES
+            if (sse2 && !(x & 15) && x + 16 <= rect->right - rect->left)
+            {
+                enum glyph_run run = get_glyph_run_sse2( glyph_ptr + x );
+                if (run == GLYPH_RUN_CLEAR) { x += 15; continue; }
+                if (run == GLYPH_RUN_SOLID) { memset_16( dst_ptr + x, text_pixel, 16 ); x += 15; continue; }
+            }
+#endif
             if (glyph_ptr[x] <= 1) continue;
             if (glyph_ptr[x] >= 16) { dst_ptr[x] = text_pixel; continue; }
             val = aa_rgb( ((dst_ptr[x] >> 7) & 0xf8) | ((dst_ptr[x] >> 12) & 0x07),
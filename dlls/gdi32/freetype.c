@@ -110,6 +110,8 @@ WINE_DEFAULT_DEBUG_CHANNEL(font);
 
 #ifdef HAVE_FREETYPE
 
+WINE_DECLARE_DEBUG_CHANNEL(fontinit);
+
 #ifndef HAVE_FT_TRUETYPEENGINETYPE
 typedef enum
 {
@@ -288,6 +290,21 @@ typedef struct tagFace {
     struct enum_data *cached_enum_data;
 } Face;
 
+/* face properties read from the font file, before the face is added to a family */
+struct face_metadata
+{
+    WCHAR        *family_name;
+    WCHAR        *english_name;
+    WCHAR        *style_name;
+    WCHAR        *full_name;
+    FT_Long       face_index;
+    FONTSIGNATURE fs;
+    DWORD         ntm_flags;
+    FT_Fixed      font_version;
+    BOOL          scalable;
+    Bitmap_Size   size;
+};
+
 #define ADDFONT_EXTERNAL_FONT 0x01
 #define ADDFONT_ALLOW_BITMAP  0x02
 #define ADDFONT_ADD_TO_CACHE  0x04
@@ -1927,12 +1944,18 @@ static void get_family_names( FT_Face ft_face, WCHAR **name, WCHAR **english, BO
     }
 }
 
-static Family *get_family( FT_Face ft_face, BOOL vertical )
+static Family *get_family( const struct face_metadata *md, BOOL vertical )
 {
     Family *family;
     WCHAR *name, *english_name;
 
-    get_family_names( ft_face, &name, &english_name, vertical );
+    name = strdupW( md->family_name );
+    english_name = md->english_name ? strdupW( md->english_name ) : NULL;
+    if (vertical)
+    {
+        name = prepend_at( name );
+        english_name = prepend_at( english_name );
+    }
 
     family = find_family_from_name( name );
 
@@ -2079,17 +2102,48 @@ static inline void get_fontsig( FT_Face ft_face, FONTSIGNATURE *fs )
     }
 }
 
-static Face *create_face( FT_Face ft_face, FT_Long face_index, const char *file, void *font_data_ptr, DWORD font_data_size,
-                          DWORD flags )
+static void get_face_metadata( FT_Face ft_face, FT_Long face_index, struct face_metadata *md )
+{
+    get_family_names( ft_face, &md->family_name, &md->english_name, FALSE );
+
+    md->style_name = get_face_name( ft_face, TT_NAME_ID_FONT_SUBFAMILY, GetSystemDefaultLangID() );
+    if (!md->style_name) md->style_name = towstr( CP_ACP, ft_face->style_name );
+    md->full_name = get_face_name( ft_face, TT_NAME_ID_FULL_NAME, GetSystemDefaultLangID() );
+
+    md->face_index = face_index;
+    get_fontsig( ft_face, &md->fs );
+    md->ntm_flags = get_ntm_flags( ft_face );
+    md->font_version = get_font_version( ft_face );
+
+    if (FT_IS_SCALABLE( ft_face ))
+    {
+        memset( &md->size, 0, sizeof(md->size) );
+        md->scalable = TRUE;
+    }
+    else
+    {
+        get_bitmap_size( ft_face, &md->size );
+        md->scalable = FALSE;
+    }
+}
+
+static void free_face_metadata( struct face_metadata *md )
+{
+    HeapFree( GetProcessHeap(), 0, md->family_name );
+    HeapFree( GetProcessHeap(), 0, md->english_name );
+    HeapFree( GetProcessHeap(), 0, md->style_name );
+    HeapFree( GetProcessHeap(), 0, md->full_name );
+}
+
+static Face *create_face( const struct face_metadata *md, const char *file, void *font_data_ptr,
+                          DWORD font_data_size, DWORD flags )
 {
     struct stat st;
     Face *face = HeapAlloc( GetProcessHeap(), 0, sizeof(*face) );
 
     face->refcount = 1;
-    face->StyleName = get_face_name( ft_face, TT_NAME_ID_FONT_SUBFAMILY, GetSystemDefaultLangID() );
-    if (!face->StyleName) face->StyleName = towstr( CP_ACP, ft_face->style_name );
-
-    face->FullName = get_face_name( ft_face, TT_NAME_ID_FULL_NAME, GetSystemDefaultLangID() );
+    face->StyleName = strdupW( md->style_name );
+    face->FullName = md->full_name ? strdupW( md->full_name ) : NULL;
     if (flags & ADDFONT_VERTICAL_FONT)
         face->FullName = prepend_at( face->FullName );
 
@@ -2113,21 +2167,12 @@ static Face *create_face( FT_Face ft_face, FT_Long face_index, const char *file,
         face->font_data_size = font_data_size;
     }
 
-    face->face_index = face_index;
-    get_fontsig( ft_face, &face->fs );
-    face->ntmFlags = get_ntm_flags( ft_face );
-    face->font_version = get_font_version( ft_face );
-
-    if (FT_IS_SCALABLE( ft_face ))
-    {
-        memset( &face->size, 0, sizeof(face->size) );
-        face->scalable = TRUE;
-    }
-    else
-    {
-        get_bitmap_size( ft_face, &face->size );
-        face->scalable = FALSE;
-    }
+    face->face_index = md->face_index;
+    face->fs = md->fs;
+    face->ntmFlags = md->ntm_flags;
+    face->font_version = md->font_version;
+    face->size = md->size;
+    face->scalable = md->scalable;
 
     if (!HIWORD( flags )) flags |= ADDFONT_AA_FLAGS( default_aa_flags );
     face->flags  = flags;
@@ -2142,14 +2187,14 @@ static Face *create_face( FT_Face ft_face, FT_Long face_index, const char *file,
     return face;
 }
 
-static void AddFaceToList(FT_Face ft_face, const char *file, void *font_data_ptr, DWORD font_data_size,
-                          FT_Long face_index, DWORD flags )
+static void AddFaceToList( const struct face_metadata *md, const char *file, void *font_data_ptr,
+                           DWORD font_data_size, DWORD flags )
 {
     Face *face;
     Family *family;
 
-    face = create_face( ft_face, face_index, file, font_data_ptr, font_data_size, flags );
-    family = get_family( ft_face, flags & ADDFONT_VERTICAL_FONT );
+    face = create_face( md, file, font_data_ptr, font_data_size, flags );
+    family = get_family( md, flags & ADDFONT_VERTICAL_FONT );
 
     if (insert_face_in_family_list( face, family ))
     {
@@ -2239,10 +2284,445 @@ fail:
     return NULL;
 }
 
+/* The font index remembers the faces found in each font file, so that the
+ * first process of a session doesn't need to open every font with FreeType.
+ * It is stored in the Windows directory, shared by all the processes of the
+ * prefix, and only accessed while holding the font mutex.  Files are scanned
+ * again when their size or modification time changes. */
+
+#define FONT_INDEX_MAGIC    0x58444946  /* 'FIDX' */
+#define FONT_INDEX_VERSION  1
+
+#define FONT_INDEX_ALLOW_BITMAP  0x01  /* scanned with ADDFONT_ALLOW_BITMAP */
+#define FONT_INDEX_FAILED        0x02  /* the file was rejected after the recorded faces */
+
+struct font_index_header
+{
+    DWORD magic;
+    DWORD version;
+    DWORD ft_version;
+    DWORD lcid;
+    DWORD acp;
+    DWORD count;
+    DWORD size;
+    DWORD reserved;
+};
+
+struct font_index_file
+{
+    ULONGLONG mtime;
+    ULONGLONG file_size;
+    DWORD     record_size;  /* including path and faces, multiple of 8 */
+    DWORD     flags;
+    DWORD     face_count;
+    DWORD     path_len;     /* including the terminating null */
+    /* followed by the path, padded to 8 bytes, and the faces */
+};
+
+struct font_index_face
+{
+    DWORD         record_size;  /* including the names, multiple of 8 */
+    DWORD         face_index;
+    FONTSIGNATURE fs;
+    DWORD         ntm_flags;
+    LONG          font_version;
+    DWORD         scalable;
+    LONG          size;
+    LONG          x_ppem;
+    LONG          y_ppem;
+    SHORT         height;
+    SHORT         width;
+    SHORT         internal_leading;
+    SHORT         reserved;
+    WORD          name_len[4];  /* family, english, style and full name lengths including the null, 0 if missing */
+    /* followed by the names */
+};
+
+struct font_index
+{
+    const BYTE                    *base;       /* mapping of the existing index */
+    DWORD                          size;
+    DWORD                          old_count;
+    const struct font_index_file **hash;       /* existing records by path */
+    BYTE                          *used;       /* records already copied to the new index */
+    UINT                           hash_size;
+    BYTE                          *data;       /* new index */
+    DWORD                          data_size;
+    DWORD                          data_alloc;
+    DWORD                          count;
+    DWORD                          record;     /* offset of the record being built */
+    BOOL                           dirty;
+    UINT                           hits;
+    UINT                           misses;
+};
+
+static struct font_index *font_index;
+
+static void get_font_index_path( WCHAR *path, const WCHAR *name )
+{
+    GetWindowsDirectoryW( path, MAX_PATH );
+    strcatW( path, name );
+}
+
+static UINT hash_font_index_path( const char *path, DWORD flags )
+{
+    UINT hash = 2166136261u ^ flags;
+
+    while (*path) hash = (hash ^ (BYTE)*path++) * 16777619;
+    return hash;
+}
+
+static inline const char *get_font_index_file_path( const struct font_index_file *rec )
+{
+    return (const char *)(rec + 1);
+}
+
+static inline const struct font_index_face *get_font_index_first_face( const struct font_index_file *rec )
+{
+    return (const struct font_index_face *)((const BYTE *)(rec + 1) + ((rec->path_len + 7) & ~7));
+}
+
+static BOOL validate_font_index_file( const struct font_index_file *rec, DWORD remaining )
+{
+    const struct font_index_face *face;
+    const WCHAR *name;
+    const BYTE *end;
+    DWORD i, j, len;
+
+    if (remaining < sizeof(*rec) || rec->record_size < sizeof(*rec) ||
+        rec->record_size > remaining || rec->record_size % 8) return FALSE;
+    end = (const BYTE *)rec + rec->record_size;
+    if (!rec->path_len || rec->path_len > end - (const BYTE *)(rec + 1)) return FALSE;
+    if (get_font_index_file_path( rec )[rec->path_len - 1]) return FALSE;
+
+    face = get_font_index_first_face( rec );
+    for (i = 0; i < rec->face_count; i++)
+    {
+        if ((const BYTE *)face > end || end - (const BYTE *)face < sizeof(*face) ||
+            face->record_size < sizeof(*face) || face->record_size > end - (const BYTE *)face ||
+            face->record_size % 8) return FALSE;
+        for (j = len = 0; j < ARRAY_SIZE(face->name_len); j++) len += face->name_len[j];
+        if (!face->name_len[0] || !face->name_len[2]) return FALSE;
+        if (len * sizeof(WCHAR) > face->record_size - sizeof(*face)) return FALSE;
+        name = (const WCHAR *)(face + 1);
+        for (j = 0; j < ARRAY_SIZE(face->name_len); j++)
+        {
+            if (face->name_len[j] && name[face->name_len[j] - 1]) return FALSE;
+            name += face->name_len[j];
+        }
+        face = (const struct font_index_face *)((const BYTE *)face + face->record_size);
+    }
+    return TRUE;
+}
+
+static void load_font_index( struct font_index *index )
+{
+    static const WCHAR index_nameW[] = {'\\','f','o','n','t','i','n','d','e','x','.','d','a','t',0};
+    const struct font_index_header *header;
+    const struct font_index_file *rec;
+    WCHAR path[MAX_PATH + ARRAY_SIZE(index_nameW)];
+    HANDLE file, mapping;
+    DWORD i, pos, size;
+    UINT hash;
+
+    get_font_index_path( path, index_nameW );
+    file = CreateFileW( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0 );
+    if (file == INVALID_HANDLE_VALUE) return;
+    size = GetFileSize( file, NULL );
+    if (size != INVALID_FILE_SIZE && size >= sizeof(*header) &&
+        (mapping = CreateFileMappingW( file, NULL, PAGE_READONLY, 0, 0, NULL )))
+    {
+        index->base = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+        index->size = size;
+        CloseHandle( mapping );
+    }
+    CloseHandle( file );
+    if (!index->base) return;
+
+    header = (const struct font_index_header *)index->base;
+    if (header->magic != FONT_INDEX_MAGIC || header->version != FONT_INDEX_VERSION ||
+        header->size != size || header->count > size / sizeof(*rec))
+    {
+        WARN( "ignoring invalid font index\n" );
+        goto failed;
+    }
+    /* face names depend on the FreeType version and the locale */
+    if (header->ft_version != FT_SimpleVersion || header->lcid != GetSystemDefaultLCID() ||
+        header->acp != GetACP())
+    {
+        TRACE( "font index is out of date\n" );
+        goto failed;
+    }
+
+    for (index->hash_size = 64; index->hash_size < header->count * 2; index->hash_size *= 2) ;
+    index->hash = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, index->hash_size * sizeof(*index->hash) );
+    index->used = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, index->hash_size );
+    if (!index->hash || !index->used) goto failed;
+
+    for (i = 0, pos = sizeof(*header); i < header->count; i++, pos += rec->record_size)
+    {
+        rec = (const struct font_index_file *)(index->base + pos);
+        if (!validate_font_index_file( rec, size - pos ))
+        {
+            WARN( "ignoring corrupted font index\n" );
+            goto failed;
+        }
+        hash = hash_font_index_path( get_font_index_file_path( rec ), rec->flags & FONT_INDEX_ALLOW_BITMAP );
+        while (index->hash[hash & (index->hash_size - 1)]) hash++;
+        index->hash[hash & (index->hash_size - 1)] = rec;
+    }
+    index->old_count = header->count;
+    return;
+
+failed:
+    HeapFree( GetProcessHeap(), 0, index->hash );
+    HeapFree( GetProcessHeap(), 0, index->used );
+    index->hash = NULL;
+    index->used = NULL;
+    UnmapViewOfFile( index->base );
+    index->base = NULL;
+    index->dirty = TRUE;
+}
+
+static void open_font_index(void)
+{
+    if (!(font_index = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*font_index) ))) return;
+    load_font_index( font_index );
+    font_index->data_size = sizeof(struct font_index_header);
+}
+
+static void close_font_index(void)
+{
+    static const WCHAR index_nameW[] = {'\\','f','o','n','t','i','n','d','e','x','.','d','a','t',0};
+    static const WCHAR tmp_nameW[] = {'\\','f','o','n','t','i','n','d','e','x','.','t','m','p',0};
+    struct font_index_header *header;
+    WCHAR path[MAX_PATH + ARRAY_SIZE(index_nameW)], tmp_path[MAX_PATH + ARRAY_SIZE(tmp_nameW)];
+    HANDLE file;
+    DWORD written;
+
+    if (!font_index) return;
+
+    TRACE_(fontinit)( "%u files from the font index, %u scanned\n", font_index->hits, font_index->misses );
+
+    if (font_index->base) UnmapViewOfFile( font_index->base );
+    /* files that are gone are dropped from the index */
+    if ((font_index->dirty || font_index->count != font_index->old_count) && font_index->data)
+    {
+        header = (struct font_index_header *)font_index->data;
+        header->magic      = FONT_INDEX_MAGIC;
+        header->version    = FONT_INDEX_VERSION;
+        header->ft_version = FT_SimpleVersion;
+        header->lcid       = GetSystemDefaultLCID();
+        header->acp        = GetACP();
+        header->count      = font_index->count;
+        header->size       = font_index->data_size;
+        header->reserved   = 0;
+
+        get_font_index_path( path, index_nameW );
+        get_font_index_path( tmp_path, tmp_nameW );
+        file = CreateFileW( tmp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0 );
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            BOOL ret = WriteFile( file, font_index->data, font_index->data_size, &written, NULL ) &&
+                       written == font_index->data_size;
+            CloseHandle( file );
+            if (ret) ret = MoveFileExW( tmp_path, path, MOVEFILE_REPLACE_EXISTING );
+            if (!ret)
+            {
+                WARN( "failed to write the font index, error %u\n", GetLastError() );
+                DeleteFileW( tmp_path );
+            }
+            else TRACE( "saved %u files in the font index\n", font_index->count );
+        }
+    }
+
+    HeapFree( GetProcessHeap(), 0, font_index->hash );
+    HeapFree( GetProcessHeap(), 0, font_index->used );
+    HeapFree( GetProcessHeap(), 0, font_index->data );
+    HeapFree( GetProcessHeap(), 0, font_index );
+    font_index = NULL;
+}
+
+static void *append_font_index( DWORD size )
+{
+    BYTE *ptr;
+
+    if (font_index->data_size + size > font_index->data_alloc)
+    {
+        DWORD new_size = max( font_index->data_alloc * 2, font_index->data_size + size );
+        new_size = max( new_size, 65536 );
+        if (font_index->data)
+            ptr = HeapReAlloc( GetProcessHeap(), 0, font_index->data, new_size );
+        else
+            ptr = HeapAlloc( GetProcessHeap(), 0, new_size );
+        if (!ptr) return NULL;
+        font_index->data = ptr;
+        font_index->data_alloc = new_size;
+    }
+    ptr = font_index->data + font_index->data_size;
+    memset( ptr, 0, size );
+    font_index->data_size += size;
+    return ptr;
+}
+
+/* returns the slot of the up-to-date record for the file, or -1 */
+static int find_font_index_file( const char *file, DWORD flags, const struct stat *st )
+{
+    const struct font_index_file *rec;
+    UINT hash, slot;
+
+    if (!font_index->hash) return -1;
+    flags = (flags & ADDFONT_ALLOW_BITMAP) ? FONT_INDEX_ALLOW_BITMAP : 0;
+    hash = hash_font_index_path( file, flags );
+    while ((rec = font_index->hash[(slot = hash & (font_index->hash_size - 1))]))
+    {
+        if ((rec->flags & FONT_INDEX_ALLOW_BITMAP) == flags &&
+            !strcmp( get_font_index_file_path( rec ), file ))
+        {
+            if (rec->mtime != st->st_mtime || rec->file_size != st->st_size) return -1;
+            return slot;
+        }
+        hash++;
+    }
+    return -1;
+}
+
+static void begin_font_index_file( const char *file, DWORD flags, const struct stat *st )
+{
+    struct font_index_file *rec;
+    DWORD len = strlen( file ) + 1;
+
+    font_index->record = font_index->data_size;
+    if (!(rec = append_font_index( sizeof(*rec) + ((len + 7) & ~7) )))
+    {
+        font_index->record = 0;
+        return;
+    }
+    rec->mtime = st->st_mtime;
+    rec->file_size = st->st_size;
+    rec->flags = (flags & ADDFONT_ALLOW_BITMAP) ? FONT_INDEX_ALLOW_BITMAP : 0;
+    rec->path_len = len;
+    memcpy( rec + 1, file, len );
+}
+
+static void add_font_index_face( const struct face_metadata *md )
+{
+    const WCHAR *names[4] = { md->family_name, md->english_name, md->style_name, md->full_name };
+    struct font_index_face *face;
+    WCHAR *ptr;
+    DWORD i, len = 0;
+
+    if (!font_index->record) return;
+
+    for (i = 0; i < ARRAY_SIZE(names); i++)
+        if (names[i]) len += strlenW( names[i] ) + 1;
+    len = (sizeof(*face) + len * sizeof(WCHAR) + 7) & ~7;
+
+    if (!(face = append_font_index( len )))
+    {
+        font_index->data_size = font_index->record;
+        font_index->record = 0;
+        return;
+    }
+    face->record_size      = len;
+    face->face_index       = md->face_index;
+    face->fs               = md->fs;
+    face->ntm_flags        = md->ntm_flags;
+    face->font_version     = md->font_version;
+    face->scalable         = md->scalable;
+    face->size             = md->size.size;
+    face->x_ppem           = md->size.x_ppem;
+    face->y_ppem           = md->size.y_ppem;
+    face->height           = md->size.height;
+    face->width            = md->size.width;
+    face->internal_leading = md->size.internal_leading;
+
+    ptr = (WCHAR *)(face + 1);
+    for (i = 0; i < ARRAY_SIZE(names); i++)
+    {
+        if (!names[i]) continue;
+        face->name_len[i] = strlenW( names[i] ) + 1;
+        memcpy( ptr, names[i], face->name_len[i] * sizeof(WCHAR) );
+        ptr += face->name_len[i];
+    }
+    ((struct font_index_file *)(font_index->data + font_index->record))->face_count++;
+}
+
+static void end_font_index_file( BOOL failed )
+{
+    struct font_index_file *rec;
+
+    if (!font_index->record) return;
+    rec = (struct font_index_file *)(font_index->data + font_index->record);
+    if (failed) rec->flags |= FONT_INDEX_FAILED;
+    rec->record_size = font_index->data_size - font_index->record;
+    font_index->record = 0;
+    font_index->count++;
+    font_index->dirty = TRUE;
+}
+
+/* add the faces recorded in the index, with the same results as AddFontToList */
+static INT add_font_from_index( int slot, const char *file, DWORD flags )
+{
+    const DWORD FS_DBCS_MASK = FS_JISJAPAN|FS_CHINESESIMP|FS_WANSUNG|FS_CHINESETRAD|FS_JOHAB;
+    const struct font_index_file *rec = font_index->hash[slot];
+    const struct font_index_face *face = get_font_index_first_face( rec );
+    struct face_metadata md;
+    const WCHAR *names[4];
+    const WCHAR *ptr;
+    void *copy;
+    DWORD i, j;
+    INT ret = 0;
+
+    /* keep the record in the new index */
+    if (!font_index->used[slot] && (copy = append_font_index( rec->record_size )))
+    {
+        memcpy( copy, rec, rec->record_size );
+        font_index->used[slot] = 1;
+        font_index->count++;
+    }
+
+    for (i = 0; i < rec->face_count; i++)
+    {
+        for (j = 0, ptr = (const WCHAR *)(face + 1); j < ARRAY_SIZE(names); j++)
+        {
+            names[j] = face->name_len[j] ? ptr : NULL;
+            ptr += face->name_len[j];
+        }
+        md.family_name  = (WCHAR *)names[0];
+        md.english_name = (WCHAR *)names[1];
+        md.style_name   = (WCHAR *)names[2];
+        md.full_name    = (WCHAR *)names[3];
+        md.face_index   = face->face_index;
+        md.fs           = face->fs;
+        md.ntm_flags    = face->ntm_flags;
+        md.font_version = face->font_version;
+        md.scalable     = face->scalable;
+        md.size.size    = face->size;
+        md.size.x_ppem  = face->x_ppem;
+        md.size.y_ppem  = face->y_ppem;
+        md.size.height  = face->height;
+        md.size.width   = face->width;
+        md.size.internal_leading = face->internal_leading;
+
+        AddFaceToList( &md, file, NULL, 0, flags );
+        ++ret;
+        if (md.fs.fsCsb[0] & FS_DBCS_MASK)
+        {
+            AddFaceToList( &md, file, NULL, 0, flags | ADDFONT_VERTICAL_FONT );
+            ++ret;
+        }
+        face = (const struct font_index_face *)((const BYTE *)face + face->record_size);
+    }
+    return (rec->flags & FONT_INDEX_FAILED) ? 0 : ret;
+}
+
 static INT AddFontToList(const char *file, void *font_data_ptr, DWORD font_data_size, DWORD flags)
 {
     FT_Face ft_face;
     FT_Long face_index = 0, num_faces;
+    struct stat st;
+    BOOL indexed = FALSE, failed = FALSE;
     INT ret = 0;
 
     /* we always load external fonts from files - otherwise we would get a crash in update_reg_entries */
@@ -2269,35 +2749,57 @@ static INT AddFontToList(const char *file, void *font_data_ptr, DWORD font_data_
     }
 #endif /* HAVE_CARBON_CARBON_H */
 
+    if (file && font_index && !stat( file, &st ))
+    {
+        int slot = find_font_index_file( file, flags, &st );
+
+        if (slot != -1)
+        {
+            font_index->hits++;
+            return add_font_from_index( slot, file, flags );
+        }
+        font_index->misses++;
+        begin_font_index_file( file, flags, &st );
+        indexed = TRUE;
+    }
+
     do {
         const DWORD FS_DBCS_MASK = FS_JISJAPAN|FS_CHINESESIMP|FS_WANSUNG|FS_CHINESETRAD|FS_JOHAB;
-        FONTSIGNATURE fs;
+        struct face_metadata md;
 
         ft_face = new_ft_face( file, font_data_ptr, font_data_size, face_index, flags & ADDFONT_ALLOW_BITMAP );
-        if (!ft_face) return 0;
+        if (!ft_face)
+        {
+            failed = TRUE;
+            break;
+        }
 
         if(ft_face->family_name[0] == '.') /* Ignore fonts with names beginning with a dot */
         {
             TRACE("Ignoring %s since its family name begins with a dot\n", debugstr_a(file));
             pFT_Done_Face(ft_face);
-            return 0;
+            failed = TRUE;
+            break;
         }
 
-        AddFaceToList(ft_face, file, font_data_ptr, font_data_size, face_index, flags);
+        get_face_metadata(ft_face, face_index, &md);
+        AddFaceToList(&md, file, font_data_ptr, font_data_size, flags);
         ++ret;
 
-        get_fontsig(ft_face, &fs);
-        if (fs.fsCsb[0] & FS_DBCS_MASK)
+        if (md.fs.fsCsb[0] & FS_DBCS_MASK)
         {
-            AddFaceToList(ft_face, file, font_data_ptr, font_data_size, face_index,
-                          flags | ADDFONT_VERTICAL_FONT);
+            AddFaceToList(&md, file, font_data_ptr, font_data_size, flags | ADDFONT_VERTICAL_FONT);
             ++ret;
         }
+        if (indexed) add_font_index_face(&md);
+        free_face_metadata(&md);
 
 	num_faces = ft_face->num_faces;
 	pFT_Done_Face(ft_face);
     } while(num_faces > ++face_index);
-    return ret;
+
+    if (indexed) end_font_index_file(failed);
+    return failed ? 0 : ret;
 }
 
 static int add_font_resource( const WCHAR *file, DWORD flags )
@@ -3468,21 +3970,20 @@ static void GetEnumStructs(Face *face, const WCHAR *family_name, LPENUMLOGFONTEX
 static BOOL get_fontdir( const char *unix_name, struct fontdir *fd )
 {
     FT_Face ft_face = new_ft_face( unix_name, NULL, 0, 0, FALSE );
+    struct face_metadata md;
     Face *face;
-    WCHAR *name, *english_name;
     ENUMLOGFONTEXW elf;
     NEWTEXTMETRICEXW ntm;
     DWORD type;
 
     if (!ft_face) return FALSE;
-    face = create_face( ft_face, 0, unix_name, NULL, 0, 0 );
-    get_family_names( ft_face, &name, &english_name, FALSE );
+    get_face_metadata( ft_face, 0, &md );
+    face = create_face( &md, unix_name, NULL, 0, 0 );
     pFT_Done_Face( ft_face );
 
-    GetEnumStructs( face, name, &elf, &ntm, &type );
+    GetEnumStructs( face, md.family_name, &elf, &ntm, &type );
     release_face( face );
-    HeapFree( GetProcessHeap(), 0, name );
-    HeapFree( GetProcessHeap(), 0, english_name );
+    free_face_metadata( &md );
 
     if ((type & TRUETYPE_FONTTYPE) == 0) return FALSE;
 
@@ -4209,6 +4710,26 @@ sym_not_found:
     return FALSE;
 }
 
+static LONGLONG font_init_time(void)
+{
+    LARGE_INTEGER counter;
+
+    if (!TRACE_ON(fontinit)) return 0;
+    QueryPerformanceCounter( &counter );
+    return counter.QuadPart;
+}
+
+/* milliseconds elapsed since a font_init_time() timestamp */
+static DWORD font_init_elapsed( LONGLONG start )
+{
+    LARGE_INTEGER counter, frequency;
+
+    if (!TRACE_ON(fontinit)) return 0;
+    QueryPerformanceCounter( &counter );
+    QueryPerformanceFrequency( &frequency );
+    return (counter.QuadPart - start) * 1000 / frequency.QuadPart;
+}
+
 static void init_font_list(void)
 {
     static const WCHAR dot_fonW[] = {'.','f','o','n','\0'};
@@ -4217,8 +4738,10 @@ static void init_font_list(void)
     DWORD valuelen, datalen, i = 0, type, dlen, vlen;
     WCHAR path[MAX_PATH];
     char *unixname;
+    LONGLONG start = font_init_time();
 
     delete_external_font_keys();
+    open_font_index();
 
     /* load the system bitmap fonts */
     load_system_fonts();
@@ -4329,6 +4852,9 @@ static void init_font_list(void)
         }
         RegCloseKey(hkey);
     }
+
+    close_font_index();
+    TRACE_(fontinit)( "scanned fonts in %u ms\n", font_init_elapsed( start ));
 }
 
 static BOOL move_to_front(const WCHAR *name)
@@ -4376,6 +4902,7 @@ BOOL WineEngInit(void)
     HKEY hkey;
     DWORD disposition;
     HANDLE font_mutex;
+    LONGLONG start = font_init_time(), list_start;
 
     /* update locale dependent font info in registry */
     update_font_info();
@@ -4412,10 +4939,13 @@ BOOL WineEngInit(void)
 
     create_font_cache_key(&hkey_font_cache, &disposition);
 
+    list_start = font_init_time();
     if(disposition == REG_CREATED_NEW_KEY)
         init_font_list();
     else
         load_font_list_from_cache(hkey_font_cache);
+    TRACE_(fontinit)( "font list %s in %u ms\n", disposition == REG_CREATED_NEW_KEY ? "built" : "loaded from cache",
+                      font_init_elapsed( list_start ));
 
     reorder_font_list();
 
@@ -4430,6 +4960,7 @@ BOOL WineEngInit(void)
     init_system_links();
     
     ReleaseMutex(font_mutex);
+    TRACE_(fontinit)( "font engine initialized in %u ms\n", font_init_elapsed( start ));
     return TRUE;
 }
 
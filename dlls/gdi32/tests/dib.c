@@ -26,6 +26,7 @@
 #include "winbase.h"
 #include "wingdi.h"
 #include "winuser.h"
+#include "winreg.h"
 #include "wincrypt.h"
 #include "mmsystem.h" /* DIBINDEX */
 
@@ -3516,11 +3517,463 @@ static void test_simple_graphics(void)
     DeleteDC(mem_dc);
 }
 
+static HBITMAP create_perf_dib( HDC dc, int bpp, int width, int height, void **bits )
+{
+    BITMAPINFO bmi;
+    HBITMAP dib;
+
+    memset( &bmi, 0, sizeof(bmi) );
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = bpp;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    dib = CreateDIBSection( 0, &bmi, DIB_RGB_COLORS, bits, NULL, 0 );
+    ok( dib != NULL, "failed to create %u-bpp dib\n", bpp );
+    SelectObject( dc, dib );
+    return dib;
+}
+
+/* timings are only traced in interactive runs, with large enough blits */
+static void trace_throughput( const char *name, DWORD pixels, DWORD start )
+{
+    DWORD elapsed = GetTickCount() - start;
+
+    if (!winetest_interactive) return;
+    trace( "%s: %u Mpixels/s\n", name, elapsed ? pixels / 1000 / elapsed : 0 );
+}
+
+static inline BYTE ref_blend_channel( BYTE dst, BYTE src, BYTE alpha )
+{
+    return src + (dst * (255 - alpha) + 127) / 255;
+}
+
+/* check and time the primitives that the dib engine uses for window surfaces */
+static void test_primitives_throughput(void)
+{
+    int width = 67, height = 16, loops = 1;
+    DWORD pixels;
+    BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+    HDC src_dc = CreateCompatibleDC( NULL ), dst_dc = CreateCompatibleDC( NULL ), dc16 = CreateCompatibleDC( NULL );
+    HBITMAP src_dib, dst_dib, dib16;
+    DWORD *src_bits, *dst_bits, *ref_bits, start;
+    WORD *bits16;
+    int i, j, x, mismatches = 0;
+    LOGFONTA lf;
+    HFONT font;
+    char text[100];
+
+    if (winetest_interactive)
+    {
+        width = 1024;
+        height = 768;
+        loops = 20;
+    }
+    pixels = width * height * loops;
+
+    src_dib = create_perf_dib( src_dc, 32, width, height, (void **)&src_bits );
+    dst_dib = create_perf_dib( dst_dc, 32, width, height, (void **)&dst_bits );
+    dib16 = create_perf_dib( dc16, 16, width, height, (void **)&bits16 );
+    ref_bits = HeapAlloc( GetProcessHeap(), 0, width * height * sizeof(DWORD) );
+
+    /* premultiplied source with a mix of transparent, opaque and translucent pixels */
+    for (i = 0; i < width * height; i++)
+    {
+        BYTE alpha = (i % 3) ? (i / 7) & 0xff : (i & 0x100) ? 0xff : 0;
+        src_bits[i] = (DWORD)alpha << 24 | (alpha * (i & 0xff) / 255) << 16 |
+                      (alpha * ((i >> 3) & 0xff) / 255) << 8 | alpha * ((i >> 5) & 0xff) / 255;
+        dst_bits[i] = ref_bits[i] = (DWORD)i * 0x01010101;
+    }
+
+    start = GetTickCount();
+    for (i = 0; i < loops; i++)
+        for (j = 0; j < width * height; j++)
+        {
+            DWORD s = src_bits[j], d = ref_bits[j];
+            BYTE alpha = s >> 24;
+            ref_bits[j] = ref_blend_channel( d, s, alpha ) |
+                          ref_blend_channel( d >> 8, s >> 8, alpha ) << 8 |
+                          ref_blend_channel( d >> 16, s >> 16, alpha ) << 16 |
+                          (DWORD)ref_blend_channel( d >> 24, s >> 24, alpha ) << 24;
+        }
+    trace_throughput( "scalar blend reference", pixels, start );
+
+    start = GetTickCount();
+    for (i = 0; i < loops; i++)
+        GdiAlphaBlend( dst_dc, 0, 0, width, height, src_dc, 0, 0, width, height, blend );
+    trace_throughput( "AlphaBlend 32-bpp per-pixel alpha", pixels, start );
+
+    for (i = 0; i < width * height; i++)
+    {
+        for (x = 0; x < 32; x += 8)
+        {
+            int diff = (int)((dst_bits[i] >> x) & 0xff) - (int)((ref_bits[i] >> x) & 0xff);
+            if (diff > 1 || diff < -1) break;
+        }
+        if (x < 32) mismatches++;
+    }
+    ok( !mismatches, "%u pixels differ from the reference\n", mismatches );
+
+    blend.AlphaFormat = 0;
+    blend.SourceConstantAlpha = 0x80;
+    start = GetTickCount();
+    for (i = 0; i < loops; i++)
+        GdiAlphaBlend( dst_dc, 0, 0, width, height, src_dc, 0, 0, width, height, blend );
+    trace_throughput( "AlphaBlend 32-bpp constant alpha", pixels, start );
+
+    blend.AlphaFormat = AC_SRC_ALPHA;
+    blend.SourceConstantAlpha = 255;
+    start = GetTickCount();
+    for (i = 0; i < loops; i++)
+        GdiAlphaBlend( dc16, 0, 0, width, height, src_dc, 0, 0, width, height, blend );
+    trace_throughput( "AlphaBlend 16-bpp per-pixel alpha", pixels, start );
+
+    start = GetTickCount();
+    for (i = 0; i < loops; i++)
+        BitBlt( dst_dc, 0, 0, width, height, dc16, 0, 0, SRCCOPY );
+    trace_throughput( "BitBlt 16-bpp to 32-bpp", pixels, start );
+
+    start = GetTickCount();
+    for (i = 0; i < loops; i++)
+        BitBlt( dc16, 0, 0, width, height, dst_dc, 0, 0, SRCCOPY );
+    trace_throughput( "BitBlt 32-bpp to 16-bpp", pixels, start );
+
+    start = GetTickCount();
+    for (i = 0; i < loops; i++)
+        PatBlt( dst_dc, 0, 0, width, height, WHITENESS );
+    trace_throughput( "PatBlt 32-bpp", pixels, start );
+
+    memset( &lf, 0, sizeof(lf) );
+    lf.lfHeight = 24;
+    lf.lfQuality = ANTIALIASED_QUALITY;
+    strcpy( lf.lfFaceName, "Tahoma" );
+    font = CreateFontIndirectA( &lf );
+    for (i = 0; i < ARRAY_SIZE(text) - 1; i++) text[i] = 'A' + i % 58;
+    text[i] = 0;
+    SelectObject( dst_dc, font );
+    SelectObject( dc16, font );
+    SetBkMode( dst_dc, TRANSPARENT );
+    SetBkMode( dc16, TRANSPARENT );
+
+    start = GetTickCount();
+    for (i = 0; i < loops; i++)
+        for (j = 0; j < height; j += 24) TextOutA( dst_dc, 0, j, text, strlen(text) );
+    trace_throughput( "TextOut 32-bpp", pixels, start );
+
+    start = GetTickCount();
+    for (i = 0; i < loops; i++)
+        for (j = 0; j < height; j += 24) TextOutA( dc16, 0, j, text, strlen(text) );
+    trace_throughput( "TextOut 16-bpp", pixels, start );
+
+    DeleteDC( src_dc );
+    DeleteDC( dst_dc );
+    DeleteDC( dc16 );
+    DeleteObject( src_dib );
+    DeleteObject( dst_dib );
+    DeleteObject( dib16 );
+    DeleteObject( font );
+    HeapFree( GetProcessHeap(), 0, ref_bits );
+}
+
+static DWORD apply_rop( DWORD rop, DWORD src, DWORD dst )
+{
+    switch (rop)
+    {
+    case SRCCOPY:     return src;
+    case SRCPAINT:    return src | dst;
+    case SRCAND:      return src & dst;
+    case SRCINVERT:   return src ^ dst;
+    case SRCERASE:    return src & ~dst;
+    case NOTSRCCOPY:  return ~src;
+    case NOTSRCERASE: return ~(src | dst);
+    case MERGEPAINT:  return ~src | dst;
+    case DSTINVERT:   return ~dst;
+    }
+    return dst;
+}
+
+/* check blits that are large enough to be split into bands rendered in parallel */
+static void test_banded_blits(void)
+{
+    static const DWORD rops[] = { SRCCOPY, SRCPAINT, SRCAND, SRCINVERT, SRCERASE,
+                                  NOTSRCCOPY, NOTSRCERASE, MERGEPAINT, DSTINVERT };
+    static const int width = 512, height = 256;
+    BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+    HDC src_dc = CreateCompatibleDC( NULL ), dst_dc = CreateCompatibleDC( NULL );
+    HBITMAP src_dib, dst_dib;
+    DWORD *src_bits, *dst_bits, *ref_bits;
+    HBRUSH brush;
+    HRGN rgn;
+    char name[32];
+    int i, j, x, y, mismatches;
+
+    src_dib = create_perf_dib( src_dc, 32, width, height, (void **)&src_bits );
+    dst_dib = create_perf_dib( dst_dc, 32, width, height, (void **)&dst_bits );
+    ref_bits = HeapAlloc( GetProcessHeap(), 0, width * height * sizeof(DWORD) );
+
+    for (i = 0; i < width * height; i++) src_bits[i] = (DWORD)i * 0x9e3779b1;
+
+    for (i = 0; i < ARRAY_SIZE(rops); i++)
+    {
+        for (j = 0; j < width * height; j++) dst_bits[j] = ref_bits[j] = (DWORD)j * 0x01010101;
+        BitBlt( dst_dc, 0, 0, width, height, src_dc, 0, 0, rops[i] );
+        for (j = mismatches = 0; j < width * height; j++)
+            if ((dst_bits[j] ^ apply_rop( rops[i], src_bits[j], ref_bits[j] )) & 0xffffff) mismatches++;
+        ok( !mismatches, "rop %08x: %u pixels differ\n", rops[i], mismatches );
+    }
+
+    /* compare with the timings of the child process that renders in bands */
+    if (winetest_interactive)
+    {
+        for (i = 0; i < ARRAY_SIZE(rops); i++)
+        {
+            DWORD start = GetTickCount();
+
+            for (j = 0; j < 100; j++) BitBlt( dst_dc, 0, 0, width, height, src_dc, 0, 0, rops[i] );
+            sprintf( name, "BitBlt rop %08x", rops[i] );
+            trace_throughput( name, width * height * 100, start );
+        }
+    }
+
+    /* clipped to many stripes */
+    rgn = CreateRectRgn( 0, 0, 0, 0 );
+    for (y = 0; y < height; y += 64)
+    {
+        HRGN stripe = CreateRectRgn( 16, y, width - 16, y + 48 );
+        CombineRgn( rgn, rgn, stripe, RGN_OR );
+        DeleteObject( stripe );
+    }
+    SelectClipRgn( dst_dc, rgn );
+    for (j = 0; j < width * height; j++) dst_bits[j] = ref_bits[j] = (DWORD)j * 0x01010101;
+    BitBlt( dst_dc, 0, 0, width, height, src_dc, 0, 0, SRCINVERT );
+    for (y = mismatches = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+        {
+            DWORD expect = ref_bits[y * width + x];
+            if (x >= 16 && x < width - 16 && y % 64 < 48) expect ^= src_bits[y * width + x];
+            if ((dst_bits[y * width + x] ^ expect) & 0xffffff) mismatches++;
+        }
+    ok( !mismatches, "clipped SRCINVERT: %u pixels differ\n", mismatches );
+    SelectClipRgn( dst_dc, NULL );
+    DeleteObject( rgn );
+
+    /* overlapping blits are always rendered serially */
+    for (j = 0; j < width * height; j++) dst_bits[j] = ref_bits[j] = (DWORD)j * 0x01010101;
+    BitBlt( dst_dc, 0, 1, width, height - 1, dst_dc, 0, 0, SRCCOPY );
+    for (j = mismatches = 0; j < width * height; j++)
+        if ((dst_bits[j] ^ ref_bits[j % width]) & 0xffffff) mismatches++;
+    ok( !mismatches, "overlapping SRCCOPY: %u pixels differ\n", mismatches );
+
+    brush = CreateSolidBrush( RGB(0x12,0x34,0x56) );
+    SelectObject( dst_dc, brush );
+    PatBlt( dst_dc, 0, 0, width, height, PATCOPY );
+    PatBlt( dst_dc, 0, 0, width, height, PATINVERT );
+    for (j = mismatches = 0; j < width * height; j++)
+        if (dst_bits[j] & 0xffffff) mismatches++;
+    ok( !mismatches, "PatBlt: %u pixels differ\n", mismatches );
+    SelectObject( dst_dc, GetStockObject( WHITE_BRUSH ));
+    DeleteObject( brush );
+
+    StretchBlt( dst_dc, 0, 0, width, height, src_dc, 0, 0, width / 2, height / 2, SRCCOPY );
+    for (y = mismatches = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+            if ((dst_bits[y * width + x] ^ src_bits[y / 2 * width + x / 2]) & 0xffffff) mismatches++;
+    ok( !mismatches, "StretchBlt: %u pixels differ\n", mismatches );
+
+    for (i = 0; i < width * height; i++)
+    {
+        BYTE alpha = i / 3;
+        src_bits[i] = (DWORD)alpha << 24 | (alpha * (i & 0xff) / 255) << 16 | (alpha / 2) << 8 | alpha / 3;
+        dst_bits[i] = ref_bits[i] = (DWORD)i * 0x01010101;
+    }
+    GdiAlphaBlend( dst_dc, 0, 0, width, height, src_dc, 0, 0, width, height, blend );
+    for (i = mismatches = 0; i < width * height; i++)
+    {
+        DWORD s = src_bits[i], d = ref_bits[i];
+        for (x = 0; x < 32; x += 8)
+        {
+            int diff = (int)((dst_bits[i] >> x) & 0xff) -
+                       (int)ref_blend_channel( d >> x, s >> x, s >> 24 );
+            if (diff > 1 || diff < -1) break;
+        }
+        if (x < 32) mismatches++;
+    }
+    ok( !mismatches, "AlphaBlend: %u pixels differ from the reference\n", mismatches );
+
+    DeleteDC( src_dc );
+    DeleteDC( dst_dc );
+    DeleteObject( src_dib );
+    DeleteObject( dst_dib );
+    HeapFree( GetProcessHeap(), 0, ref_bits );
+}
+
+/* run one of the tests in a child process with some gdi options set for the test executable */
+static void run_test_with_options( const char *test, const char * const *names, const DWORD *values,
+                                   unsigned int count )
+{
+    char path[MAX_PATH], subkey[MAX_PATH + 64], cmdline[MAX_PATH + 32], **argv, *name;
+    PROCESS_INFORMATION info;
+    STARTUPINFOA startup;
+    DWORD app_disp, gdi_disp;
+    HKEY app_key, gdi_key;
+    unsigned int i;
+    LONG err;
+
+    winetest_get_mainargs( &argv );
+    GetModuleFileNameA( 0, path, MAX_PATH );
+    if ((name = strrchr( path, '\\' ))) name++;
+    else name = path;
+    sprintf( subkey, "Software\\Wine\\AppDefaults\\%s", name );
+
+    err = RegCreateKeyExA( HKEY_CURRENT_USER, subkey, 0, NULL, 0, KEY_ALL_ACCESS, NULL, &app_key, &app_disp );
+    if (err)
+    {
+        skip( "can't create the app defaults key, error %d\n", err );
+        return;
+    }
+    err = RegCreateKeyExA( app_key, "Gdi", 0, NULL, 0, KEY_ALL_ACCESS, NULL, &gdi_key, &gdi_disp );
+    ok( !err, "RegCreateKeyEx failed, error %d\n", err );
+    for (i = 0; i < count; i++)
+    {
+        err = RegSetValueExA( gdi_key, names[i], 0, REG_DWORD, (const BYTE *)&values[i], sizeof(values[i]) );
+        ok( !err, "RegSetValueEx %s failed, error %d\n", names[i], err );
+    }
+
+    memset( &startup, 0, sizeof(startup) );
+    startup.cb = sizeof(startup);
+    sprintf( cmdline, "\"%s\" dib %s", argv[0], test );
+    ok( CreateProcessA( NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info ),
+        "CreateProcess failed, error %u\n", GetLastError() );
+    wait_child_process( info.hProcess );
+    CloseHandle( info.hProcess );
+    CloseHandle( info.hThread );
+
+    for (i = 0; i < count; i++) RegDeleteValueA( gdi_key, names[i] );
+    RegCloseKey( gdi_key );
+    if (gdi_disp == REG_CREATED_NEW_KEY) RegDeleteKeyA( app_key, "Gdi" );
+    RegCloseKey( app_key );
+    if (app_disp == REG_CREATED_NEW_KEY) RegDeleteKeyA( HKEY_CURRENT_USER, subkey );
+}
+
+/* run test_banded_blits with banding enabled */
+static void test_banded_blits_option(void)
+{
+    static const char * const names[] = { "BlitThreads", "BlitThreshold" };
+    static const DWORD values[] = { 4, 16384 };
+
+    run_test_with_options( "banded_blits", names, values, ARRAY_SIZE(names) );
+}
+
+static HFONT create_test_font( int height )
+{
+    LOGFONTA lf;
+
+    memset( &lf, 0, sizeof(lf) );
+    lf.lfHeight = height;
+    lf.lfQuality = ANTIALIASED_QUALITY;
+    strcpy( lf.lfFaceName, "Tahoma" );
+    return CreateFontIndirectA( &lf );
+}
+
+/* check that text output is the same with glyphs shared across dcs,
+ * and after the glyphs have been evicted from the cache */
+static void test_glyph_cache(void)
+{
+    static const int width = 1024, height = 96;
+    const DWORD size = width * height * sizeof(DWORD);
+    HDC dcs[4];
+    HBITMAP dibs[4];
+    DWORD *bits[4], *refs[16];
+    HFONT fonts[16];
+    char text[96];
+    int i, j, len, pass;
+
+    for (i = 0; i < ARRAY_SIZE(text) - 1; i++) text[i] = ' ' + i;
+    text[i] = 0;
+    len = strlen( text );
+
+    for (i = 0; i < ARRAY_SIZE(dcs); i++)
+    {
+        dcs[i] = CreateCompatibleDC( NULL );
+        dibs[i] = create_perf_dib( dcs[i], 32, width, height, (void **)&bits[i] );
+    }
+    for (i = 0; i < ARRAY_SIZE(fonts); i++)
+    {
+        fonts[i] = create_test_font( 8 + 4 * i );
+        refs[i] = HeapAlloc( GetProcessHeap(), 0, size );
+    }
+
+    SelectObject( dcs[0], fonts[0] );
+    TextOutA( dcs[0], 0, 0, text, len );
+    memcpy( refs[0], bits[0], size );
+    for (i = 1; i < ARRAY_SIZE(dcs); i++)
+    {
+        SelectObject( dcs[i], fonts[0] );
+        TextOutA( dcs[i], 0, 0, text, len );
+        ok( !memcmp( bits[i], refs[0], size ), "%u: output differs\n", i );
+    }
+
+    /* the glyphs of all the fonts don't fit in a small cache, so the
+     * later passes draw glyphs that have been evicted and rendered again */
+    for (pass = 0; pass < 3; pass++)
+        for (j = 0; j < ARRAY_SIZE(fonts); j++)
+        {
+            i = j % ARRAY_SIZE(dcs);
+            SelectObject( dcs[i], fonts[j] );
+            memset( bits[i], 0, size );
+            TextOutA( dcs[i], 0, 0, text, len );
+            if (!pass) memcpy( refs[j], bits[i], size );
+            else ok( !memcmp( bits[i], refs[j], size ), "pass %u font %u: output differs\n", pass, j );
+        }
+
+    for (i = 0; i < ARRAY_SIZE(dcs); i++)
+    {
+        SelectObject( dcs[i], GetStockObject( SYSTEM_FONT ));
+        DeleteDC( dcs[i] );
+        DeleteObject( dibs[i] );
+    }
+    for (i = 0; i < ARRAY_SIZE(fonts); i++)
+    {
+        DeleteObject( fonts[i] );
+        HeapFree( GetProcessHeap(), 0, refs[i] );
+    }
+}
+
+/* run test_glyph_cache with the smallest glyph cache, to force evictions */
+static void test_glyph_cache_option(void)
+{
+    static const char * const names[] = { "GlyphCacheSize" };
+    static const DWORD values[] = { 64 };
+
+    run_test_with_options( "glyph_cache", names, values, ARRAY_SIZE(names) );
+}
+
 START_TEST(dib)
 {
+    char **argv;
+    int argc;
+
+    argc = winetest_get_mainargs( &argv );
+    if (argc >= 3 && !strcmp( argv[2], "banded_blits" ))
+    {
+        test_banded_blits();
+        return;
+    }
+    if (argc >= 3 && !strcmp( argv[2], "glyph_cache" ))
+    {
+        test_glyph_cache();
+        return;
+    }
+
     CryptAcquireContextW(&crypt_prov, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT);
 
     test_simple_graphics();
+    test_primitives_throughput();
+    test_banded_blits();
+    test_banded_blits_option();
+    test_glyph_cache();
+    test_glyph_cache_option();
 
     CryptReleaseContext(crypt_prov, 0);
 }
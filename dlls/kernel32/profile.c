@@ -29,6 +29,7 @@
 #include "winbase.h"
 #include "winnls.h"
 #include "winerror.h"
+#include "winreg.h"
 #include "winternl.h"
 #include "wine/unicode.h"
 #include "wine/library.h"
@@ -61,6 +62,21 @@ typedef struct tagPROFILESECTION
 } PROFILESECTION;
 
 
+/* hash index of the sections and keys of a profile tree; only the first
+ * section with a given name and the first key of that section with a given
+ * name are indexed, which is what PROFILE_Find() would return */
+struct profile_index
+{
+    ULONG count;
+    ULONG mask;
+    struct
+    {
+        ULONG            hash;
+        PROFILESECTION  *section;
+        PROFILEKEY      *key;      /* NULL for a section entry */
+    } entries[1];
+};
+
 typedef struct
 {
     BOOL             changed;
@@ -68,13 +84,18 @@ typedef struct
     WCHAR           *filename;
     FILETIME LastWriteTime;
     ENCODING encoding;
+    struct profile_index *index;   /* built on demand, NULL if not valid */
+    HANDLE           notify;       /* change notification for the file directory */
+    BOOL             stable;       /* no change since the file was last checked */
 } PROFILE;
 
 
-#define N_CACHED_PROFILES 10
+#define N_CACHED_PROFILES 32
+#define MAX_CACHED_PROFILES 1024
 
 /* Cached profile files */
-static PROFILE *MRUProfile[N_CACHED_PROFILES]={NULL};
+static PROFILE **MRUProfile;
+static unsigned int nb_cached_profiles;
 
 #define CurProfile (MRUProfile[0])
 
@@ -267,6 +288,131 @@ static void PROFILE_Free( PROFILESECTION *section )
     }
 }
 
+
+/***********************************************************************
+ *           PROFILE_HashName
+ *
+ * Case insensitive hash of the first len characters of a name.
+ */
+static ULONG PROFILE_HashName( LPCWSTR name, int len )
+{
+    ULONG hash = 0;
+
+    while (len--) hash = hash * 31 + tolowerW( *name++ );
+    return hash;
+}
+
+static inline ULONG PROFILE_HashKey( const PROFILESECTION *section, ULONG hash )
+{
+    return hash + (ULONG)(ULONG_PTR)section * 0x9e3779b1;
+}
+
+
+/***********************************************************************
+ *           PROFILE_InvalidateIndex
+ *
+ * Discard the index of a profile, it will be rebuilt on the next lookup.
+ */
+static void PROFILE_InvalidateIndex( PROFILE *profile )
+{
+    HeapFree( GetProcessHeap(), 0, profile->index );
+    profile->index = NULL;
+}
+
+
+/***********************************************************************
+ *           PROFILE_IndexLookup
+ *
+ * Find a section (if section is NULL) or a key of a section in the index.
+ */
+static void *PROFILE_IndexLookup( const struct profile_index *index, const PROFILESECTION *section,
+                                  LPCWSTR name, int len, ULONG hash )
+{
+    ULONG pos;
+
+    if (section) hash = PROFILE_HashKey( section, hash );
+    for (pos = hash & index->mask; index->entries[pos].section; pos = (pos + 1) & index->mask)
+    {
+        if (index->entries[pos].hash != hash) continue;
+        if (section)
+        {
+            PROFILEKEY *key = index->entries[pos].key;
+            if (index->entries[pos].section != section || !key) continue;
+            if (!strncmpiW( key->name, name, len ) && !key->name[len]) return key;
+        }
+        else
+        {
+            if (index->entries[pos].key) continue;
+            if (!strncmpiW( index->entries[pos].section->name, name, len ) &&
+                !index->entries[pos].section->name[len])
+                return index->entries[pos].section;
+        }
+    }
+    return NULL;
+}
+
+
+/***********************************************************************
+ *           PROFILE_IndexAdd
+ *
+ * Add a section or a key to the index, unless an entry with the same
+ * name is already present. Returns FALSE if the index is full.
+ */
+static BOOL PROFILE_IndexAdd( struct profile_index *index, PROFILESECTION *section, PROFILEKEY *key )
+{
+    const WCHAR *name = key ? key->name : section->name;
+    int len = strlenW( name );
+    ULONG hash = PROFILE_HashName( name, len ), pos;
+
+    if ((index->count + 1) * 2 > index->mask + 1) return FALSE;
+    if (PROFILE_IndexLookup( index, key ? section : NULL, name, len, hash )) return TRUE;
+
+    if (key) hash = PROFILE_HashKey( section, hash );
+    for (pos = hash & index->mask; index->entries[pos].section; pos = (pos + 1) & index->mask) ;
+    index->entries[pos].hash = hash;
+    index->entries[pos].section = section;
+    index->entries[pos].key = key;
+    index->count++;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           PROFILE_GetIndex
+ *
+ * Get the index of a profile, building it from the profile tree if needed.
+ */
+static const struct profile_index *PROFILE_GetIndex( PROFILE *profile )
+{
+    struct profile_index *index;
+    PROFILESECTION *section;
+    PROFILEKEY *key;
+    ULONG count = 0, size = 64;
+
+    if (profile->index) return profile->index;
+
+    for (section = profile->section; section; section = section->next)
+        for (count++, key = section->key; key; key = key->next) count++;
+    /* leave room for as many new entries as there are now before the index is full */
+    while (size < 4 * (count + 16)) size <<= 1;
+
+    if (!(index = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                             FIELD_OFFSET( struct profile_index, entries[size] ))))
+        return NULL;
+    index->mask = size - 1;
+
+    for (section = profile->section; section; section = section->next)
+    {
+        ULONG prev = index->count;
+
+        PROFILE_IndexAdd( index, section, NULL );
+        if (index->count == prev) continue;  /* hidden by an earlier section */
+        for (key = section->key; key; key = key->next) PROFILE_IndexAdd( index, section, key );
+    }
+    TRACE( "indexed %u entries for %s\n", index->count, debugstr_w(profile->filename) );
+    return profile->index = index;
+}
+
 /* returns TRUE if a whitespace character, else FALSE */
 static inline BOOL PROFILE_isspaceW(WCHAR c)
 {
@@ -552,6 +698,8 @@ static BOOL PROFILE_DeleteKey( PROFILESECTION **section,
 static void PROFILE_DeleteAllKeys( LPCWSTR section_name)
 {
     PROFILESECTION **section= &CurProfile->section;
+
+    PROFILE_InvalidateIndex( CurProfile );
     while (*section)
     {
         if (!strcmpiW( (*section)->name, section_name ))
@@ -576,9 +724,12 @@ static void PROFILE_DeleteAllKeys( LPCWSTR section_name)
  *
  * Find a key in a profile tree, optionally creating it.
  */
-static PROFILEKEY *PROFILE_Find( PROFILESECTION **section, LPCWSTR section_name,
+static PROFILEKEY *PROFILE_Find( PROFILE *profile, LPCWSTR section_name,
                                  LPCWSTR key_name, BOOL create, BOOL create_always )
 {
+    const struct profile_index *index = PROFILE_GetIndex( profile );
+    PROFILESECTION **section = &profile->section, *found = NULL;
+    PROFILEKEY **key;
     LPCWSTR p;
     int seclen = 0, keylen = 0;
 
@@ -598,39 +749,57 @@ static PROFILEKEY *PROFILE_Find( PROFILESECTION **section, LPCWSTR section_name,
         keylen = p - key_name + 1;
     }
 
-    while (*section)
+    if (index)
+        found = PROFILE_IndexLookup( index, NULL, section_name, seclen,
+                                     PROFILE_HashName( section_name, seclen ));
+    else
     {
-        if (!strncmpiW((*section)->name, section_name, seclen) &&
-            ((*section)->name)[seclen] == '\0')
+        for ( ; *section; section = &(*section)->next)
         {
-            PROFILEKEY **key = &(*section)->key;
+            if (!strncmpiW((*section)->name, section_name, seclen) &&
+                ((*section)->name)[seclen] == '\0')
+            {
+                found = *section;
+                break;
+            }
+        }
+    }
 
-            while (*key)
+    if (found)
+    {
+        /* If create_always is FALSE then we check if the keyname
+         * already exists. Otherwise we add it regardless of its
+         * existence, to allow keys to be added more than once in
+         * some cases.
+         */
+        if (!create_always)
+        {
+            if (index)
             {
-                /* If create_always is FALSE then we check if the keyname
-                 * already exists. Otherwise we add it regardless of its
-                 * existence, to allow keys to be added more than once in
-                 * some cases.
-                 */
-                if(!create_always)
-                {
-                    if ( (!(strncmpiW( (*key)->name, key_name, keylen )))
-                         && (((*key)->name)[keylen] == '\0') )
+                PROFILEKEY *ret = PROFILE_IndexLookup( index, found, key_name, keylen,
+                                                       PROFILE_HashName( key_name, keylen ));
+                if (ret) return ret;
+            }
+            else
+            {
+                for (key = &found->key; *key; key = &(*key)->next)
+                    if (!strncmpiW( (*key)->name, key_name, keylen ) && !(*key)->name[keylen])
                         return *key;
-                }
-                key = &(*key)->next;
             }
-            if (!create) return NULL;
-            if (!(*key = HeapAlloc( GetProcessHeap(), 0, sizeof(PROFILEKEY) + strlenW(key_name) * sizeof(WCHAR) )))
-                return NULL;
-            strcpyW( (*key)->name, key_name );
-            (*key)->value = NULL;
-            (*key)->next  = NULL;
-            return *key;
         }
-        section = &(*section)->next;
+        if (!create) return NULL;
+        for (key = &found->key; *key; key = &(*key)->next) ;
+        if (!(*key = HeapAlloc( GetProcessHeap(), 0, sizeof(PROFILEKEY) + strlenW(key_name) * sizeof(WCHAR) )))
+            return NULL;
+        strcpyW( (*key)->name, key_name );
+        (*key)->value = NULL;
+        (*key)->next  = NULL;
+        if (profile->index && !PROFILE_IndexAdd( profile->index, found, *key ))
+            PROFILE_InvalidateIndex( profile );
+        return *key;
     }
     if (!create) return NULL;
+    while (*section) section = &(*section)->next;
     *section = HeapAlloc( GetProcessHeap(), 0, sizeof(PROFILESECTION) + strlenW(section_name) * sizeof(WCHAR) );
     if(*section == NULL) return NULL;
     strcpyW( (*section)->name, section_name );
@@ -639,11 +808,15 @@ static PROFILEKEY *PROFILE_Find( PROFILESECTION **section, LPCWSTR section_name,
                                         sizeof(PROFILEKEY) + strlenW(key_name) * sizeof(WCHAR) )))
     {
         HeapFree(GetProcessHeap(), 0, *section);
+        *section = NULL;
         return NULL;
     }
     strcpyW( (*section)->key->name, key_name );
     (*section)->key->value = NULL;
     (*section)->key->next  = NULL;
+    if (profile->index && (!PROFILE_IndexAdd( profile->index, *section, NULL ) ||
+                           !PROFILE_IndexAdd( profile->index, *section, (*section)->key )))
+        PROFILE_InvalidateIndex( profile );
     return (*section)->key;
 }
 
@@ -700,6 +873,10 @@ static void PROFILE_ReleaseFile(void)
     CurProfile->filename  = NULL;
     CurProfile->encoding = ENCODING_ANSI;
     ZeroMemory(&CurProfile->LastWriteTime, sizeof(CurProfile->LastWriteTime));
+    PROFILE_InvalidateIndex( CurProfile );
+    if (CurProfile->notify) FindCloseChangeNotification( CurProfile->notify );
+    CurProfile->notify = NULL;
+    CurProfile->stable = FALSE;
 }
 
 /***********************************************************************
@@ -722,6 +899,83 @@ static BOOL is_not_current(FILETIME *ft)
     return ftll + 21000000 < now.QuadPart;
 }
 
+/***********************************************************************
+ *           PROFILE_Watch
+ *
+ * Update the change notification state of a profile after its file
+ * has been checked. Only files that were already being watched when
+ * they were checked, and that are old enough for their time stamp to
+ * be trusted, are considered stable and not checked again until
+ * something changes in their directory.
+ */
+static void PROFILE_Watch( PROFILE *profile, FILETIME *ft )
+{
+    WCHAR *dir, *p;
+
+    profile->stable = FALSE;
+    if (!is_not_current( ft )) return;
+    if (profile->notify)
+    {
+        profile->stable = TRUE;
+        return;
+    }
+
+    if (!(dir = HeapAlloc( GetProcessHeap(), 0, (strlenW(profile->filename) + 1) * sizeof(WCHAR) )))
+        return;
+    strcpyW( dir, profile->filename );
+    if ((p = strrchrW( dir, '\\' )))
+    {
+        p[1] = 0;
+        profile->notify = FindFirstChangeNotificationW( dir, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME |
+                                                        FILE_NOTIFY_CHANGE_SIZE |
+                                                        FILE_NOTIFY_CHANGE_LAST_WRITE );
+        if (profile->notify == INVALID_HANDLE_VALUE) profile->notify = NULL;
+    }
+    HeapFree( GetProcessHeap(), 0, dir );
+}
+
+/***********************************************************************
+ *           PROFILE_MakeCurrent
+ *
+ * Move a cached profile to the front of the MRU list.
+ */
+static void PROFILE_MakeCurrent( unsigned int pos )
+{
+    PROFILE *profile = MRUProfile[pos];
+
+    if (!pos) return;
+    PROFILE_FlushFile();
+    memmove( MRUProfile + 1, MRUProfile, pos * sizeof(*MRUProfile) );
+    CurProfile = profile;
+}
+
+/***********************************************************************
+ *           PROFILE_GetCacheSize
+ *
+ * Get the number of profile files to keep cached.
+ */
+static unsigned int PROFILE_GetCacheSize(void)
+{
+    /* @@ Wine registry key: HKCU\Software\Wine\Profile */
+    static const WCHAR profileW[] = {'S','o','f','t','w','a','r','e','\\','W','i','n','e','\\',
+                                     'P','r','o','f','i','l','e',0};
+    static const WCHAR cachesizeW[] = {'C','a','c','h','e','S','i','z','e',0};
+    WCHAR buffer[16];
+    DWORD type, size = sizeof(buffer) - sizeof(WCHAR);
+    unsigned int ret = N_CACHED_PROFILES;
+    HKEY key;
+
+    if (RegOpenKeyExW( HKEY_CURRENT_USER, profileW, 0, KEY_READ, &key )) return ret;
+    memset( buffer, 0, sizeof(buffer) );
+    if (!RegQueryValueExW( key, cachesizeW, NULL, &type, (BYTE *)buffer, &size ))
+    {
+        if (type == REG_DWORD) ret = *(DWORD *)buffer;
+        else if (type == REG_SZ) ret = atoiW( buffer );
+    }
+    RegCloseKey( key );
+    return max( 1, min( ret, MAX_CACHED_PROFILES ));
+}
+
 /***********************************************************************
  *           PROFILE_Open
  *
@@ -732,24 +986,27 @@ static BOOL PROFILE_Open( LPCWSTR filename, BOOL write_access )
     WCHAR buffer[MAX_PATH];
     HANDLE hFile = INVALID_HANDLE_VALUE;
     FILETIME LastWriteTime;
-    int i,j;
+    unsigned int i;
     PROFILE *tempProfile;
     
     ZeroMemory(&LastWriteTime, sizeof(LastWriteTime));
 
     /* First time around */
 
-    if(!CurProfile)
-       for(i=0;i<N_CACHED_PROFILES;i++)
+    if(!MRUProfile)
+    {
+       nb_cached_profiles = PROFILE_GetCacheSize();
+       TRACE("caching %u profiles\n", nb_cached_profiles);
+       if (!(MRUProfile = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                     nb_cached_profiles * sizeof(*MRUProfile) )))
+           return FALSE;
+       for(i=0;i<nb_cached_profiles;i++)
        {
-          MRUProfile[i]=HeapAlloc( GetProcessHeap(), 0, sizeof(PROFILE) );
+          MRUProfile[i]=HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(PROFILE) );
           if(MRUProfile[i] == NULL) break;
-          MRUProfile[i]->changed=FALSE;
-          MRUProfile[i]->section=NULL;
-          MRUProfile[i]->filename=NULL;
           MRUProfile[i]->encoding=ENCODING_ANSI;
-          ZeroMemory(&MRUProfile[i]->LastWriteTime, sizeof(FILETIME));
        }
+    }
 
     if (!filename)
 	filename = wininiW;
@@ -772,6 +1029,30 @@ static BOOL PROFILE_Open( LPCWSTR filename, BOOL write_access )
         
     TRACE("path: %s\n", debugstr_w(buffer));
 
+    /* a stable cached file doesn't need to be opened again until its directory changes,
+     * but the time stamp is still checked in case the change notification missed it */
+    for(i=0;i<nb_cached_profiles;i++)
+    {
+        PROFILE *profile = MRUProfile[i];
+        WIN32_FILE_ATTRIBUTE_DATA data;
+
+        if (!profile->notify || strcmpiW( buffer, profile->filename )) continue;
+        if (WaitForSingleObject( profile->notify, 0 ) == WAIT_TIMEOUT)
+        {
+            if (profile->stable && !write_access &&
+                GetFileAttributesExW( buffer, GetFileExInfoStandard, &data ) &&
+                !memcmp( &profile->LastWriteTime, &data.ftLastWriteTime, sizeof(FILETIME) ))
+            {
+                TRACE("(%s): already opened, unchanged (mru=%d)\n", debugstr_w(buffer), i);
+                PROFILE_MakeCurrent( i );
+                return TRUE;
+            }
+        }
+        else FindNextChangeNotification( profile->notify );
+        profile->stable = FALSE;
+        break;
+    }
+
     hFile = CreateFileW(buffer, GENERIC_READ | (write_access ? GENERIC_WRITE : 0),
                         FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
@@ -782,19 +1063,12 @@ static BOOL PROFILE_Open( LPCWSTR filename, BOOL write_access )
         return FALSE;
     }
 
-    for(i=0;i<N_CACHED_PROFILES;i++)
+    for(i=0;i<nb_cached_profiles;i++)
     {
         if ((MRUProfile[i]->filename && !strcmpiW( buffer, MRUProfile[i]->filename )))
         {
             TRACE("MRU Filename: %s, new filename: %s\n", debugstr_w(MRUProfile[i]->filename), debugstr_w(buffer));
-            if(i)
-            {
-                PROFILE_FlushFile();
-                tempProfile=MRUProfile[i];
-                for(j=i;j>0;j--)
-                    MRUProfile[j]=MRUProfile[j-1];
-                CurProfile=tempProfile;
-            }
+            PROFILE_MakeCurrent( i );
 
             if (hFile != INVALID_HANDLE_VALUE)
             {
@@ -808,9 +1082,11 @@ static BOOL PROFILE_Open( LPCWSTR filename, BOOL write_access )
                     TRACE("(%s): already opened, needs refreshing (mru=%d)\n",
                           debugstr_w(buffer), i);
                     PROFILE_Free(CurProfile->section);
+                    PROFILE_InvalidateIndex(CurProfile);
                     CurProfile->section = PROFILE_Load(hFile, &CurProfile->encoding);
                     CurProfile->LastWriteTime = LastWriteTime;
                 }
+                PROFILE_Watch(CurProfile, &LastWriteTime);
                 CloseHandle(hFile);
                 return TRUE;
             }
@@ -823,10 +1099,10 @@ static BOOL PROFILE_Open( LPCWSTR filename, BOOL write_access )
     PROFILE_FlushFile();
 
     /* Make the oldest profile the current one only in order to get rid of it */
-    if(i==N_CACHED_PROFILES)
+    if(i==nb_cached_profiles)
       {
-       tempProfile=MRUProfile[N_CACHED_PROFILES-1];
-       for(i=N_CACHED_PROFILES-1;i>0;i--)
+       tempProfile=MRUProfile[nb_cached_profiles-1];
+       for(i=nb_cached_profiles-1;i>0;i--)
           MRUProfile[i]=MRUProfile[i-1];
        CurProfile=tempProfile;
       }
@@ -840,6 +1116,7 @@ static BOOL PROFILE_Open( LPCWSTR filename, BOOL write_access )
     {
         CurProfile->section = PROFILE_Load(hFile, &CurProfile->encoding);
         GetFileTime(hFile, NULL, NULL, &CurProfile->LastWriteTime);
+        PROFILE_Watch(CurProfile, &CurProfile->LastWriteTime);
         CloseHandle(hFile);
     }
     else
@@ -857,15 +1134,24 @@ static BOOL PROFILE_Open( LPCWSTR filename, BOOL write_access )
  * Returns all keys of a section.
  * If return_values is TRUE, also include the corresponding values.
  */
-static INT PROFILE_GetSection( PROFILESECTION *section, LPCWSTR section_name,
+static INT PROFILE_GetSection( PROFILE *profile, LPCWSTR section_name,
 			       LPWSTR buffer, UINT len, BOOL return_values )
 {
+    const struct profile_index *index;
+    PROFILESECTION *section = profile->section;
     PROFILEKEY *key;
 
     if(!buffer) return 0;
 
     TRACE("%s,%p,%u\n", debugstr_w(section_name), buffer, len);
 
+    if ((index = PROFILE_GetIndex( profile )))
+    {
+        int namelen = strlenW( section_name );
+        section = PROFILE_IndexLookup( index, NULL, section_name, namelen,
+                                       PROFILE_HashName( section_name, namelen ));
+    }
+
     while (section)
     {
         if (!strcmpiW( section->name, section_name ))
@@ -983,7 +1269,7 @@ static INT PROFILE_GetString( LPCWSTR section, LPCWSTR key_name,
     if (!def_val) def_val = empty_strW;
     if (key_name)
     {
-        key = PROFILE_Find( &CurProfile->section, section, key_name, FALSE, FALSE);
+        key = PROFILE_Find( CurProfile, section, key_name, FALSE, FALSE);
         PROFILE_CopyEntry( buffer, (key && key->value) ? key->value : def_val,
                            len, TRUE );
         TRACE("(%s,%s,%s): returning %s\n",
@@ -994,7 +1280,7 @@ static INT PROFILE_GetString( LPCWSTR section, LPCWSTR key_name,
     /* no "else" here ! */
     if (section)
     {
-        INT ret = PROFILE_GetSection(CurProfile->section, section, buffer, len, FALSE);
+        INT ret = PROFILE_GetSection(CurProfile, section, buffer, len, FALSE);
         if (!buffer[0]) /* no luck -> def_val */
         {
             PROFILE_CopyEntry(buffer, def_val, len, TRUE);
@@ -1018,6 +1304,7 @@ static BOOL PROFILE_SetString( LPCWSTR section_name, LPCWSTR key_name,
     if (!key_name)  /* Delete a whole section */
     {
         TRACE("(%s)\n", debugstr_w(section_name));
+        PROFILE_InvalidateIndex( CurProfile );
         CurProfile->changed |= PROFILE_DeleteSection( &CurProfile->section,
                                                       section_name );
         return TRUE;         /* Even if PROFILE_DeleteSection() has failed,
@@ -1026,13 +1313,14 @@ static BOOL PROFILE_SetString( LPCWSTR section_name, LPCWSTR key_name,
     else if (!value)  /* Delete a key */
     {
         TRACE("(%s,%s)\n", debugstr_w(section_name), debugstr_w(key_name) );
+        PROFILE_InvalidateIndex( CurProfile );
         CurProfile->changed |= PROFILE_DeleteKey( &CurProfile->section,
                                                   section_name, key_name );
         return TRUE;          /* same error handling as above */
     }
     else  /* Set the key value */
     {
-        PROFILEKEY *key = PROFILE_Find(&CurProfile->section, section_name,
+        PROFILEKEY *key = PROFILE_Find(CurProfile, section_name,
                                         key_name, TRUE, create_always );
         TRACE("(%s,%s,%s):\n",
               debugstr_w(section_name), debugstr_w(key_name), debugstr_w(value) );
@@ -1287,7 +1575,7 @@ INT WINAPI GetPrivateProfileSectionW( LPCWSTR section, LPWSTR buffer,
     RtlEnterCriticalSection( &PROFILE_CritSect );
 
     if (PROFILE_Open( filename, FALSE ))
-        ret = PROFILE_GetSection(CurProfile->section, section, buffer, len, TRUE);
+        ret = PROFILE_GetSection(CurProfile, section, buffer, len, TRUE);
 
     RtlLeaveCriticalSection( &PROFILE_CritSect );
 
@@ -1371,7 +1659,7 @@ BOOL WINAPI WritePrivateProfileStringW( LPCWSTR section, LPCWSTR entry,
     {
         if (!filename || PROFILE_Open( filename, TRUE ))
         {
-            if (CurProfile) PROFILE_ReleaseFile();  /* always return FALSE in this case */
+            if (MRUProfile && CurProfile) PROFILE_ReleaseFile();  /* always return FALSE in this case */
         }
     }
     else if (PROFILE_Open( filename, TRUE ))
@@ -1430,7 +1718,7 @@ BOOL WINAPI WritePrivateProfileSectionW( LPCWSTR section,
     {
         if (!filename || PROFILE_Open( filename, TRUE ))
         {
-            if (CurProfile) PROFILE_ReleaseFile();  /* always return FALSE in this case */
+            if (MRUProfile && CurProfile) PROFILE_ReleaseFile();  /* always return FALSE in this case */
         }
     }
     else if (PROFILE_Open( filename, TRUE )) {
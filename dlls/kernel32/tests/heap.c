@@ -842,8 +842,11 @@ static void test_obsolete_flags(void)
 
 static void test_HeapQueryInformation(void)
 {
+    PROCESS_HEAP_ENTRY entry;
+    void *blocks[300];
+    HANDLE heap;
     ULONG info;
-    SIZE_T size;
+    SIZE_T size, i;
     BOOL ret;
 
     pHeapQueryInformation = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "HeapQueryInformation");
@@ -890,6 +893,58 @@ static void test_HeapQueryInformation(void)
                                 &info, sizeof(info) + 1, NULL);
     ok(ret, "HeapQueryInformation error %u\n", GetLastError());
     ok(info == 0 || info == 1 || info == 2, "expected 0, 1 or 2, got %u\n", info);
+
+    heap = HeapCreate(0, 0, 0);
+    ok(heap != NULL, "HeapCreate error %u\n", GetLastError());
+    info = 2;
+    ret = HeapSetInformation(heap, HeapCompatibilityInformation, &info, sizeof(info));
+    ok(ret, "HeapSetInformation error %u\n", GetLastError());
+    info = 0xdeadbeef;
+    ret = pHeapQueryInformation(heap, HeapCompatibilityInformation, &info, sizeof(info), NULL);
+    ok(ret, "HeapQueryInformation error %u\n", GetLastError());
+    ok(info == 2, "expected 2, got %u\n", info);
+
+    for (i = 0; i < ARRAY_SIZE(blocks); i++)
+    {
+        blocks[i] = HeapAlloc(heap, 0, i + 1);
+        ok(blocks[i] != NULL, "HeapAlloc failed\n");
+        memset(blocks[i], 0xcc, i + 1);
+    }
+    for (i = 0; i < ARRAY_SIZE(blocks); i += 2)
+    {
+        ret = HeapFree(heap, 0, blocks[i]);
+        ok(ret, "HeapFree error %u\n", GetLastError());
+    }
+    ok(HeapValidate(heap, 0, NULL), "HeapValidate failed\n");
+    /* freed blocks are not reported as busy, even if they are kept around */
+    memset(&entry, 0, sizeof(entry));
+    while (HeapWalk(heap, &entry))
+    {
+        if (!(entry.wFlags & PROCESS_HEAP_ENTRY_BUSY)) continue;
+        for (i = 0; i < ARRAY_SIZE(blocks); i += 2)
+            ok(entry.lpData != blocks[i], "freed block %p reported busy\n", blocks[i]);
+    }
+    for (i = 0; i < ARRAY_SIZE(blocks); i += 2)
+    {
+        blocks[i] = HeapAlloc(heap, HEAP_ZERO_MEMORY, i + 1);
+        ok(blocks[i] != NULL, "HeapAlloc failed\n");
+        ok(HeapSize(heap, 0, blocks[i]) == i + 1, "wrong size %lu\n", HeapSize(heap, 0, blocks[i]));
+        ok(!((BYTE *)blocks[i])[i], "block not zeroed\n");
+    }
+    ok(HeapValidate(heap, 0, NULL), "HeapValidate failed\n");
+    for (i = 0; i < ARRAY_SIZE(blocks); i++)
+    {
+        ret = HeapFree(heap, 0, blocks[i]);
+        ok(ret, "HeapFree error %u\n", GetLastError());
+    }
+    HeapDestroy(heap);
+
+    heap = HeapCreate(HEAP_NO_SERIALIZE, 0, 0);
+    ok(heap != NULL, "HeapCreate error %u\n", GetLastError());
+    info = 2;
+    ret = HeapSetInformation(heap, HeapCompatibilityInformation, &info, sizeof(info));
+    ok(!ret, "HeapSetInformation succeeded on a HEAP_NO_SERIALIZE heap\n");
+    HeapDestroy(heap);
 }
 
 static void test_heap_checks( DWORD flags )
@@ -312,6 +312,43 @@ static void testGetProcAddress_Wrong(void)
     ok( GetLastError() == ERROR_MOD_NOT_FOUND, "Expected ERROR_MOD_NOT_FOUND, got %d\n", GetLastError() );
 }
 
+static void testGetProcAddress_AllNames(void)
+{
+    HMODULE module = GetModuleHandleA( "kernel32.dll" );
+    const IMAGE_NT_HEADERS *nt = (const IMAGE_NT_HEADERS *)((const char *)module + ((const IMAGE_DOS_HEADER *)module)->e_lfanew);
+    const IMAGE_DATA_DIRECTORY *dir = &nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+    const IMAGE_EXPORT_DIRECTORY *exports = (const IMAGE_EXPORT_DIRECTORY *)((const char *)module + dir->VirtualAddress);
+    const DWORD *names = (const DWORD *)((const char *)module + exports->AddressOfNames);
+    const WORD *ordinals = (const WORD *)((const char *)module + exports->AddressOfNameOrdinals);
+    FARPROC fp, fp_ordinal;
+    DWORD i, pass;
+
+    ok( dir->VirtualAddress != 0, "no export directory\n" );
+
+    /* look up every name more than once so that the loader's name index gets used */
+    for (pass = 0; pass < 2; pass++)
+    {
+        for (i = 0; i < exports->NumberOfNames; i++)
+        {
+            const char *name = (const char *)module + names[i];
+
+            fp = GetProcAddress( module, name );
+            fp_ordinal = GetProcAddress( module, (LPCSTR)(ULONG_PTR)(ordinals[i] + exports->Base) );
+            ok( fp == fp_ordinal, "%s: got %p, by ordinal %p\n", name, fp, fp_ordinal );
+        }
+    }
+
+    SetLastError( 0xdeadbeef );
+    fp = GetProcAddress( module, "createfilea" );
+    ok( !fp, "createfilea should not be found\n" );
+    ok( GetLastError() == ERROR_PROC_NOT_FOUND, "Expected ERROR_PROC_NOT_FOUND, got %d\n", GetLastError() );
+
+    SetLastError( 0xdeadbeef );
+    fp = GetProcAddress( module, "CreateFileAX" );
+    ok( !fp, "CreateFileAX should not be found\n" );
+    ok( GetLastError() == ERROR_PROC_NOT_FOUND, "Expected ERROR_PROC_NOT_FOUND, got %d\n", GetLastError() );
+}
+
 static void testLoadLibraryEx(void)
 {
     CHAR path[MAX_PATH];
@@ -1178,6 +1215,7 @@ START_TEST(module)
     testNestedLoadLibraryA();
     testLoadLibraryA_Wrong();
     testGetProcAddress_Wrong();
+    testGetProcAddress_AllNames();
     testLoadLibraryEx();
     test_LoadLibraryEx_search_flags();
     testGetModuleHandleEx();
@@ -516,6 +516,88 @@ static BOOL emptystr_ok(CHAR emptystr[MAX_PATH])
     return TRUE;
 }
 
+static void test_profile_many_keys(void)
+{
+    static const char testfile[] = ".\\winetest_many.ini";
+    char name[32], key[32], expect[32], buf[64], *data, *p;
+    DWORD ret;
+    int i, j;
+
+    data = HeapAlloc( GetProcessHeap(), 0, 100 * 20 * 32 );
+    for (i = 0, p = data; i < 100; i++)
+    {
+        p += sprintf( p, "[section%d]\r\n", i );
+        for (j = 0; j < 20; j++) p += sprintf( p, "key%d=%d_%d\r\n", j, i, j );
+    }
+    create_test_file( testfile, data, p - data );
+    HeapFree( GetProcessHeap(), 0, data );
+
+    for (i = 0; i < 100; i += 7)
+    {
+        for (j = 0; j < 20; j += 3)
+        {
+            sprintf( name, "SECTION%d", i );
+            sprintf( key, "Key%d", j );
+            sprintf( expect, "%d_%d", i, j );
+            ret = GetPrivateProfileStringA( name, key, "default", buf, sizeof(buf), testfile );
+            ok( ret == strlen(expect) && !strcmp( buf, expect ), "%s %s: got %u %s\n", name, key, ret, buf );
+        }
+    }
+
+    ret = GetPrivateProfileStringA( "section42", "key20", "default", buf, sizeof(buf), testfile );
+    ok( ret == 7 && !strcmp( buf, "default" ), "got %u %s\n", ret, buf );
+    ret = GetPrivateProfileStringA( "section100", "key1", "default", buf, sizeof(buf), testfile );
+    ok( ret == 7 && !strcmp( buf, "default" ), "got %u %s\n", ret, buf );
+
+    ret = WritePrivateProfileStringA( "section42", "newkey", "new", testfile );
+    ok( ret, "WritePrivateProfileString failed\n" );
+    ret = GetPrivateProfileStringA( "Section42", "NewKey", "default", buf, sizeof(buf), testfile );
+    ok( ret == 3 && !strcmp( buf, "new" ), "got %u %s\n", ret, buf );
+    ret = GetPrivateProfileStringA( "section42", "key3", "default", buf, sizeof(buf), testfile );
+    ok( ret == 4 && !strcmp( buf, "42_3" ), "got %u %s\n", ret, buf );
+
+    ret = WritePrivateProfileStringA( "section42", "key3", NULL, testfile );
+    ok( ret, "WritePrivateProfileString failed\n" );
+    ret = GetPrivateProfileStringA( "section42", "key3", "default", buf, sizeof(buf), testfile );
+    ok( ret == 7 && !strcmp( buf, "default" ), "got %u %s\n", ret, buf );
+    ret = GetPrivateProfileStringA( "section42", "key4", "default", buf, sizeof(buf), testfile );
+    ok( ret == 4 && !strcmp( buf, "42_4" ), "got %u %s\n", ret, buf );
+
+    ret = WritePrivateProfileStringA( "newsection", "a", "b", testfile );
+    ok( ret, "WritePrivateProfileString failed\n" );
+    ret = GetPrivateProfileStringA( "NEWSECTION", "A", "default", buf, sizeof(buf), testfile );
+    ok( ret == 1 && !strcmp( buf, "b" ), "got %u %s\n", ret, buf );
+
+    for (i = 0; i < 50; i++)
+    {
+        sprintf( name, "added%d", i );
+        sprintf( expect, "%d", i );
+        ret = WritePrivateProfileStringA( name, "key", expect, testfile );
+        ok( ret, "WritePrivateProfileString failed\n" );
+    }
+    for (i = 0; i < 50; i++)
+    {
+        sprintf( name, "ADDED%d", i );
+        sprintf( expect, "%d", i );
+        ret = GetPrivateProfileStringA( name, "key", "default", buf, sizeof(buf), testfile );
+        ok( ret == strlen(expect) && !strcmp( buf, expect ), "%s: got %u %s\n", name, ret, buf );
+    }
+
+    ret = WritePrivateProfileStringA( "section10", NULL, NULL, testfile );
+    ok( ret, "WritePrivateProfileString failed\n" );
+    ret = GetPrivateProfileStringA( "section10", "key1", "default", buf, sizeof(buf), testfile );
+    ok( ret == 7 && !strcmp( buf, "default" ), "got %u %s\n", ret, buf );
+    ret = GetPrivateProfileStringA( "section11", "key1", "default", buf, sizeof(buf), testfile );
+    ok( ret == 4 && !strcmp( buf, "11_1" ), "got %u %s\n", ret, buf );
+
+    ret = GetPrivateProfileSectionA( "section99", buf, sizeof(buf), testfile );
+    ok( ret == sizeof(buf) - 2, "got %u\n", ret );
+    ok( !strcmp( buf, "key0=99_0" ), "got %s\n", buf );
+
+    WritePrivateProfileStringA( NULL, NULL, NULL, testfile );
+    ok( DeleteFileA( testfile ), "failed to delete %s\n", testfile );
+}
+
 static void test_profile_directory_readonly(void)
 {
     BOOL ret;
@@ -1101,6 +1183,7 @@ START_TEST(profile)
     test_profile_existing();
     test_profile_delete_on_close();
     test_profile_refresh();
+    test_profile_many_keys();
     test_profile_directory_readonly();
     test_GetPrivateProfileString(
         "[section1]\r\n"
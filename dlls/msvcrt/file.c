@@ -37,6 +37,9 @@
 #endif
 #include <sys/types.h>
 #include <limits.h>
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif
 
 #include "windef.h"
 #include "winbase.h"
@@ -143,8 +146,7 @@ static const ULONGLONG WCCMD = TOUL('c') << 32 | TOUL('m') << 16 | TOUL('d');
 static const ULONGLONG WCCOM = TOUL('c') << 32 | TOUL('o') << 16 | TOUL('m');
 
 /* This critical section protects the MSVCRT_fstreams table
- * and MSVCRT_stream_idx from race conditions. It also
- * protects fd critical sections creation code.
+ * and MSVCRT_stream_idx from race conditions.
  */
 static CRITICAL_SECTION MSVCRT_file_cs;
 static CRITICAL_SECTION_DEBUG MSVCRT_file_cs_debug =
@@ -253,24 +255,11 @@ static inline ioinfo* get_ioinfo_nolock(int fd)
     return ret + (fd%MSVCRT_FD_BLOCK_SIZE);
 }
 
-static inline void init_ioinfo_cs(ioinfo *info)
-{
-    if(!(info->exflag & EF_CRIT_INIT)) {
-        LOCK_FILES();
-        if(!(info->exflag & EF_CRIT_INIT)) {
-            InitializeCriticalSection(&info->crit);
-            info->exflag |= EF_CRIT_INIT;
-        }
-        UNLOCK_FILES();
-    }
-}
-
 static inline ioinfo* get_ioinfo(int fd)
 {
     ioinfo *ret = get_ioinfo_nolock(fd);
     if(ret == &MSVCRT___badioinfo)
         return ret;
-    init_ioinfo_cs(ret);
     EnterCriticalSection(&ret->crit);
     return ret;
 }
@@ -293,10 +282,20 @@ static inline BOOL alloc_pioinfo_block(int fd)
         *MSVCRT__errno() = MSVCRT_ENOMEM;
         return FALSE;
     }
+    /* initialize the locks before the block gets published so that
+     * looking up an fd never needs to take the files lock */
     for(i=0; i<MSVCRT_FD_BLOCK_SIZE; i++)
+    {
         block[i].handle = INVALID_HANDLE_VALUE;
+        InitializeCriticalSection(&block[i].crit);
+        block[i].exflag = EF_CRIT_INIT;
+    }
     if(InterlockedCompareExchangePointer((void**)&MSVCRT___pioinfo[fd/MSVCRT_FD_BLOCK_SIZE], block, NULL))
+    {
+        for(i=0; i<MSVCRT_FD_BLOCK_SIZE; i++)
+            DeleteCriticalSection(&block[i].crit);
         MSVCRT_free(block);
+    }
     return TRUE;
 }
 
@@ -330,7 +329,10 @@ static inline ioinfo* get_ioinfo_alloc(int *fd)
             info = get_ioinfo_nolock(i);
         }
 
-        init_ioinfo_cs(info);
+        /* don't bother locking descriptors that are obviously in use */
+        if(info->handle != INVALID_HANDLE_VALUE)
+            continue;
+
         if(TryEnterCriticalSection(&info->crit))
         {
             if(info->handle == INVALID_HANDLE_VALUE)
@@ -349,7 +351,7 @@ static inline ioinfo* get_ioinfo_alloc(int *fd)
 
 static inline void release_ioinfo(ioinfo *info)
 {
-    if(info!=&MSVCRT___badioinfo && info->exflag & EF_CRIT_INIT)
+    if(info!=&MSVCRT___badioinfo)
         LeaveCriticalSection(&info->crit);
 }
 
@@ -977,11 +979,16 @@ int CDECL MSVCRT_fflush(MSVCRT_FILE* file);
 /* INTERNAL: Flush all stream buffer */
 static int msvcrt_flush_all_buffers(int mask)
 {
-  int i, num_flushed = 0;
+  int i, num_flushed = 0, stream_idx;
   MSVCRT_FILE *file;
 
+  /* streams are never freed before process exit and fflush locks each of
+   * them, so don't block other threads' fopen/fclose while writing */
   LOCK_FILES();
-  for (i = 0; i < MSVCRT_stream_idx; i++) {
+  stream_idx = MSVCRT_stream_idx;
+  UNLOCK_FILES();
+
+  for (i = 0; i < stream_idx; i++) {
     file = msvcrt_get_file(i);
 
     if (file->_flag)
@@ -992,7 +999,6 @@ static int msvcrt_flush_all_buffers(int mask)
       }
     }
   }
-  UNLOCK_FILES();
 
   TRACE(":flushed (%d) handles\n",num_flushed);
   return num_flushed;
@@ -2560,6 +2566,84 @@ int CDECL MSVCRT__rmtmp(void)
   return num_removed;
 }
 
+/* Returns the offset of the first byte of buf equal to c1 or c2, or len if there
+ * is none. In UTF-16 mode only whole little-endian characters are matched. */
+static unsigned int find_text_chars(const char *buf, unsigned int len, char c1, char c2, BOOL utf16)
+{
+    unsigned int i = 0;
+
+#if defined(__SSE2__) && defined(__GNUC__)
+    if (utf16)
+    {
+        __m128i v1 = _mm_set1_epi16((unsigned char)c1), v2 = _mm_set1_epi16((unsigned char)c2);
+
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(v, v1), _mm_cmpeq_epi16(v, v2)));
+            if (mask) return i + __builtin_ctz(mask);
+        }
+    }
+    else
+    {
+        __m128i v1 = _mm_set1_epi8(c1), v2 = _mm_set1_epi8(c2);
+
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, v1), _mm_cmpeq_epi8(v, v2)));
+            if (mask) return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    if (utf16)
+    {
+        for (; i + 1 < len; i += 2)
+            if ((buf[i] == c1 || buf[i] == c2) && !buf[i + 1]) return i;
+        return len;
+    }
+
+    for (; i < len; i++)
+        if (buf[i] == c1 || buf[i] == c2) return i;
+    return len;
+}
+
+/* Counts the '\n' characters in a text mode buffer */
+static unsigned int count_text_lf(const char *buf, unsigned int len, BOOL utf16)
+{
+    unsigned int i = 0, nr_lf = 0;
+
+    while ((i += find_text_chars(buf + i, len - i, '\n', '\n', utf16)) < len)
+    {
+        nr_lf++;
+        i += 1 + utf16;
+    }
+    return nr_lf;
+}
+
+/* Copies a text mode buffer, inserting '\r' before every '\n'. Returns the number
+ * of bytes written to dst. */
+static unsigned int expand_text_lf(char *dst, const char *src, unsigned int len, BOOL utf16)
+{
+    unsigned int i = 0, j = 0, run;
+
+    for (;;)
+    {
+        run = find_text_chars(src + i, len - i, '\n', '\n', utf16);
+        memcpy(dst + j, src + i, run);
+        i += run;
+        j += run;
+        if (i >= len) break;
+
+        dst[j++] = '\r';
+        if (utf16) dst[j++] = 0;
+        dst[j++] = src[i++];
+        if (utf16) dst[j++] = src[i++];
+    }
+    return j;
+}
+
 static inline int get_utf8_char_len(char ch)
 {
     if((ch&0xf8) == 0xf0)
@@ -2707,6 +2791,15 @@ static int read_utf8(ioinfo *fdinfo, MSVCRT_wchar_t *buf, unsigned int count)
     pos = i;
 
     for(i=0, j=0; i<pos; i++) {
+        DWORD run = find_text_chars(readbuf+i, pos-i, '\r', 0x1a, FALSE);
+
+        if(run) {
+            memmove(readbuf+j, readbuf+i, run);
+            i += run;
+            j += run;
+            if(i == pos) break;
+        }
+
         if(readbuf[i] == 0x1a) {
             fdinfo->wxflag |= WX_ATEOF;
             break;
@@ -2824,6 +2917,17 @@ static int read_i(int fd, ioinfo *fdinfo, void *buf, unsigned int count)
 
             for (i=0, j=0; i<num_read; i+=1+utf16)
             {
+                /* copy everything up to the next \r or ctrl-z in one go */
+                DWORD run = find_text_chars(bufstart+i, num_read-i, '\r', 0x1a, utf16);
+
+                if (run)
+                {
+                    memmove(bufstart+j, bufstart+i, run);
+                    i += run;
+                    j += run;
+                    if (i == num_read) break;
+                }
+
                 /* in text mode, a ctrl-z signals EOF */
                 if (bufstart[i]==0x1a && (!utf16 || bufstart[i+1]==0))
                 {
@@ -3484,7 +3588,7 @@ int CDECL MSVCRT__write(int fd, const void* buf, unsigned int count)
     }
     else
     {
-        unsigned int i, j, nr_lf, size;
+        unsigned int nr_lf, size;
         char *p = NULL;
         const char *q;
         const char *s = buf;
@@ -3492,21 +3596,12 @@ int CDECL MSVCRT__write(int fd, const void* buf, unsigned int count)
         if (!(info->exflag & (EF_UTF8|EF_UTF16)))
         {
             /* find number of \n */
-            for (nr_lf=0, i=0; i<count; i++)
-                if (s[i] == '\n')
-                    nr_lf++;
+            nr_lf = count_text_lf(s, count, FALSE);
             if (nr_lf)
             {
                 size = count+nr_lf;
                 if ((q = p = MSVCRT_malloc(size)))
-                {
-                    for (s = buf, i = 0, j = 0; i < count; i++)
-                    {
-                        if (s[i] == '\n')
-                            p[j++] = '\r';
-                        p[j++] = s[i];
-                    }
-                }
+                    expand_text_lf(p, s, count, FALSE);
                 else
                 {
                     FIXME("Malloc failed\n");
@@ -3523,25 +3618,12 @@ int CDECL MSVCRT__write(int fd, const void* buf, unsigned int count)
         }
         else if (info->exflag & EF_UTF16)
         {
-            for (nr_lf=0, i=0; i<count; i+=2)
-                if (s[i]=='\n' && s[i+1]==0)
-                    nr_lf += 2;
+            nr_lf = count_text_lf(s, count, TRUE) * 2;
             if (nr_lf)
             {
                 size = count+nr_lf;
                 if ((q = p = MSVCRT_malloc(size)))
-                {
-                    for (s=buf, i=0, j=0; i<count; i++)
-                    {
-                        if (s[i]=='\n' && s[i+1]==0)
-                        {
-                            p[j++] = '\r';
-                            p[j++] = 0;
-                        }
-                        p[j++] = s[i++];
-                        p[j++] = s[i];
-                    }
-                }
+                    expand_text_lf(p, s, count, TRUE);
                 else
                 {
                     FIXME("Malloc failed\n");
@@ -3560,9 +3642,7 @@ int CDECL MSVCRT__write(int fd, const void* buf, unsigned int count)
         {
             DWORD conv_len;
 
-            for(nr_lf=0, i=0; i<count; i+=2)
-                if (s[i]=='\n' && s[i+1]==0)
-                    nr_lf++;
+            nr_lf = count_text_lf(s, count, TRUE);
 
             conv_len = WideCharToMultiByte(CP_UTF8, 0, (WCHAR*)buf, count/2, NULL, 0, NULL, NULL);
             if(!conv_len) {
@@ -3575,16 +3655,7 @@ int CDECL MSVCRT__write(int fd, const void* buf, unsigned int count)
             size = conv_len+nr_lf;
             if((p = MSVCRT_malloc(count+nr_lf*2+size)))
             {
-                for (s=buf, i=0, j=0; i<count; i++)
-                {
-                    if (s[i]=='\n' && s[i+1]==0)
-                    {
-                        p[j++] = '\r';
-                        p[j++] = 0;
-                    }
-                    p[j++] = s[i++];
-                    p[j++] = s[i];
-                }
+                expand_text_lf(p, s, count, TRUE);
                 q = p+count+nr_lf*2;
                 WideCharToMultiByte(CP_UTF8, 0, (WCHAR*)p, count/2+nr_lf,
                         p+count+nr_lf*2, conv_len+nr_lf, NULL, NULL);
@@ -4142,11 +4213,12 @@ MSVCRT_FILE * CDECL MSVCRT__wfsopen(const MSVCRT_wchar_t *path, const MSVCRT_wch
   if (msvcrt_get_flags(mode, &open_flags, &stream_flags) == -1)
       return NULL;
 
-  LOCK_FILES();
   fd = MSVCRT__wsopen(path, open_flags, share, MSVCRT__S_IREAD | MSVCRT__S_IWRITE);
   if (fd < 0)
-    file = NULL;
-  else if ((file = msvcrt_alloc_fp()) && msvcrt_init_fp(file, fd, stream_flags)
+    return NULL;
+
+  LOCK_FILES();
+  if ((file = msvcrt_alloc_fp()) && msvcrt_init_fp(file, fd, stream_flags)
    != -1)
     TRACE(":fd (%d) mode (%s) FILE* (%p)\n", fd, debugstr_w(mode), file);
   else if (file)
@@ -4154,11 +4226,11 @@ MSVCRT_FILE * CDECL MSVCRT__wfsopen(const MSVCRT_wchar_t *path, const MSVCRT_wch
     file->_flag = 0;
     file = NULL;
   }
+  UNLOCK_FILES();
 
   TRACE(":got (%p)\n",file);
-  if (fd >= 0 && !file)
+  if (!file)
     MSVCRT__close(fd);
-  UNLOCK_FILES();
   return file;
 }
 
@@ -5105,23 +5177,26 @@ MSVCRT_FILE* CDECL MSVCRT_tmpfile(void)
   int fd;
   MSVCRT_FILE* file = NULL;
 
-  LOCK_FILES();
   fd = MSVCRT__open(filename, MSVCRT__O_CREAT | MSVCRT__O_BINARY | MSVCRT__O_RDWR | MSVCRT__O_TEMPORARY,
           MSVCRT__S_IREAD | MSVCRT__S_IWRITE);
-  if (fd != -1 && (file = msvcrt_alloc_fp()))
+  if (fd != -1)
   {
-    if (msvcrt_init_fp(file, fd, MSVCRT__IORW) == -1)
+    LOCK_FILES();
+    if ((file = msvcrt_alloc_fp()))
     {
-        file->_flag = 0;
-        file = NULL;
+      if (msvcrt_init_fp(file, fd, MSVCRT__IORW) == -1)
+      {
+          file->_flag = 0;
+          file = NULL;
+      }
+      else file->_tmpfname = MSVCRT__strdup(filename);
     }
-    else file->_tmpfname = MSVCRT__strdup(filename);
+    UNLOCK_FILES();
   }
 
   if(fd != -1 && !file)
       MSVCRT__close(fd);
   MSVCRT_free(filename);
-  UNLOCK_FILES();
   return file;
 }
 
@@ -867,8 +867,15 @@ int CDECL MSVCRT_strncpy_s(char *dest, MSVCRT_size_t numberOfElements,
 
 BOOL msvcrt_init_heap(void)
 {
+    ULONG lfh = 2;
+
     heap = HeapCreate(0, 0, 0);
-    return heap != NULL;
+    if (!heap) return FALSE;
+    /* small blocks of the private CRT heap are then recycled without taking
+     * the heap lock; the process heap and the small blocks heap are left alone */
+    if (heap != GetProcessHeap())
+        HeapSetInformation(heap, HeapCompatibilityInformation, &lfh, sizeof(lfh));
+    return TRUE;
 }
 
 void msvcrt_destroy_heap(void)
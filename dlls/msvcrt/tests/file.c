@@ -2608,6 +2608,120 @@ static void test_lseek(void)
     DeleteFileA("_creat.tst");
 }
 
+static void test_text_translation(void)
+{
+    static const char line[] = "2020-05-15 12:00:00 INFO text mode translation test line\n";
+    static const unsigned int size = 256 * 1024;
+    char *text, *buf, *p;
+    unsigned int len = 0, pos, nr_lf = 0;
+    int fd, ret;
+
+    text = malloc(size);
+    buf = malloc(size * 2);
+    while (len + sizeof(line) <= size)
+    {
+        /* vary line lengths so that newlines fall at every alignment */
+        memcpy(text + len, line, sizeof(line) - 1);
+        len += sizeof(line) - 1 - (nr_lf++ % 17);
+        text[len - 1] = '\n';
+    }
+
+    fd = _open("text.tst", _O_CREAT|_O_TRUNC|_O_WRONLY|_O_TEXT, _S_IREAD|_S_IWRITE);
+    ok(fd != -1, "_open failed\n");
+    ret = _write(fd, text, len);
+    ok(ret == len, "_write returned %d, expected %u\n", ret, len);
+    ret = _write(fd, "\x1a" "tail", 5);
+    ok(ret == 5, "_write returned %d\n", ret);
+    _close(fd);
+
+    fd = _open("text.tst", _O_RDONLY|_O_BINARY);
+    ok(fd != -1, "_open failed\n");
+    pos = 0;
+    while ((ret = _read(fd, buf + pos, 65536)) > 0) pos += ret;
+    _close(fd);
+    ok(pos == len + nr_lf + 5, "read %u bytes, expected %u\n", pos, len + nr_lf + 5);
+    for (p = buf; p < buf + pos - 5; p++)
+    {
+        if (*p == '\n' && p[-1] != '\r') break;
+        if (*p == '\r' && p[1] != '\n') break;
+    }
+    ok(p == buf + pos - 5, "unexpected data at offset %u\n", (unsigned int)(p - buf));
+
+    fd = _open("text.tst", _O_RDONLY|_O_TEXT);
+    ok(fd != -1, "_open failed\n");
+    pos = 0;
+    /* use an odd chunk size so that \r\n pairs get split between reads */
+    while ((ret = _read(fd, buf + pos, 65535)) > 0) pos += ret;
+    _close(fd);
+    ok(pos == len, "read %u bytes, expected %u\n", pos, len);
+    ok(!memcmp(buf, text, len), "data mismatch\n");
+
+    unlink("text.tst");
+    free(buf);
+    free(text);
+}
+
+#define STRESS_THREADS 4
+#define STRESS_ITERATIONS 32
+
+static DWORD WINAPI stream_stress_thread(void *arg)
+{
+    int id = (INT_PTR)arg, i, j, fd, failures = 0;
+    char name[32], buf[64];
+    FILE *file;
+
+    sprintf(name, "stress%d.tst", id);
+    for (i = 0; i < STRESS_ITERATIONS; i++)
+    {
+        file = fopen(name, "w");
+        if (!file)
+        {
+            failures++;
+            continue;
+        }
+        for (j = 0; j < 16; j++)
+            fprintf(file, "%d %d %d\n", id, i, j);
+        fclose(file);
+
+        fd = _open(name, _O_RDONLY|_O_BINARY);
+        if (fd == -1)
+        {
+            failures++;
+            continue;
+        }
+        /* the stream was opened in text mode */
+        j = sprintf(buf, "%d %d 0\r\n", id, i);
+        if (_read(fd, buf + 32, j) != j || memcmp(buf, buf + 32, j))
+            failures++;
+        _close(fd);
+
+        /* flushing all streams must not deadlock with other threads' streams */
+        if (!(i % 16)) fflush(NULL);
+    }
+    unlink(name);
+    return failures;
+}
+
+static void test_stream_stress(void)
+{
+    HANDLE threads[STRESS_THREADS];
+    DWORD failures;
+    int i;
+
+    for (i = 0; i < STRESS_THREADS; i++)
+    {
+        threads[i] = CreateThread(NULL, 0, stream_stress_thread, (void *)(INT_PTR)i, 0, NULL);
+        ok(threads[i] != NULL, "CreateThread failed\n");
+    }
+    for (i = 0; i < STRESS_THREADS; i++)
+    {
+        ok(!WaitForSingleObject(threads[i], 60000), "thread %d timed out\n", i);
+        GetExitCodeThread(threads[i], &failures);
+        ok(!failures, "thread %d: %u failures\n", i, failures);
+        CloseHandle(threads[i]);
+    }
+}
+
 START_TEST(file)
 {
     int arg_c;
@@ -2668,6 +2782,7 @@ START_TEST(file)
     test_fgetwc_unicode();
     test_fputwc();
     test_ctrlz();
+    test_text_translation();
     test_file_put_get();
     test_tmpnam();
     test_get_osfhandle();
@@ -2680,6 +2795,7 @@ START_TEST(file)
     test_close();
     test__creat();
     test_lseek();
+    test_stream_stress();
 
     /* Wait for the (_P_NOWAIT) spawned processes to finish to make sure the report
      * file contains lines in the correct order
@@ -1989,6 +1989,276 @@ NTSTATUS WINAPI DECLSPEC_HOTPATCH NtQueryDirectoryFile( HANDLE handle, HANDLE ev
 }
 
 
+/* Cache of the contents of the directories scanned by find_file_in_dir, indexed by
+ * upper-cased name, so that repeated case-insensitive lookups in large directories
+ * don't have to read the whole directory every time. A cached directory is dropped
+ * as soon as its modification or change time differs from the one it was read with.
+ * Directories modified less than DIR_CACHE_MIN_AGE seconds ago are not cached, since
+ * a later change could leave their time stamps unchanged. A name that is not in the
+ * cache of a valid entry doesn't exist, unless it may be a short name, which still
+ * requires a scan of the directory. */
+
+#define DIR_CACHE_MAX_DIRS  32
+#define DIR_CACHE_MIN_AGE   2
+
+struct dir_cache_name
+{
+    unsigned int hash;
+    unsigned int len;        /* length of the upper-cased name in WCHARs */
+    unsigned int name;       /* offset of the upper-cased name in the names buffer */
+    unsigned int unix_name;  /* offset of the unix name in the unix names buffer */
+};
+
+struct dir_cache
+{
+    struct list            entry;      /* entry in dir_cache_list, most recently used first */
+    char                  *path;       /* unix path of the directory */
+    dev_t                  dev;
+    ino_t                  ino;
+    struct timespec        mtime;      /* modification time of the directory when it was read */
+    struct timespec        ctime;      /* change time of the directory when it was read */
+    unsigned int           count;      /* number of names */
+    struct dir_cache_name *names;
+    unsigned int          *index;      /* hash index, name index + 1 for used buckets */
+    unsigned int           index_mask; /* size of the index minus one */
+    WCHAR                 *wnames;     /* upper-cased names */
+    char                  *unames;     /* unix names */
+};
+
+static struct list dir_cache_list = LIST_INIT( dir_cache_list );
+static unsigned int dir_cache_count;
+
+static RTL_CRITICAL_SECTION dir_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG dir_cache_critsect_debug =
+{
+    0, 0, &dir_cache_section,
+    { &dir_cache_critsect_debug.ProcessLocksList, &dir_cache_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": dir_cache_section") }
+};
+static RTL_CRITICAL_SECTION dir_cache_section = { &dir_cache_critsect_debug, -1, 0, 0, 0, 0 };
+
+static unsigned int hash_dir_cache_name( const WCHAR *name, unsigned int len )
+{
+    unsigned int hash = 0;
+    while (len--) hash = hash * 31 + *name++;
+    return hash;
+}
+
+static void get_dir_cache_times( const struct stat *st, struct timespec *mtime, struct timespec *ctime )
+{
+    mtime->tv_sec = st->st_mtime;
+    ctime->tv_sec = st->st_ctime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    mtime->tv_nsec = st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    mtime->tv_nsec = st->st_mtimespec.tv_nsec;
+#else
+    mtime->tv_nsec = 0;
+#endif
+#ifdef HAVE_STRUCT_STAT_ST_CTIM
+    ctime->tv_nsec = st->st_ctim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_CTIMESPEC)
+    ctime->tv_nsec = st->st_ctimespec.tv_nsec;
+#else
+    ctime->tv_nsec = 0;
+#endif
+}
+
+static void free_dir_cache( struct dir_cache *cache )
+{
+    list_remove( &cache->entry );
+    dir_cache_count--;
+    RtlFreeHeap( GetProcessHeap(), 0, cache->path );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->names );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->index );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->wnames );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->unames );
+    RtlFreeHeap( GetProcessHeap(), 0, cache );
+}
+
+static BOOL add_dir_cache_name( struct dir_cache *cache, unsigned int *size, unsigned int *wsize,
+                                unsigned int *usize, unsigned int *wpos, unsigned int *upos,
+                                const WCHAR *name, unsigned int len, const char *unix_name )
+{
+    unsigned int i, ulen = strlen( unix_name ) + 1;
+    void *ptr;
+
+    if (cache->count == *size)
+    {
+        *size *= 2;
+        if (!(ptr = RtlReAllocateHeap( GetProcessHeap(), 0, cache->names, *size * sizeof(*cache->names) )))
+            return FALSE;
+        cache->names = ptr;
+    }
+    if (*wpos + len > *wsize)
+    {
+        *wsize = max( *wsize * 2, *wpos + len );
+        if (!(ptr = RtlReAllocateHeap( GetProcessHeap(), 0, cache->wnames, *wsize * sizeof(WCHAR) )))
+            return FALSE;
+        cache->wnames = ptr;
+    }
+    if (*upos + ulen > *usize)
+    {
+        *usize = max( *usize * 2, *upos + ulen );
+        if (!(ptr = RtlReAllocateHeap( GetProcessHeap(), 0, cache->unames, *usize )))
+            return FALSE;
+        cache->unames = ptr;
+    }
+
+    for (i = 0; i < len; i++) cache->wnames[*wpos + i] = RtlUpcaseUnicodeChar( name[i] );
+    memcpy( cache->unames + *upos, unix_name, ulen );
+    cache->names[cache->count].hash = hash_dir_cache_name( cache->wnames + *wpos, len );
+    cache->names[cache->count].len = len;
+    cache->names[cache->count].name = *wpos;
+    cache->names[cache->count].unix_name = *upos;
+    cache->count++;
+    *wpos += len;
+    *upos += ulen;
+    return TRUE;
+}
+
+static struct dir_cache_name *find_dir_cache_name( struct dir_cache *cache, const WCHAR *name,
+                                                   unsigned int len, unsigned int hash )
+{
+    struct dir_cache_name *entry;
+    unsigned int i;
+
+    for (i = hash & cache->index_mask; cache->index[i]; i = (i + 1) & cache->index_mask)
+    {
+        entry = &cache->names[cache->index[i] - 1];
+        if (entry->hash == hash && entry->len == len &&
+            !memcmp( cache->wnames + entry->name, name, len * sizeof(WCHAR) ))
+            return entry;
+    }
+    return NULL;
+}
+
+/* read a directory into a new cache entry; dir_cache_section must be held */
+static struct dir_cache *create_dir_cache( const char *path, const struct stat *st )
+{
+    unsigned int i, size = 256, wsize = 4096, usize = 4096, wpos = 0, upos = 0;
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct dir_cache *cache;
+    struct dirent *de;
+    DIR *dir = NULL;
+    int len;
+
+    if (!(cache = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*cache) ))) return NULL;
+    cache->dev = st->st_dev;
+    cache->ino = st->st_ino;
+    get_dir_cache_times( st, &cache->mtime, &cache->ctime );
+    list_init( &cache->entry );
+    dir_cache_count++;
+
+    if (!(cache->path = RtlAllocateHeap( GetProcessHeap(), 0, strlen(path) + 1 ))) goto failed;
+    strcpy( cache->path, path );
+    if (!(cache->names = RtlAllocateHeap( GetProcessHeap(), 0, size * sizeof(*cache->names) ))) goto failed;
+    if (!(cache->wnames = RtlAllocateHeap( GetProcessHeap(), 0, wsize * sizeof(WCHAR) ))) goto failed;
+    if (!(cache->unames = RtlAllocateHeap( GetProcessHeap(), 0, usize ))) goto failed;
+
+    if (!(dir = opendir( path ))) goto failed;
+    while ((de = readdir( dir )))
+    {
+        len = ntdll_umbstowcs( de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
+        if (len <= 0) continue;
+        if (!add_dir_cache_name( cache, &size, &wsize, &usize, &wpos, &upos, buffer, len, de->d_name ))
+            goto failed;
+    }
+    closedir( dir );
+    dir = NULL;
+
+    /* build the index, keeping the first of the names that only differ by case */
+    for (size = 16; size < 2 * cache->count; size *= 2) ;
+    if (!(cache->index = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, size * sizeof(*cache->index) )))
+        goto failed;
+    cache->index_mask = size - 1;
+    for (i = 0; i < cache->count; i++)
+    {
+        struct dir_cache_name *entry = &cache->names[i];
+        unsigned int pos = entry->hash & cache->index_mask;
+
+        if (find_dir_cache_name( cache, cache->wnames + entry->name, entry->len, entry->hash )) continue;
+        while (cache->index[pos]) pos = (pos + 1) & cache->index_mask;
+        cache->index[pos] = i + 1;
+    }
+
+    TRACE( "cached %u names for %s\n", cache->count, debugstr_a(path) );
+    list_add_head( &dir_cache_list, &cache->entry );
+    return cache;
+
+failed:
+    if (dir) closedir( dir );
+    free_dir_cache( cache );
+    return NULL;
+}
+
+/***********************************************************************
+ *           lookup_dir_cache
+ *
+ * Look for a name in the cached contents of a directory.
+ * unix_name contains the directory path, the file found is appended at pos.
+ * Returns STATUS_OBJECT_NAME_NOT_FOUND if the directory is cached but doesn't contain
+ * the name, and STATUS_NOT_SUPPORTED if the directory has to be scanned.
+ */
+static NTSTATUS lookup_dir_cache( char *unix_name, int pos, const WCHAR *name, int length )
+{
+    WCHAR upname[MAX_DIR_ENTRY_LEN];
+    struct dir_cache *cache, *found = NULL;
+    struct dir_cache_name *entry;
+    struct timespec mtime, ctime;
+    struct stat st;
+    NTSTATUS status = STATUS_NOT_SUPPORTED;
+    time_t now;
+    int i;
+
+    if (length > MAX_DIR_ENTRY_LEN) return STATUS_NOT_SUPPORTED;
+    if (stat( unix_name, &st ) == -1 || !S_ISDIR( st.st_mode )) return STATUS_NOT_SUPPORTED;
+    get_dir_cache_times( &st, &mtime, &ctime );
+    now = time( NULL );
+
+    RtlEnterCriticalSection( &dir_cache_section );
+
+    LIST_FOR_EACH_ENTRY( cache, &dir_cache_list, struct dir_cache, entry )
+    {
+        if (strcmp( cache->path, unix_name )) continue;
+        /* the path may now refer to a different directory, or the directory may have changed */
+        if (cache->dev != st.st_dev || cache->ino != st.st_ino ||
+            cache->mtime.tv_sec != mtime.tv_sec || cache->mtime.tv_nsec != mtime.tv_nsec ||
+            cache->ctime.tv_sec != ctime.tv_sec || cache->ctime.tv_nsec != ctime.tv_nsec)
+        {
+            TRACE( "dropping %s\n", debugstr_a(cache->path) );
+            free_dir_cache( cache );
+            break;
+        }
+        found = cache;
+        list_remove( &found->entry );
+        list_add_head( &dir_cache_list, &found->entry );
+        break;
+    }
+    if (!found)
+    {
+        /* a recent change may be followed by another one with the same time stamps */
+        if (now - mtime.tv_sec < DIR_CACHE_MIN_AGE || now - ctime.tv_sec < DIR_CACHE_MIN_AGE) goto done;
+        if (dir_cache_count >= DIR_CACHE_MAX_DIRS)
+            free_dir_cache( LIST_ENTRY( list_tail( &dir_cache_list ), struct dir_cache, entry ) );
+        if (!(found = create_dir_cache( unix_name, &st ))) goto done;
+    }
+
+    for (i = 0; i < length; i++) upname[i] = RtlUpcaseUnicodeChar( name[i] );
+    if ((entry = find_dir_cache_name( found, upname, length, hash_dir_cache_name( upname, length ))))
+    {
+        unix_name[pos - 1] = '/';
+        strcpy( unix_name + pos, found->unames + entry->unix_name );
+        status = STATUS_SUCCESS;
+    }
+    else status = STATUS_OBJECT_NAME_NOT_FOUND;
+
+done:
+    RtlLeaveCriticalSection( &dir_cache_section );
+    return status;
+}
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2002,6 +2272,7 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     WCHAR buffer[MAX_DIR_ENTRY_LEN];
     UNICODE_STRING str;
     BOOLEAN spaces, is_name_8_dot_3;
+    NTSTATUS status;
     DIR *dir;
     struct dirent *de;
     struct stat st;
@@ -2037,6 +2308,11 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
 
     if (!is_name_8_dot_3 && !get_dir_case_sensitivity( unix_name )) goto not_found;
 
+    status = lookup_dir_cache( unix_name, pos, name, length );
+    if (!status) goto success;
+    /* short names are not cached */
+    if (status == STATUS_OBJECT_NAME_NOT_FOUND && !is_name_8_dot_3) goto not_found;
+
     /* now look for it through the directory */
 
 #ifdef VFAT_IOCTL_READDIR_BOTH
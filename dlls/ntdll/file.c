@@ -42,6 +42,12 @@
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+# include <linux/io_uring.h>
+#endif
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
 #endif
@@ -101,6 +107,7 @@
 #define NONAMELESSUNION
 #include "wine/debug.h"
 #include "wine/server.h"
+#include "wine/list.h"
 #include "ntdll_misc.h"
 
 #include "winternl.h"
@@ -728,6 +735,7 @@ static NTSTATUS get_io_timeouts( HANDLE handle, enum server_fd_type type, ULONG
         }
         break;
     case FD_TYPE_SOCKET:
+    case FD_TYPE_PIPE:
     case FD_TYPE_CHAR:
         if (is_read) timeouts->interval = 0;  /* return as soon as we got something */
         break;
@@ -780,6 +788,7 @@ static NTSTATUS get_io_avail_mode( HANDLE handle, enum server_fd_type type, BOOL
         break;
     case FD_TYPE_MAILSLOT:
     case FD_TYPE_SOCKET:
+    case FD_TYPE_PIPE:
     case FD_TYPE_CHAR:
         *avail_mode = TRUE;
         break;
@@ -821,6 +830,460 @@ static NTSTATUS register_async_file_read( HANDLE handle, HANDLE event,
 }
 
 
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) && defined(IORING_FEAT_NODROP)
+
+/* Overlapped I/O on regular files is submitted to an io_uring instance, and a dedicated
+ * thread reaps the completions and signals the event and the completion port. This
+ * lets the kernel process many concurrent requests instead of running each of them
+ * synchronously in the calling thread. Requests with an APC routine or without an
+ * event still use the synchronous path, and so does everything else while the
+ * completion thread isn't running yet, since it may be waiting for the loader lock
+ * held by the caller. */
+
+#define URING_ENTRIES 256
+#define URING_CANCEL  1  /* user data of the cancel requests */
+
+enum uring_thread_state
+{
+    URING_THREAD_NONE,
+    URING_THREAD_STARTING,
+    URING_THREAD_RUNNING
+};
+
+struct uring_io
+{
+    struct list      entry;    /* entry in uring_ios */
+    HANDLE           handle;   /* file handle the request was issued on, for cancellation */
+    DWORD            thread;   /* thread that issued the request */
+    IO_STATUS_BLOCK *iosb;
+    HANDLE           event;    /* duplicated event handle */
+    HANDLE           file;     /* duplicated file handle for the completion port */
+    ULONG_PTR        cvalue;
+    int              unix_fd;  /* duplicated unix fd, kept open until completion */
+    BOOL             write;
+    BOOL             cancelled; /* a cancel was requested */
+    ULONGLONG        offset;
+    struct iovec     iov;
+};
+
+static struct
+{
+    int                  fd;
+    unsigned int        *sq_head;
+    unsigned int        *sq_tail;
+    unsigned int        *sq_mask;
+    unsigned int        *sq_array;
+    unsigned int        *cq_head;
+    unsigned int        *cq_tail;
+    unsigned int        *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned int         cq_entries;
+    LONG                 pending;       /* submitted requests not reaped yet */
+    enum uring_thread_state thread_state;
+} uring = { -1 };
+
+static struct list uring_ios = LIST_INIT( uring_ios );
+
+static RTL_RUN_ONCE uring_once = RTL_RUN_ONCE_INIT;
+
+static RTL_CRITICAL_SECTION uring_section;
+static RTL_CRITICAL_SECTION_DEBUG uring_critsect_debug =
+{
+    0, 0, &uring_section,
+    { &uring_critsect_debug.ProcessLocksList, &uring_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": uring_section") }
+};
+static RTL_CRITICAL_SECTION uring_section = { &uring_critsect_debug, -1, 0, 0, 0, 0 };
+
+static inline int uring_enter( unsigned int to_submit, unsigned int min_complete, unsigned int flags )
+{
+    return syscall( __NR_io_uring_enter, uring.fd, to_submit, min_complete, flags, NULL, 0 );
+}
+
+/* store the final status of a request and notify the waiters */
+static void uring_complete( struct uring_io *io, int res )
+{
+    NTSTATUS status;
+    ULONG total = 0;
+    BOOL cancelled;
+
+    RtlEnterCriticalSection( &uring_section );
+    list_remove( &io->entry );
+    cancelled = io->cancelled;
+    RtlLeaveCriticalSection( &uring_section );
+
+    /* the kernel doesn't cancel reads that are already in progress, but their data
+     * can still be dropped; writes have been done and must be reported as such */
+    if (cancelled && !io->write && res >= 0) res = -ECANCELED;
+
+    /* the kernel can't handle write watches, retry through the locked path */
+    if (res == -EFAULT && !io->write)
+    {
+        while ((res = virtual_locked_pread( io->unix_fd, io->iov.iov_base, io->iov.iov_len, io->offset )) == -1)
+        {
+            if (errno != EINTR) break;
+        }
+        if (res == -1) res = -errno;
+    }
+
+    if (res >= 0)
+    {
+        total = res;
+        status = (total || !io->iov.iov_len || io->write) ? STATUS_SUCCESS : STATUS_END_OF_FILE;
+    }
+    else if (res == -ECANCELED) status = STATUS_CANCELLED;
+    else
+    {
+        errno = -res;
+        status = FILE_GetNtStatus();
+    }
+    TRACE( "io %p iosb %p status %08x total %u\n", io, io->iosb, status, total );
+
+    io->iosb->Information = total;
+    io->iosb->u.Status = status;
+    NtSetEvent( io->event, NULL );
+    NtClose( io->event );
+    if (io->cvalue)
+    {
+        NTDLL_AddCompletion( io->file, io->cvalue, status, total, TRUE );
+        NtClose( io->file );
+    }
+    close( io->unix_fd );
+    RtlFreeHeap( GetProcessHeap(), 0, io );
+}
+
+/* fill the next submission queue entry, uring_section must be held */
+static struct io_uring_sqe *uring_get_sqe( unsigned int *tail )
+{
+    unsigned int index;
+
+    *tail = *uring.sq_tail;
+    index = *tail & *uring.sq_mask;
+    uring.sq_array[index] = index;
+    memset( &uring.sqes[index], 0, sizeof(uring.sqes[index]) );
+    return &uring.sqes[index];
+}
+
+/* submit the entry filled by uring_get_sqe, uring_section must be held */
+static BOOL uring_submit_sqe( unsigned int tail )
+{
+    int ret;
+
+    __atomic_store_n( uring.sq_tail, tail + 1, __ATOMIC_RELEASE );
+    while ((ret = uring_enter( 1, 0, 0 )) == -1 && errno == EINTR);
+    if (ret != 1 && __atomic_load_n( uring.sq_head, __ATOMIC_ACQUIRE ) == tail)
+    {
+        /* the entry hasn't been consumed, take it back */
+        __atomic_store_n( uring.sq_tail, tail, __ATOMIC_RELEASE );
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void CALLBACK uring_completion_proc( void *arg )
+{
+    static const struct __kernel_timespec idle_timeout = { 5, 0 };
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    struct uring_io *io;
+    unsigned int head, tail;
+    BOOL armed = FALSE, expired = FALSE;
+    int res;
+
+    RtlEnterCriticalSection( &uring_section );
+    uring.thread_state = URING_THREAD_RUNNING;
+    RtlLeaveCriticalSection( &uring_section );
+
+    for (;;)
+    {
+        head = *uring.cq_head;
+        tail = __atomic_load_n( uring.cq_tail, __ATOMIC_ACQUIRE );
+        for ( ; head != tail; head++)
+        {
+            cqe = &uring.cqes[head & *uring.cq_mask];
+            io = (struct uring_io *)(ULONG_PTR)cqe->user_data;
+            res = cqe->res;
+            __atomic_store_n( uring.cq_head, head + 1, __ATOMIC_RELEASE );
+            if (!io)  /* idle timeout */
+            {
+                armed = FALSE;
+                expired = TRUE;
+                continue;
+            }
+            InterlockedDecrement( &uring.pending );
+            if (io != (struct uring_io *)URING_CANCEL) uring_complete( io, res );
+        }
+
+        /* exit after some idle time, so that we don't keep the process alive,
+         * or right away if the idle timeout can't be queued */
+        if (!uring.pending && (expired || !armed))
+        {
+            RtlEnterCriticalSection( &uring_section );
+            if (!uring.pending)
+            {
+                if (!expired)
+                {
+                    sqe = uring_get_sqe( &tail );
+                    sqe->opcode = IORING_OP_TIMEOUT;
+                    sqe->addr   = (ULONG_PTR)&idle_timeout;
+                    sqe->len    = 1;
+                    armed = uring_submit_sqe( tail );
+                }
+                if (expired || !armed)
+                {
+                    uring.thread_state = URING_THREAD_NONE;
+                    RtlLeaveCriticalSection( &uring_section );
+                    break;
+                }
+            }
+            RtlLeaveCriticalSection( &uring_section );
+        }
+        expired = FALSE;
+
+        uring_enter( 0, 1, IORING_ENTER_GETEVENTS );
+    }
+
+    TRACE( "exiting\n" );
+    RtlExitUserThread( 0 );
+}
+
+static DWORD WINAPI uring_init( RTL_RUN_ONCE *once, void *param, void **context )
+{
+    struct io_uring_params params;
+    size_t sq_size, cq_size;
+    char *sq_ptr, *cq_ptr = MAP_FAILED;
+    void *sqes = MAP_FAILED;
+    int fd;
+
+    memset( &params, 0, sizeof(params) );
+    if ((fd = syscall( __NR_io_uring_setup, URING_ENTRIES, &params )) == -1)
+    {
+        TRACE( "io_uring not available: %s\n", strerror(errno) );
+        return TRUE;
+    }
+    /* older kernels can't cancel requests */
+    if (!(params.features & IORING_FEAT_NODROP))
+    {
+        TRACE( "io_uring is too old, features %#x\n", params.features );
+        close( fd );
+        return TRUE;
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) sq_size = cq_size = max( sq_size, cq_size );
+
+    sq_ptr = mmap( NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+    if (sq_ptr == MAP_FAILED) goto failed;
+    if (params.features & IORING_FEAT_SINGLE_MMAP) cq_ptr = sq_ptr;
+    else cq_ptr = mmap( NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+    if (cq_ptr == MAP_FAILED) goto failed;
+    sqes = mmap( NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+    if (sqes == MAP_FAILED) goto failed;
+
+    uring.sq_head    = (unsigned int *)(sq_ptr + params.sq_off.head);
+    uring.sq_tail    = (unsigned int *)(sq_ptr + params.sq_off.tail);
+    uring.sq_mask    = (unsigned int *)(sq_ptr + params.sq_off.ring_mask);
+    uring.sq_array   = (unsigned int *)(sq_ptr + params.sq_off.array);
+    uring.cq_head    = (unsigned int *)(cq_ptr + params.cq_off.head);
+    uring.cq_tail    = (unsigned int *)(cq_ptr + params.cq_off.tail);
+    uring.cq_mask    = (unsigned int *)(cq_ptr + params.cq_off.ring_mask);
+    uring.cqes       = (struct io_uring_cqe *)(cq_ptr + params.cq_off.cqes);
+    uring.sqes       = sqes;
+    uring.cq_entries = params.cq_entries;
+    uring.fd         = fd;
+    TRACE( "using io_uring with %u entries\n", params.sq_entries );
+    return TRUE;
+
+failed:
+    WARN( "failed to map io_uring, using synchronous I/O\n" );
+    if (sqes != MAP_FAILED) munmap( sqes, params.sq_entries * sizeof(struct io_uring_sqe) );
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap( cq_ptr, cq_size );
+    if (sq_ptr != MAP_FAILED) munmap( sq_ptr, sq_size );
+    close( fd );
+    return TRUE;
+}
+
+/* transfer data without blocking, fails with EAGAIN if the request would block */
+static int uring_transfer_nowait( int fd, void *buffer, ULONG length, ULONGLONG offset, BOOL write )
+{
+#if defined(__NR_preadv2) && defined(__NR_pwritev2) && defined(RWF_NOWAIT)
+    struct iovec iov;
+    int ret;
+
+    iov.iov_base = buffer;
+    iov.iov_len  = length;
+    while ((ret = syscall( write ? __NR_pwritev2 : __NR_preadv2, fd, &iov, 1,
+                           (unsigned long)offset, (unsigned long)(offset >> 32), RWF_NOWAIT )) == -1 &&
+           errno == EINTR);
+    return ret;
+#else
+    errno = EOPNOTSUPP;
+    return -1;
+#endif
+}
+
+/* queue an overlapped read or write on a regular file; helper for NtReadFile and NtWriteFile */
+/* returns STATUS_SUCCESS with the transferred size in result if the request could be
+ * completed without blocking, and STATUS_NOT_SUPPORTED if the caller should fall back
+ * to synchronous I/O */
+static NTSTATUS uring_submit( HANDLE handle, int unix_fd, HANDLE event, IO_STATUS_BLOCK *iosb,
+                              ULONG_PTR cvalue, void *buffer, ULONG length, ULONGLONG offset,
+                              BOOL write, int *result )
+{
+    struct io_uring_sqe *sqe;
+    struct uring_io *io;
+    unsigned int tail;
+    HANDLE thread;
+    int ret;
+
+    RtlRunOnceExecuteOnce( &uring_once, uring_init, NULL, NULL );
+    if (uring.fd == -1) return STATUS_NOT_SUPPORTED;
+
+    /* errors are only reported on completion, so only requests that would block are
+     * queued; anything else is left to the synchronous path, which repeats the whole
+     * transfer if it was short */
+    if ((ret = uring_transfer_nowait( unix_fd, buffer, length, offset, write )) == length)
+    {
+        *result = ret;
+        return STATUS_SUCCESS;
+    }
+    if (ret != -1 || errno != EAGAIN) return STATUS_NOT_SUPPORTED;
+
+    /* don't let the completion queue overflow, keeping room for the idle timeout */
+    if (uring.pending >= uring.cq_entries - 1) return STATUS_NOT_SUPPORTED;
+
+    if (uring.thread_state != URING_THREAD_RUNNING)
+    {
+        /* start the thread, but don't wait for it */
+        RtlEnterCriticalSection( &uring_section );
+        if (uring.thread_state == URING_THREAD_NONE &&
+            !RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                  uring_completion_proc, NULL, &thread, NULL ))
+        {
+            NtClose( thread );
+            uring.thread_state = URING_THREAD_STARTING;
+        }
+        RtlLeaveCriticalSection( &uring_section );
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (!(io = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*io) ))) return STATUS_NOT_SUPPORTED;
+    io->handle       = handle;
+    io->thread       = GetCurrentThreadId();
+    io->iosb         = iosb;
+    io->event        = 0;
+    io->file         = 0;
+    io->cvalue       = cvalue;
+    io->write        = write;
+    io->cancelled    = FALSE;
+    io->offset       = offset;
+    io->iov.iov_base = buffer;
+    io->iov.iov_len  = length;
+    if ((io->unix_fd = dup( unix_fd )) == -1)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, io );
+        return STATUS_NOT_SUPPORTED;
+    }
+    /* the caller may close the event and the file handle before the request completes */
+    if (NtDuplicateObject( NtCurrentProcess(), event, NtCurrentProcess(), &io->event,
+                           0, 0, DUPLICATE_SAME_ACCESS ))
+        goto failed;
+    if (cvalue && NtDuplicateObject( NtCurrentProcess(), handle, NtCurrentProcess(), &io->file,
+                                     0, 0, DUPLICATE_SAME_ACCESS ))
+        goto failed;
+
+    NtResetEvent( event, NULL );
+    iosb->u.Status = STATUS_PENDING;
+    iosb->Information = 0;
+
+    RtlEnterCriticalSection( &uring_section );
+    /* the thread may have exited in the meantime */
+    if (uring.thread_state != URING_THREAD_RUNNING)
+    {
+        RtlLeaveCriticalSection( &uring_section );
+        goto failed;
+    }
+    sqe = uring_get_sqe( &tail );
+    sqe->opcode    = write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd        = io->unix_fd;
+    sqe->off       = offset;
+    sqe->addr      = (ULONG_PTR)&io->iov;
+    sqe->len       = 1;
+    sqe->user_data = (ULONG_PTR)io;
+    if (!uring_submit_sqe( tail ))
+    {
+        RtlLeaveCriticalSection( &uring_section );
+        goto failed;
+    }
+    InterlockedIncrement( &uring.pending );
+    list_add_tail( &uring_ios, &io->entry );
+    RtlLeaveCriticalSection( &uring_section );
+
+    TRACE( "queued %s io %p for %p offset %s length %u\n", write ? "write" : "read",
+           io, handle, wine_dbgstr_longlong( offset ), length );
+    return STATUS_PENDING;
+
+failed:
+    if (io->event) NtClose( io->event );
+    if (io->file) NtClose( io->file );
+    close( io->unix_fd );
+    RtlFreeHeap( GetProcessHeap(), 0, io );
+    return STATUS_NOT_SUPPORTED;
+}
+
+/* cancel the queued requests issued on a handle; helper for NtCancelIoFile(Ex) */
+/* returns TRUE if any request is being cancelled */
+static BOOL uring_cancel( HANDLE handle, IO_STATUS_BLOCK *iosb, BOOL only_thread )
+{
+    struct io_uring_sqe *sqe;
+    struct uring_io *io;
+    unsigned int tail;
+    BOOL ret = FALSE;
+
+    if (uring.fd == -1) return FALSE;
+
+    RtlEnterCriticalSection( &uring_section );
+    LIST_FOR_EACH_ENTRY( io, &uring_ios, struct uring_io, entry )
+    {
+        if (io->handle != handle) continue;
+        if (iosb && io->iosb != iosb) continue;
+        if (only_thread && io->thread != GetCurrentThreadId()) continue;
+        ret = TRUE;
+        if (io->cancelled) continue;
+        io->cancelled = TRUE;
+        if (uring.pending >= uring.cq_entries - 1) continue;
+        sqe = uring_get_sqe( &tail );
+        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe->addr      = (ULONG_PTR)io;
+        sqe->user_data = URING_CANCEL;
+        if (!uring_submit_sqe( tail )) continue;
+        InterlockedIncrement( &uring.pending );
+        TRACE( "cancelling io %p\n", io );
+    }
+    RtlLeaveCriticalSection( &uring_section );
+    return ret;
+}
+
+#else  /* HAVE_LINUX_IO_URING_H */
+
+static NTSTATUS uring_submit( HANDLE handle, int unix_fd, HANDLE event, IO_STATUS_BLOCK *iosb,
+                              ULONG_PTR cvalue, void *buffer, ULONG length, ULONGLONG offset,
+                              BOOL write, int *result )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+static BOOL uring_cancel( HANDLE handle, IO_STATUS_BLOCK *iosb, BOOL only_thread )
+{
+    return FALSE;
+}
+
+#endif  /* HAVE_LINUX_IO_URING_H */
+
+
 /******************************************************************************
  *  NtReadFile					[NTDLL.@]
  *  ZwReadFile					[NTDLL.@]
@@ -883,8 +1346,19 @@ NTSTATUS WINAPI NtReadFile(HANDLE hFile, HANDLE hEvent,
 
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
         {
+            /* without an event the caller may wait on the file handle, which needs a server async */
+            result = -1;
+            if (async_read && length && hEvent && !apc &&
+                uring_submit( hFile, unix_handle, hEvent, io_status, cvalue, buffer, length,
+                              offset->QuadPart, FALSE, &result ) == STATUS_PENDING)
+            {
+                if (needs_close) close( unix_handle );
+                return STATUS_PENDING;
+            }
+
             /* async I/O doesn't make sense on regular files */
-            while ((result = virtual_locked_pread( unix_handle, buffer, length, offset->QuadPart )) == -1)
+            while (result == -1 &&
+                   (result = virtual_locked_pread( unix_handle, buffer, length, offset->QuadPart )) == -1)
             {
                 if (errno != EINTR)
                 {
@@ -950,6 +1424,15 @@ NTSTATUS WINAPI NtReadFile(HANDLE hFile, HANDLE hEvent,
                         goto done;
                     }
                     break;
+                case FD_TYPE_PIPE:
+                    if (!length)
+                    {
+                        status = STATUS_SUCCESS;
+                        goto done;
+                    }
+                    /* the server knows why the pipe connection was shut down */
+                    if (needs_close) close( unix_handle );
+                    return server_read_file( hFile, hEvent, apc, apc_user, io_status, buffer, 0, offset, key );
                 default:
                     status = STATUS_PIPE_BROKEN;
                     goto err;
@@ -979,6 +1462,12 @@ NTSTATUS WINAPI NtReadFile(HANDLE hFile, HANDLE hEvent,
                                                buffer, total, length, avail_mode );
             goto err;
         }
+        else if (type == FD_TYPE_PIPE)
+        {
+            /* pipe sockets are blocking unless the pipe is in non-blocking mode */
+            status = total ? STATUS_SUCCESS : STATUS_PIPE_EMPTY;
+            goto done;
+        }
         else  /* synchronous read, wait for the fd to become ready */
         {
             struct pollfd pfd;
@@ -1288,8 +1777,17 @@ NTSTATUS WINAPI NtWriteFile(HANDLE hFile, HANDLE hEvent,
                 goto done;
             }
 
+            result = -1;
+            if (async_write && length && hEvent && !apc && offset->QuadPart != FILE_WRITE_TO_END_OF_FILE &&
+                uring_submit( hFile, unix_handle, hEvent, io_status, cvalue, (void *)buffer, length,
+                              off, TRUE, &result ) == STATUS_PENDING)
+            {
+                if (needs_close) close( unix_handle );
+                return STATUS_PENDING;
+            }
+
             /* async I/O doesn't make sense on regular files */
-            while ((result = pwrite( unix_handle, buffer, length, off )) == -1)
+            while (result == -1 && (result = pwrite( unix_handle, buffer, length, off )) == -1)
             {
                 if (errno != EINTR)
                 {
@@ -1339,6 +1837,12 @@ NTSTATUS WINAPI NtWriteFile(HANDLE hFile, HANDLE hEvent,
         else if (errno != EAGAIN)
         {
             if (errno == EINTR) continue;
+            if (!total && errno == EPIPE && type == FD_TYPE_PIPE)
+            {
+                /* the server knows why the pipe connection was shut down */
+                if (needs_close) close( unix_handle );
+                return server_write_file( hFile, hEvent, apc, apc_user, io_status, buffer, 0, offset, key );
+            }
             if (!total)
             {
                 if (errno == EFAULT) status = STATUS_INVALID_USER_BUFFER;
@@ -1373,6 +1877,13 @@ NTSTATUS WINAPI NtWriteFile(HANDLE hFile, HANDLE hEvent,
             if (status != STATUS_PENDING) RtlFreeHeap( GetProcessHeap(), 0, fileio );
             goto err;
         }
+        else if (type == FD_TYPE_PIPE)
+        {
+            /* pipe sockets are blocking unless the pipe is in non-blocking mode,
+             * in which case we return with what fits in the buffer */
+            status = STATUS_SUCCESS;
+            goto done;
+        }
         else  /* synchronous write, wait for the fd to become ready */
         {
             struct pollfd pfd;
@@ -3799,8 +4310,12 @@ NTSTATUS WINAPI NtDeleteFile( POBJECT_ATTRIBUTES ObjectAttributes )
  */
 NTSTATUS WINAPI NtCancelIoFileEx( HANDLE hFile, PIO_STATUS_BLOCK iosb, PIO_STATUS_BLOCK io_status )
 {
+    BOOL cancelled;
+
     TRACE("%p %p %p\n", hFile, iosb, io_status );
 
+    cancelled = uring_cancel( hFile, iosb, FALSE );
+
     SERVER_START_REQ( cancel_async )
     {
         req->handle      = wine_server_obj_handle( hFile );
@@ -3810,6 +4325,7 @@ NTSTATUS WINAPI NtCancelIoFileEx( HANDLE hFile, PIO_STATUS_BLOCK iosb, PIO_STATU
     }
     SERVER_END_REQ;
 
+    if (cancelled && io_status->u.Status == STATUS_NOT_FOUND) io_status->u.Status = STATUS_SUCCESS;
     return io_status->u.Status;
 }
 
@@ -3820,8 +4336,12 @@ NTSTATUS WINAPI NtCancelIoFileEx( HANDLE hFile, PIO_STATUS_BLOCK iosb, PIO_STATU
  */
 NTSTATUS WINAPI NtCancelIoFile( HANDLE hFile, PIO_STATUS_BLOCK io_status )
 {
+    BOOL cancelled;
+
     TRACE("%p %p\n", hFile, io_status );
 
+    cancelled = uring_cancel( hFile, NULL, TRUE );
+
     SERVER_START_REQ( cancel_async )
     {
         req->handle      = wine_server_obj_handle( hFile );
@@ -3831,6 +4351,7 @@ NTSTATUS WINAPI NtCancelIoFile( HANDLE hFile, PIO_STATUS_BLOCK io_status )
     }
     SERVER_END_REQ;
 
+    if (cancelled && io_status->u.Status == STATUS_NOT_FOUND) io_status->u.Status = STATUS_SUCCESS;
     return io_status->u.Status;
 }
 
@@ -83,6 +83,7 @@ typedef struct
 /* Value for arena 'magic' field */
 #define ARENA_INUSE_MAGIC      0x455355
 #define ARENA_PENDING_MAGIC    0xbedead
+#define ARENA_CACHED_MAGIC     0xcac4ed
 #define ARENA_FREE_MAGIC       0x45455246
 #define ARENA_LARGE_MAGIC      0x6752614c
 
@@ -148,6 +149,34 @@ typedef struct tagSUBHEAP
 
 #define SUBHEAP_MAGIC    ((DWORD)('S' | ('U'<<8) | ('B'<<16) | ('H'<<24)))
 
+/* Wine specific: allocation statistics returned by RtlQueryHeapInformation */
+#define HeapWineStatistics ((HEAP_INFORMATION_CLASS)0x1000)
+
+#define HEAP_WINE_SIZE_CLASSES 32
+
+typedef struct _HEAP_WINE_STATISTICS
+{
+    ULONGLONG AllocationCount;
+    ULONGLONG FreeCount;
+    SIZE_T    BytesInUse;         /* bytes requested by the live allocations */
+    SIZE_T    PeakBytesInUse;
+    SIZE_T    CommittedSize;
+    SIZE_T    FreeSize;           /* bytes in the free lists */
+    SIZE_T    CachedSize;         /* bytes in the low-fragmentation heap thread caches */
+    ULONG     LockContentionCount;
+    ULONG     SizeClasses[HEAP_WINE_SIZE_CLASSES];  /* allocations of up to 16 << n bytes */
+    ULONG     FreeListCount;
+    ULONG     FreeListLengths[ANYSIZE_ARRAY];
+} HEAP_WINE_STATISTICS;
+
+struct heap_stats
+{
+    ULONGLONG        allocs;        /* number of allocations */
+    ULONGLONG        frees;         /* number of frees */
+    LONG_PTR         size;          /* user bytes in use, only a delta in thread caches */
+    ULONG            sizes[HEAP_WINE_SIZE_CLASSES]; /* allocations by size class */
+};
+
 typedef struct tagHEAP
 {
     DWORD_PTR        unknown1[2];
@@ -164,6 +193,12 @@ typedef struct tagHEAP
     ARENA_INUSE    **pending_free;  /* Ring buffer for pending free requests */
     RTL_CRITICAL_SECTION critSection; /* Critical section for serialization */
     FREE_LIST_ENTRY *freeList;      /* Free lists */
+    DWORD            compat_info;   /* HeapCompatibilityInformation value */
+    struct list      thread_caches; /* Per-thread block caches of the low-fragmentation heap */
+    LONG             subheap_generation; /* Incremented when sub-heap memory is released */
+    struct heap_stats stats;        /* Allocation statistics */
+    SIZE_T           peak_size;     /* Peak user bytes in use */
+    ULONG            contentions;   /* Number of times the lock was already held */
 } HEAP;
 
 #define HEAP_MAGIC       ((DWORD)('H' | ('E'<<8) | ('A'<<16) | ('P'<<24)))
@@ -172,6 +207,35 @@ typedef struct tagHEAP
 #define COMMIT_MASK          0xffff  /* bitmask for commit/decommit granularity */
 #define MAX_FREE_PENDING     1024    /* max number of free requests to delay */
 
+#define HEAP_LFH             2       /* HeapCompatibilityInformation value of the low-fragmentation heap */
+
+/* low-fragmentation heap: small blocks are recycled through per-thread caches */
+#define HEAP_CACHE_MAX_SIZE   0x400    /* largest block data size kept in a cache */
+#define HEAP_CACHE_NB_CLASSES ((HEAP_CACHE_MAX_SIZE - HEAP_MIN_DATA_SIZE) / ALIGNMENT + 1)
+#define HEAP_CACHE_DEPTH      16       /* max number of cached blocks per size class */
+#define HEAP_CACHE_REFILL     8        /* number of blocks carved at once on a cache miss */
+#define HEAP_CACHE_MAX_BYTES  0x10000  /* max total size of the blocks in a cache */
+#define HEAP_CACHE_RANGES     8        /* number of sub-heap ranges known to a cache */
+
+struct heap_thread_cache
+{
+    struct heap_thread_cache *next;  /* next cache of the same thread */
+    struct tagHEAP *heap;            /* heap the blocks belong to, NULL once it is destroyed */
+    struct list     entry;           /* entry in the heap list of thread caches */
+    SIZE_T          total;           /* total data size of the cached blocks */
+    ARENA_INUSE    *blocks[HEAP_CACHE_NB_CLASSES];  /* lists linked through the block data */
+    BYTE            count[HEAP_CACHE_NB_CLASSES];
+    struct heap_stats stats;         /* statistics not yet added to the heap ones */
+    BOOL            abandoned;       /* owner thread was terminated */
+    LONG            generation;      /* heap sub-heap generation the ranges are valid for */
+    unsigned int    nb_ranges;
+    struct
+    {
+        const char *start;           /* first block of the sub-heap */
+        const char *end;             /* end of its committed area */
+    } ranges[HEAP_CACHE_RANGES];     /* sub-heaps the cached blocks are known to come from */
+};
+
 /* some undocumented flags (names are made up) */
 #define HEAP_PAGE_ALLOCS      0x01000000
 #define HEAP_VALIDATE         0x10000000
@@ -179,6 +243,7 @@ typedef struct tagHEAP
 #define HEAP_VALIDATE_PARAMS  0x40000000
 
 static HEAP *processHeap;  /* main process heap */
+static BOOL heap_stats_dump;  /* print the heap statistics on exit */
 
 static BOOL HEAP_IsRealArena( HEAP *heapPtr, DWORD flags, LPCVOID block, BOOL quiet );
 
@@ -295,7 +360,8 @@ static void subheap_notify_free_all(SUBHEAP const *subheap)
         else
         {
             ARENA_INUSE const *pArena = (ARENA_INUSE const *)ptr;
-            if (pArena->magic == ARENA_INUSE_MAGIC) notify_free(pArena + 1);
+            if (pArena->magic == ARENA_INUSE_MAGIC || pArena->magic == ARENA_CACHED_MAGIC)
+                notify_free(pArena + 1);
             else if (pArena->magic != ARENA_PENDING_MAGIC) ERR("bad inuse_magic @%p\n", pArena);
             ptr += sizeof(*pArena) + (pArena->size & ARENA_SIZE_MASK);
         }
@@ -558,6 +624,7 @@ static inline BOOL HEAP_Decommit( SUBHEAP *subheap, void *ptr )
     if (size >= subheap->commitSize) return TRUE;
     decommit_size = subheap->commitSize - size;
     addr = (char *)subheap->base + size;
+    InterlockedIncrement( &subheap->heap->subheap_generation );
 
     if (NtFreeVirtualMemory( NtCurrentProcess(), &addr, &decommit_size, MEM_DECOMMIT ))
     {
@@ -682,6 +749,7 @@ static void HEAP_MakeInUseBlockFree( SUBHEAP *subheap, ARENA_INUSE *pArena )
         list_remove( &subheap->entry );
         /* Free the memory */
         subheap->magic = 0;
+        InterlockedIncrement( &subheap->heap->subheap_generation );
         NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
         return;
     }
@@ -927,6 +995,7 @@ static SUBHEAP *HEAP_CreateSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         heap->grow_size     = max( HEAP_DEF_SIZE, totalSize );
         list_init( &heap->subheap_list );
         list_init( &heap->large_list );
+        list_init( &heap->thread_caches );
 
         subheap = &heap->subheap;
         subheap->base       = address;
@@ -1214,7 +1283,8 @@ static BOOL HEAP_ValidateInUseArena( const SUBHEAP *subheap, const ARENA_INUSE *
     }
 
     /* Check magic number */
-    if (pArena->magic != ARENA_INUSE_MAGIC && pArena->magic != ARENA_PENDING_MAGIC)
+    if (pArena->magic != ARENA_INUSE_MAGIC && pArena->magic != ARENA_PENDING_MAGIC &&
+        pArena->magic != ARENA_CACHED_MAGIC)
     {
         if (quiet == NOISY) {
             ERR("Heap %p: invalid in-use arena magic %08x for %p\n", subheap->heap, pArena->magic, pArena );
@@ -1357,6 +1427,10 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
             }
             else ret = validate_large_arena( heapPtr, large_arena, quiet );
         }
+        else if (arena->magic == ARENA_CACHED_MAGIC)  /* freed to a thread cache */
+        {
+            if (WARN_ON(heap)) WARN( "Heap %p: block %p was freed\n", heapPtr, block );
+        }
         else ret = HEAP_ValidateInUseArena( subheap, arena, quiet );
         goto done;
     }
@@ -1420,7 +1494,7 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
         ret = HEAP_ValidateInUseArena( subheap, arena, QUIET );
     else if ((ULONG_PTR)arena % ALIGNMENT != ARENA_OFFSET)
         WARN( "Heap %p: unaligned arena pointer %p\n", subheap->heap, arena );
-    else if (arena->magic == ARENA_PENDING_MAGIC)
+    else if (arena->magic == ARENA_PENDING_MAGIC || arena->magic == ARENA_CACHED_MAGIC)
         WARN( "Heap %p: block %p used after free\n", subheap->heap, arena + 1 );
     else if (arena->magic != ARENA_INUSE_MAGIC)
         WARN( "Heap %p: invalid in-use arena magic %08x for %p\n", subheap->heap, arena->magic, arena );
@@ -1438,6 +1512,558 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
 }
 
 
+/* size class of an allocation: class n holds sizes up to 16 << n */
+static inline unsigned int get_size_class( SIZE_T size )
+{
+    if (size <= 16) return 0;
+    return min( RtlFindMostSignificantBit( (size - 1) >> 4 ) + 1, HEAP_WINE_SIZE_CLASSES - 1 );
+}
+
+static inline void stats_alloc( struct heap_stats *stats, SIZE_T size )
+{
+    stats->allocs++;
+    stats->size += size;
+    stats->sizes[get_size_class( size )]++;
+}
+
+static inline void stats_free( struct heap_stats *stats, SIZE_T size )
+{
+    stats->frees++;
+    stats->size -= size;
+}
+
+static inline void update_peak_size( HEAP *heap )
+{
+    if (heap->stats.size > (LONG_PTR)heap->peak_size) heap->peak_size = heap->stats.size;
+}
+
+static void add_heap_stats( struct heap_stats *dst, const struct heap_stats *src )
+{
+    unsigned int i;
+
+    dst->allocs += src->allocs;
+    dst->frees += src->frees;
+    dst->size += src->size;
+    for (i = 0; i < HEAP_WINE_SIZE_CLASSES; i++) dst->sizes[i] += src->sizes[i];
+}
+
+/* move the statistics of a thread cache to its heap; the heap must be locked */
+static void flush_cache_stats( HEAP *heap, struct heap_stats *stats )
+{
+    add_heap_stats( &heap->stats, stats );
+    update_peak_size( heap );
+    memset( stats, 0, sizeof(*stats) );
+}
+
+/* lock the heap, counting how often it was already held */
+static inline void enter_heap_lock( HEAP *heap )
+{
+    if (RtlTryEnterCriticalSection( &heap->critSection )) return;
+    RtlEnterCriticalSection( &heap->critSection );
+    heap->contentions++;
+}
+
+/* user size of a valid in-use block */
+static inline SIZE_T get_block_size( const ARENA_INUSE *arena, const SUBHEAP *subheap )
+{
+    if (!subheap) return ((const ARENA_LARGE *)(arena + 1) - 1)->data_size;
+    return (arena->size & ARENA_SIZE_MASK) - arena->unused_bytes;
+}
+
+
+/***********************************************************************
+ *           allocate_block
+ *
+ * Carve an in-use block of the given size out of the free lists. The heap must be locked.
+ */
+static ARENA_INUSE *allocate_block( HEAP *heap, SIZE_T rounded_size, SUBHEAP **ret_subheap )
+{
+    ARENA_FREE *pArena;
+    ARENA_INUSE *pInUse;
+
+    /* Locate a suitable free block */
+
+    if (!(pArena = HEAP_FindFreeBlock( heap, rounded_size, ret_subheap ))) return NULL;
+
+    /* Remove the arena from the free list */
+
+    list_remove( &pArena->entry );
+
+    /* Build the in-use arena */
+
+    pInUse = (ARENA_INUSE *)pArena;
+
+    /* in-use arena is smaller than free arena,
+     * so we have to add the difference to the size */
+    pInUse->size  = (pInUse->size & ~ARENA_FLAG_FREE) + sizeof(ARENA_FREE) - sizeof(ARENA_INUSE);
+    pInUse->magic = ARENA_INUSE_MAGIC;
+
+    /* Shrink the block */
+
+    HEAP_ShrinkBlock( *ret_subheap, pInUse, rounded_size );
+    return pInUse;
+}
+
+
+/* The low-fragmentation heap keeps recently freed small blocks in per-thread
+ * caches, so that most allocations and frees don't need the heap lock. Cached
+ * blocks stay in-use from the heap point of view and are only returned to the
+ * free lists in batches, when a size class overflows or the thread exits.
+ * The thread caches and their heap pointer are protected by heap_cache_section. */
+
+static RTL_CRITICAL_SECTION heap_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG heap_cache_section_debug =
+{
+    0, 0, &heap_cache_section,
+    { &heap_cache_section_debug.ProcessLocksList, &heap_cache_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": heap_cache_section") }
+};
+static RTL_CRITICAL_SECTION heap_cache_section = { &heap_cache_section_debug, -1, 0, 0, 0, 0 };
+
+static inline unsigned int get_cache_class( SIZE_T size )
+{
+    return (size - HEAP_MIN_DATA_SIZE) / ALIGNMENT;
+}
+
+static inline SIZE_T get_cache_class_size( unsigned int class )
+{
+    return HEAP_MIN_DATA_SIZE + class * ALIGNMENT;
+}
+
+/* find the calling thread cache for a given heap */
+static inline struct heap_thread_cache *get_thread_cache( const HEAP *heap )
+{
+    struct heap_thread_cache *cache;
+
+    for (cache = ntdll_get_thread_data()->heap_cache; cache; cache = cache->next)
+        if (cache->heap == heap) return cache;
+    return NULL;
+}
+
+static inline void push_cached_block( struct heap_thread_cache *cache, ARENA_INUSE *arena, SIZE_T size )
+{
+    unsigned int class = get_cache_class( size );
+
+    arena->magic = ARENA_CACHED_MAGIC;
+    *(ARENA_INUSE **)(arena + 1) = cache->blocks[class];
+    cache->blocks[class] = arena;
+    cache->count[class]++;
+    cache->total += size;
+}
+
+/* return a list of cached blocks to the heap free lists; the heap must be locked */
+static void free_cached_blocks( HEAP *heap, ARENA_INUSE *arena )
+{
+    ARENA_INUSE *next;
+    SUBHEAP *subheap;
+
+    for ( ; arena; arena = next)
+    {
+        next = *(ARENA_INUSE **)(arena + 1);
+        arena->magic = ARENA_INUSE_MAGIC;
+        /* blocks freed to the wrong heap are left alone */
+        if (validate_block_pointer( heap, &subheap, arena ) && subheap)
+            HEAP_MakeInUseBlockFree( subheap, arena );
+    }
+}
+
+/* free cache structures chained through their first pointer; they are not freed
+ * through RtlFreeHeap, as it could create a new cache for the process heap */
+static void free_thread_cache_structs( ARENA_INUSE *list )
+{
+    if (!list) return;
+    RtlEnterCriticalSection( &processHeap->critSection );
+    free_cached_blocks( processHeap, list );
+    RtlLeaveCriticalSection( &processHeap->critSection );
+}
+
+/* return the blocks of a cache to its heap and detach it; heap_cache_section must be held */
+static void release_thread_cache( struct heap_thread_cache *cache )
+{
+    ARENA_INUSE *list;
+    unsigned int i;
+
+    if (!cache->heap) return;
+    RtlEnterCriticalSection( &cache->heap->critSection );
+    for (i = 0; i < HEAP_CACHE_NB_CLASSES; i++)
+    {
+        list = cache->blocks[i];
+        cache->blocks[i] = NULL;
+        cache->count[i] = 0;
+        free_cached_blocks( cache->heap, list );
+    }
+    cache->total = 0;
+    flush_cache_stats( cache->heap, &cache->stats );
+    RtlLeaveCriticalSection( &cache->heap->critSection );
+    list_remove( &cache->entry );
+    cache->heap = NULL;
+}
+
+/* return the blocks cached by terminated threads to a heap; heap_cache_section must be held */
+static void reclaim_abandoned_caches( HEAP *heap, ARENA_INUSE **list )
+{
+    struct heap_thread_cache *cache, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE( cache, next, &heap->thread_caches, struct heap_thread_cache, entry )
+    {
+        if (!cache->abandoned) continue;
+        release_thread_cache( cache );
+        /* the owner is gone, nothing walks its chain of caches anymore */
+        *(ARENA_INUSE **)cache = *list;
+        *list = (ARENA_INUSE *)cache - 1;
+    }
+}
+
+/* create a cache for a given heap, reusing the cache of a destroyed heap if possible */
+static struct heap_thread_cache *create_thread_cache( HEAP *heap )
+{
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    struct heap_thread_cache *cache;
+    ARENA_INUSE *list = NULL;
+
+    for (cache = thread_data->heap_cache; cache; cache = cache->next)
+        if (!cache->heap) break;
+
+    if (cache)
+    {
+        memset( cache->blocks, 0, sizeof(cache->blocks) );
+        memset( cache->count, 0, sizeof(cache->count) );
+        memset( &cache->stats, 0, sizeof(cache->stats) );
+        cache->total = 0;
+        cache->nb_ranges = 0;
+    }
+    else
+    {
+        if (!(cache = RtlAllocateHeap( processHeap, HEAP_ZERO_MEMORY, sizeof(*cache) ))) return NULL;
+        cache->next = thread_data->heap_cache;
+        thread_data->heap_cache = cache;
+    }
+
+    RtlEnterCriticalSection( &heap_cache_section );
+    reclaim_abandoned_caches( heap, &list );
+    cache->heap = heap;
+    list_add_tail( &heap->thread_caches, &cache->entry );
+    RtlLeaveCriticalSection( &heap_cache_section );
+
+    free_thread_cache_structs( list );
+    return cache;
+}
+
+/* find the end of the committed sub-heap area containing a block header, looking
+ * it up under the heap lock if the cache doesn't know about that sub-heap yet */
+static const char *find_cache_range( struct heap_thread_cache *cache, const ARENA_INUSE *arena )
+{
+    HEAP *heap = cache->heap;
+    const char *ptr = (const char *)arena, *start, *end = NULL;
+    SUBHEAP *subheap;
+    unsigned int i;
+
+    if (cache->generation == heap->subheap_generation)
+    {
+        for (i = 0; i < cache->nb_ranges; i++)
+            if (ptr >= cache->ranges[i].start && ptr + sizeof(*arena) <= cache->ranges[i].end)
+                return cache->ranges[i].end;
+    }
+
+    enter_heap_lock( heap );
+    if (cache->generation != heap->subheap_generation)
+    {
+        cache->generation = heap->subheap_generation;
+        cache->nb_ranges = 0;
+    }
+    if ((subheap = HEAP_FindSubHeap( heap, arena )))
+    {
+        start = (const char *)subheap->base + subheap->headerSize;
+        end = (const char *)subheap->base + subheap->commitSize;
+        if (ptr >= start && ptr + sizeof(*arena) <= end)
+        {
+            for (i = 0; i < cache->nb_ranges; i++) if (cache->ranges[i].start == start) break;
+            if (i == HEAP_CACHE_RANGES)
+            {
+                memmove( cache->ranges, cache->ranges + 1, (HEAP_CACHE_RANGES - 1) * sizeof(cache->ranges[0]) );
+                i--;
+            }
+            else if (i == cache->nb_ranges) cache->nb_ranges++;
+            cache->ranges[i].start = start;
+            cache->ranges[i].end = end;
+        }
+        else end = NULL;
+    }
+    RtlLeaveCriticalSection( &heap->critSection );
+    return end;
+}
+
+/* flush all the blocks of a size class */
+static void flush_cache_class( struct heap_thread_cache *cache, unsigned int class )
+{
+    ARENA_INUSE *list;
+
+    enter_heap_lock( cache->heap );
+    /* detach the list first, a cache abandoned halfway must not free the blocks again */
+    list = cache->blocks[class];
+    cache->total -= cache->count[class] * get_cache_class_size( class );
+    cache->blocks[class] = NULL;
+    cache->count[class] = 0;
+    free_cached_blocks( cache->heap, list );
+    flush_cache_stats( cache->heap, &cache->stats );
+    RtlLeaveCriticalSection( &cache->heap->critSection );
+}
+
+/* carve a batch of blocks of the requested size under a single lock */
+static void refill_cache_class( struct heap_thread_cache *cache, SIZE_T rounded_size )
+{
+    HEAP *heap = cache->heap;
+    ARENA_INUSE *arena;
+    SUBHEAP *subheap;
+    SIZE_T size;
+    unsigned int i;
+
+    enter_heap_lock( heap );
+    flush_cache_stats( heap, &cache->stats );
+    for (i = 0; i < HEAP_CACHE_REFILL; i++)
+    {
+        if (cache->total + rounded_size > HEAP_CACHE_MAX_BYTES) break;
+        if (!(arena = allocate_block( heap, rounded_size, &subheap ))) break;
+        size = arena->size & ARENA_SIZE_MASK;
+        if (size > HEAP_CACHE_MAX_SIZE || cache->count[get_cache_class( size )] >= HEAP_CACHE_DEPTH)
+        {
+            HEAP_MakeInUseBlockFree( subheap, arena );
+            break;
+        }
+        push_cached_block( cache, arena, size );
+    }
+    RtlLeaveCriticalSection( &heap->critSection );
+}
+
+/***********************************************************************
+ *           heap_cache_alloc
+ *
+ * Allocate a block from the thread cache of a low-fragmentation heap.
+ */
+static ARENA_INUSE *heap_cache_alloc( HEAP *heap, SIZE_T rounded_size, SIZE_T size )
+{
+    struct heap_thread_cache *cache;
+    unsigned int class = get_cache_class( rounded_size );
+    ARENA_INUSE *arena;
+
+    /* caches are created on free, so that threads that only allocate don't hoard blocks */
+    if (!(cache = get_thread_cache( heap ))) return NULL;
+
+    if (!cache->blocks[class]) refill_cache_class( cache, rounded_size );
+    if (!(arena = cache->blocks[class])) return NULL;
+
+    cache->blocks[class] = *(ARENA_INUSE **)(arena + 1);
+    cache->count[class]--;
+    cache->total -= rounded_size;
+    stats_alloc( &cache->stats, size );
+    arena->magic = ARENA_INUSE_MAGIC;
+    return arena;
+}
+
+/***********************************************************************
+ *           heap_cache_free
+ *
+ * Free a block to the thread cache of a low-fragmentation heap.
+ * The block must be inside a sub-heap of that heap and have a sane
+ * header; anything suspicious is left to the fully validating path.
+ */
+static BOOL heap_cache_free( HEAP *heap, ARENA_INUSE *arena )
+{
+    struct heap_thread_cache *cache;
+    unsigned int class;
+    const char *end;
+    SIZE_T size;
+
+    if ((ULONG_PTR)arena % ALIGNMENT != ARENA_OFFSET) return FALSE;
+    if (!(cache = get_thread_cache( heap )) && !(cache = create_thread_cache( heap ))) return FALSE;
+    if (!(end = find_cache_range( cache, arena ))) return FALSE;
+    if (arena->magic != ARENA_INUSE_MAGIC || (arena->size & ARENA_FLAG_FREE)) return FALSE;
+
+    size = arena->size & ARENA_SIZE_MASK;
+    if (size < HEAP_MIN_DATA_SIZE || size > HEAP_CACHE_MAX_SIZE) return FALSE;
+    if ((size - HEAP_MIN_DATA_SIZE) % ALIGNMENT) return FALSE;
+    if ((const char *)(arena + 1) + size > end) return FALSE;
+
+    class = get_cache_class( size );
+    if (cache->count[class] >= HEAP_CACHE_DEPTH) flush_cache_class( cache, class );
+    else if (cache->total + size > HEAP_CACHE_MAX_BYTES) return FALSE;
+
+    stats_free( &cache->stats, size - arena->unused_bytes );
+    push_cached_block( cache, arena, size );
+    return TRUE;
+}
+
+/***********************************************************************
+ *           heap_thread_detach
+ *
+ * Return the blocks of the exiting thread caches to their heaps.
+ */
+void heap_thread_detach(void)
+{
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    struct heap_thread_cache *cache, *next;
+    ARENA_INUSE *list = NULL;
+
+    if (!(cache = thread_data->heap_cache)) return;
+    thread_data->heap_cache = NULL;
+
+    RtlEnterCriticalSection( &heap_cache_section );
+    for ( ; cache; cache = next)
+    {
+        next = cache->next;
+        release_thread_cache( cache );
+        *(ARENA_INUSE **)cache = list;
+        list = (ARENA_INUSE *)cache - 1;
+    }
+    RtlLeaveCriticalSection( &heap_cache_section );
+
+    free_thread_cache_structs( list );
+}
+
+
+/***********************************************************************
+ *           heap_thread_abort
+ *
+ * Mark the caches of a thread that is being terminated, so that other
+ * threads return their blocks. This may run from a signal handler, so
+ * nothing else is done here.
+ */
+void heap_thread_abort(void)
+{
+    struct heap_thread_cache *cache;
+
+    for (cache = ntdll_get_thread_data()->heap_cache; cache; cache = cache->next)
+        cache->abandoned = TRUE;
+}
+
+
+/***********************************************************************
+ *           heap_process_detach
+ *
+ * Return the blocks of the remaining thread caches to their heaps on process exit.
+ */
+void heap_process_detach(void)
+{
+    HANDLE heaps[256];
+    ARENA_INUSE *list = NULL;
+    HEAP *heap;
+    ULONG i, count;
+
+    heap_thread_detach();
+
+    count = min( RtlGetProcessHeaps( ARRAY_SIZE(heaps), heaps ), ARRAY_SIZE(heaps) );
+    RtlEnterCriticalSection( &heap_cache_section );
+    for (i = 0; i < count; i++)
+        if ((heap = HEAP_GetPtr( heaps[i] ))) reclaim_abandoned_caches( heap, &list );
+    RtlLeaveCriticalSection( &heap_cache_section );
+
+    free_thread_cache_structs( list );
+}
+
+
+/***********************************************************************
+ *           get_heap_statistics
+ *
+ * Gather the statistics of a heap, including the thread caches.
+ */
+static void get_heap_statistics( HEAP *heap, HEAP_WINE_STATISTICS *info )
+{
+    struct heap_thread_cache *cache;
+    struct heap_stats stats;
+    ARENA_LARGE *large;
+    SUBHEAP *subheap;
+    struct list *ptr, *end;
+    unsigned int i;
+
+    RtlEnterCriticalSection( &heap_cache_section );
+    if (!(heap->flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heap->critSection );
+
+    stats = heap->stats;
+    info->CachedSize = 0;
+    LIST_FOR_EACH_ENTRY( cache, &heap->thread_caches, struct heap_thread_cache, entry )
+    {
+        add_heap_stats( &stats, &cache->stats );
+        info->CachedSize += cache->total;
+    }
+    info->AllocationCount = stats.allocs;
+    info->FreeCount = stats.frees;
+    info->BytesInUse = max( stats.size, 0 );
+    info->PeakBytesInUse = max( heap->peak_size, info->BytesInUse );
+    info->LockContentionCount = heap->contentions;
+    memcpy( info->SizeClasses, stats.sizes, sizeof(info->SizeClasses) );
+
+    info->CommittedSize = 0;
+    LIST_FOR_EACH_ENTRY( subheap, &heap->subheap_list, SUBHEAP, entry )
+        info->CommittedSize += subheap->commitSize;
+    LIST_FOR_EACH_ENTRY( large, &heap->large_list, ARENA_LARGE, entry )
+        info->CommittedSize += large->block_size;
+
+    info->FreeSize = 0;
+    info->FreeListCount = HEAP_NB_FREE_LISTS;
+    for (i = 0; i < HEAP_NB_FREE_LISTS; i++)
+    {
+        end = &heap->freeList[(i + 1) % HEAP_NB_FREE_LISTS].arena.entry;
+        info->FreeListLengths[i] = 0;
+        for (ptr = heap->freeList[i].arena.entry.next; ptr != end; ptr = ptr->next)
+        {
+            info->FreeSize += LIST_ENTRY( ptr, ARENA_FREE, entry )->size & ARENA_SIZE_MASK;
+            info->FreeListLengths[i]++;
+        }
+    }
+
+    if (!(heap->flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heap->critSection );
+    RtlLeaveCriticalSection( &heap_cache_section );
+}
+
+/***********************************************************************
+ *           dump_heap_statistics
+ */
+static void dump_heap_statistics( HEAP *heap )
+{
+    struct
+    {
+        HEAP_WINE_STATISTICS info;
+        ULONG                lengths[HEAP_NB_FREE_LISTS];
+    } stats;
+    unsigned int i;
+
+    get_heap_statistics( heap, &stats.info );
+
+    MESSAGE( "heap %p: %s allocs, %s frees, %lu bytes in use (peak %lu), %lu committed, "
+             "%lu free, %lu cached, %u lock contentions\n", heap,
+             wine_dbgstr_longlong( stats.info.AllocationCount ), wine_dbgstr_longlong( stats.info.FreeCount ),
+             stats.info.BytesInUse, stats.info.PeakBytesInUse, stats.info.CommittedSize,
+             stats.info.FreeSize, stats.info.CachedSize, stats.info.LockContentionCount );
+    for (i = 0; i < HEAP_WINE_SIZE_CLASSES; i++)
+    {
+        if (!stats.info.SizeClasses[i]) continue;
+        if (i < HEAP_WINE_SIZE_CLASSES - 1)
+            MESSAGE( "heap %p:   <= %10lu bytes: %u\n", heap, (SIZE_T)16 << i, stats.info.SizeClasses[i] );
+        else
+            MESSAGE( "heap %p:    > %10lu bytes: %u\n", heap, (SIZE_T)8 << i, stats.info.SizeClasses[i] );
+    }
+    MESSAGE( "heap %p: free lists", heap );
+    for (i = 0; i < stats.info.FreeListCount; i++) MESSAGE( " %u", stats.info.FreeListLengths[i] );
+    MESSAGE( "\n" );
+}
+
+/***********************************************************************
+ *           heap_dump_statistics
+ *
+ * Print the statistics of all the heaps if WINEHEAPSTATS is set.
+ */
+void heap_dump_statistics(void)
+{
+    HANDLE heaps[256];
+    ULONG i, count;
+
+    if (!heap_stats_dump) return;
+
+    count = min( RtlGetProcessHeaps( ARRAY_SIZE(heaps), heaps ), ARRAY_SIZE(heaps) );
+    for (i = 0; i < count; i++) dump_heap_statistics( heaps[i] );
+}
+
+
 /***********************************************************************
  *           heap_set_debug_flags
  */
@@ -1560,8 +2186,11 @@ HANDLE WINAPI RtlCreateHeap( ULONG flags, PVOID addr, SIZE_T totalSize, SIZE_T c
     }
     else if (!addr)
     {
+        const char *env = getenv( "WINEHEAPSTATS" );
+
         processHeap = subheap->heap;  /* assume the first heap we create is the process main heap */
         list_init( &processHeap->entry );
+        heap_stats_dump = env && atoi( env );
     }
 
     return subheap->heap;
@@ -1585,6 +2214,7 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
     HEAP *heapPtr = HEAP_GetPtr( heap );
     SUBHEAP *subheap, *next;
     ARENA_LARGE *arena, *arena_next;
+    struct heap_thread_cache *cache;
     SIZE_T size;
     void *addr;
 
@@ -1593,11 +2223,19 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
 
     if (heap == processHeap) return heap; /* cannot delete the main process heap */
 
+    if (heap_stats_dump) dump_heap_statistics( heapPtr );
+
     /* remove it from the per-process list */
     RtlEnterCriticalSection( &processHeap->critSection );
     list_remove( &heapPtr->entry );
     RtlLeaveCriticalSection( &processHeap->critSection );
 
+    /* detach the thread caches, their blocks go away with the heap */
+    RtlEnterCriticalSection( &heap_cache_section );
+    LIST_FOR_EACH_ENTRY( cache, &heapPtr->thread_caches, struct heap_thread_cache, entry )
+        cache->heap = NULL;
+    RtlLeaveCriticalSection( &heap_cache_section );
+
     heapPtr->critSection.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &heapPtr->critSection );
 
@@ -1645,7 +2283,6 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
  */
 void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
 {
-    ARENA_FREE *pArena;
     ARENA_INUSE *pInUse;
     SUBHEAP *subheap;
     HEAP *heapPtr = HEAP_GetPtr( heap );
@@ -1664,20 +2301,33 @@ void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
-    if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
+    if (heapPtr->compat_info == HEAP_LFH && rounded_size <= HEAP_CACHE_MAX_SIZE &&
+        (pInUse = heap_cache_alloc( heapPtr, rounded_size, size )))
+    {
+        pInUse->unused_bytes = (pInUse->size & ARENA_SIZE_MASK) - size;
+        notify_alloc( pInUse + 1, size, flags & HEAP_ZERO_MEMORY );
+        initialize_block( pInUse + 1, size, pInUse->unused_bytes, flags );
+        TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, pInUse + 1 );
+        return pInUse + 1;
+    }
+
+    if (!(flags & HEAP_NO_SERIALIZE)) enter_heap_lock( heapPtr );
 
     if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
     {
         void *ret = allocate_large_block( heap, flags, size );
+        if (ret)
+        {
+            stats_alloc( &heapPtr->stats, size );
+            update_peak_size( heapPtr );
+        }
         if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
         if (!ret && (flags & HEAP_GENERATE_EXCEPTIONS)) RtlRaiseStatus( STATUS_NO_MEMORY );
         TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
         return ret;
     }
 
-    /* Locate a suitable free block */
-
-    if (!(pArena = HEAP_FindFreeBlock( heapPtr, rounded_size, &subheap )))
+    if (!(pInUse = allocate_block( heapPtr, rounded_size, &subheap )))
     {
         TRACE("(%p,%08x,%08lx): returning NULL\n",
                   heap, flags, size  );
@@ -1686,23 +2336,9 @@ void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_
         return NULL;
     }
 
-    /* Remove the arena from the free list */
-
-    list_remove( &pArena->entry );
-
-    /* Build the in-use arena */
-
-    pInUse = (ARENA_INUSE *)pArena;
-
-    /* in-use arena is smaller than free arena,
-     * so we have to add the difference to the size */
-    pInUse->size  = (pInUse->size & ~ARENA_FLAG_FREE) + sizeof(ARENA_FREE) - sizeof(ARENA_INUSE);
-    pInUse->magic = ARENA_INUSE_MAGIC;
-
-    /* Shrink the block */
-
-    HEAP_ShrinkBlock( subheap, pInUse, rounded_size );
     pInUse->unused_bytes = (pInUse->size & ARENA_SIZE_MASK) - size;
+    stats_alloc( &heapPtr->stats, size );
+    update_peak_size( heapPtr );
 
     notify_alloc( pInUse + 1, size, flags & HEAP_ZERO_MEMORY );
     initialize_block( pInUse + 1, size, pInUse->unused_bytes, flags );
@@ -1747,7 +2383,14 @@ BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE heap, ULONG flags, void *pt
 
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
-    if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
+
+    if (heapPtr->compat_info == HEAP_LFH && heap_cache_free( heapPtr, (ARENA_INUSE *)ptr - 1 ))
+    {
+        TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
+    if (!(flags & HEAP_NO_SERIALIZE)) enter_heap_lock( heapPtr );
 
     /* Inform valgrind we are trying to free memory, so it can throw up an error message */
     notify_free( ptr );
@@ -1756,6 +2399,8 @@ BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE heap, ULONG flags, void *pt
     pInUse  = (ARENA_INUSE *)ptr - 1;
     if (!validate_block_pointer( heapPtr, &subheap, pInUse )) goto error;
 
+    stats_free( &heapPtr->stats, get_block_size( pInUse, subheap ));
+
     if (!subheap)
         free_large_block( heapPtr, flags, ptr );
     else
@@ -1793,7 +2438,7 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     ARENA_INUSE *pArena;
     HEAP *heapPtr;
     SUBHEAP *subheap;
-    SIZE_T oldBlockSize, oldActualSize, rounded_size;
+    SIZE_T oldBlockSize, oldActualSize, rounded_size, old_size;
     void *ret;
 
     if (!ptr) return NULL;
@@ -1808,7 +2453,7 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     flags &= HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY |
              HEAP_REALLOC_IN_PLACE_ONLY;
     flags |= heapPtr->flags;
-    if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
+    if (!(flags & HEAP_NO_SERIALIZE)) enter_heap_lock( heapPtr );
 
     rounded_size = ROUND_SIZE(size) + HEAP_TAIL_EXTRA_SIZE(flags);
     if (rounded_size < size) goto oom;  /* overflow */
@@ -1816,6 +2461,7 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
 
     pArena = (ARENA_INUSE *)ptr - 1;
     if (!validate_block_pointer( heapPtr, &subheap, pArena )) goto error;
+    old_size = get_block_size( pArena, subheap );
     if (!subheap)
     {
         if (!(ret = realloc_large_block( heapPtr, flags, ptr, size ))) goto oom;
@@ -1902,6 +2548,8 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
 
     ret = pArena + 1;
 done:
+    heapPtr->stats.size += size - old_size;
+    update_peak_size( heapPtr );
     if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
     TRACE("(%p,%08x,%p,%08lx): returning %p\n", heap, flags, ptr, size, ret );
     return ret;
@@ -2017,7 +2665,7 @@ SIZE_T WINAPI RtlSizeHeap( HANDLE heap, ULONG flags, const void *ptr )
     }
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
-    if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
+    if (!(flags & HEAP_NO_SERIALIZE)) enter_heap_lock( heapPtr );
 
     pArena = (const ARENA_INUSE *)ptr - 1;
     if (!validate_block_pointer( heapPtr, &subheap, pArena ))
@@ -2114,7 +2762,8 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         }
 
         if (((ARENA_INUSE *)ptr - 1)->magic == ARENA_INUSE_MAGIC ||
-            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_PENDING_MAGIC)
+            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_PENDING_MAGIC ||
+            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_CACHED_MAGIC)
         {
             ARENA_INUSE *pArena = (ARENA_INUSE *)ptr - 1;
             ptr += pArena->size & ARENA_SIZE_MASK;
@@ -2162,7 +2811,7 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         entry->lpData = pArena + 1;
         entry->cbData = pArena->size & ARENA_SIZE_MASK;
         entry->cbOverhead = sizeof(ARENA_INUSE);
-        entry->wFlags = (pArena->magic == ARENA_PENDING_MAGIC) ?
+        entry->wFlags = (pArena->magic == ARENA_PENDING_MAGIC || pArena->magic == ARENA_CACHED_MAGIC) ?
                         PROCESS_HEAP_UNCOMMITTED_RANGE : PROCESS_HEAP_ENTRY_BUSY;
         /* FIXME: can't handle PROCESS_HEAP_ENTRY_MOVEABLE
         and PROCESS_HEAP_ENTRY_DDESHARE yet */
@@ -2227,7 +2876,10 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
 NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
                                          PVOID info, SIZE_T size_in, PSIZE_T size_out)
 {
-    switch (info_class)
+    HEAP *heapPtr;
+    SIZE_T size;
+
+    switch ((ULONG)info_class)  /* may be a Wine specific class */
     {
     case HeapCompatibilityInformation:
         if (size_out) *size_out = sizeof(ULONG);
@@ -2235,7 +2887,17 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
         if (size_in < sizeof(ULONG))
             return STATUS_BUFFER_TOO_SMALL;
 
-        *(ULONG *)info = 0; /* standard heap */
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+        *(ULONG *)info = heapPtr->compat_info;
+        return STATUS_SUCCESS;
+
+    case HeapWineStatistics:
+        size = FIELD_OFFSET( HEAP_WINE_STATISTICS, FreeListLengths[HEAP_NB_FREE_LISTS] );
+        if (size_out) *size_out = size;
+        if (size_in < size) return STATUS_BUFFER_TOO_SMALL;
+
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+        get_heap_statistics( heapPtr, info );
         return STATUS_SUCCESS;
 
     default:
@@ -2249,6 +2911,31 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
  */
 NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class, PVOID info, SIZE_T size)
 {
-    FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
-    return STATUS_SUCCESS;
+    HEAP *heapPtr;
+    ULONG value;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+
+        value = *(ULONG *)info;
+        TRACE( "%p: compatibility information %u\n", heap, value );
+        if (value == heapPtr->compat_info) return STATUS_SUCCESS;
+        /* the low-fragmentation heap cannot be turned off once enabled */
+        if (value != HEAP_LFH || heapPtr->compat_info == HEAP_LFH) return STATUS_UNSUCCESSFUL;
+        if (heapPtr->flags & (HEAP_NO_SERIALIZE | HEAP_SHARED | HEAP_TAIL_CHECKING_ENABLED |
+                              HEAP_FREE_CHECKING_ENABLED | HEAP_VALIDATE | HEAP_VALIDATE_ALL |
+                              HEAP_VALIDATE_PARAMS | HEAP_PAGE_ALLOCS))
+            return STATUS_UNSUCCESSFUL;
+        if (heapPtr->pending_free || RUNNING_ON_VALGRIND) return STATUS_UNSUCCESSFUL;
+
+        heapPtr->compat_info = HEAP_LFH;
+        return STATUS_SUCCESS;
+
+    default:
+        FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
+        return STATUS_SUCCESS;
+    }
 }
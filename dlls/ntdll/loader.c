@@ -24,6 +24,7 @@
 
 #include <assert.h>
 #include <stdarg.h>
+#include <fcntl.h>
 #ifdef HAVE_LINK_H
 # include <link.h>
 #endif
@@ -53,6 +54,7 @@ WINE_DECLARE_DEBUG_CHANNEL(relay);
 WINE_DECLARE_DEBUG_CHANNEL(snoop);
 WINE_DECLARE_DEBUG_CHANNEL(loaddll);
 WINE_DECLARE_DEBUG_CHANNEL(imports);
+WINE_DECLARE_DEBUG_CHANNEL(loadtime);
 
 #ifdef _WIN64
 #define DEFAULT_SECURITY_COOKIE_64  (((ULONGLONG)0x00002b99 << 32) | 0x2ddfa232)
@@ -92,6 +94,8 @@ static ULONG path_safe_mode;  /* path mode set by RtlSetSearchPathMode */
 static ULONG dll_safe_mode = 1;  /* dll search mode */
 static UNICODE_STRING dll_directory;  /* extra path for LdrSetDllDirectory */
 static DWORD default_search_flags;  /* default flags set by LdrSetDefaultDllDirectories */
+static ULONG max_loader_threads;  /* number of dependencies to read ahead, from MaxLoaderThreads */
+static ULONGLONG child_load_time;  /* time spent in nested load_dll calls, for the loadtime channel */
 
 struct dll_dir_entry
 {
@@ -122,6 +126,33 @@ static const char * const reason_names[] =
 
 static const WCHAR dllW[] = {'.','d','l','l',0};
 
+/* hash tables for looking up loaded modules */
+enum module_hash_type
+{
+    MODULE_HASH_BASE,     /* by DllBase */
+    MODULE_HASH_NAME,     /* by BaseDllName, case insensitive */
+    MODULE_HASH_PATH,     /* by FullDllName, case insensitive */
+    MODULE_HASH_FILEID,   /* by device and inode */
+    NB_MODULE_HASHES
+};
+
+#define MODULE_HASH_SIZE 64
+
+/* index of the export names of a module, built once enough names have been looked up in it */
+struct export_hash
+{
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    ULONG                         mask;
+    struct
+    {
+        ULONG hash;
+        ULONG index;   /* index in AddressOfNames + 1, 0 for an empty slot */
+    } entries[1];
+};
+
+#define EXPORT_HASH_MIN_NAMES    64  /* binary search is good enough for smaller tables */
+#define EXPORT_HASH_MIN_SEARCHES 16  /* lookups done with binary search before building the index */
+
 /* internal representation of 32bit modules. per process. */
 typedef struct _wine_modref
 {
@@ -132,6 +163,15 @@ typedef struct _wine_modref
     int                   alloc_deps;
     int                   nDeps;
     struct _wine_modref **deps;
+    struct _wine_modref  *hash_next[NB_MODULE_HASHES];
+    ULONG                 hash_bucket[NB_MODULE_HASHES];  /* bucket + 1, 0 if not hashed */
+    struct export_hash   *export_hash;
+    ULONG                 export_searches;
+    /* time spent loading the module, in 100ns units, for the loadtime channel */
+    ULONGLONG             map_time;
+    ULONGLONG             reloc_time;
+    ULONGLONG             prefetch_time;
+    ULONGLONG             bind_time;
 } WINE_MODREF;
 
 /* info about the current builtin dll load */
@@ -170,6 +210,20 @@ static CRITICAL_SECTION_DEBUG dlldir_critsect_debug =
 static CRITICAL_SECTION dlldir_section = { &dlldir_critsect_debug, -1, 0, 0, 0, 0 };
 
 static WINE_MODREF *cached_modref;
+static WINE_MODREF *module_hash[NB_MODULE_HASHES][MODULE_HASH_SIZE];
+
+/* lookup counters, dumped on process exit with +module */
+static struct
+{
+    ULONG module_lookups;     /* calls to the find_*_module functions and get_modref */
+    ULONG module_cache_hits;  /* lookups satisfied by cached_modref */
+    ULONG module_probes;      /* modules compared while walking hash chains */
+    ULONG export_lookups;     /* calls to find_named_export */
+    ULONG export_hint_hits;   /* lookups satisfied by the import hint */
+    ULONG export_hash_hits;   /* lookups satisfied by an export name index */
+    ULONG export_searches;    /* lookups done with a binary search */
+    ULONG export_indexes;     /* export name indexes built */
+} loader_stats;
 static WINE_MODREF *current_modref;
 static WINE_MODREF *last_failed_modref;
 
@@ -462,6 +516,68 @@ static void call_ldr_notifications( ULONG reason, LDR_DATA_TABLE_ENTRY *module )
     }
 }
 
+/* hash functions for the module tables */
+static inline ULONG hash_module_base( const void *base )
+{
+    return (ULONG_PTR)base >> 16;
+}
+
+static ULONG hash_module_name( const UNICODE_STRING *name )
+{
+    ULONG i, hash = 0;
+
+    for (i = 0; i < name->Length / sizeof(WCHAR); i++)
+        hash = hash * 31 + RtlUpcaseUnicodeChar( name->Buffer[i] );
+    return hash;
+}
+
+static inline ULONG hash_module_fileid( dev_t dev, ino_t ino )
+{
+    return (ULONG)dev * 31 + (ULONG)ino + (ULONG)((ULONGLONG)ino >> 32);
+}
+
+
+/*************************************************************************
+ *		hash_module
+ *
+ * Add a module to one of the lookup tables.
+ * The loader_section must be locked while calling this function.
+ */
+static void hash_module( WINE_MODREF *wm, enum module_hash_type type, ULONG hash )
+{
+    ULONG bucket = hash % MODULE_HASH_SIZE;
+
+    wm->hash_next[type] = module_hash[type][bucket];
+    module_hash[type][bucket] = wm;
+    wm->hash_bucket[type] = bucket + 1;
+}
+
+
+/*************************************************************************
+ *		unhash_module
+ *
+ * Remove a module from all the lookup tables.
+ * The loader_section must be locked while calling this function.
+ */
+static void unhash_module( WINE_MODREF *wm )
+{
+    WINE_MODREF **ptr;
+    int type;
+
+    for (type = 0; type < NB_MODULE_HASHES; type++)
+    {
+        if (!wm->hash_bucket[type]) continue;
+        for (ptr = &module_hash[type][wm->hash_bucket[type] - 1]; *ptr; ptr = &(*ptr)->hash_next[type])
+        {
+            if (*ptr != wm) continue;
+            *ptr = wm->hash_next[type];
+            break;
+        }
+        wm->hash_bucket[type] = 0;
+    }
+}
+
+
 /*************************************************************************
  *		get_modref
  *
@@ -470,17 +586,20 @@ static void call_ldr_notifications( ULONG reason, LDR_DATA_TABLE_ENTRY *module )
  */
 static WINE_MODREF *get_modref( HMODULE hmod )
 {
-    PLIST_ENTRY mark, entry;
-    PLDR_DATA_TABLE_ENTRY mod;
+    WINE_MODREF *wm;
 
-    if (cached_modref && cached_modref->ldr.DllBase == hmod) return cached_modref;
+    loader_stats.module_lookups++;
+    if (cached_modref && cached_modref->ldr.DllBase == hmod)
+    {
+        loader_stats.module_cache_hits++;
+        return cached_modref;
+    }
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InMemoryOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
+    for (wm = module_hash[MODULE_HASH_BASE][hash_module_base( hmod ) % MODULE_HASH_SIZE];
+         wm; wm = wm->hash_next[MODULE_HASH_BASE])
     {
-        mod = CONTAINING_RECORD(entry, LDR_DATA_TABLE_ENTRY, InMemoryOrderLinks);
-        if (mod->DllBase == hmod)
-            return cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
+        loader_stats.module_probes++;
+        if (wm->ldr.DllBase == hmod) return cached_modref = wm;
     }
     return NULL;
 }
@@ -494,23 +613,24 @@ static WINE_MODREF *get_modref( HMODULE hmod )
  */
 static WINE_MODREF *find_basename_module( LPCWSTR name )
 {
-    PLIST_ENTRY mark, entry;
+    WINE_MODREF *wm;
     UNICODE_STRING name_str;
 
     RtlInitUnicodeString( &name_str, name );
 
+    loader_stats.module_lookups++;
     if (cached_modref && RtlEqualUnicodeString( &name_str, &cached_modref->ldr.BaseDllName, TRUE ))
+    {
+        loader_stats.module_cache_hits++;
         return cached_modref;
+    }
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
+    for (wm = module_hash[MODULE_HASH_NAME][hash_module_name( &name_str ) % MODULE_HASH_SIZE];
+         wm; wm = wm->hash_next[MODULE_HASH_NAME])
     {
-        LDR_DATA_TABLE_ENTRY *mod = CONTAINING_RECORD(entry, LDR_DATA_TABLE_ENTRY, InLoadOrderLinks);
-        if (RtlEqualUnicodeString( &name_str, &mod->BaseDllName, TRUE ))
-        {
-            cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
-            return cached_modref;
-        }
+        loader_stats.module_probes++;
+        if (RtlEqualUnicodeString( &name_str, &wm->ldr.BaseDllName, TRUE ))
+            return cached_modref = wm;
     }
     return NULL;
 }
@@ -524,25 +644,26 @@ static WINE_MODREF *find_basename_module( LPCWSTR name )
  */
 static WINE_MODREF *find_fullname_module( const UNICODE_STRING *nt_name )
 {
-    PLIST_ENTRY mark, entry;
+    WINE_MODREF *wm;
     UNICODE_STRING name = *nt_name;
 
     if (name.Length <= 4 * sizeof(WCHAR)) return NULL;
     name.Length -= 4 * sizeof(WCHAR);  /* for \??\ prefix */
     name.Buffer += 4;
 
+    loader_stats.module_lookups++;
     if (cached_modref && RtlEqualUnicodeString( &name, &cached_modref->ldr.FullDllName, TRUE ))
+    {
+        loader_stats.module_cache_hits++;
         return cached_modref;
+    }
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
+    for (wm = module_hash[MODULE_HASH_PATH][hash_module_name( &name ) % MODULE_HASH_SIZE];
+         wm; wm = wm->hash_next[MODULE_HASH_PATH])
     {
-        LDR_DATA_TABLE_ENTRY *mod = CONTAINING_RECORD(entry, LDR_DATA_TABLE_ENTRY, InLoadOrderLinks);
-        if (RtlEqualUnicodeString( &name, &mod->FullDllName, TRUE ))
-        {
-            cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
-            return cached_modref;
-        }
+        loader_stats.module_probes++;
+        if (RtlEqualUnicodeString( &name, &wm->ldr.FullDllName, TRUE ))
+            return cached_modref = wm;
     }
     return NULL;
 }
@@ -556,22 +677,20 @@ static WINE_MODREF *find_fullname_module( const UNICODE_STRING *nt_name )
  */
 static WINE_MODREF *find_fileid_module( struct stat *st )
 {
-    LIST_ENTRY *mark, *entry;
+    WINE_MODREF *wm;
 
+    loader_stats.module_lookups++;
     if (cached_modref && cached_modref->dev == st->st_dev && cached_modref->ino == st->st_ino)
+    {
+        loader_stats.module_cache_hits++;
         return cached_modref;
+    }
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
+    for (wm = module_hash[MODULE_HASH_FILEID][hash_module_fileid( st->st_dev, st->st_ino ) % MODULE_HASH_SIZE];
+         wm; wm = wm->hash_next[MODULE_HASH_FILEID])
     {
-        LDR_DATA_TABLE_ENTRY *mod = CONTAINING_RECORD( entry, LDR_DATA_TABLE_ENTRY, InLoadOrderLinks );
-        WINE_MODREF *wm = CONTAINING_RECORD( mod, WINE_MODREF, ldr );
-
-        if (wm->dev == st->st_dev && wm->ino == st->st_ino)
-        {
-            cached_modref = wm;
-            return wm;
-        }
+        loader_stats.module_probes++;
+        if (wm->dev == st->st_dev && wm->ino == st->st_ino) return cached_modref = wm;
     }
     return NULL;
 }
@@ -732,6 +851,54 @@ static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY
 }
 
 
+static inline ULONG hash_export_name( const char *name )
+{
+    ULONG hash = 2166136261u;
+
+    while (*name) hash = (hash ^ (unsigned char)*name++) * 16777619;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		get_export_hash
+ *
+ * Get the export name index of a module, building it if the module
+ * has had enough lookups to make it worthwhile.
+ * The loader_section must be locked while calling this function.
+ */
+static const struct export_hash *get_export_hash( WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    const DWORD *names = get_rva( wm->ldr.DllBase, exports->AddressOfNames );
+    struct export_hash *table;
+    ULONG i, pos, size = 1;
+
+    if (wm->export_hash) return wm->export_hash->exports == exports ? wm->export_hash : NULL;
+    if (exports->NumberOfNames < EXPORT_HASH_MIN_NAMES) return NULL;
+    if (++wm->export_searches < EXPORT_HASH_MIN_SEARCHES) return NULL;
+
+    while (size < 2 * exports->NumberOfNames) size <<= 1;
+    if (!(table = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                   offsetof( struct export_hash, entries[size] ))))
+        return NULL;
+    table->exports = exports;
+    table->mask = size - 1;
+
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        ULONG hash = hash_export_name( get_rva( wm->ldr.DllBase, names[i] ));
+
+        for (pos = hash & table->mask; table->entries[pos].index; pos = (pos + 1) & table->mask) ;
+        table->entries[pos].hash = hash;
+        table->entries[pos].index = i + 1;
+    }
+    TRACE( "built export index for %s, %u names\n",
+           debugstr_w(wm->ldr.BaseDllName.Buffer), exports->NumberOfNames );
+    loader_stats.export_indexes++;
+    return wm->export_hash = table;
+}
+
+
 /*************************************************************************
  *		find_named_export
  *
@@ -743,17 +910,42 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 {
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
+    const struct export_hash *table;
+    WINE_MODREF *wm;
     int min = 0, max = exports->NumberOfNames - 1;
 
+    loader_stats.export_lookups++;
+
     /* first check the hint */
     if (hint >= 0 && hint <= max)
     {
         char *ename = get_rva( module, names[hint] );
         if (!strcmp( ename, name ))
+        {
+            loader_stats.export_hint_hits++;
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
+        }
+    }
+
+    /* then the name index if the module has one */
+    if ((wm = get_modref( module )) && (table = get_export_hash( wm, exports )))
+    {
+        ULONG hash = hash_export_name( name ), pos;
+
+        for (pos = hash & table->mask; table->entries[pos].index; pos = (pos + 1) & table->mask)
+        {
+            ULONG index = table->entries[pos].index - 1;
+
+            if (table->entries[pos].hash != hash) continue;
+            if (strcmp( get_rva( module, names[index] ), name )) continue;
+            loader_stats.export_hash_hits++;
+            return find_ordinal_export( module, exports, exp_size, ordinals[index], load_path );
+        }
+        return NULL;
     }
 
     /* then do a binary search */
+    loader_stats.export_searches++;
     while (min <= max)
     {
         int res, pos = (min + max) / 2;
@@ -1126,6 +1318,109 @@ static NTSTATUS fixup_imports_ilonly( WINE_MODREF *wm, LPCWSTR load_path, void *
 }
 
 
+/* returns a timestamp in 100ns units if the loadtime channel is enabled */
+static inline ULONGLONG loader_time(void)
+{
+    LARGE_INTEGER counter;
+
+    if (!TRACE_ON(loadtime)) return 0;
+    NtQueryPerformanceCounter( &counter, NULL );
+    return counter.QuadPart;
+}
+
+
+/*************************************************************************
+ *		prefetch_dll_file
+ *
+ * Find a dll in the search path and ask the kernel to start reading it.
+ * Nothing is mapped here, load_dll() will search for the file again.
+ */
+static void prefetch_dll_file( LPCWSTR paths, LPCWSTR search )
+{
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING nt_name;
+    IO_STATUS_BLOCK io;
+    HANDLE handle;
+    WCHAR *name;
+    ULONG len = wcslen( paths ) + wcslen( search ) + 2;
+    int fd, needs_close;
+
+    if (!(name = RtlAllocateHeap( GetProcessHeap(), 0, len * sizeof(WCHAR) ))) return;
+
+    attr.Length = sizeof(attr);
+    attr.RootDirectory = 0;
+    attr.Attributes = OBJ_CASE_INSENSITIVE;
+    attr.ObjectName = &nt_name;
+    attr.SecurityDescriptor = NULL;
+    attr.SecurityQualityOfService = NULL;
+
+    while (*paths)
+    {
+        LPCWSTR ptr = paths;
+
+        while (*ptr && *ptr != ';') ptr++;
+        len = ptr - paths;
+        if (*ptr == ';') ptr++;
+        memcpy( name, paths, len * sizeof(WCHAR) );
+        if (len && name[len - 1] != '\\') name[len++] = '\\';
+        wcscpy( name + len, search );
+        paths = ptr;
+
+        if (RtlDosPathNameToNtPathName_U_WithStatus( name, &nt_name, NULL, NULL )) continue;
+        if (!NtOpenFile( &handle, GENERIC_READ | SYNCHRONIZE, &attr, &io,
+                         FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                         FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE ))
+        {
+            if (!server_get_unix_fd( handle, 0, &fd, &needs_close, NULL, NULL ))
+            {
+                TRACE( "reading ahead %s\n", debugstr_us(&nt_name) );
+#ifdef POSIX_FADV_WILLNEED
+                posix_fadvise( fd, 0, 0, POSIX_FADV_WILLNEED );
+#endif
+                if (needs_close) close( fd );
+            }
+            NtClose( handle );
+            RtlFreeUnicodeString( &nt_name );
+            break;
+        }
+        RtlFreeUnicodeString( &nt_name );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, name );
+}
+
+
+/*************************************************************************
+ *		prefetch_imports
+ *
+ * Start reading the files of the dependencies of a module that aren't loaded
+ * yet, so that the disk I/O for all of them overlaps instead of happening
+ * one dll at a time while they are mapped and relocated.
+ * The loader_section must be locked while calling this function.
+ */
+static void prefetch_imports( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *imports,
+                              int nb_imports, LPCWSTR load_path )
+{
+    WCHAR buffer[64];
+    ULONG count = 0;
+    int i;
+
+    for (i = 0; i < nb_imports && count < max_loader_threads; i++)
+    {
+        const char *name = get_rva( module, imports[i].Name );
+        DWORD len = strlen( name );
+
+        while (len && name[len-1] == ' ') len--;
+        if (len >= ARRAY_SIZE(buffer)) continue;
+        ascii_to_unicode( buffer, name, len );
+        buffer[len] = 0;
+        if (contains_path( buffer ) || find_basename_module( buffer )) continue;
+
+        prefetch_dll_file( load_path, buffer );
+        count++;
+    }
+}
+
+
 /****************************************************************
  *       fixup_imports
  *
@@ -1140,6 +1435,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     DWORD size;
     NTSTATUS status;
     ULONG_PTR cookie;
+    ULONGLONG start, outer_child_time;
 
     if (!(wm->ldr.Flags & LDR_DONT_RESOLVE_REFS)) return STATUS_SUCCESS;  /* already done */
     wm->ldr.Flags &= ~LDR_DONT_RESOLVE_REFS;
@@ -1159,12 +1455,22 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     if (!create_module_activation_context( &wm->ldr ))
         RtlActivateActivationContext( 0, wm->ldr.ActivationContext, &cookie );
 
+    if (max_loader_threads > 1 && !wm->ldr.ActivationContext)
+    {
+        start = loader_time();
+        prefetch_imports( wm->ldr.DllBase, imports, nb_imports, load_path );
+        wm->prefetch_time = loader_time() - start;
+    }
+
     /* load the imported modules. They are automatically
      * added to the modref list of the process.
      */
     prev = current_modref;
     current_modref = wm;
     status = STATUS_SUCCESS;
+    start = loader_time();
+    outer_child_time = child_load_time;
+    child_load_time = 0;
     for (i = 0; i < nb_imports; i++)
     {
         dep = wm->nDeps++;
@@ -1176,6 +1482,8 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
         }
         wm->deps[dep] = imp;
     }
+    wm->bind_time = loader_time() - start - child_load_time;
+    child_load_time += outer_child_time;
     current_modref = prev;
     if (wm->ldr.ActivationContext) RtlDeactivateActivationContext( 0, cookie );
     return status;
@@ -1214,6 +1522,9 @@ static WINE_MODREF *alloc_module( HMODULE hModule, const UNICODE_STRING *nt_name
     else p = buffer;
     RtlInitUnicodeString( &wm->ldr.FullDllName, buffer );
     RtlInitUnicodeString( &wm->ldr.BaseDllName, p );
+    hash_module( wm, MODULE_HASH_BASE, hash_module_base( hModule ));
+    hash_module( wm, MODULE_HASH_NAME, hash_module_name( &wm->ldr.BaseDllName ));
+    hash_module( wm, MODULE_HASH_PATH, hash_module_name( &wm->ldr.FullDllName ));
 
     if (!is_dll_native_subsystem( &wm->ldr, nt, p ))
     {
@@ -1518,13 +1829,22 @@ static NTSTATUS process_attach( WINE_MODREF *wm, LPVOID lpReserved )
     if (status == STATUS_SUCCESS)
     {
         WINE_MODREF *prev = current_modref;
+        ULONGLONG start;
+
         current_modref = wm;
 
         call_ldr_notifications( LDR_DLL_NOTIFICATION_REASON_LOADED, &wm->ldr );
+        start = loader_time();
         status = MODULE_InitDLL( wm, DLL_PROCESS_ATTACH, lpReserved );
         if (status == STATUS_SUCCESS)
         {
             wm->ldr.Flags |= LDR_PROCESS_ATTACHED;
+            TRACE_(loadtime)( "%s: map %u us, relocate %u us, read ahead %u us, imports %u us, "
+                              "init %u us\n",
+                              debugstr_w(wm->ldr.BaseDllName.Buffer),
+                              (unsigned int)(wm->map_time / 10), (unsigned int)(wm->reloc_time / 10),
+                              (unsigned int)(wm->prefetch_time / 10), (unsigned int)(wm->bind_time / 10),
+                              (unsigned int)((loader_time() - start) / 10) );
         }
         else
         {
@@ -1886,6 +2206,7 @@ static NTSTATUS build_so_dll_module( const WCHAR *load_path, const UNICODE_STRIN
             /* the module has only been inserted in the load & memory order lists */
             RemoveEntryList(&wm->ldr.InLoadOrderLinks);
             RemoveEntryList(&wm->ldr.InMemoryOrderLinks);
+            unhash_module( wm );
             /* FIXME: free the modref */
             return status;
         }
@@ -2394,21 +2715,25 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, const UNICODE_STRING *nt_nam
     IMAGE_NT_HEADERS *nt = RtlImageNtHeader( *module );
     WINE_MODREF *wm;
     NTSTATUS status;
+    ULONGLONG start;
     const char *dll_type = (image_info->image_flags & IMAGE_FLAGS_WineBuiltin) ? "PE builtin" : "native";
 
     TRACE("Trying %s dll %s\n", dll_type, debugstr_us(nt_name) );
 
     /* perform base relocation, if necessary */
 
+    start = loader_time();
     if ((status = perform_relocations( *module, nt, image_info->map_size ))) return status;
 
     /* create the MODREF */
 
     if (!(wm = alloc_module( *module, nt_name, (image_info->image_flags & IMAGE_FLAGS_WineBuiltin) )))
         return STATUS_NO_MEMORY;
+    wm->reloc_time = loader_time() - start;
 
     wm->dev = st->st_dev;
     wm->ino = st->st_ino;
+    hash_module( wm, MODULE_HASH_FILEID, hash_module_fileid( wm->dev, wm->ino ));
     if (image_info->loader_flags) wm->ldr.Flags |= LDR_COR_IMAGE;
     if (image_info->image_flags & IMAGE_FLAGS_ComPlusILOnly) wm->ldr.Flags |= LDR_COR_ILONLY;
 
@@ -2429,6 +2754,7 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, const UNICODE_STRING *nt_nam
             /* the module has only be inserted in the load & memory order lists */
             RemoveEntryList(&wm->ldr.InLoadOrderLinks);
             RemoveEntryList(&wm->ldr.InMemoryOrderLinks);
+            unhash_module( wm );
 
             /* FIXME: there are several more dangling references
              * left. Including dlls loaded by this dll before the
@@ -3038,13 +3364,16 @@ static NTSTATUS load_dll( const WCHAR *load_path, const WCHAR *libname, const WC
     void *module;
     pe_image_info_t image_info;
     NTSTATUS nts;
+    ULONGLONG start = loader_time(), outer_child_time = child_load_time;
 
     TRACE( "looking for %s in %s\n", debugstr_w(libname), debugstr_w(load_path) );
 
+    child_load_time = 0;
     nts = find_dll_file( load_path, libname, default_ext, &nt_name, pwm, &module, &image_info, &st );
 
     if (*pwm)  /* found already loaded module */
     {
+        child_load_time = outer_child_time + loader_time() - start;
         if ((*pwm)->ldr.LoadCount != -1) (*pwm)->ldr.LoadCount++;
 
         TRACE("Found %s for %s at %p, count=%d\n",
@@ -3153,9 +3482,19 @@ static NTSTATUS load_dll( const WCHAR *load_path, const WCHAR *libname, const WC
 
 done:
     if (nts == STATUS_SUCCESS)
+    {
+        ULONGLONG total = loader_time() - start;
+
         TRACE("Loaded module %s at %p\n", debugstr_us(&nt_name), (*pwm)->ldr.DllBase);
+        (*pwm)->map_time = total - child_load_time - (*pwm)->reloc_time - (*pwm)->prefetch_time -
+                           (*pwm)->bind_time;
+        child_load_time = outer_child_time + total;
+    }
     else
+    {
         WARN("Failed to load module %s; status=%x\n", debugstr_w(libname), nts);
+        child_load_time = outer_child_time + loader_time() - start;
+    }
 
     RtlFreeUnicodeString( &nt_name );
     return nts;
@@ -3578,6 +3917,13 @@ void WINAPI LdrShutdownProcess(void)
     TRACE("()\n");
     process_detaching = TRUE;
     process_detach();
+    heap_process_detach();
+    heap_dump_statistics();
+    TRACE( "module lookups %u, cache hits %u, hash probes %u\n", loader_stats.module_lookups,
+           loader_stats.module_cache_hits, loader_stats.module_probes );
+    TRACE( "export lookups %u, hint hits %u, index hits %u, searches %u, indexes %u\n",
+           loader_stats.export_lookups, loader_stats.export_hint_hits, loader_stats.export_hash_hits,
+           loader_stats.export_searches, loader_stats.export_indexes );
 }
 
 
@@ -3649,6 +3995,7 @@ static void free_modref( WINE_MODREF *wm )
 {
     RemoveEntryList(&wm->ldr.InLoadOrderLinks);
     RemoveEntryList(&wm->ldr.InMemoryOrderLinks);
+    unhash_module( wm );
     if (wm->ldr.InInitializationOrderLinks.Flink)
         RemoveEntryList(&wm->ldr.InInitializationOrderLinks);
 
@@ -3671,6 +4018,7 @@ static void free_modref( WINE_MODREF *wm )
     NtUnmapViewOfSection( NtCurrentProcess(), wm->ldr.DllBase );
     if (cached_modref == wm) cached_modref = NULL;
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_hash );
     RtlFreeHeap( GetProcessHeap(), 0, wm->deps );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
 }
@@ -3921,6 +4269,7 @@ static void load_global_options(void)
     static const WCHAR heapcommitW[] = {'H','e','a','p','S','e','g','m','e','n','t','C','o','m','m','i','t',0};
     static const WCHAR decommittotalW[] = {'H','e','a','p','D','e','C','o','m','m','i','t','T','o','t','a','l','F','r','e','e','T','h','r','e','s','h','o','l','d',0};
     static const WCHAR decommitfreeW[] = {'H','e','a','p','D','e','C','o','m','m','i','t','F','r','e','e','B','l','o','c','k','T','h','r','e','s','h','o','l','d',0};
+    static const WCHAR maxthreadsW[] = {'M','a','x','L','o','a','d','e','r','T','h','r','e','a','d','s',0};
 
     OBJECT_ATTRIBUTES attr;
     UNICODE_STRING name_str;
@@ -3961,6 +4310,9 @@ static void load_global_options(void)
     LdrQueryImageFileExecutionOptions( &NtCurrentTeb()->Peb->ProcessParameters->ImagePathName,
                                        globalflagW, REG_DWORD, &NtCurrentTeb()->Peb->NtGlobalFlag,
                                        sizeof(DWORD), NULL );
+    LdrQueryImageFileExecutionOptions( &NtCurrentTeb()->Peb->ProcessParameters->ImagePathName,
+                                       maxthreadsW, REG_DWORD, &max_loader_threads,
+                                       sizeof(DWORD), NULL );
     heap_set_debug_flags( GetProcessHeap() );
 }
 
@@ -94,6 +94,7 @@
 #include "ddk/wdm.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(server);
+WINE_DECLARE_DEBUG_CHANNEL(fdcache);
 
 /* Some versions of glibc don't define this */
 #ifndef SCM_RIGHTS
@@ -146,6 +147,15 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
 };
 static RTL_CRITICAL_SECTION fd_cache_section = { &critsect_debug, -1, 0, 0, 0, 0 };
 
+static RTL_CRITICAL_SECTION sync_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG sync_cache_section_debug =
+{
+    0, 0, &sync_cache_section,
+    { &sync_cache_section_debug.ProcessLocksList, &sync_cache_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": sync_cache_section") }
+};
+static RTL_CRITICAL_SECTION sync_cache_section = { &sync_cache_section_debug, -1, 0, 0, 0, 0 };
+
 /* atomically exchange a 64-bit value */
 static inline LONG64 interlocked_xchg64( LONG64 *dest, LONG64 val )
 {
@@ -923,6 +933,11 @@ C_ASSERT( sizeof(union fd_cache_entry) == sizeof(LONG64) );
 static union fd_cache_entry *fd_cache[FD_CACHE_ENTRIES];
 static union fd_cache_entry fd_cache_initial_block[FD_CACHE_BLOCK_SIZE];
 
+/* cache statistics, only maintained while the fdcache channel is enabled */
+static LONG fd_cache_hits;
+static LONG fd_cache_misses;
+static LONG fd_cache_uncached;
+
 static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
 {
     unsigned int idx = (wine_server_obj_handle(handle) >> 2) - 1;
@@ -1033,11 +1048,19 @@ int server_get_unix_fd( HANDLE handle, unsigned int wanted_access, int *unix_fd,
     wanted_access &= FILE_READ_DATA | FILE_WRITE_DATA | FILE_APPEND_DATA;
 
     ret = get_cached_fd( handle, &fd, type, &access, options );
-    if (ret != STATUS_INVALID_HANDLE) goto done;
+    if (ret != STATUS_INVALID_HANDLE)
+    {
+        if (TRACE_ON(fdcache)) InterlockedIncrement( &fd_cache_hits );
+        goto done;
+    }
 
     server_enter_uninterrupted_section( &fd_cache_section, &sigset );
     ret = get_cached_fd( handle, &fd, type, &access, options );
-    if (ret == STATUS_INVALID_HANDLE)
+    if (ret != STATUS_INVALID_HANDLE)
+    {
+        if (TRACE_ON(fdcache)) InterlockedIncrement( &fd_cache_hits );
+    }
+    else
     {
         SERVER_START_REQ( get_handle_fd )
         {
@@ -1062,6 +1085,13 @@ int server_get_unix_fd( HANDLE handle, unsigned int wanted_access, int *unix_fd,
             }
         }
         SERVER_END_REQ;
+
+        if (TRACE_ON(fdcache))
+        {
+            if (*needs_close) InterlockedIncrement( &fd_cache_uncached );
+            TRACE_(fdcache)( "miss for %p status %08x, %d hits %d misses %d uncached\n", handle, ret,
+                             fd_cache_hits, InterlockedIncrement( &fd_cache_misses ), fd_cache_uncached );
+        }
     }
     server_leave_uninterrupted_section( &fd_cache_section, &sigset );
 
@@ -1076,6 +1106,191 @@ done:
 }
 
 
+/***********************************************************************/
+/* sync state cache support */
+
+union sync_cache_entry
+{
+    LONG64 data;
+    struct
+    {
+        unsigned int            id;          /* object id stored in the state entry */
+        unsigned int            index : 24;  /* index of the state entry, 0 if not published */
+        enum sync_state_type    type : 2;
+        unsigned int            modify : 1;  /* handle has the modify state access right */
+        unsigned int            wait : 1;    /* handle has the synchronize access right */
+        unsigned int            valid : 1;
+    } s;
+};
+
+C_ASSERT( sizeof(union sync_cache_entry) == sizeof(LONG64) );
+
+static union sync_cache_entry *sync_cache[FD_CACHE_ENTRIES];
+static const struct sync_state *sync_states;
+
+static inline int read_sync_state( const int *ptr )
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return *(const volatile int *)ptr;
+#else
+    return __atomic_load_n( ptr, __ATOMIC_SEQ_CST );
+#endif
+}
+
+/***********************************************************************
+ *           map_sync_states
+ *
+ * Map the state entries published by the server.
+ * Caller must hold sync_cache_section.
+ */
+static void map_sync_states( obj_handle_t handle )
+{
+    int fd, needs_close;
+    void *ptr;
+
+    if (!server_get_unix_fd( wine_server_ptr_handle( handle ), 0, &fd, &needs_close, NULL, NULL ))
+    {
+        ptr = mmap( NULL, SYNC_STATE_ENTRIES * sizeof(*sync_states), PROT_READ, MAP_SHARED, fd, 0 );
+        if (ptr != MAP_FAILED) sync_states = ptr;
+        if (needs_close) close( fd );
+    }
+    close_handle( wine_server_ptr_handle( handle ));
+}
+
+/***********************************************************************
+ *           add_sync_to_cache
+ *
+ * Caller must hold sync_cache_section.
+ */
+static void add_sync_to_cache( HANDLE handle, union sync_cache_entry cache )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+
+    if (entry >= FD_CACHE_ENTRIES) return;
+    if (!sync_cache[entry])
+    {
+        void *ptr = wine_anon_mmap( NULL, FD_CACHE_BLOCK_SIZE * sizeof(union sync_cache_entry),
+                                    PROT_READ | PROT_WRITE, 0 );
+        if (ptr == MAP_FAILED) return;
+        sync_cache[entry] = ptr;
+    }
+    interlocked_xchg64( &sync_cache[entry][idx].data, cache.data );
+}
+
+/***********************************************************************
+ *           query_sync_state
+ *
+ * Ask the server where the state of an object is published.
+ * Caller must hold sync_cache_section.
+ */
+static LONG64 query_sync_state( HANDLE handle )
+{
+    union sync_cache_entry cache;
+    obj_handle_t mapping = 0;
+    NTSTATUS ret;
+
+    cache.data = 0;
+    SERVER_START_REQ( get_sync_state )
+    {
+        req->handle = wine_server_obj_handle( handle );
+        req->want_mapping = !sync_states;
+        if (!(ret = wine_server_call( req )))
+        {
+            cache.s.id     = reply->id;
+            cache.s.index  = reply->index;
+            cache.s.type   = reply->type;
+            cache.s.modify = !!(reply->access & EVENT_MODIFY_STATE);
+            cache.s.wait   = !!(reply->access & SYNCHRONIZE);
+            cache.s.valid  = 1;
+            mapping = reply->mapping;
+        }
+    }
+    SERVER_END_REQ;
+
+    if (mapping) map_sync_states( mapping );
+    if (!ret) add_sync_to_cache( handle, cache );
+    return cache.data;
+}
+
+/***********************************************************************
+ *           get_cached_sync_state
+ */
+static inline LONG64 get_cached_sync_state( HANDLE handle )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+
+    if (entry >= FD_CACHE_ENTRIES || !sync_cache[entry]) return 0;
+    return InterlockedCompareExchange64( &sync_cache[entry][idx].data, 0, 0 );
+}
+
+/***********************************************************************
+ *           server_cache_sync_state
+ *
+ * Remember where the state of an event or semaphore is published, as returned
+ * by an operation on it. Must not be called inside another server request.
+ */
+void server_cache_sync_state( HANDLE handle, enum sync_state_type type, unsigned int access,
+                              unsigned int index, unsigned int id )
+{
+    union sync_cache_entry cache;
+    sigset_t sigset;
+
+    if (!index || get_cached_sync_state( handle )) return;
+
+    server_enter_uninterrupted_section( &sync_cache_section, &sigset );
+    if (!sync_states) query_sync_state( handle );  /* the state mapping is needed first */
+    else
+    {
+        cache.data     = 0;
+        cache.s.id     = id;
+        cache.s.index  = index;
+        cache.s.type   = type;
+        cache.s.modify = !!(access & EVENT_MODIFY_STATE);
+        cache.s.wait   = !!(access & SYNCHRONIZE);
+        cache.s.valid  = 1;
+        add_sync_to_cache( handle, cache );
+    }
+    server_leave_uninterrupted_section( &sync_cache_section, &sigset );
+}
+
+/***********************************************************************
+ *           server_get_sync_state
+ *
+ * Get the published state of an event or semaphore. Fails if the handle has
+ * not been cached by a previous operation, lacks the requested access, or the
+ * object is gone; the server has to be called in that case.
+ */
+BOOL server_get_sync_state( HANDLE handle, ACCESS_MASK access, enum sync_state_type *type, int *state )
+{
+    const struct sync_state *entry;
+    union sync_cache_entry cache;
+
+    if (!(cache.data = get_cached_sync_state( handle ))) return FALSE;
+    if (!cache.s.index || !sync_states) return FALSE;
+    if ((access & EVENT_MODIFY_STATE) && !cache.s.modify) return FALSE;
+    if ((access & SYNCHRONIZE) && !cache.s.wait) return FALSE;
+
+    /* the entry may be reused for another object at any time, check the id on both sides */
+    entry = &sync_states[cache.s.index];
+    if ((unsigned int)read_sync_state( (const int *)&entry->id ) != cache.s.id) return FALSE;
+    *state = read_sync_state( &entry->state );
+    if ((unsigned int)read_sync_state( (const int *)&entry->id ) != cache.s.id) return FALSE;
+    *type = cache.s.type;
+    return TRUE;
+}
+
+/***********************************************************************
+ *           server_remove_sync_from_cache
+ */
+void server_remove_sync_from_cache( HANDLE handle )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+
+    if (entry < FD_CACHE_ENTRIES && sync_cache[entry])
+        interlocked_xchg64( &sync_cache[entry][idx].data, 0 );
+}
+
+
 /***********************************************************************
  *           wine_server_fd_to_handle   (NTDLL.@)
  *
@@ -338,6 +338,7 @@ NTSTATUS WINAPI NtQuerySemaphore( HANDLE handle, SEMAPHORE_INFORMATION_CLASS cla
  */
 NTSTATUS WINAPI NtReleaseSemaphore( HANDLE handle, ULONG count, PULONG previous )
 {
+    unsigned int access = 0, index = 0, id = 0;
     NTSTATUS ret;
     SERVER_START_REQ( release_semaphore )
     {
@@ -346,9 +347,13 @@ NTSTATUS WINAPI NtReleaseSemaphore( HANDLE handle, ULONG count, PULONG previous
         if (!(ret = wine_server_call( req )))
         {
             if (previous) *previous = reply->prev_count;
+            access = reply->access;
+            index  = reply->index;
+            id     = reply->id;
         }
     }
     SERVER_END_REQ;
+    if (index) server_cache_sync_state( handle, SYNC_STATE_SEMAPHORE, access, index, id );
     return ret;
 }
 
@@ -415,15 +420,34 @@ NTSTATUS WINAPI NtOpenEvent( HANDLE *handle, ACCESS_MASK access, const OBJECT_AT
  */
 NTSTATUS WINAPI NtSetEvent( HANDLE handle, LONG *prev_state )
 {
+    unsigned int access = 0, index = 0, id = 0;
+    enum sync_state_type type;
     NTSTATUS ret;
+    int state;
+
+    /* setting a signaled event doesn't change anything */
+    if (server_get_sync_state( handle, EVENT_MODIFY_STATE, &type, &state ) &&
+        type != SYNC_STATE_SEMAPHORE && state)
+    {
+        if (prev_state) *prev_state = 1;
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
         req->op     = SET_EVENT;
-        ret = wine_server_call( req );
-        if (!ret && prev_state) *prev_state = reply->state;
+        if (!(ret = wine_server_call( req )))
+        {
+            if (prev_state) *prev_state = reply->state;
+            type   = reply->manual_reset ? SYNC_STATE_MANUAL_EVENT : SYNC_STATE_AUTO_EVENT;
+            access = reply->access;
+            index  = reply->index;
+            id     = reply->id;
+        }
     }
     SERVER_END_REQ;
+    if (index) server_cache_sync_state( handle, type, access, index, id );
     return ret;
 }
 
@@ -432,15 +456,34 @@ NTSTATUS WINAPI NtSetEvent( HANDLE handle, LONG *prev_state )
  */
 NTSTATUS WINAPI NtResetEvent( HANDLE handle, LONG *prev_state )
 {
+    unsigned int access = 0, index = 0, id = 0;
+    enum sync_state_type type;
     NTSTATUS ret;
+    int state;
+
+    /* neither does resetting a non-signaled one */
+    if (server_get_sync_state( handle, EVENT_MODIFY_STATE, &type, &state ) &&
+        type != SYNC_STATE_SEMAPHORE && !state)
+    {
+        if (prev_state) *prev_state = 0;
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
         req->op     = RESET_EVENT;
-        ret = wine_server_call( req );
-        if (!ret && prev_state) *prev_state = reply->state;
+        if (!(ret = wine_server_call( req )))
+        {
+            if (prev_state) *prev_state = reply->state;
+            type   = reply->manual_reset ? SYNC_STATE_MANUAL_EVENT : SYNC_STATE_AUTO_EVENT;
+            access = reply->access;
+            index  = reply->index;
+            id     = reply->id;
+        }
     }
     SERVER_END_REQ;
+    if (index) server_cache_sync_state( handle, type, access, index, id );
     return ret;
 }
 
@@ -1121,6 +1164,17 @@ NTSTATUS WINAPI NtWaitForMultipleObjects( DWORD count, const HANDLE *handles,
  */
 NTSTATUS WINAPI NtWaitForSingleObject(HANDLE handle, BOOLEAN alertable, const LARGE_INTEGER *timeout )
 {
+    enum sync_state_type type;
+    int state;
+
+    /* polling a known event or semaphore doesn't need the server,
+     * unless the wait would change the object state */
+    if (!alertable && timeout && !timeout->QuadPart &&
+        server_get_sync_state( handle, SYNCHRONIZE, &type, &state ))
+    {
+        if (!state) return STATUS_TIMEOUT;
+        if (type == SYNC_STATE_MANUAL_EVENT) return STATUS_SUCCESS;
+    }
     return wait_objects( 1, &handle, FALSE, alertable, timeout );
 }
 
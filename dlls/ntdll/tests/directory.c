@@ -829,6 +829,87 @@ done:
     pRtlFreeUnicodeString(&ntdirname);
 }
 
+static void test_case_insensitive_lookup(void)
+{
+    char testdir[MAX_PATH], path[MAX_PATH], path2[MAX_PATH];
+    unsigned int i, pass;
+    HANDLE file;
+    DWORD attrs;
+    BOOL ret;
+
+    GetTempPathA(MAX_PATH, testdir);
+    strcat(testdir, "lookup.tmp");
+    ret = CreateDirectoryA(testdir, NULL);
+    ok(ret || GetLastError() == ERROR_ALREADY_EXISTS, "CreateDirectory failed, error %u\n", GetLastError());
+
+    for (i = 0; i < 200; i++)
+    {
+        sprintf(path, "%s\\File%03u.txt", testdir, i);
+        file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+        ok(file != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", path, GetLastError());
+        CloseHandle(file);
+    }
+
+    /* Wine doesn't cache the contents of directories modified in the last two seconds */
+    Sleep(2500);
+
+    /* repeated lookups with a different case, served from the cache after the first one */
+    for (pass = 0; pass < 2; pass++)
+    {
+        for (i = 0; i < 200; i++)
+        {
+            sprintf(path, "%s\\FILE%03u.TXT", testdir, i);
+            attrs = GetFileAttributesA(path);
+            ok(attrs != INVALID_FILE_ATTRIBUTES, "%s not found, error %u\n", path, GetLastError());
+        }
+        sprintf(path, "%s\\MISSING.TXT", testdir);
+        attrs = GetFileAttributesA(path);
+        ok(attrs == INVALID_FILE_ATTRIBUTES, "%s found\n", path);
+        sprintf(path, "%s\\Missing long file name.txt", testdir);
+        attrs = GetFileAttributesA(path);
+        ok(attrs == INVALID_FILE_ATTRIBUTES, "%s found\n", path);
+        ok(GetLastError() == ERROR_FILE_NOT_FOUND, "got error %u\n", GetLastError());
+        sprintf(path, "%s\\Missing long file name.txt\\file", testdir);
+        attrs = GetFileAttributesA(path);
+        ok(attrs == INVALID_FILE_ATTRIBUTES, "%s found\n", path);
+        ok(GetLastError() == ERROR_PATH_NOT_FOUND, "got error %u\n", GetLastError());
+    }
+
+    /* changes made after the lookups must be visible */
+    sprintf(path, "%s\\NewFile.txt", testdir);
+    file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", path, GetLastError());
+    CloseHandle(file);
+    sprintf(path, "%s\\NEWFILE.TXT", testdir);
+    attrs = GetFileAttributesA(path);
+    ok(attrs != INVALID_FILE_ATTRIBUTES, "%s not found, error %u\n", path, GetLastError());
+
+    ret = DeleteFileA(path);
+    ok(ret, "DeleteFile failed, error %u\n", GetLastError());
+    attrs = GetFileAttributesA(path);
+    ok(attrs == INVALID_FILE_ATTRIBUTES, "%s found after deletion\n", path);
+
+    sprintf(path, "%s\\FILE000.TXT", testdir);
+    sprintf(path2, "%s\\Renamed.txt", testdir);
+    ret = MoveFileA(path, path2);
+    ok(ret, "MoveFile failed, error %u\n", GetLastError());
+    attrs = GetFileAttributesA(path);
+    ok(attrs == INVALID_FILE_ATTRIBUTES, "%s found after rename\n", path);
+    sprintf(path, "%s\\RENAMED.TXT", testdir);
+    attrs = GetFileAttributesA(path);
+    ok(attrs != INVALID_FILE_ATTRIBUTES, "%s not found, error %u\n", path, GetLastError());
+    DeleteFileA(path);
+
+    for (i = 1; i < 200; i++)
+    {
+        sprintf(path, "%s\\file%03u.TXT", testdir, i);
+        ret = DeleteFileA(path);
+        ok(ret, "failed to delete %s, error %u\n", path, GetLastError());
+    }
+    ret = RemoveDirectoryA(testdir);
+    ok(ret, "RemoveDirectory failed, error %u\n", GetLastError());
+}
+
 static void test_redirection(void)
 {
     ULONG old, cur;
@@ -907,5 +988,6 @@ START_TEST(directory)
     test_directory_sort( sysdir );
     test_NtQueryDirectoryFile();
     test_NtQueryDirectoryFile_case();
+    test_case_insensitive_lookup();
     test_redirection();
 }
@@ -3666,6 +3666,236 @@ static void test_file_completion_information(void)
     CloseHandle(h);
 }
 
+#define SPARSE_STRIDE (4 * 1024 * 1024)  /* far enough apart to stay out of each other's readahead */
+
+/* create a file made of holes, reading them can't be satisfied from the page cache */
+static HANDLE create_sparse_file( unsigned int blocks )
+{
+    LARGE_INTEGER size;
+    HANDLE h;
+    BOOL ret;
+
+    if (!(h = create_temp_file( FILE_FLAG_OVERLAPPED ))) return 0;
+    size.QuadPart = (LONGLONG)blocks * SPARSE_STRIDE;
+    ret = SetFilePointerEx( h, size, NULL, FILE_BEGIN );
+    ok( ret, "SetFilePointerEx failed, error %u\n", GetLastError() );
+    ret = SetEndOfFile( h );
+    ok( ret, "SetEndOfFile failed, error %u\n", GetLastError() );
+    return h;
+}
+
+/* read a block of a sparse file that hasn't been read before */
+static BOOL read_sparse_block( HANDLE h, unsigned int index, char *buffer, DWORD size,
+                               OVERLAPPED *ov, HANDLE event )
+{
+    ULONGLONG offset = (ULONGLONG)index * SPARSE_STRIDE;
+
+    memset( ov, 0, sizeof(*ov) );
+    ov->Offset     = (DWORD)offset;
+    ov->OffsetHigh = offset >> 32;
+    ov->hEvent     = event;
+    memset( buffer, 0xcc, size );
+    return ReadFile( h, buffer, size, NULL, ov );
+}
+
+/* Issue reads until one is queued instead of being completed synchronously; the
+ * first requests only start the thread handling the queued ones. Returns the
+ * index of the next unread block, or 0 if reads are never queued. */
+static unsigned int start_queued_reads( HANDLE h, char *buffer, HANDLE event )
+{
+    unsigned int index;
+    DWORD num_bytes;
+    OVERLAPPED ov;
+    BOOL ret;
+
+    for (index = 1; index <= 50; index++)
+    {
+        if (!read_sparse_block( h, index, buffer, 4096, &ov, (HANDLE)((ULONG_PTR)event | 1) ))
+        {
+            ok( GetLastError() == ERROR_IO_PENDING, "ReadFile failed, error %u\n", GetLastError() );
+            ret = GetOverlappedResult( h, &ov, &num_bytes, TRUE );
+            ok( ret, "GetOverlappedResult failed, error %u\n", GetLastError() );
+            return index + 1;
+        }
+        Sleep( 10 );
+    }
+    return 0;
+}
+
+static void test_overlapped_queue_depth(void)
+{
+    enum { BLOCK_SIZE = 4096, DEPTH = 128 };
+    static const char zero[BLOCK_SIZE];
+    OVERLAPPED ov[DEPTH], *pov;
+    HANDLE events[DEPTH], port, h;
+    unsigned int i, first, idx;
+    BOOL seen[DEPTH] = { 0 };
+    DWORD num_bytes;
+    ULONG_PTR key;
+    char *data;
+    BOOL ret;
+
+    if (!(h = create_sparse_file( DEPTH + 64 ))) return;
+    port = CreateIoCompletionPort(h, NULL, 0xdeadbeef, 0);
+    ok(port != NULL, "CreateIoCompletionPort failed, error %u\n", GetLastError());
+    data = HeapAlloc(GetProcessHeap(), 0, DEPTH * BLOCK_SIZE);
+    for (i = 0; i < DEPTH; i++) events[i] = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+    if (!(first = start_queued_reads(h, data, events[0])))
+    {
+        skip("overlapped reads are completed synchronously\n");
+        goto done;
+    }
+
+    /* all the requests are in flight at the same time */
+    for (i = 0; i < DEPTH; i++)
+    {
+        ret = read_sparse_block(h, first + i, data + i * BLOCK_SIZE, BLOCK_SIZE, &ov[i], events[i]);
+        ok(!ret && GetLastError() == ERROR_IO_PENDING, "%u: got %d, error %u\n", i, ret, GetLastError());
+    }
+    for (i = 0; i < DEPTH; i++)
+    {
+        ret = GetQueuedCompletionStatus(port, &num_bytes, &key, &pov, 5000);
+        ok(ret, "GetQueuedCompletionStatus failed, error %u\n", GetLastError());
+        if (!ret) break;
+        idx = pov - ov;
+        ok(idx < DEPTH && !seen[idx], "unexpected overlapped %p\n", pov);
+        if (idx >= DEPTH) continue;
+        seen[idx] = TRUE;
+        ok(key == 0xdeadbeef, "got key %#lx\n", key);
+        ok(num_bytes == BLOCK_SIZE, "read %u bytes\n", num_bytes);
+        ok(ov[idx].Internal == STATUS_SUCCESS, "got status %#lx\n", ov[idx].Internal);
+        ok(!memcmp(data + idx * BLOCK_SIZE, zero, BLOCK_SIZE), "%u: wrong data\n", idx);
+    }
+
+done:
+    for (i = 0; i < DEPTH; i++) CloseHandle(events[i]);
+    HeapFree(GetProcessHeap(), 0, data);
+    CloseHandle(port);
+    CloseHandle(h);
+}
+
+/* Issue reads and cancel them right away, either all of them or only the last one,
+ * and return the number of cancelled requests. Requests that complete before the
+ * cancel are reported normally, so the caller retries until one is cancelled. */
+static unsigned int cancel_reads( HANDLE h, unsigned int *index, char *data, DWORD size,
+                              OVERLAPPED *ov, unsigned int count, HANDLE event, BOOL last_only )
+{
+    unsigned int i, cancelled = 0;
+    IO_STATUS_BLOCK io;
+    DWORD num_bytes, error;
+    NTSTATUS status;
+    BOOL ret;
+
+    for (i = 0; i < count; i++)
+    {
+        ret = read_sparse_block( h, (*index)++, data + i * size, size, &ov[i], (HANDLE)((ULONG_PTR)event | 1) );
+        ok( !ret && GetLastError() == ERROR_IO_PENDING, "%u: got %d, error %u\n", i, ret, GetLastError() );
+    }
+    if (last_only)
+    {
+        status = pNtCancelIoFileEx( h, (IO_STATUS_BLOCK *)&ov[count - 1], &io );
+        ok( status == STATUS_SUCCESS || status == STATUS_NOT_FOUND, "got %#x\n", status );
+    }
+    else
+    {
+        status = pNtCancelIoFile( h, &io );
+        ok( status == STATUS_SUCCESS, "got %#x\n", status );
+    }
+    ok( U(io).Status == status, "got iosb status %#x\n", U(io).Status );
+
+    for (i = 0; i < count; i++)
+    {
+        while (ov[i].Internal == STATUS_PENDING) Sleep( 1 );
+        ret = GetOverlappedResult( h, &ov[i], &num_bytes, FALSE );
+        error = GetLastError();
+        if (ov[i].Internal == STATUS_CANCELLED)
+        {
+            ok( !ret && error == ERROR_OPERATION_ABORTED, "%u: got %d, error %u\n", i, ret, error );
+            ok( !last_only || i == count - 1, "%u: request was cancelled\n", i );
+            cancelled++;
+        }
+        else
+        {
+            ok( ov[i].Internal == STATUS_SUCCESS, "%u: got status %#lx\n", i, ov[i].Internal );
+            ok( ret && num_bytes == size, "%u: got %d, read %u bytes\n", i, ret, num_bytes );
+        }
+    }
+    /* a request found by the cancel is always reported as cancelled */
+    if (last_only)
+        ok( (status == STATUS_SUCCESS) == (cancelled != 0), "got %#x with %u cancelled\n", status, cancelled );
+    return cancelled;
+}
+
+static void test_overlapped_cancel(void)
+{
+    enum { BLOCK_SIZE = 1024 * 1024, BLOCK_COUNT = 16, BLOCKS = 256 };
+    OVERLAPPED ov[BLOCK_COUNT], *pov;
+    unsigned int i, first, cancelled;
+    IO_STATUS_BLOCK io;
+    HANDLE event, port, h;
+    DWORD num_bytes;
+    NTSTATUS status;
+    ULONG_PTR key;
+    char *data;
+    BOOL ret;
+
+    if (!(h = create_sparse_file( BLOCKS ))) return;
+    port = CreateIoCompletionPort(h, NULL, 0xdeadbeef, 0);
+    ok(port != NULL, "CreateIoCompletionPort failed, error %u\n", GetLastError());
+    data = HeapAlloc(GetProcessHeap(), 0, BLOCK_COUNT * BLOCK_SIZE);
+    event = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+    memset(&ov[0], 0, sizeof(ov[0]));
+    ov[0].Offset = BLOCKS * SPARSE_STRIDE;
+    ov[0].hEvent = (HANDLE)((ULONG_PTR)event | 1);
+    ret = ReadFile(h, data, BLOCK_SIZE, NULL, &ov[0]);
+    if (!ret && GetLastError() == ERROR_IO_PENDING) ret = GetOverlappedResult(h, &ov[0], &num_bytes, TRUE);
+    ok(!ret && GetLastError() == ERROR_HANDLE_EOF, "got %d, error %u\n", ret, GetLastError());
+
+    if (!(first = start_queued_reads(h, data, event)))
+    {
+        skip("overlapped reads are completed synchronously\n");
+        goto done;
+    }
+
+    /* the event handle may be closed before the request completes */
+    for (i = 0; i < BLOCK_COUNT; i++)
+    {
+        ret = read_sparse_block(h, first++, data + i * BLOCK_SIZE, BLOCK_SIZE, &ov[i],
+                                CreateEventA(NULL, TRUE, FALSE, NULL));
+        ok(!ret && GetLastError() == ERROR_IO_PENDING, "%u: got %d, error %u\n", i, ret, GetLastError());
+        CloseHandle(ov[i].hEvent);
+    }
+    for (i = 0; i < BLOCK_COUNT; i++)
+    {
+        ret = GetQueuedCompletionStatus(port, &num_bytes, &key, &pov, 5000);
+        ok(ret, "GetQueuedCompletionStatus failed, error %u\n", GetLastError());
+        if (!ret) break;
+        ok(num_bytes == BLOCK_SIZE, "read %u bytes\n", num_bytes);
+    }
+
+    /* pending requests can be cancelled */
+    for (i = cancelled = 0; i < 5 && !cancelled; i++)
+        cancelled = cancel_reads(h, &first, data, BLOCK_SIZE, ov, BLOCK_COUNT, event, FALSE);
+    ok(cancelled, "NtCancelIoFile never cancelled a request\n");
+
+    for (i = cancelled = 0; i < 20 && !cancelled; i++)
+        cancelled = cancel_reads(h, &first, data, BLOCK_SIZE, ov, 2, event, TRUE);
+    ok(cancelled, "NtCancelIoFileEx never cancelled the request\n");
+
+    /* nothing left to cancel */
+    status = pNtCancelIoFileEx(h, (IO_STATUS_BLOCK *)&ov[1], &io);
+    ok(status == STATUS_NOT_FOUND, "NtCancelIoFileEx returned %#x\n", status);
+    ok(first < BLOCKS, "used %u blocks\n", first);
+
+done:
+    CloseHandle(event);
+    HeapFree(GetProcessHeap(), 0, data);
+    CloseHandle(port);
+    CloseHandle(h);
+}
+
 static void test_file_id_information(void)
 {
     BY_HANDLE_FILE_INFORMATION info;
@@ -5014,6 +5244,8 @@ START_TEST(file)
     test_file_link_information();
     test_file_disposition_information();
     test_file_completion_information();
+    test_overlapped_queue_depth();
+    test_overlapped_cancel();
     test_file_id_information();
     test_file_access_information();
     test_file_attribute_tag_information();
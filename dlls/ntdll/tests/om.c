@@ -1614,6 +1614,7 @@ static void test_event(void)
     UNICODE_STRING str;
     OBJECT_ATTRIBUTES attr;
     EVENT_BASIC_INFORMATION info;
+    DWORD ret;
     static const WCHAR eventName[] = {'\\','B','a','s','e','N','a','m','e','d','O','b','j','e','c','t','s','\\','t','e','s','t','E','v','e','n','t',0};
 
     pRtlInitUnicodeString(&str, eventName);
@@ -1670,7 +1671,49 @@ static void test_event(void)
     ok( status == STATUS_SUCCESS, "NtPulseEvent failed %08x\n", status );
     ok( prev_state == 1, "prev_state = %x\n", prev_state );
 
+    /* no-op operations must still check the handle access */
+    status = pNtSetEvent( Event, NULL );
+    ok( status == STATUS_SUCCESS, "NtSetEvent failed: %08x\n", status );
+    ret = WaitForSingleObject( Event, 0 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %08x\n", ret );
+
+    ret = DuplicateHandle( GetCurrentProcess(), Event, GetCurrentProcess(), &Event2,
+                           SYNCHRONIZE, FALSE, 0 );
+    ok( ret, "DuplicateHandle failed %u\n", GetLastError() );
+    status = pNtSetEvent( Event2, &prev_state );
+    ok( status == STATUS_ACCESS_DENIED, "NtSetEvent returned %08x\n", status );
+    status = pNtResetEvent( Event, NULL );
+    ok( status == STATUS_SUCCESS, "NtResetEvent failed: %08x\n", status );
+    ret = WaitForSingleObject( Event2, 0 );
+    ok( ret == WAIT_TIMEOUT, "WaitForSingleObject returned %08x\n", ret );
+    pNtClose( Event2 );
+
+    ret = DuplicateHandle( GetCurrentProcess(), Event, GetCurrentProcess(), &Event2,
+                           EVENT_MODIFY_STATE, FALSE, 0 );
+    ok( ret, "DuplicateHandle failed %u\n", GetLastError() );
+    status = pNtResetEvent( Event2, &prev_state );
+    ok( status == STATUS_SUCCESS, "NtResetEvent failed: %08x\n", status );
+    ok( !prev_state, "prev_state = %x\n", prev_state );
+    ret = WaitForSingleObject( Event2, 0 );
+    ok( ret == WAIT_FAILED && GetLastError() == ERROR_ACCESS_DENIED,
+        "WaitForSingleObject returned %08x error %u\n", ret, GetLastError() );
+    pNtClose( Event2 );
+
     pNtClose(Event);
+
+    status = pNtCreateSemaphore( &Event, GENERIC_ALL, NULL, 0, 2 );
+    ok( status == STATUS_SUCCESS, "NtCreateSemaphore failed %08x\n", status );
+    ret = WaitForSingleObject( Event, 0 );
+    ok( ret == WAIT_TIMEOUT, "WaitForSingleObject returned %08x\n", ret );
+    status = pNtReleaseSemaphore( Event, 2, NULL );
+    ok( status == STATUS_SUCCESS, "NtReleaseSemaphore failed %08x\n", status );
+    ret = WaitForSingleObject( Event, 0 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %08x\n", ret );
+    ret = WaitForSingleObject( Event, 0 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %08x\n", ret );
+    ret = WaitForSingleObject( Event, 0 );
+    ok( ret == WAIT_TIMEOUT, "WaitForSingleObject returned %08x\n", ret );
+    pNtClose( Event );
 }
 
 static const WCHAR keyed_nameW[] = {'\\','B','a','s','e','N','a','m','e','d','O','b','j','e','c','t','s',
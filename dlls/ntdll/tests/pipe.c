@@ -1646,6 +1646,209 @@ static void test_blocking(ULONG options)
     CloseHandle(thread);
 }
 
+static DWORD WINAPI byte_stream_writer(void *arg)
+{
+    static char buf[0x10000];
+    HANDLE pipe = arg;
+    DWORD i, num_bytes;
+    BOOL ret;
+
+    for (i = 0; i < 64; i++)
+    {
+        memset(buf, i, sizeof(buf));
+        ret = WriteFile(pipe, buf, sizeof(buf), &num_bytes, NULL);
+        ok(ret, "WriteFile failed, error %u\n", GetLastError());
+        ok(num_bytes == sizeof(buf), "num_bytes = %u\n", num_bytes);
+    }
+    return 0;
+}
+
+static void test_byte_stream(void)
+{
+    HANDLE server, client, thread;
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+    char buf[0x1000];
+    DWORD total = 0, num_bytes, avail, i;
+    BOOL ret;
+
+    create_pipe_pair(&server, &client, PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE, 4096);
+
+    /* large transfer through a synchronous byte mode pipe */
+    thread = CreateThread(NULL, 0, byte_stream_writer, client, 0, NULL);
+    while (total < 64 * 0x10000)
+    {
+        ret = ReadFile(server, buf, sizeof(buf), &num_bytes, NULL);
+        ok(ret, "ReadFile failed, error %u\n", GetLastError());
+        if (!ret || !num_bytes) break;
+        for (i = 0; i < num_bytes; i++)
+            if (buf[i] != (char)((total + i) / 0x10000)) break;
+        ok(i == num_bytes, "got wrong data at %u\n", total + i);
+        total += num_bytes;
+    }
+    ok(total == 64 * 0x10000, "total = %u\n", total);
+    WaitForSingleObject(thread, 10000);
+    CloseHandle(thread);
+
+    ret = WriteFile(client, "data", 4, &num_bytes, NULL);
+    ok(ret, "WriteFile failed, error %u\n", GetLastError());
+    ret = WriteFile(server, "data", 4, &num_bytes, NULL);
+    ok(ret, "WriteFile failed, error %u\n", GetLastError());
+
+    avail = 0xdeadbeef;
+    ret = PeekNamedPipe(server, buf, 2, &num_bytes, &avail, NULL);
+    ok(ret, "PeekNamedPipe failed, error %u\n", GetLastError());
+    ok(num_bytes == 2, "num_bytes = %u\n", num_bytes);
+    ok(avail == 4, "avail = %u\n", avail);
+    ok(!memcmp(buf, "da", 2), "got wrong data\n");
+
+    /* data not read by the client is lost on disconnect */
+    ret = DisconnectNamedPipe(server);
+    ok(ret, "DisconnectNamedPipe failed, error %u\n", GetLastError());
+
+    status = NtReadFile(client, NULL, NULL, NULL, &io, buf, sizeof(buf), NULL, NULL);
+    ok(status == STATUS_PIPE_DISCONNECTED, "status = %x\n", status);
+    status = NtWriteFile(client, NULL, NULL, NULL, &io, buf, 1, NULL, NULL);
+    ok(status == STATUS_PIPE_DISCONNECTED, "status = %x\n", status);
+
+    CloseHandle(client);
+    CloseHandle(server);
+}
+
+static DWORD WINAPI byte_stream_reader(void *arg)
+{
+    HANDLE pipe = arg;
+    char buf[16];
+    DWORD num_bytes;
+    BOOL ret;
+
+    Sleep(100);
+    ret = ReadFile(pipe, buf, sizeof(buf), &num_bytes, NULL);
+    ok(ret, "ReadFile failed, error %u\n", GetLastError());
+    ok(num_bytes == 4, "num_bytes = %u\n", num_bytes);
+    return 0;
+}
+
+/* start listening on a synchronous pipe without blocking */
+static void listen_nowait(HANDLE server)
+{
+    DWORD mode = PIPE_NOWAIT;
+    BOOL ret;
+
+    ret = SetNamedPipeHandleState(server, &mode, NULL, NULL);
+    ok(ret, "SetNamedPipeHandleState failed, error %u\n", GetLastError());
+    ret = ConnectNamedPipe(server, NULL);
+    ok(!ret && GetLastError() == ERROR_PIPE_LISTENING, "ConnectNamedPipe returned %x(%u)\n", ret, GetLastError());
+    mode = PIPE_WAIT;
+    ret = SetNamedPipeHandleState(server, &mode, NULL, NULL);
+    ok(ret, "SetNamedPipeHandleState failed, error %u\n", GetLastError());
+}
+
+static void test_byte_stream_state(void)
+{
+    HANDLE server, client, dup, thread, read, write;
+    DWORD num_bytes, avail, mode;
+    OVERLAPPED overlapped;
+    char buf[16];
+    BOOL ret;
+
+    create_pipe_pair(&server, &client, PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE, 4096);
+
+    /* zero-length reads don't consume anything */
+    ret = WriteFile(client, "data", 4, &num_bytes, NULL);
+    ok(ret, "WriteFile failed, error %u\n", GetLastError());
+    num_bytes = 0xdeadbeef;
+    ret = ReadFile(server, buf, 0, &num_bytes, NULL);
+    ok(ret, "ReadFile failed, error %u\n", GetLastError());
+    ok(!num_bytes, "num_bytes = %u\n", num_bytes);
+
+    /* peeking with a large buffer returns only the available data */
+    memset(buf, 0xcc, sizeof(buf));
+    avail = 0xdeadbeef;
+    ret = PeekNamedPipe(server, buf, sizeof(buf), &num_bytes, &avail, NULL);
+    ok(ret, "PeekNamedPipe failed, error %u\n", GetLastError());
+    ok(num_bytes == 4, "num_bytes = %u\n", num_bytes);
+    ok(avail == 4, "avail = %u\n", avail);
+    ok(!memcmp(buf, "data", 4), "got wrong data\n");
+    ok((BYTE)buf[4] == 0xcc, "buffer overwritten\n");
+
+    /* flushing waits for the reader */
+    thread = CreateThread(NULL, 0, byte_stream_reader, server, 0, NULL);
+    ret = FlushFileBuffers(client);
+    ok(ret, "FlushFileBuffers failed, error %u\n", GetLastError());
+    avail = 0xdeadbeef;
+    ret = PeekNamedPipe(server, NULL, 0, NULL, &avail, NULL);
+    ok(ret, "PeekNamedPipe failed, error %u\n", GetLastError());
+    ok(!avail, "avail = %u\n", avail);
+    WaitForSingleObject(thread, 10000);
+    CloseHandle(thread);
+
+    /* duplicated server handles follow reconnections */
+    ret = DuplicateHandle(GetCurrentProcess(), server, GetCurrentProcess(), &dup,
+                          0, FALSE, DUPLICATE_SAME_ACCESS);
+    ok(ret, "DuplicateHandle failed, error %u\n", GetLastError());
+    ret = WriteFile(client, "data", 4, &num_bytes, NULL);
+    ok(ret, "WriteFile failed, error %u\n", GetLastError());
+    ret = ReadFile(dup, buf, sizeof(buf), &num_bytes, NULL);
+    ok(ret, "ReadFile failed, error %u\n", GetLastError());
+    ok(num_bytes == 4, "num_bytes = %u\n", num_bytes);
+
+    ret = DisconnectNamedPipe(server);
+    ok(ret, "DisconnectNamedPipe failed, error %u\n", GetLastError());
+    CloseHandle(client);
+    listen_nowait(server);
+
+    client = CreateFileA(PIPENAME, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    ok(client != INVALID_HANDLE_VALUE, "CreateFile failed, error %u\n", GetLastError());
+    ret = WriteFile(client, "test", 4, &num_bytes, NULL);
+    ok(ret, "WriteFile failed, error %u\n", GetLastError());
+    memset(buf, 0, sizeof(buf));
+    ret = ReadFile(dup, buf, sizeof(buf), &num_bytes, NULL);
+    ok(ret, "ReadFile failed, error %u\n", GetLastError());
+    ok(num_bytes == 4, "num_bytes = %u\n", num_bytes);
+    ok(!memcmp(buf, "test", 4), "got wrong data\n");
+    CloseHandle(dup);
+    CloseHandle(client);
+
+    /* overlapped clients of a synchronous server */
+    ret = DisconnectNamedPipe(server);
+    ok(ret, "DisconnectNamedPipe failed, error %u\n", GetLastError());
+    listen_nowait(server);
+
+    client = CreateFileA(PIPENAME, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+                         FILE_FLAG_OVERLAPPED, NULL);
+    ok(client != INVALID_HANDLE_VALUE, "CreateFile failed, error %u\n", GetLastError());
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ret = ReadFile(client, buf, sizeof(buf), NULL, &overlapped);
+    ok(!ret && GetLastError() == ERROR_IO_PENDING, "ReadFile returned %x(%u)\n", ret, GetLastError());
+    ret = WriteFile(server, "data", 4, &num_bytes, NULL);
+    ok(ret, "WriteFile failed, error %u\n", GetLastError());
+    ret = GetOverlappedResult(client, &overlapped, &num_bytes, TRUE);
+    ok(ret, "GetOverlappedResult failed, error %u\n", GetLastError());
+    ok(num_bytes == 4, "num_bytes = %u\n", num_bytes);
+    CloseHandle(overlapped.hEvent);
+    CloseHandle(client);
+    CloseHandle(server);
+
+    /* anonymous pipes can switch to non-blocking mode */
+    ret = CreatePipe(&read, &write, NULL, 4096);
+    ok(ret, "CreatePipe failed, error %u\n", GetLastError());
+    mode = PIPE_NOWAIT;
+    ret = SetNamedPipeHandleState(read, &mode, NULL, NULL);
+    ok(ret, "SetNamedPipeHandleState failed, error %u\n", GetLastError());
+    SetLastError(0xdeadbeef);
+    ret = ReadFile(read, buf, sizeof(buf), &num_bytes, NULL);
+    ok(!ret && GetLastError() == ERROR_NO_DATA, "ReadFile returned %x(%u)\n", ret, GetLastError());
+    ret = WriteFile(write, "data", 4, &num_bytes, NULL);
+    ok(ret, "WriteFile failed, error %u\n", GetLastError());
+    ret = ReadFile(read, buf, sizeof(buf), &num_bytes, NULL);
+    ok(ret, "ReadFile failed, error %u\n", GetLastError());
+    ok(num_bytes == 4, "num_bytes = %u\n", num_bytes);
+    CloseHandle(read);
+    CloseHandle(write);
+}
+
 static void test_volume_info(void)
 {
     FILE_FS_DEVICE_INFORMATION *device_info;
@@ -2412,6 +2615,10 @@ START_TEST(pipe)
     test_blocking(FILE_SYNCHRONOUS_IO_NONALERT);
     test_blocking(FILE_SYNCHRONOUS_IO_ALERT);
 
+    trace("starting byte stream tests\n");
+    test_byte_stream();
+    test_byte_stream_state();
+
     trace("starting FILE_PIPE_INFORMATION tests\n");
     test_filepipeinfo();
 
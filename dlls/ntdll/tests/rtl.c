@@ -3673,6 +3673,131 @@ static void test_LdrRegisterDllNotification(void)
     pLdrUnregisterDllNotification(cookie);
 }
 
+/* Wine specific heap statistics, see dlls/ntdll/heap.c */
+#define HeapWineStatistics ((HEAP_INFORMATION_CLASS)0x1000)
+
+typedef struct
+{
+    ULONGLONG AllocationCount;
+    ULONGLONG FreeCount;
+    SIZE_T    BytesInUse;
+    SIZE_T    PeakBytesInUse;
+    SIZE_T    CommittedSize;
+    SIZE_T    FreeSize;
+    SIZE_T    CachedSize;
+    ULONG     LockContentionCount;
+    ULONG     SizeClasses[32];
+    ULONG     FreeListCount;
+    ULONG     FreeListLengths[256];
+} HEAP_WINE_STATISTICS;
+
+static BOOL get_heap_stats( HANDLE heap, HEAP_WINE_STATISTICS *stats )
+{
+    NTSTATUS status;
+    SIZE_T size;
+
+    status = RtlQueryHeapInformation( heap, HeapWineStatistics, stats, sizeof(*stats), &size );
+    if (status) return FALSE;
+    ok( size <= sizeof(*stats), "wrong size %lu\n", size );
+    return TRUE;
+}
+
+#define LFH_BLOCKS 48  /* enough to overflow the thread cache of a size class */
+
+static DWORD WINAPI heap_stats_thread( void *arg )
+{
+    HANDLE heap = arg;
+    void *ptrs[LFH_BLOCKS];
+    unsigned int i;
+
+    for (i = 0; i < LFH_BLOCKS; i++) ptrs[i] = HeapAlloc( heap, 0, 64 );
+    for (i = 0; i < LFH_BLOCKS - 8; i++) HeapFree( heap, 0, ptrs[i] );
+    return 0;
+}
+
+static void test_heap_statistics(void)
+{
+    HEAP_WINE_STATISTICS before, after;
+    void *ptrs[LFH_BLOCKS], *ptr;
+    ULONG compat = 2;
+    HANDLE heap, thread;
+    unsigned int i;
+    DWORD ret;
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed\n" );
+    if (!get_heap_stats( heap, &before ))
+    {
+        skip( "HeapWineStatistics not supported\n" );
+        HeapDestroy( heap );
+        return;
+    }
+
+    ptr = HeapAlloc( heap, 0, 100 );
+    get_heap_stats( heap, &after );
+    ok( after.AllocationCount == before.AllocationCount + 1, "got %s allocs\n",
+        wine_dbgstr_longlong( after.AllocationCount - before.AllocationCount ));
+    ok( after.FreeCount == before.FreeCount, "got %s frees\n",
+        wine_dbgstr_longlong( after.FreeCount - before.FreeCount ));
+    ok( after.BytesInUse == before.BytesInUse + 100, "got %lu bytes\n", after.BytesInUse - before.BytesInUse );
+    ok( after.SizeClasses[3] == before.SizeClasses[3] + 1, "got %u in class 3\n",
+        after.SizeClasses[3] - before.SizeClasses[3] );
+
+    ptr = HeapReAlloc( heap, 0, ptr, 300 );
+    get_heap_stats( heap, &after );
+    ok( after.AllocationCount == before.AllocationCount + 1, "got %s allocs\n",
+        wine_dbgstr_longlong( after.AllocationCount - before.AllocationCount ));
+    ok( after.BytesInUse == before.BytesInUse + 300, "got %lu bytes\n", after.BytesInUse - before.BytesInUse );
+
+    ptr = HeapReAlloc( heap, 0, ptr, 50 );
+    HeapFree( heap, 0, ptr );
+    get_heap_stats( heap, &after );
+    ok( after.AllocationCount == before.AllocationCount + 1, "got %s allocs\n",
+        wine_dbgstr_longlong( after.AllocationCount - before.AllocationCount ));
+    ok( after.FreeCount == before.FreeCount + 1, "got %s frees\n",
+        wine_dbgstr_longlong( after.FreeCount - before.FreeCount ));
+    ok( after.BytesInUse == before.BytesInUse, "got %lu bytes\n", after.BytesInUse - before.BytesInUse );
+    ok( after.PeakBytesInUse >= before.BytesInUse + 300, "got peak %lu\n", after.PeakBytesInUse );
+    HeapDestroy( heap );
+
+    /* blocks going through the low-fragmentation heap caches are counted too */
+    heap = HeapCreate( 0, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed\n" );
+    ret = HeapSetInformation( heap, HeapCompatibilityInformation, &compat, sizeof(compat) );
+    ok( ret, "HeapSetInformation failed %u\n", GetLastError() );
+    get_heap_stats( heap, &before );
+
+    for (i = 0; i < LFH_BLOCKS; i++) ptrs[i] = HeapAlloc( heap, 0, 64 );
+    get_heap_stats( heap, &after );
+    ok( after.AllocationCount == before.AllocationCount + LFH_BLOCKS, "got %s allocs\n",
+        wine_dbgstr_longlong( after.AllocationCount - before.AllocationCount ));
+    ok( after.BytesInUse == before.BytesInUse + LFH_BLOCKS * 64, "got %lu bytes\n",
+        after.BytesInUse - before.BytesInUse );
+    ok( after.SizeClasses[2] == before.SizeClasses[2] + LFH_BLOCKS, "got %u in class 2\n",
+        after.SizeClasses[2] - before.SizeClasses[2] );
+
+    for (i = 0; i < LFH_BLOCKS; i++) HeapFree( heap, 0, ptrs[i] );
+    get_heap_stats( heap, &after );
+    ok( after.FreeCount == before.FreeCount + LFH_BLOCKS, "got %s frees\n",
+        wine_dbgstr_longlong( after.FreeCount - before.FreeCount ));
+    ok( after.BytesInUse == before.BytesInUse, "got %lu bytes\n", after.BytesInUse - before.BytesInUse );
+    ok( after.CachedSize != 0, "no cached blocks\n" );
+
+    /* the counters of an exiting thread are moved to the heap */
+    before = after;
+    thread = CreateThread( NULL, 0, heap_stats_thread, heap, 0, NULL );
+    ok( thread != NULL, "CreateThread failed %u\n", GetLastError() );
+    WaitForSingleObject( thread, INFINITE );
+    CloseHandle( thread );
+    get_heap_stats( heap, &after );
+    ok( after.AllocationCount == before.AllocationCount + LFH_BLOCKS, "got %s allocs\n",
+        wine_dbgstr_longlong( after.AllocationCount - before.AllocationCount ));
+    ok( after.FreeCount == before.FreeCount + LFH_BLOCKS - 8, "got %s frees\n",
+        wine_dbgstr_longlong( after.FreeCount - before.FreeCount ));
+    ok( after.BytesInUse == before.BytesInUse + 8 * 64, "got %lu bytes\n", after.BytesInUse - before.BytesInUse );
+    HeapDestroy( heap );
+}
+
 START_TEST(rtl)
 {
     InitFunctionPtrs();
@@ -3713,4 +3838,5 @@ START_TEST(rtl)
     test_LdrEnumerateLoadedModules();
     test_RtlMakeSelfRelativeSD();
     test_LdrRegisterDllNotification();
+    test_heap_statistics();
 }
@@ -732,6 +732,50 @@ static void test_tp_work_scheduler(void)
     pTpReleasePool(pool);
 }
 
+static void CALLBACK work3_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
+{
+    InterlockedIncrement((LONG *)userdata);
+}
+
+static void test_tp_work_throughput(void)
+{
+    TP_CALLBACK_ENVIRON environment;
+    TP_WORK *work;
+    TP_POOL *pool;
+    NTSTATUS status;
+    LONG userdata;
+    DWORD ticks;
+    int i;
+
+    /* allocate new threadpool with the default number of threads */
+    pool = NULL;
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %x\n", status);
+    ok(pool != NULL, "expected pool != NULL\n");
+
+    /* allocate new work item */
+    work = NULL;
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = pool;
+    status = pTpAllocWork(&work, work3_cb, &userdata, &environment);
+    ok(!status, "TpAllocWork failed with status %x\n", status);
+    ok(work != NULL, "expected work != NULL\n");
+
+    /* post many short work items while the workers are running them */
+    userdata = 0;
+    ticks = GetTickCount();
+    for (i = 0; i < 10000; i++)
+        pTpPostWork(work);
+    pTpWaitForWork(work, FALSE);
+    trace("10000 work items took %u ms\n", GetTickCount() - ticks);
+    ok(userdata == 10000, "expected userdata = 10000, got %u\n", userdata);
+
+    /* cleanup */
+    pTpReleaseWork(work);
+    pTpReleasePool(pool);
+}
+
 static void CALLBACK simple_release_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
 {
     HANDLE *semaphores = userdata;
@@ -2244,6 +2288,7 @@ START_TEST(threadpool)
     test_tp_simple();
     test_tp_work();
     test_tp_work_scheduler();
+    test_tp_work_throughput();
     test_tp_group_wait();
     test_tp_group_cancel();
     test_tp_instance();
@@ -375,6 +375,7 @@ void abort_thread( int status )
 {
     pthread_sigmask( SIG_BLOCK, &server_block_set, NULL );
     if (InterlockedDecrement( &nb_threads ) <= 0) _exit( get_unix_exit_code( status ));
+    heap_thread_abort();
     signal_exit_thread( status );
 }
 
@@ -420,6 +421,7 @@ void WINAPI RtlExitUserThread( ULONG status )
 
     LdrShutdownThread();
     RtlFreeThreadActivationContextStack();
+    heap_thread_detach();
 
     pthread_sigmask( SIG_BLOCK, &server_block_set, NULL );
 
@@ -173,6 +173,7 @@ struct threadpool_object
     struct list             pool_entry;
     RTL_CONDITION_VARIABLE  finished_event;
     RTL_CONDITION_VARIABLE  group_finished_event;
+    /* modified with interlocked functions, a non-zero value can grow without .pool->cs */
     LONG                    num_pending_callbacks;
     LONG                    num_running_callbacks;
     LONG                    num_associated_callbacks;
@@ -1844,7 +1845,8 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
     pool->objcount              = 0;
     pool->shutdown              = FALSE;
 
-    RtlInitializeCriticalSection( &pool->cs );
+    /* the lock is only held briefly, spin before falling back to a server wait */
+    RtlInitializeCriticalSectionAndSpinCount( &pool->cs, 4000 );
     pool->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool.cs");
 
     for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
@@ -2150,10 +2152,30 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
 {
     struct threadpool *pool = object->pool;
     NTSTATUS status = STATUS_UNSUCCESSFUL;
+    LONG pending;
 
     assert( !object->shutdown );
     assert( !pool->shutdown );
 
+    /* Increment refcount, it is released after the callback or on cancel. */
+    InterlockedIncrement( &object->refcount );
+
+    /* A work object with pending callbacks is already queued, so we only have to
+     * bump its pending count. The workers remove it from the queue under the pool
+     * lock when the count drops to zero, after which we have to queue it again.
+     * Keep going through the lock when all workers are busy, a new one may be needed. */
+    if (object->type == TP_OBJECT_TYPE_WORK && pool->num_busy_workers < pool->num_workers)
+    {
+        while ((pending = object->num_pending_callbacks))
+        {
+            if (InterlockedCompareExchange( &object->num_pending_callbacks, pending + 1, pending ) == pending)
+            {
+                RtlWakeConditionVariable( &pool->update_event );
+                return;
+            }
+        }
+    }
+
     RtlEnterCriticalSection( &pool->cs );
 
     /* Start new worker threads if required. */
@@ -2161,9 +2183,8 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
         pool->num_workers < pool->max_workers)
         status = tp_new_worker_thread( pool );
 
-    /* Queue work item and increment refcount. */
-    InterlockedIncrement( &object->refcount );
-    if (!object->num_pending_callbacks++)
+    /* Queue work item. */
+    if (InterlockedIncrement( &object->num_pending_callbacks ) == 1)
         tp_object_prio_queue( object );
 
     /* Count how often the object was signaled. */
@@ -2191,10 +2212,8 @@ static void tp_object_cancel( struct threadpool_object *object )
     LONG pending_callbacks = 0;
 
     RtlEnterCriticalSection( &pool->cs );
-    if (object->num_pending_callbacks)
+    if ((pending_callbacks = InterlockedExchange( &object->num_pending_callbacks, 0 )))
     {
-        pending_callbacks = object->num_pending_callbacks;
-        object->num_pending_callbacks = 0;
         list_remove( &object->pool_entry );
 
         if (object->type == TP_OBJECT_TYPE_WAIT)
@@ -2341,7 +2360,7 @@ static void CALLBACK threadpool_worker_proc( void *param )
             /* If further pending callbacks are queued, move the work item to
              * the end of the pool list. Otherwise remove it from the pool. */
             list_remove( &object->pool_entry );
-            if (--object->num_pending_callbacks)
+            if (InterlockedDecrement( &object->num_pending_callbacks ))
                 tp_object_prio_queue( object );
 
             /* For wait objects check if they were signaled or have timed out. */
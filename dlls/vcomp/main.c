@@ -23,6 +23,7 @@
 
 #include <stdarg.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "windef.h"
 #include "winbase.h"
@@ -41,8 +42,18 @@ static DWORD   vcomp_context_tls = TLS_OUT_OF_INDEXES;
 static HMODULE vcomp_module;
 static int     vcomp_max_threads;
 static int     vcomp_num_threads;
+static int     vcomp_num_procs;
 static BOOL    vcomp_nested_fork = FALSE;
 
+/* number of pause loops before a waiting thread goes to sleep, see OMP_WAIT_POLICY */
+static int     vcomp_spin_count = 20000;
+
+#define VCOMP_BIND_FALSE    0
+#define VCOMP_BIND_CLOSE    1
+#define VCOMP_BIND_SPREAD   2
+
+static int     vcomp_proc_bind = VCOMP_BIND_FALSE;
+
 static RTL_CRITICAL_SECTION vcomp_section;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
 {
@@ -57,6 +68,9 @@ static RTL_CRITICAL_SECTION vcomp_section = { &critsect_debug, -1, 0, 0, 0, 0 };
 #define VCOMP_DYNAMIC_FLAGS_GUIDED      0x03
 #define VCOMP_DYNAMIC_FLAGS_INCREMENT   0x40
 
+/* iteration index of a dynamic loop that is still being set up */
+#define VCOMP_DYNAMIC_BUSY              0xffffffff
+
 struct vcomp_thread_data
 {
     struct vcomp_team_data  *team;
@@ -64,6 +78,7 @@ struct vcomp_thread_data
     int                     thread_num;
     BOOL                    parallel;
     int                     fork_threads;
+    int                     bound_cpu;
 
     /* only used for concurrent tasks */
     struct list             entry;
@@ -95,7 +110,8 @@ struct vcomp_team_data
 
     /* barrier */
     unsigned int            barrier;
-    int                     barrier_count;
+    LONG                    barrier_count;
+    LONG                    barrier_sleepers;
 };
 
 struct vcomp_task_data
@@ -110,6 +126,7 @@ struct vcomp_task_data
 
     /* dynamic */
     unsigned int            dynamic;
+    LONGLONG                dynamic_next;   /* loop generation << 32 | next iteration */
     unsigned int            dynamic_first;
     unsigned int            dynamic_last;
     unsigned int            dynamic_iterations;
@@ -317,21 +334,28 @@ static inline char interlocked_xchg_add8(char *dest, char incr)
     return __sync_fetch_and_add(dest, incr);
 }
 #else
+/* emulate byte sized atomics with a compare-and-swap on the containing aligned dword */
 static char interlocked_cmpxchg8(char *dest, char xchg, char compare)
 {
-    EnterCriticalSection(&vcomp_section);
-    if (*dest == compare) *dest = xchg; else compare = *dest;
-    LeaveCriticalSection(&vcomp_section);
+    LONG *ptr = (LONG *)((ULONG_PTR)dest & ~3);
+    unsigned int shift = ((ULONG_PTR)dest & 3) * 8;
+    LONG old, new;
+
+    do
+    {
+        old = *ptr;
+        if ((char)(old >> shift) != compare) return old >> shift;
+        new = (old & ~(0xff << shift)) | ((LONG)(unsigned char)xchg << shift);
+    }
+    while (InterlockedCompareExchange(ptr, new, old) != old);
     return compare;
 }
 
 static char interlocked_xchg_add8(char *dest, char incr)
 {
-    char ret;
-    EnterCriticalSection(&vcomp_section);
-    ret = *dest; *dest += incr;
-    LeaveCriticalSection(&vcomp_section);
-    return ret;
+    char old;
+    do old = *dest; while (interlocked_cmpxchg8(dest, old + incr, old) != old);
+    return old;
 }
 #endif
 
@@ -348,24 +372,87 @@ static inline short interlocked_xchg_add16(short *dest, short incr)
 #else
 static short interlocked_cmpxchg16(short *dest, short xchg, short compare)
 {
-    EnterCriticalSection(&vcomp_section);
-    if (*dest == compare) *dest = xchg; else compare = *dest;
-    LeaveCriticalSection(&vcomp_section);
+    LONG *ptr = (LONG *)((ULONG_PTR)dest & ~3);
+    unsigned int shift = ((ULONG_PTR)dest & 2) * 8;
+    LONG old, new;
+
+    do
+    {
+        old = *ptr;
+        if ((short)(old >> shift) != compare) return old >> shift;
+        new = (old & ~(0xffff << shift)) | ((LONG)(unsigned short)xchg << shift);
+    }
+    while (InterlockedCompareExchange(ptr, new, old) != old);
     return compare;
 }
 
 static short interlocked_xchg_add16(short *dest, short incr)
 {
-    short ret;
-    EnterCriticalSection(&vcomp_section);
-    ret = *dest; *dest += incr;
-    LeaveCriticalSection(&vcomp_section);
-    return ret;
+    short old;
+    do old = *dest; while (interlocked_cmpxchg16(dest, old + incr, old) != old);
+    return old;
 }
 #endif
 
 #endif  /* __GNUC__ */
 
+static inline void vcomp_pause(void)
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __asm__ __volatile__( "rep;nop" : : : "memory" );
+#elif defined(__GNUC__)
+    __asm__ __volatile__( "" : : : "memory" );
+#endif
+}
+
+/* Busy wait until *ptr no longer equals value. Returns FALSE if the caller
+ * should block instead, either because the spin count ran out or because
+ * there are more threads than processors and spinning would only steal
+ * time from the threads we're waiting for. */
+static BOOL vcomp_spin_wait(volatile LONG *ptr, LONG value, int num_threads)
+{
+    int i;
+
+    if (num_threads > vcomp_num_procs)
+        return FALSE;
+
+    for (i = 0; i < vcomp_spin_count; i++)
+    {
+        if (*ptr != value) return TRUE;
+        vcomp_pause();
+    }
+    return *ptr != value;
+}
+
+static void vcomp_bind_thread(struct vcomp_thread_data *thread_data, int thread_num, int num_threads)
+{
+    DWORD_PTR mask;
+    int cpu;
+
+    if (vcomp_proc_bind == VCOMP_BIND_SPREAD && num_threads < vcomp_num_procs)
+        cpu = thread_num * vcomp_num_procs / num_threads;
+    else
+        cpu = thread_num % vcomp_num_procs;
+
+    if (cpu == thread_data->bound_cpu || cpu >= sizeof(mask) * 8) return;
+    mask = (DWORD_PTR)1 << cpu;
+    if (SetThreadAffinityMask(GetCurrentThread(), mask))
+        thread_data->bound_cpu = cpu;
+    else
+        WARN("failed to bind thread %d to cpu %d\n", thread_num, cpu);
+}
+
+static inline void interlocked_xchg64(LONGLONG *dest, LONGLONG val)
+{
+    LONGLONG old;
+    do old = *dest; while (InterlockedCompareExchange64(dest, val, old) != old);
+}
+
+static inline LONGLONG vcomp_dynamic_next(unsigned int generation, unsigned int index)
+{
+    return ((LONGLONG)generation << 32) | index;
+}
+
 static inline struct vcomp_thread_data *vcomp_get_thread_data(void)
 {
     return (struct vcomp_thread_data *)TlsGetValue(vcomp_context_tls);
@@ -395,6 +482,7 @@ static struct vcomp_thread_data *vcomp_init_thread_data(void)
     data->task.single           = 0;
     data->task.section          = 0;
     data->task.dynamic          = 0;
+    data->task.dynamic_next     = 0;
 
     thread_data = &data->thread;
     thread_data->team           = NULL;
@@ -402,6 +490,7 @@ static struct vcomp_thread_data *vcomp_init_thread_data(void)
     thread_data->thread_num     = 0;
     thread_data->parallel       = FALSE;
     thread_data->fork_threads   = 0;
+    thread_data->bound_cpu      = -1;
     thread_data->single         = 1;
     thread_data->section        = 1;
     thread_data->dynamic        = 1;
@@ -986,8 +1075,8 @@ int CDECL omp_get_nested(void)
 
 int CDECL omp_get_num_procs(void)
 {
-    TRACE("stub\n");
-    return 1;
+    TRACE("()\n");
+    return vcomp_num_procs;
 }
 
 int CDECL omp_get_num_threads(void)
@@ -1041,26 +1130,36 @@ void CDECL _vcomp_flush(void)
 void CDECL _vcomp_barrier(void)
 {
     struct vcomp_team_data *team_data = vcomp_init_thread_data()->team;
+    unsigned int barrier;
 
     TRACE("()\n");
 
     if (!team_data)
         return;
 
-    EnterCriticalSection(&vcomp_section);
-    if (++team_data->barrier_count >= team_data->num_threads)
+    barrier = team_data->barrier;
+    if (InterlockedIncrement(&team_data->barrier_count) >= team_data->num_threads)
     {
-        team_data->barrier++;
+        /* last one in: start the next generation, and only take the lock
+         * if somebody gave up spinning and went to sleep */
         team_data->barrier_count = 0;
-        WakeAllConditionVariable(&team_data->cond);
+        InterlockedIncrement((LONG *)&team_data->barrier);
+        if (team_data->barrier_sleepers)
+        {
+            EnterCriticalSection(&vcomp_section);
+            WakeAllConditionVariable(&team_data->cond);
+            LeaveCriticalSection(&vcomp_section);
+        }
     }
-    else
+    else if (!vcomp_spin_wait((LONG *)&team_data->barrier, barrier, team_data->num_threads))
     {
-        unsigned int barrier = team_data->barrier;
+        EnterCriticalSection(&vcomp_section);
+        InterlockedIncrement(&team_data->barrier_sleepers);
         while (team_data->barrier == barrier)
             SleepConditionVariableCS(&team_data->cond, &vcomp_section, INFINITE);
+        InterlockedDecrement(&team_data->barrier_sleepers);
+        LeaveCriticalSection(&vcomp_section);
     }
-    LeaveCriticalSection(&vcomp_section);
 }
 
 void CDECL _vcomp_set_num_threads(int num_threads)
@@ -1326,19 +1425,28 @@ void CDECL _vcomp_for_dynamic_init(unsigned int flags, unsigned int first, unsig
             type = VCOMP_DYNAMIC_FLAGS_GUIDED;
         }
 
-        EnterCriticalSection(&vcomp_section);
         thread_data->dynamic++;
         thread_data->dynamic_type = type;
-        if ((int)(thread_data->dynamic - task_data->dynamic) > 0)
+        for (;;)
         {
-            task_data->dynamic              = thread_data->dynamic;
+            unsigned int dynamic = task_data->dynamic;
+            if ((int)(thread_data->dynamic - dynamic) <= 0) break;
+            if (InterlockedCompareExchange((LONG *)&task_data->dynamic, thread_data->dynamic, dynamic) != dynamic)
+                continue;
+
+            /* switch the chunk counter to the new generation before touching the
+             * loop parameters, so that threads still handing out chunks of the
+             * previous loop fail their compare-and-swap and stop */
+            interlocked_xchg64(&task_data->dynamic_next,
+                                  vcomp_dynamic_next(thread_data->dynamic, VCOMP_DYNAMIC_BUSY));
             task_data->dynamic_first        = first;
             task_data->dynamic_last         = last;
             task_data->dynamic_iterations   = iterations;
             task_data->dynamic_step         = step;
             task_data->dynamic_chunksize    = chunksize;
+            interlocked_xchg64(&task_data->dynamic_next, vcomp_dynamic_next(thread_data->dynamic, 0));
+            break;
         }
-        LeaveCriticalSection(&vcomp_section);
     }
 }
 
@@ -1361,26 +1469,43 @@ int CDECL _vcomp_for_dynamic_next(unsigned int *begin, unsigned int *end)
     else if (thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_CHUNKED ||
              thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_GUIDED)
     {
-        unsigned int iterations = 0;
-        EnterCriticalSection(&vcomp_section);
-        if (thread_data->dynamic == task_data->dynamic &&
-            task_data->dynamic_iterations != 0)
+        unsigned int iterations, remaining, index;
+        LONGLONG next;
+
+        for (;;)
         {
-            iterations = min(task_data->dynamic_iterations, task_data->dynamic_chunksize);
+            next = task_data->dynamic_next;
+            if ((unsigned int)(next >> 32) != thread_data->dynamic)
+            {
+                /* a newer loop was started, so this one has no iterations left */
+                if ((int)((unsigned int)(next >> 32) - thread_data->dynamic) > 0) return 0;
+                vcomp_pause();
+                continue;
+            }
+            index = (unsigned int)next;
+            if (index == VCOMP_DYNAMIC_BUSY)
+            {
+                vcomp_pause();
+                continue;
+            }
+
+            remaining = task_data->dynamic_iterations - index;
+            if (!remaining) return 0;
+
+            iterations = min(remaining, task_data->dynamic_chunksize);
             if (thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_GUIDED &&
-                task_data->dynamic_iterations > num_threads * task_data->dynamic_chunksize)
+                remaining > num_threads * task_data->dynamic_chunksize)
             {
-                iterations = (task_data->dynamic_iterations + num_threads - 1) / num_threads;
+                iterations = (remaining + num_threads - 1) / num_threads;
             }
-            *begin = task_data->dynamic_first;
-            *end   = task_data->dynamic_first + (iterations - 1) * task_data->dynamic_step;
-            task_data->dynamic_iterations -= iterations;
-            task_data->dynamic_first      += iterations * task_data->dynamic_step;
-            if (!task_data->dynamic_iterations)
+            *begin = task_data->dynamic_first + index * task_data->dynamic_step;
+            *end   = *begin + (iterations - 1) * task_data->dynamic_step;
+            if (iterations == remaining)
                 *end = task_data->dynamic_last;
+
+            if (InterlockedCompareExchange64(&task_data->dynamic_next, next + iterations, next) == next)
+                return 1;
         }
-        LeaveCriticalSection(&vcomp_section);
-        return iterations != 0;
     }
 
     return 0;
@@ -1395,6 +1520,8 @@ int CDECL omp_in_parallel(void)
 static DWORD WINAPI _vcomp_fork_worker(void *param)
 {
     struct vcomp_thread_data *thread_data = param;
+    int i;
+
     vcomp_set_thread_data(thread_data);
 
     TRACE("starting worker thread for %p\n", thread_data);
@@ -1405,7 +1532,11 @@ static DWORD WINAPI _vcomp_fork_worker(void *param)
         struct vcomp_team_data *team = thread_data->team;
         if (team != NULL)
         {
+            int num_threads = team->num_threads;
+
             LeaveCriticalSection(&vcomp_section);
+            if (vcomp_proc_bind != VCOMP_BIND_FALSE)
+                vcomp_bind_thread(thread_data, thread_data->thread_num, num_threads);
             _vcomp_fork_call_wrapper(team->wrapper, team->nargs, team->valist);
             EnterCriticalSection(&vcomp_section);
 
@@ -1414,6 +1545,17 @@ static DWORD WINAPI _vcomp_fork_worker(void *param)
             list_add_tail(&vcomp_idle_threads, &thread_data->entry);
             if (++team->finished_threads >= team->num_threads)
                 WakeAllConditionVariable(&team->cond);
+
+            /* parallel regions often come in quick succession, so wait
+             * a bit for the next one before going to sleep */
+            LeaveCriticalSection(&vcomp_section);
+            for (i = 0; i < vcomp_spin_count && num_threads <= vcomp_num_procs; i++)
+            {
+                if (*(struct vcomp_team_data * volatile *)&thread_data->team) break;
+                vcomp_pause();
+            }
+            EnterCriticalSection(&vcomp_section);
+            if (thread_data->team) continue;
         }
 
         if (!SleepConditionVariableCS(&thread_data->cond, &vcomp_section, 5000) &&
@@ -1461,16 +1603,19 @@ void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
     __ms_va_start(team_data.valist, wrapper);
     team_data.barrier           = 0;
     team_data.barrier_count     = 0;
+    team_data.barrier_sleepers  = 0;
 
     task_data.single            = 0;
     task_data.section           = 0;
     task_data.dynamic           = 0;
+    task_data.dynamic_next      = 0;
 
     thread_data.team            = &team_data;
     thread_data.task            = &task_data;
     thread_data.thread_num      = 0;
     thread_data.parallel        = ifval || prev_thread_data->parallel;
     thread_data.fork_threads    = 0;
+    thread_data.bound_cpu       = prev_thread_data->bound_cpu;
     thread_data.single          = 1;
     thread_data.section         = 1;
     thread_data.dynamic         = 1;
@@ -1516,6 +1661,7 @@ void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
             data->thread_num    = team_data.num_threads;
             data->parallel      = thread_data.parallel;
             data->fork_threads  = 0;
+            data->bound_cpu     = -1;
             data->single        = 1;
             data->section       = 1;
             data->dynamic       = 1;
@@ -1539,6 +1685,9 @@ void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
         LeaveCriticalSection(&vcomp_section);
     }
 
+    if (vcomp_proc_bind != VCOMP_BIND_FALSE && team_data.num_threads > 1 && !prev_thread_data->parallel)
+        vcomp_bind_thread(prev_thread_data, 0, team_data.num_threads);
+
     vcomp_set_thread_data(&thread_data);
     _vcomp_fork_call_wrapper(team_data.wrapper, team_data.nargs, team_data.valist);
     vcomp_set_thread_data(prev_thread_data);
@@ -1546,6 +1695,14 @@ void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
 
     if (team_data.num_threads > 1)
     {
+        int i;
+
+        for (i = 0; i < vcomp_spin_count && team_data.num_threads <= vcomp_num_procs; i++)
+        {
+            if (*(volatile int *)&team_data.finished_threads >= team_data.num_threads - 1) break;
+            vcomp_pause();
+        }
+
         EnterCriticalSection(&vcomp_section);
 
         team_data.finished_threads++;
@@ -1660,6 +1817,32 @@ void CDECL _vcomp_leave_critsect(CRITICAL_SECTION *critsect)
     LeaveCriticalSection(critsect);
 }
 
+static void vcomp_read_environment(void)
+{
+    char buffer[16];
+    DWORD len;
+
+    len = GetEnvironmentVariableA("OMP_WAIT_POLICY", buffer, sizeof(buffer));
+    if (len && len < sizeof(buffer))
+    {
+        if (!lstrcmpiA(buffer, "active"))
+            vcomp_spin_count = INT_MAX;
+        else if (!lstrcmpiA(buffer, "passive"))
+            vcomp_spin_count = 0;
+    }
+
+    len = GetEnvironmentVariableA("OMP_PROC_BIND", buffer, sizeof(buffer));
+    if (len && len < sizeof(buffer))
+    {
+        if (!lstrcmpiA(buffer, "true") || !lstrcmpiA(buffer, "close") || !lstrcmpiA(buffer, "master"))
+            vcomp_proc_bind = VCOMP_BIND_CLOSE;
+        else if (!lstrcmpiA(buffer, "spread"))
+            vcomp_proc_bind = VCOMP_BIND_SPREAD;
+    }
+
+    TRACE("spin count %d, proc bind %d\n", vcomp_spin_count, vcomp_proc_bind);
+}
+
 BOOL WINAPI DllMain(HINSTANCE instance, DWORD reason, LPVOID reserved)
 {
     TRACE("(%p, %d, %p)\n", instance, reason, reserved);
@@ -1680,6 +1863,8 @@ BOOL WINAPI DllMain(HINSTANCE instance, DWORD reason, LPVOID reserved)
             vcomp_module      = instance;
             vcomp_max_threads = sysinfo.dwNumberOfProcessors;
             vcomp_num_threads = sysinfo.dwNumberOfProcessors;
+            vcomp_num_procs   = sysinfo.dwNumberOfProcessors;
+            vcomp_read_environment();
             break;
         }
 
@@ -2209,6 +2209,58 @@ static void test_reduction_float_double(void)
     }
 }
 
+#define THREADS_SIZE    4096
+#define THREADS_ROUNDS  4
+
+static void CDECL threads_cb(int *data, LONG64 *total)
+{
+    unsigned int begin, end, i;
+    LONG64 sum;
+    int round;
+
+    for (round = 0; round < THREADS_ROUNDS; round++)
+    {
+        p_vcomp_for_dynamic_init(VCOMP_DYNAMIC_FLAGS_CHUNKED | VCOMP_DYNAMIC_FLAGS_INCREMENT,
+                                 0, THREADS_SIZE - 1, 1, 256);
+        while (p_vcomp_for_dynamic_next(&begin, &end))
+            for (i = begin; i <= end; i++) data[i]++;
+        p_vcomp_barrier();
+
+        sum = 0;
+        p_vcomp_for_dynamic_init(VCOMP_DYNAMIC_FLAGS_GUIDED | VCOMP_DYNAMIC_FLAGS_INCREMENT,
+                                 0, THREADS_SIZE - 1, 1, 16);
+        while (p_vcomp_for_dynamic_next(&begin, &end))
+            for (i = begin; i <= end; i++) sum += data[i];
+        p_vcomp_atomic_add_i8(total, sum);
+        p_vcomp_barrier();
+    }
+}
+
+static void test_vcomp_threads(void)
+{
+    static const LONG64 expected = (LONG64)THREADS_SIZE * THREADS_ROUNDS * (THREADS_ROUNDS + 1) / 2;
+    int max_threads = pomp_get_max_threads();
+    LONG64 total;
+    int *data, i;
+
+    data = HeapAlloc(GetProcessHeap(), 0, THREADS_SIZE * sizeof(*data));
+
+    for (i = 1; i <= max(max_threads, 4); i *= 2)
+    {
+        memset(data, 0, THREADS_SIZE * sizeof(*data));
+        total = 0;
+        pomp_set_num_threads(i);
+
+        p_vcomp_fork(TRUE, 2, threads_cb, data, &total);
+
+        ok(total == expected, "%d threads: expected %s, got %s\n", i,
+           wine_dbgstr_longlong(expected), wine_dbgstr_longlong(total));
+    }
+
+    pomp_set_num_threads(max_threads);
+    HeapFree(GetProcessHeap(), 0, data);
+}
+
 START_TEST(vcomp)
 {
     if (!init_vcomp())
@@ -2221,6 +2273,7 @@ START_TEST(vcomp)
     test_vcomp_for_static_simple_init();
     test_vcomp_for_static_init();
     test_vcomp_for_dynamic_init();
+    test_vcomp_threads();
     test_vcomp_master_begin();
     test_vcomp_single_begin();
     test_vcomp_enter_critsect();
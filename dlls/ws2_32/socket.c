@@ -64,6 +64,9 @@
 #ifdef HAVE_SYS_UIO_H
 # include <sys/uio.h>
 #endif
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
@@ -131,6 +134,9 @@
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
 #endif
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
 
 #define NONAMELESSUNION
 #define NONAMELESSSTRUCT
@@ -160,6 +166,7 @@
 #include "wine/exception.h"
 #include "wine/unicode.h"
 #include "wine/heap.h"
+#include "wine/list.h"
 
 #if defined(linux) && !defined(IP_UNICAST_IF)
 #define IP_UNICAST_IF 50
@@ -610,6 +617,8 @@ static INT WINAPI WSA_DefaultBlockingHook( FARPROC x );
 
 /* hostent's, servent's and protent's are stored in one buffer per thread,
  * as documented on MSDN for the functions that return any of the buffers */
+struct poll_cache;
+
 struct per_thread_data
 {
     int opentype;
@@ -618,6 +627,7 @@ struct per_thread_data
     struct WS_protoent *pe_buffer;
     struct pollfd *fd_cache;
     unsigned int fd_count;
+    struct poll_cache *poll_cache;
     int he_len;
     int se_len;
     int pe_len;
@@ -1339,6 +1349,9 @@ static BOOL get_dont_fragment(SOCKET s, int level, BOOL *out)
     return value;
 }
 
+static void free_poll_cache( struct poll_cache *cache );
+static void poll_cache_remove_socket( SOCKET s );
+
 static struct per_thread_data *get_per_thread_data(void)
 {
     struct per_thread_data * ptb = NtCurrentTeb()->WinSockData;
@@ -1362,6 +1375,7 @@ static void free_per_thread_data(void)
     HeapFree( GetProcessHeap(), 0, ptb->se_buffer );
     HeapFree( GetProcessHeap(), 0, ptb->pe_buffer );
     HeapFree( GetProcessHeap(), 0, ptb->fd_cache );
+    free_poll_cache( ptb->poll_cache );
 
     HeapFree( GetProcessHeap(), 0, ptb );
     NtCurrentTeb()->WinSockData = NULL;
@@ -2551,6 +2565,8 @@ static NTSTATUS WS2_async_accept( void *user, IO_STATUS_BLOCK *iosb, NTSTATUS st
             status = wine_server_call( req );
         }
         SERVER_END_REQ;
+        /* the accepting socket now has a new fd */
+        if (!status) poll_cache_remove_socket( HANDLE2SOCKET(wsa->accept_socket) );
 
         if (NtStatusToWSAError( status ) == WSAEWOULDBLOCK)
             return STATUS_PENDING;
@@ -2821,6 +2837,7 @@ SOCKET WINAPI WS_accept(SOCKET s, struct WS_sockaddr *addr, int *addrlen32)
         SERVER_END_REQ;
         if (!err)
         {
+            poll_cache_remove_socket(as);
             if (addr && addrlen32 && WS_getpeername(as, addr, addrlen32))
             {
                 WS_closesocket(as);
@@ -3456,6 +3473,7 @@ int WINAPI WS_closesocket(SOCKET s)
         if (fd >= 0)
         {
             release_sock_fd(s, fd);
+            poll_cache_remove_socket(s);
             if (CloseHandle(SOCKET2HANDLE(s)))
                 res = 0;
         }
@@ -5224,13 +5242,30 @@ int WINAPI WS_recvfrom(SOCKET s, char *buf, INT len, int flags,
         return n;
 }
 
+/* get the per-thread poll array, resizing it if needed */
+static struct pollfd *get_poll_buffer( unsigned int count )
+{
+    struct per_thread_data *ptb = get_per_thread_data();
+    struct pollfd *fds;
+
+    /* check if the cache can hold all descriptors, if not do the resizing */
+    if (ptb->fd_count < count)
+    {
+        if (!(fds = HeapAlloc(GetProcessHeap(), 0, count * sizeof(fds[0]))))
+            return NULL;
+        HeapFree(GetProcessHeap(), 0, ptb->fd_cache);
+        ptb->fd_cache = fds;
+        ptb->fd_count = count;
+    }
+    return ptb->fd_cache;
+}
+
 /* allocate a poll array for the corresponding fd sets */
 static struct pollfd *fd_sets_to_poll( const WS_fd_set *readfds, const WS_fd_set *writefds,
                                        const WS_fd_set *exceptfds, int *count_ptr )
 {
     unsigned int i, j = 0, count = 0;
     struct pollfd *fds;
-    struct per_thread_data *ptb = get_per_thread_data();
 
     if (readfds) count += readfds->fd_count;
     if (writefds) count += writefds->fd_count;
@@ -5242,20 +5277,11 @@ static struct pollfd *fd_sets_to_poll( const WS_fd_set *readfds, const WS_fd_set
         return NULL;
     }
 
-    /* check if the cache can hold all descriptors, if not do the resizing */
-    if (ptb->fd_count < count)
+    if (!(fds = get_poll_buffer( count )))
     {
-        if (!(fds = HeapAlloc(GetProcessHeap(), 0, count * sizeof(fds[0]))))
-        {
-            SetLastError( ERROR_NOT_ENOUGH_MEMORY );
-            return NULL;
-        }
-        HeapFree(GetProcessHeap(), 0, ptb->fd_cache);
-        ptb->fd_cache = fds;
-        ptb->fd_count = count;
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return NULL;
     }
-    else
-        fds = ptb->fd_cache;
 
     if (readfds)
         for (i = 0; i < readfds->fd_count; i++, j++)
@@ -5336,27 +5362,28 @@ failed:
 
 /* release the file descriptor obtained in fd_sets_to_poll */
 /* must be called with the original fd_set arrays, before calling get_poll_results */
+/* descriptors belonging to the poll cache are not released */
 static void release_poll_fds( const WS_fd_set *readfds, const WS_fd_set *writefds,
-                              const WS_fd_set *exceptfds, struct pollfd *fds )
+                              const WS_fd_set *exceptfds, struct pollfd *fds, BOOL cached )
 {
     unsigned int i, j = 0;
 
     if (readfds)
     {
         for (i = 0; i < readfds->fd_count; i++, j++)
-            if (fds[j].fd != -1) release_sock_fd( readfds->fd_array[i], fds[j].fd );
+            if (fds[j].fd != -1 && !cached) release_sock_fd( readfds->fd_array[i], fds[j].fd );
     }
     if (writefds)
     {
         for (i = 0; i < writefds->fd_count; i++, j++)
-            if (fds[j].fd != -1) release_sock_fd( writefds->fd_array[i], fds[j].fd );
+            if (fds[j].fd != -1 && !cached) release_sock_fd( writefds->fd_array[i], fds[j].fd );
     }
     if (exceptfds)
     {
         for (i = 0; i < exceptfds->fd_count; i++, j++)
         {
             if (fds[j].fd == -1) continue;
-            release_sock_fd( exceptfds->fd_array[i], fds[j].fd );
+            if (!cached) release_sock_fd( exceptfds->fd_array[i], fds[j].fd );
             if (fds[j].revents & POLLHUP)
             {
                 int fd = get_sock_fd( exceptfds->fd_array[i], 0, NULL );
@@ -5369,9 +5396,27 @@ static void release_poll_fds( const WS_fd_set *readfds, const WS_fd_set *writefd
     }
 }
 
+/* compute the time left after an interrupted wait */
+static int get_remaining_timeout( const struct timeval *start, int torig )
+{
+    struct timeval tv;
+
+    gettimeofday( &tv, 0 );
+
+    tv.tv_sec  -= start->tv_sec;
+    tv.tv_usec -= start->tv_usec;
+    if (tv.tv_usec < 0)
+    {
+        tv.tv_usec += 1000000;
+        tv.tv_sec  -= 1;
+    }
+
+    return torig - (tv.tv_sec * 1000) - (tv.tv_usec + 999) / 1000;
+}
+
 static int do_poll(struct pollfd *pollfds, int count, int timeout)
 {
-    struct timeval tv1, tv2;
+    struct timeval tv1;
     int ret, torig = timeout;
 
     if (timeout > 0) gettimeofday( &tv1, 0 );
@@ -5382,22 +5427,440 @@ static int do_poll(struct pollfd *pollfds, int count, int timeout)
         if (timeout < 0) continue;
         if (timeout == 0) return 0;
 
-        gettimeofday( &tv2, 0 );
+        timeout = get_remaining_timeout( &tv1, torig );
+        if (timeout <= 0) return 0;
+    }
+    return ret;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/* Persistent per-thread epoll set used by select() and WSAPoll().
+ *
+ * Applications usually call select() in a loop with mostly the same sockets. Instead
+ * of fetching, checking and polling every descriptor on each call, each thread keeps
+ * a private duplicate of the socket fds registered in an epoll set, keyed on the
+ * socket handle and set type, and only updates the entries that changed since the
+ * previous call. Cached entries are used without asking the server again: the
+ * duplicates keep the sockets open, so closesocket() purges them from the caches of
+ * all threads, and so does every call that creates a socket handle or changes the
+ * socket behind one, since the handle may have been closed with CloseHandle() and
+ * reused. A handle closed that way and reused for another kind of object isn't
+ * noticed until the entry is dropped by a call that doesn't use it. */
+
+#define POLL_KEY_READ   0x10000
+#define POLL_KEY_WRITE  0x20000
+#define POLL_KEY_EXCEPT 0x30000  /* other keys are WSAPoll event masks */
+
+struct poll_cache_entry
+{
+    SOCKET       sock;       /* socket handle, INVALID_SOCKET if the entry is free */
+    unsigned int key;        /* select set type or WSAPoll event mask */
+    int          fd;         /* private duplicate of the socket fd */
+    BOOL         registered; /* fd is registered in the epoll set */
+    unsigned int pos;        /* index in the caller's array, next free entry for free entries */
+    unsigned int serial;     /* serial of the last call using this entry */
+};
+
+struct poll_cache
+{
+    struct list              entry;      /* entry in the global list of caches */
+    CRITICAL_SECTION         cs;         /* protects the entries against closesocket() */
+    int                      epoll_fd;
+    unsigned int             serial;     /* serial of the current call */
+    struct poll_cache_entry *entries;
+    unsigned int             size;       /* allocated entries */
+    unsigned int             count;      /* entries in use, including freed ones */
+    unsigned int             free_list;  /* first free entry */
+    unsigned int            *hash;       /* entry index + 1 for each hash bucket, 0 if empty */
+    unsigned int             hash_size;  /* always a power of 2, larger than twice size */
+    BOOL                     dirty;      /* hash needs to be rebuilt */
+    struct epoll_event      *events;     /* result buffer for epoll_wait */
+};
+
+static struct list poll_caches = LIST_INIT( poll_caches );
+static BOOL epoll_unavailable;
+
+static CRITICAL_SECTION poll_cache_section;
+static CRITICAL_SECTION_DEBUG poll_cache_critsect_debug =
+{
+    0, 0, &poll_cache_section,
+    { &poll_cache_critsect_debug.ProcessLocksList, &poll_cache_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": poll_cache_section") }
+};
+static CRITICAL_SECTION poll_cache_section = { &poll_cache_critsect_debug, -1, 0, 0, 0, 0 };
+
+static inline unsigned int poll_cache_hash( SOCKET s, unsigned int key )
+{
+    return ((unsigned int)s >> 2) * 0x9e3779b1 + key;
+}
+
+static void poll_cache_rebuild_hash( struct poll_cache *cache )
+{
+    unsigned int i, h, mask = cache->hash_size - 1;
+
+    memset( cache->hash, 0, cache->hash_size * sizeof(cache->hash[0]) );
+    for (i = 0; i < cache->count; i++)
+    {
+        if (cache->entries[i].sock == INVALID_SOCKET) continue;
+        h = poll_cache_hash( cache->entries[i].sock, cache->entries[i].key ) & mask;
+        while (cache->hash[h]) h = (h + 1) & mask;
+        cache->hash[h] = i + 1;
+    }
+    cache->dirty = FALSE;
+}
+
+static BOOL poll_cache_grow( struct poll_cache *cache )
+{
+    unsigned int size = max( 16, cache->size * 2 );
+    struct poll_cache_entry *entries;
+    struct epoll_event *events;
+    unsigned int *hash;
+
+    if (!(hash = heap_alloc( 4 * size * sizeof(*hash) ))) return FALSE;
+    if (!(events = heap_realloc( cache->events, size * sizeof(*events) )))
+    {
+        heap_free( hash );
+        return FALSE;
+    }
+    cache->events = events;
+    if (!(entries = heap_realloc( cache->entries, size * sizeof(*entries) )))
+    {
+        heap_free( hash );
+        return FALSE;
+    }
+    cache->entries = entries;
+    cache->size = size;
+    heap_free( cache->hash );
+    cache->hash = hash;
+    cache->hash_size = 4 * size;
+    poll_cache_rebuild_hash( cache );
+    return TRUE;
+}
+
+/* free an entry, the cache lock must be held */
+static void poll_cache_free_entry( struct poll_cache *cache, struct poll_cache_entry *entry )
+{
+    if (entry->registered) epoll_ctl( cache->epoll_fd, EPOLL_CTL_DEL, entry->fd, NULL );
+    close( entry->fd );
+    entry->sock = INVALID_SOCKET;
+    entry->registered = FALSE;
+    entry->pos = cache->free_list;
+    cache->free_list = entry - cache->entries;
+    cache->dirty = TRUE;
+}
+
+/* register the entry fd in the epoll set once the socket can be polled */
+static void poll_cache_register( struct poll_cache *cache, struct poll_cache_entry *entry )
+{
+    struct epoll_event ev;
+    int oob_inlined = 0;
+    socklen_t olen = sizeof(oob_inlined);
+
+    switch (entry->key)
+    {
+    case POLL_KEY_READ:
+        if (is_fd_bound( entry->fd, NULL, NULL ) != 1) return;
+        ev.events = POLLIN;
+        break;
+    case POLL_KEY_WRITE:
+        if (is_fd_bound( entry->fd, NULL, NULL ) != 1 && _get_fd_type( entry->fd ) != SOCK_DGRAM) return;
+        ev.events = POLLOUT;
+        break;
+    case POLL_KEY_EXCEPT:
+        if (is_fd_bound( entry->fd, NULL, NULL ) != 1) return;
+        ev.events = POLLHUP;
+        /* Check if we need to test for urgent data or not */
+        getsockopt( entry->fd, SOL_SOCKET, SO_OOBINLINE, (char *)&oob_inlined, &olen );
+        if (!oob_inlined) ev.events |= POLLPRI;
+        break;
+    default:
+        ev.events = convert_poll_w2u( entry->key );
+        break;
+    }
+    ev.data.u32 = entry - cache->entries;
+    if (!epoll_ctl( cache->epoll_fd, EPOLL_CTL_ADD, entry->fd, &ev ))
+        entry->registered = TRUE;
+    else
+        WARN( "failed to add fd %d to epoll set: %s\n", entry->fd, strerror(errno) );
+}
+
+/* find or create the entry for a socket, the cache lock must be held */
+static struct poll_cache_entry *poll_cache_add( struct poll_cache *cache, SOCKET s, unsigned int key,
+                                                DWORD access, unsigned int pos )
+{
+    struct poll_cache_entry *entry;
+    unsigned int i, h, mask = cache->hash_size - 1;
+    int fd;
+
+    for (h = poll_cache_hash( s, key ) & mask; cache->hash[h]; h = (h + 1) & mask)
+    {
+        entry = &cache->entries[cache->hash[h] - 1];
+        /* the same socket may be listed several times */
+        if (entry->sock == s && entry->key == key && entry->serial != cache->serial) goto done;
+    }
+
+    if ((fd = get_sock_fd( s, access, NULL )) == -1) return NULL;
+
+    if (cache->free_list != ~0u)
+    {
+        i = cache->free_list;
+        cache->free_list = cache->entries[i].pos;
+    }
+    else
+    {
+        if (cache->count == cache->size && !poll_cache_grow( cache ))
+        {
+            release_sock_fd( s, fd );
+            SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+            return NULL;
+        }
+        i = cache->count++;
+    }
+    fcntl( fd, F_SETFD, FD_CLOEXEC );
+
+    entry = &cache->entries[i];
+    entry->sock = s;
+    entry->key = key;
+    entry->fd = fd;
+    entry->registered = FALSE;
+
+    /* a freed entry may still be in the hash, that doesn't matter since it won't match */
+    for (h = poll_cache_hash( s, key ) & mask; cache->hash[h]; h = (h + 1) & mask)
+        if (cache->hash[h] == i + 1) break;
+    cache->hash[h] = i + 1;
+
+done:
+    entry->pos = pos;
+    entry->serial = cache->serial;
+    if (!entry->registered) poll_cache_register( cache, entry );
+    return entry;
+}
+
+/* start updating the cache for a new call */
+static void poll_cache_begin( struct poll_cache *cache )
+{
+    EnterCriticalSection( &cache->cs );
+    if (cache->dirty) poll_cache_rebuild_hash( cache );
+    cache->serial++;
+}
+
+/* free the entries that were not used by the current call */
+static void poll_cache_end( struct poll_cache *cache )
+{
+    unsigned int i;
+
+    for (i = 0; i < cache->count; i++)
+    {
+        if (cache->entries[i].sock == INVALID_SOCKET) continue;
+        if (cache->entries[i].serial != cache->serial)
+            poll_cache_free_entry( cache, &cache->entries[i] );
+    }
+    LeaveCriticalSection( &cache->cs );
+}
+
+static struct poll_cache *get_poll_cache(void)
+{
+    struct per_thread_data *ptb = get_per_thread_data();
+    struct poll_cache *cache;
+    int fd;
+
+    if (ptb->poll_cache || epoll_unavailable) return ptb->poll_cache;
+
+    if ((fd = epoll_create( 16 )) == -1)
+    {
+        WARN( "epoll_create failed, falling back to poll: %s\n", strerror(errno) );
+        epoll_unavailable = TRUE;
+        return NULL;
+    }
+    fcntl( fd, F_SETFD, FD_CLOEXEC );
+
+    if (!(cache = heap_alloc_zero( sizeof(*cache) )))
+    {
+        close( fd );
+        return NULL;
+    }
+    cache->epoll_fd = fd;
+    cache->free_list = ~0u;
+    if (!poll_cache_grow( cache ))
+    {
+        heap_free( cache );
+        close( fd );
+        return NULL;
+    }
+    InitializeCriticalSection( &cache->cs );
+    cache->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": poll_cache.cs");
+
+    EnterCriticalSection( &poll_cache_section );
+    list_add_tail( &poll_caches, &cache->entry );
+    LeaveCriticalSection( &poll_cache_section );
+    return ptb->poll_cache = cache;
+}
+
+static void free_poll_cache( struct poll_cache *cache )
+{
+    unsigned int i;
+
+    if (!cache) return;
+
+    EnterCriticalSection( &poll_cache_section );
+    list_remove( &cache->entry );
+    LeaveCriticalSection( &poll_cache_section );
+
+    for (i = 0; i < cache->count; i++)
+        if (cache->entries[i].sock != INVALID_SOCKET) close( cache->entries[i].fd );
+    close( cache->epoll_fd );
+    cache->cs.DebugInfo->Spare[0] = 0;
+    DeleteCriticalSection( &cache->cs );
+    heap_free( cache->entries );
+    heap_free( cache->events );
+    heap_free( cache->hash );
+    heap_free( cache );
+}
+
+/* drop a socket handle that is closed, created or changed from the caches of all threads */
+static void poll_cache_remove_socket( SOCKET s )
+{
+    struct poll_cache *cache;
+    unsigned int i;
+
+    EnterCriticalSection( &poll_cache_section );
+    LIST_FOR_EACH_ENTRY( cache, &poll_caches, struct poll_cache, entry )
+    {
+        EnterCriticalSection( &cache->cs );
+        for (i = 0; i < cache->count; i++)
+            if (cache->entries[i].sock == s) poll_cache_free_entry( cache, &cache->entries[i] );
+        LeaveCriticalSection( &cache->cs );
+    }
+    LeaveCriticalSection( &poll_cache_section );
+}
+
+/* update the cache for the corresponding fd sets and return the poll array */
+static struct pollfd *poll_cache_set_fds( struct poll_cache *cache, const WS_fd_set *readfds,
+                                          const WS_fd_set *writefds, const WS_fd_set *exceptfds,
+                                          int *count_ptr )
+{
+    static const unsigned int keys[3] = { POLL_KEY_READ, POLL_KEY_WRITE, POLL_KEY_EXCEPT };
+    static const DWORD access[3] = { FILE_READ_DATA, FILE_WRITE_DATA, 0 };
+    const WS_fd_set *sets[3];
+    struct poll_cache_entry *entry;
+    unsigned int i, j = 0, k, count = 0;
+    struct pollfd *fds;
+
+    sets[0] = readfds;
+    sets[1] = writefds;
+    sets[2] = exceptfds;
+    for (k = 0; k < 3; k++) if (sets[k]) count += sets[k]->fd_count;
+    *count_ptr = count;
+    if (!count)
+    {
+        SetLastError(WSAEINVAL);
+        return NULL;
+    }
+
+    if (!(fds = get_poll_buffer( count )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return NULL;
+    }
 
-        tv2.tv_sec  -= tv1.tv_sec;
-        tv2.tv_usec -= tv1.tv_usec;
-        if (tv2.tv_usec < 0)
+    poll_cache_begin( cache );
+    for (k = 0; k < 3; k++)
+    {
+        if (!sets[k]) continue;
+        for (i = 0; i < sets[k]->fd_count; i++, j++)
         {
-            tv2.tv_usec += 1000000;
-            tv2.tv_sec  -= 1;
+            if (!(entry = poll_cache_add( cache, sets[k]->fd_array[i], keys[k], access[k], j )))
+            {
+                /* keep the entries of the previous call */
+                LeaveCriticalSection( &cache->cs );
+                return NULL;
+            }
+            fds[j].fd = entry->registered ? entry->fd : -1;
         }
+    }
+    poll_cache_end( cache );
+    return fds;
+}
+
+/* update the cache for a WSAPoll array, invalid sockets are set to -1 in the poll array */
+static void poll_cache_set_wsapoll_fds( struct poll_cache *cache, const WSAPOLLFD *wfds,
+                                        unsigned int count, struct pollfd *fds )
+{
+    struct poll_cache_entry *entry;
+    unsigned int i;
+
+    poll_cache_begin( cache );
+    for (i = 0; i < count; i++)
+    {
+        entry = poll_cache_add( cache, wfds[i].fd, (unsigned short)wfds[i].events, 0, i );
+        fds[i].fd = entry && entry->registered ? entry->fd : -1;
+    }
+    poll_cache_end( cache );
+}
 
-        timeout = torig - (tv2.tv_sec * 1000) - (tv2.tv_usec + 999) / 1000;
+/* wait on the epoll set and store the results in the poll array */
+static int poll_cache_wait( struct poll_cache *cache, struct pollfd *fds, unsigned int count, int timeout )
+{
+    struct poll_cache_entry *entry;
+    struct timeval tv1;
+    int i, n, ret = 0, torig = timeout;
+
+    for (i = 0; i < count; i++) fds[i].revents = 0;
+
+    if (timeout > 0) gettimeofday( &tv1, 0 );
+
+    while ((n = epoll_wait( cache->epoll_fd, cache->events, cache->size, timeout )) < 0)
+    {
+        if (errno != EINTR) return n;
+        if (timeout < 0) continue;
+        if (timeout == 0) return 0;
+
+        timeout = get_remaining_timeout( &tv1, torig );
         if (timeout <= 0) return 0;
     }
+
+    EnterCriticalSection( &cache->cs );
+    for (i = 0; i < n; i++)
+    {
+        entry = &cache->entries[cache->events[i].data.u32];
+        /* the socket may have been closed by another thread in the meantime */
+        if (entry->sock == INVALID_SOCKET || entry->serial != cache->serial) continue;
+        /* epoll flags have the same values as the poll ones */
+        fds[entry->pos].revents = cache->events[i].events;
+        ret++;
+    }
+    LeaveCriticalSection( &cache->cs );
     return ret;
 }
 
+#else  /* HAVE_SYS_EPOLL_H */
+
+struct poll_cache;
+
+static inline struct poll_cache *get_poll_cache(void) { return NULL; }
+static void free_poll_cache( struct poll_cache *cache ) { }
+static void poll_cache_remove_socket( SOCKET s ) { }
+
+static struct pollfd *poll_cache_set_fds( struct poll_cache *cache, const WS_fd_set *readfds,
+                                          const WS_fd_set *writefds, const WS_fd_set *exceptfds,
+                                          int *count_ptr )
+{
+    return NULL;
+}
+
+static void poll_cache_set_wsapoll_fds( struct poll_cache *cache, const WSAPOLLFD *wfds,
+                                        unsigned int count, struct pollfd *fds )
+{
+}
+
+static int poll_cache_wait( struct poll_cache *cache, struct pollfd *fds, unsigned int count, int timeout )
+{
+    return -1;
+}
+
+#endif  /* HAVE_SYS_EPOLL_H */
+
 /* map the poll results back into the Windows fd sets */
 static int get_poll_results( WS_fd_set *readfds, WS_fd_set *writefds, WS_fd_set *exceptfds,
                              const struct pollfd *fds )
@@ -5446,20 +5909,29 @@ int WINAPI WS_select(int nfds, WS_fd_set *ws_readfds,
                      WS_fd_set *ws_writefds, WS_fd_set *ws_exceptfds,
                      const struct WS_timeval* ws_timeout)
 {
+    struct poll_cache *cache;
     struct pollfd *pollfds;
     int count, ret, timeout = -1;
 
     TRACE("read %p, write %p, excp %p timeout %p\n",
           ws_readfds, ws_writefds, ws_exceptfds, ws_timeout);
 
-    if (!(pollfds = fd_sets_to_poll( ws_readfds, ws_writefds, ws_exceptfds, &count )))
-        return SOCKET_ERROR;
-
     if (ws_timeout)
         timeout = (ws_timeout->tv_sec * 1000) + (ws_timeout->tv_usec + 999) / 1000;
 
-    ret = do_poll(pollfds, count, timeout);
-    release_poll_fds( ws_readfds, ws_writefds, ws_exceptfds, pollfds );
+    if ((cache = get_poll_cache()))
+    {
+        if (!(pollfds = poll_cache_set_fds( cache, ws_readfds, ws_writefds, ws_exceptfds, &count )))
+            return SOCKET_ERROR;
+        ret = poll_cache_wait( cache, pollfds, count, timeout );
+    }
+    else
+    {
+        if (!(pollfds = fd_sets_to_poll( ws_readfds, ws_writefds, ws_exceptfds, &count )))
+            return SOCKET_ERROR;
+        ret = do_poll(pollfds, count, timeout);
+    }
+    release_poll_fds( ws_readfds, ws_writefds, ws_exceptfds, pollfds, cache != NULL );
 
     if (ret == -1) SetLastError(wsaErrno());
     else ret = get_poll_results( ws_readfds, ws_writefds, ws_exceptfds, pollfds );
@@ -5472,6 +5944,7 @@ int WINAPI WS_select(int nfds, WS_fd_set *ws_readfds,
 int WINAPI WSAPoll(WSAPOLLFD *wfds, ULONG count, int timeout)
 {
     int i, ret;
+    struct poll_cache *cache;
     struct pollfd *ufds;
 
     if (!count)
@@ -5485,26 +5958,34 @@ int WINAPI WSAPoll(WSAPOLLFD *wfds, ULONG count, int timeout)
         return SOCKET_ERROR;
     }
 
-    if (!(ufds = HeapAlloc(GetProcessHeap(), 0, count * sizeof(ufds[0]))))
+    if (!(ufds = get_poll_buffer( count )))
     {
         SetLastError(WSAENOBUFS);
         return SOCKET_ERROR;
     }
 
-    for (i = 0; i < count; i++)
+    if ((cache = get_poll_cache()))
     {
-        ufds[i].fd = get_sock_fd(wfds[i].fd, 0, NULL);
-        ufds[i].events = convert_poll_w2u(wfds[i].events);
-        ufds[i].revents = 0;
+        poll_cache_set_wsapoll_fds( cache, wfds, count, ufds );
+        ret = poll_cache_wait( cache, ufds, count, timeout );
     }
+    else
+    {
+        for (i = 0; i < count; i++)
+        {
+            ufds[i].fd = get_sock_fd(wfds[i].fd, 0, NULL);
+            ufds[i].events = convert_poll_w2u(wfds[i].events);
+            ufds[i].revents = 0;
+        }
 
-    ret = do_poll(ufds, count, timeout);
+        ret = do_poll(ufds, count, timeout);
+    }
 
     for (i = 0; i < count; i++)
     {
         if (ufds[i].fd != -1)
         {
-            release_sock_fd(wfds[i].fd, ufds[i].fd);
+            if (!cache) release_sock_fd(wfds[i].fd, ufds[i].fd);
             if (ufds[i].revents & POLLHUP)
             {
                 /* Check if the socket still exists */
@@ -5524,7 +6005,6 @@ int WINAPI WSAPoll(WSAPOLLFD *wfds, ULONG count, int timeout)
             wfds[i].revents = WS_POLLNVAL;
     }
 
-    HeapFree(GetProcessHeap(), 0, ufds);
     return ret;
 }
 
@@ -5545,6 +6025,23 @@ static void WS_AddCompletion( SOCKET sock, ULONG_PTR CompletionValue, NTSTATUS C
 }
 
 
+/* finish an overlapped operation that succeeded right away, posting its completion
+ * and re-enabling the socket events in a single server call */
+static void complete_sock_io( SOCKET sock, ULONG_PTR cvalue, ULONG information, unsigned int mask )
+{
+    SERVER_START_REQ( complete_socket_io )
+    {
+        req->handle      = wine_server_obj_handle( SOCKET2HANDLE(sock) );
+        req->mask        = mask;
+        req->cvalue      = cvalue;
+        req->information = information;
+        req->status      = STATUS_SUCCESS;
+        wine_server_call( req );
+    }
+    SERVER_END_REQ;
+}
+
+
 /***********************************************************************
  *		send			(WS2_32.19)
  */
@@ -7589,6 +8086,7 @@ SOCKET WINAPI WSASocketW(int af, int type, int protocol,
     if (lpProtocolInfo && lpProtocolInfo->dwServiceFlags4 == 0xff00ff00) {
       ret = lpProtocolInfo->dwServiceFlags3;
       TRACE("\tgot duplicate %04lx\n", ret);
+      poll_cache_remove_socket(ret);
       return ret;
     }
 
@@ -7687,6 +8185,7 @@ SOCKET WINAPI WSASocketW(int af, int type, int protocol,
     if (ret)
     {
         TRACE("\tcreated %04lx\n", ret );
+        poll_cache_remove_socket(ret);
         if (ipxptype > 0)
             set_ipx_packettype(ret, ipxptype);
 
@@ -8121,13 +8620,16 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
             iosb->Information = n;
             if (!wsa->completion_func)
             {
-                if (cvalue) WS_AddCompletion( s, cvalue, STATUS_SUCCESS, n, FALSE );
+                complete_sock_io( s, cvalue, n, FD_READ );
                 if (lpOverlapped->hEvent) SetEvent( lpOverlapped->hEvent );
                 HeapFree( GetProcessHeap(), 0, wsa );
             }
-            else NtQueueApcThread( GetCurrentThread(), (PNTAPCFUNC)ws2_async_apc,
-                                   (ULONG_PTR)wsa, (ULONG_PTR)iosb, 0 );
-            _enable_event(SOCKET2HANDLE(s), FD_READ, 0, 0);
+            else
+            {
+                NtQueueApcThread( GetCurrentThread(), (PNTAPCFUNC)ws2_async_apc,
+                                  (ULONG_PTR)wsa, (ULONG_PTR)iosb, 0 );
+                _enable_event(SOCKET2HANDLE(s), FD_READ, 0, 0);
+            }
             return 0;
         }
 
@@ -4096,6 +4096,85 @@ todo_wine
 #undef FD_SET_ALL
 #undef FD_ZERO_ALL
 
+static void test_select_loop(void)
+{
+    static const struct timeval zero_timeout, timeout = { 1, 0 };
+    SOCKET src[16], dst[16], old;
+    fd_set readfds;
+    unsigned int i, j, k;
+    char buf[4];
+    int ret;
+
+    for (i = 0; i < ARRAY_SIZE(src); i++)
+        ok(!tcp_socketpair(&src[i], &dst[i]), "creating socket pair failed\n");
+
+    /* select repeatedly on the same set, with a different socket ready each time */
+    for (k = 0; k < 100; k++)
+    {
+        i = k % ARRAY_SIZE(src);
+        ret = send(src[i], "x", 1, 0);
+        ok(ret == 1, "send failed: %d\n", WSAGetLastError());
+
+        FD_ZERO(&readfds);
+        for (j = 0; j < ARRAY_SIZE(dst); j++) FD_SET(dst[j], &readfds);
+        ret = select(0, &readfds, NULL, NULL, &timeout);
+        ok(ret == 1, "iteration %u: expected 1, got %d\n", k, ret);
+        ok(FD_ISSET(dst[i], &readfds), "iteration %u: socket %u is not in the set\n", k, i);
+
+        ret = recv(dst[i], buf, sizeof(buf), 0);
+        ok(ret == 1, "recv failed: %d\n", WSAGetLastError());
+    }
+
+    /* replace a socket by a new one, which usually gets the same handle value */
+    old = dst[0];
+    closesocket(src[0]);
+    closesocket(dst[0]);
+    ok(!tcp_socketpair(&src[0], &dst[0]), "creating socket pair failed\n");
+    if (dst[0] != old) trace("got a different handle value\n");
+
+    FD_ZERO(&readfds);
+    for (j = 0; j < ARRAY_SIZE(dst); j++) FD_SET(dst[j], &readfds);
+    ret = select(0, &readfds, NULL, NULL, &zero_timeout);
+    ok(!ret, "expected 0, got %d\n", ret);
+
+    ret = send(src[0], "x", 1, 0);
+    ok(ret == 1, "send failed: %d\n", WSAGetLastError());
+    FD_ZERO(&readfds);
+    for (j = 0; j < ARRAY_SIZE(dst); j++) FD_SET(dst[j], &readfds);
+    ret = select(0, &readfds, NULL, NULL, &timeout);
+    ok(ret == 1, "expected 1, got %d\n", ret);
+    ok(FD_ISSET(dst[0], &readfds), "socket 0 is not in the set\n");
+    ret = recv(dst[0], buf, sizeof(buf), 0);
+    ok(ret == 1, "recv failed: %d\n", WSAGetLastError());
+
+    /* same thing without closesocket, the peer sees the socket closed */
+    old = src[0];
+    CloseHandle((HANDLE)dst[0]);
+    ok(!tcp_socketpair(&src[0], &dst[0]), "creating socket pair failed\n");
+
+    ret = send(src[0], "x", 1, 0);
+    ok(ret == 1, "send failed: %d\n", WSAGetLastError());
+    FD_ZERO(&readfds);
+    for (j = 0; j < ARRAY_SIZE(dst); j++) FD_SET(dst[j], &readfds);
+    ret = select(0, &readfds, NULL, NULL, &timeout);
+    ok(ret == 1, "expected 1, got %d\n", ret);
+    ok(FD_ISSET(dst[0], &readfds), "socket 0 is not in the set\n");
+
+    FD_ZERO(&readfds);
+    FD_SET(old, &readfds);
+    ret = select(0, &readfds, NULL, NULL, &timeout);
+    ok(ret == 1, "expected 1, got %d\n", ret);
+    ret = recv(old, buf, sizeof(buf), 0);
+    ok(!ret, "expected 0, got %d\n", ret);
+    closesocket(old);
+
+    for (i = 0; i < ARRAY_SIZE(src); i++)
+    {
+        closesocket(src[i]);
+        closesocket(dst[i]);
+    }
+}
+
 static DWORD WINAPI AcceptKillThread(void *param)
 {
     select_thread_params *par = param;
@@ -11500,6 +11579,82 @@ static void test_iocp(void)
     closesocket(dst);
 }
 
+static void test_iocp_throughput(void)
+{
+    static const int count = 1000;
+    char send_buf[256], recv_buf[256];
+    WSABUF send_wsabuf, recv_wsabuf;
+    OVERLAPPED send_ovl, recv_ovl, *ovl;
+    DWORD flags, bytes, ticks, total = 0;
+    ULONG_PTR key;
+    SOCKET src, dst;
+    HANDLE port;
+    int i, ret;
+
+    ret = tcp_socketpair_ovl(&src, &dst);
+    ok(!ret, "creating socket pair failed\n");
+    if (ret) return;
+
+    port = CreateIoCompletionPort((HANDLE)dst, NULL, 0x12345678, 0);
+    ok(port != NULL, "CreateIoCompletionPort failed, error %u\n", GetLastError());
+
+    memset(send_buf, 0x55, sizeof(send_buf));
+    send_wsabuf.buf = send_buf;
+    send_wsabuf.len = sizeof(send_buf);
+    recv_wsabuf.buf = recv_buf;
+    recv_wsabuf.len = sizeof(recv_buf);
+
+    /* ping-pong on loopback, the data is usually there before the overlapped recv is issued */
+    ticks = GetTickCount();
+    for (i = 0; i < count; i++)
+    {
+        ret = send(src, send_buf, sizeof(send_buf), 0);
+        ok(ret == sizeof(send_buf), "send returned %d, error %u\n", ret, WSAGetLastError());
+
+        memset(&recv_ovl, 0, sizeof(recv_ovl));
+        flags = 0;
+        ret = WSARecv(dst, &recv_wsabuf, 1, NULL, &flags, &recv_ovl, NULL);
+        ok(!ret || WSAGetLastError() == ERROR_IO_PENDING, "WSARecv failed, error %u\n", WSAGetLastError());
+
+        bytes = 0xdeadbeef;
+        key = 0xdeadbeef;
+        ovl = NULL;
+        ret = GetQueuedCompletionStatus(port, &bytes, &key, &ovl, 1000);
+        ok(ret, "GetQueuedCompletionStatus failed, error %u\n", GetLastError());
+        ok(key == 0x12345678, "got key %#lx\n", key);
+        ok(ovl == &recv_ovl, "got ovl %p\n", ovl);
+        if (!ret) break;
+        total += bytes;
+
+        /* a short read leaves the rest of the data for the next iteration */
+        if (bytes < sizeof(send_buf))
+        {
+            ret = recv(dst, recv_buf, sizeof(recv_buf) - bytes, 0);
+            ok(ret == sizeof(recv_buf) - bytes, "recv returned %d\n", ret);
+            total += ret;
+        }
+
+        memset(&send_ovl, 0, sizeof(send_ovl));
+        ret = WSASend(dst, &send_wsabuf, 1, NULL, 0, &send_ovl, NULL);
+        ok(!ret || WSAGetLastError() == ERROR_IO_PENDING, "WSASend failed, error %u\n", WSAGetLastError());
+
+        ret = GetQueuedCompletionStatus(port, &bytes, &key, &ovl, 1000);
+        ok(ret, "GetQueuedCompletionStatus failed, error %u\n", GetLastError());
+        ok(ovl == &send_ovl, "got ovl %p\n", ovl);
+        ok(bytes == sizeof(send_buf), "got bytes %u\n", bytes);
+
+        ret = recv(src, recv_buf, sizeof(recv_buf), MSG_WAITALL);
+        ok(ret == sizeof(recv_buf), "recv returned %d\n", ret);
+    }
+    ticks = GetTickCount() - ticks;
+    ok(total == count * sizeof(send_buf), "got %u bytes\n", total);
+    trace("%d overlapped round trips took %u ms\n", count, ticks);
+
+    CloseHandle(port);
+    closesocket(src);
+    closesocket(dst);
+}
+
 static void test_WSCGetProviderInfo(void)
 {
     int ret;
@@ -11582,6 +11737,7 @@ START_TEST( sock )
     test_errors();
     test_listen();
     test_select();
+    test_select_loop();
     test_accept();
     test_getpeername();
     test_getsockname();
@@ -11599,6 +11755,7 @@ START_TEST( sock )
     test_WSAPoll();
     test_write_watch();
     test_iocp();
+    test_iocp_throughput();
 
     test_events(0);
     test_events(1);
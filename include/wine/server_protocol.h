@@ -772,6 +772,15 @@ struct rawinput_device
 };
 
 
+struct sync_state
+{
+    unsigned int id;
+    int          state;
+};
+
+#define SYNC_STATE_ENTRIES 65536
+
+
 
 
 
@@ -1305,7 +1314,11 @@ struct event_op_reply
 {
     struct reply_header __header;
     int           state;
-    char __pad_12[4];
+    int           manual_reset;
+    unsigned int  access;
+    unsigned int  index;
+    unsigned int  id;
+    char __pad_28[4];
 };
 enum event_op { PULSE_EVENT, SET_EVENT, RESET_EVENT };
 
@@ -1322,6 +1335,26 @@ struct query_event_reply
 };
 
 
+struct get_sync_state_request
+{
+    struct request_header __header;
+    obj_handle_t  handle;
+    int           want_mapping;
+    char __pad_20[4];
+};
+struct get_sync_state_reply
+{
+    struct reply_header __header;
+    unsigned int  access;
+    unsigned int  type;
+    unsigned int  index;
+    unsigned int  id;
+    obj_handle_t  mapping;
+    char __pad_28[4];
+};
+enum sync_state_type { SYNC_STATE_NONE, SYNC_STATE_MANUAL_EVENT, SYNC_STATE_AUTO_EVENT, SYNC_STATE_SEMAPHORE };
+
+
 struct open_event_request
 {
     struct request_header __header;
@@ -1462,7 +1495,9 @@ struct release_semaphore_reply
 {
     struct reply_header __header;
     unsigned int prev_count;
-    char __pad_12[4];
+    unsigned int access;
+    unsigned int index;
+    unsigned int id;
 };
 
 struct query_semaphore_request
@@ -1798,6 +1833,23 @@ struct enable_socket_event_reply
     struct reply_header __header;
 };
 
+
+struct complete_socket_io_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+    unsigned int mask;
+    char __pad_20[4];
+    apc_param_t  cvalue;
+    apc_param_t  information;
+    unsigned int status;
+    char __pad_44[4];
+};
+struct complete_socket_io_reply
+{
+    struct reply_header __header;
+};
+
 struct set_socket_deferred_request
 {
     struct request_header __header;
@@ -5814,6 +5866,7 @@ enum request
     REQ_create_event,
     REQ_event_op,
     REQ_query_event,
+    REQ_get_sync_state,
     REQ_open_event,
     REQ_create_keyed_event,
     REQ_open_keyed_event,
@@ -5843,6 +5896,7 @@ enum request
     REQ_get_socket_event,
     REQ_get_socket_info,
     REQ_enable_socket_event,
+    REQ_complete_socket_io,
     REQ_set_socket_deferred,
     REQ_alloc_console,
     REQ_free_console,
@@ -6116,6 +6170,7 @@ union generic_request
     struct create_event_request create_event_request;
     struct event_op_request event_op_request;
     struct query_event_request query_event_request;
+    struct get_sync_state_request get_sync_state_request;
     struct open_event_request open_event_request;
     struct create_keyed_event_request create_keyed_event_request;
     struct open_keyed_event_request open_keyed_event_request;
@@ -6145,6 +6200,7 @@ union generic_request
     struct get_socket_event_request get_socket_event_request;
     struct get_socket_info_request get_socket_info_request;
     struct enable_socket_event_request enable_socket_event_request;
+    struct complete_socket_io_request complete_socket_io_request;
     struct set_socket_deferred_request set_socket_deferred_request;
     struct alloc_console_request alloc_console_request;
     struct free_console_request free_console_request;
@@ -6416,6 +6472,7 @@ union generic_reply
     struct create_event_reply create_event_reply;
     struct event_op_reply event_op_reply;
     struct query_event_reply query_event_reply;
+    struct get_sync_state_reply get_sync_state_reply;
     struct open_event_reply open_event_reply;
     struct create_keyed_event_reply create_keyed_event_reply;
     struct open_keyed_event_reply open_keyed_event_reply;
@@ -6445,6 +6502,7 @@ union generic_reply
     struct get_socket_event_reply get_socket_event_reply;
     struct get_socket_info_reply get_socket_info_reply;
     struct enable_socket_event_reply enable_socket_event_reply;
+    struct complete_socket_io_reply complete_socket_io_reply;
     struct set_socket_deferred_reply set_socket_deferred_reply;
     struct alloc_console_reply alloc_console_reply;
     struct free_console_reply free_console_reply;
@@ -6684,7 +6742,7 @@ union generic_reply
 
 /* ### protocol_version begin ### */
 
-#define SERVER_PROTOCOL_VERSION 603
+#define SERVER_PROTOCOL_VERSION 605
 
 /* ### protocol_version end ### */
 
@@ -31,6 +31,7 @@
 #include "windef.h"
 #include "winternl.h"
 
+#include "file.h"
 #include "handle.h"
 #include "thread.h"
 #include "request.h"
@@ -42,6 +43,7 @@ struct event
     struct list    kernel_object;   /* list of kernel object pointers */
     int            manual_reset;    /* is it a manual reset event? */
     int            signaled;        /* event has been signaled */
+    unsigned int   state_index;     /* index of the published state */
 };
 
 static void event_dump( struct object *obj, int verbose );
@@ -51,6 +53,7 @@ static void event_satisfied( struct object *obj, struct wait_queue_entry *entry
 static unsigned int event_map_access( struct object *obj, unsigned int access );
 static int event_signal( struct object *obj, unsigned int access);
 static struct list *event_get_kernel_obj_list( struct object *obj );
+static void event_destroy( struct object *obj );
 
 static const struct object_ops event_ops =
 {
@@ -72,7 +75,7 @@ static const struct object_ops event_ops =
     no_open_file,              /* open_file */
     event_get_kernel_obj_list, /* get_kernel_obj_list */
     no_close_handle,           /* close_handle */
-    no_destroy                 /* destroy */
+    event_destroy              /* destroy */
 };
 
 
@@ -110,6 +113,73 @@ static const struct object_ops keyed_event_ops =
 };
 
 
+/* The state of events and semaphores is published in a mapping shared with
+ * all the clients, so that they can tell without a server call when setting,
+ * resetting or polling an object would not change anything. Entries are
+ * tagged with an object id, so that clients can detect reused entries. */
+
+static struct mapping *sync_state_mapping;
+static struct sync_state *sync_states;
+static unsigned int sync_states_used = 1;  /* entry 0 is never used */
+static unsigned int sync_states_free;      /* free list, linked through the state field */
+static unsigned int last_sync_state_id;
+
+static inline void store_sync_state( int *ptr, int value )
+{
+    /* clients check the id again after reading the state, the stores must not be reordered */
+#if defined(__i386__) || defined(__x86_64__)
+    *(volatile int *)ptr = value;
+#else
+    __atomic_store_n( ptr, value, __ATOMIC_SEQ_CST );
+#endif
+}
+
+/* allocate a published state entry, return 0 if none is available */
+unsigned int alloc_sync_state( int state )
+{
+    static int failed;
+    unsigned int index;
+
+    if (!sync_states)
+    {
+        if (failed) return 0;
+        if (!(sync_state_mapping = create_shared_mapping( SYNC_STATE_ENTRIES * sizeof(*sync_states),
+                                                          (void **)&sync_states )))
+        {
+            failed = 1;
+            clear_error();
+            return 0;
+        }
+    }
+
+    if ((index = sync_states_free)) sync_states_free = sync_states[index].state;
+    else if (sync_states_used < SYNC_STATE_ENTRIES) index = sync_states_used++;
+    else return 0;
+
+    if (!++last_sync_state_id) last_sync_state_id++;
+    store_sync_state( &sync_states[index].state, state );
+    store_sync_state( (int *)&sync_states[index].id, last_sync_state_id );
+    return index;
+}
+
+void free_sync_state( unsigned int index )
+{
+    if (!index) return;
+    store_sync_state( (int *)&sync_states[index].id, 0 );
+    store_sync_state( &sync_states[index].state, sync_states_free );
+    sync_states_free = index;
+}
+
+void set_sync_state( unsigned int index, int state )
+{
+    if (index) store_sync_state( &sync_states[index].state, state );
+}
+
+unsigned int get_sync_state_id( unsigned int index )
+{
+    return index ? sync_states[index].id : 0;
+}
+
 struct event *create_event( struct object *root, const struct unicode_str *name,
                             unsigned int attr, int manual_reset, int initial_state,
                             const struct security_descriptor *sd )
@@ -124,6 +194,7 @@ struct event *create_event( struct object *root, const struct unicode_str *name,
             list_init( &event->kernel_object );
             event->manual_reset = manual_reset;
             event->signaled     = initial_state;
+            event->state_index  = alloc_sync_state( initial_state );
         }
     }
     return event;
@@ -140,6 +211,7 @@ void pulse_event( struct event *event )
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
     event->signaled = 0;
+    set_sync_state( event->state_index, 0 );
 }
 
 void set_event( struct event *event )
@@ -147,11 +219,13 @@ void set_event( struct event *event )
     event->signaled = 1;
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
+    set_sync_state( event->state_index, event->signaled );
 }
 
 void reset_event( struct event *event )
 {
     event->signaled = 0;
+    set_sync_state( event->state_index, 0 );
 }
 
 static void event_dump( struct object *obj, int verbose )
@@ -181,7 +255,11 @@ static void event_satisfied( struct object *obj, struct wait_queue_entry *entry
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
     /* Reset if it's an auto-reset event */
-    if (!event->manual_reset) event->signaled = 0;
+    if (!event->manual_reset)
+    {
+        event->signaled = 0;
+        set_sync_state( event->state_index, 0 );
+    }
 }
 
 static unsigned int event_map_access( struct object *obj, unsigned int access )
@@ -213,6 +291,13 @@ static struct list *event_get_kernel_obj_list( struct object *obj )
     return &event->kernel_object;
 }
 
+static void event_destroy( struct object *obj )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    free_sync_state( event->state_index );
+}
+
 struct keyed_event *create_keyed_event( struct object *root, const struct unicode_str *name,
                                         unsigned int attr, const struct security_descriptor *sd )
 {
@@ -323,6 +408,10 @@ DECL_HANDLER(event_op)
 
     if (!(event = get_event_obj( current->process, req->handle, EVENT_MODIFY_STATE ))) return;
     reply->state = event->signaled;
+    reply->manual_reset = event->manual_reset;
+    reply->access = get_handle_access( current->process, req->handle );
+    reply->index = event->state_index;
+    reply->id = get_sync_state_id( event->state_index );
     switch(req->op)
     {
     case PULSE_EVENT:
@@ -354,6 +443,29 @@ DECL_HANDLER(query_event)
     release_object( event );
 }
 
+/* find the published state of an event or semaphore */
+DECL_HANDLER(get_sync_state)
+{
+    struct object *obj;
+
+    if (!(obj = get_handle_obj( current->process, req->handle, 0, NULL ))) return;
+
+    reply->access = get_handle_access( current->process, req->handle );
+    if (obj->ops == &event_ops)
+    {
+        struct event *event = (struct event *)obj;
+        reply->type  = event->manual_reset ? SYNC_STATE_MANUAL_EVENT : SYNC_STATE_AUTO_EVENT;
+        reply->index = event->state_index;
+    }
+    else if ((reply->index = get_semaphore_state_index( obj ))) reply->type = SYNC_STATE_SEMAPHORE;
+
+    reply->id = get_sync_state_id( reply->index );
+    if (req->want_mapping && sync_state_mapping)
+        reply->mapping = alloc_handle_no_access_check( current->process, sync_state_mapping,
+                                                       SECTION_MAP_READ, 0 );
+    release_object( obj );
+}
+
 /* create a keyed event */
 DECL_HANDLER(create_keyed_event)
 {
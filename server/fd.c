@@ -363,14 +363,25 @@ static file_pos_t max_unix_offset = OFF_T_MAX;
 
 struct timeout_user
 {
-    struct list           entry;      /* entry in sorted timeout list */
+    struct list           entry;      /* entry in expired timeout list */
+    unsigned int          index;      /* index in timeout heap, or TIMEOUT_EXPIRED */
     abstime_t             when;       /* timeout expiry */
     timeout_callback      callback;   /* callback function */
     void                 *private;    /* callback private data */
 };
 
-static struct list abs_timeout_list = LIST_INIT(abs_timeout_list); /* sorted absolute timeouts list */
-static struct list rel_timeout_list = LIST_INIT(rel_timeout_list); /* sorted relative timeouts list */
+#define TIMEOUT_EXPIRED (~0u)
+
+/* binary min-heap of timeouts, ordered by expiry time */
+struct timeout_heap
+{
+    struct timeout_user **users;      /* heap array */
+    unsigned int          count;      /* number of entries in use */
+    unsigned int          size;       /* allocated size of the array */
+};
+
+static struct timeout_heap abs_timeouts;  /* absolute timeouts heap */
+static struct timeout_heap rel_timeouts;  /* relative timeouts heap */
 timeout_t current_time;
 timeout_t monotonic_time;
 
@@ -383,43 +394,117 @@ void set_current_time(void)
     monotonic_time = monotonic_counter();
 }
 
+/* expiry time of a timeout; absolute in the absolute heap, monotonic in the relative one */
+static inline timeout_t get_timeout_expiry( const struct timeout_user *user )
+{
+    return user->when > 0 ? user->when : -user->when;
+}
+
+static inline struct timeout_heap *get_timeout_heap( const struct timeout_user *user )
+{
+    return user->when > 0 ? &abs_timeouts : &rel_timeouts;
+}
+
+static inline void timeout_heap_set( struct timeout_heap *heap, unsigned int index, struct timeout_user *user )
+{
+    heap->users[index] = user;
+    user->index = index;
+}
+
+/* move an entry towards the root until the heap property is restored */
+static void timeout_heap_sift_up( struct timeout_heap *heap, unsigned int index )
+{
+    struct timeout_user *user = heap->users[index];
+    timeout_t expiry = get_timeout_expiry( user );
+
+    while (index)
+    {
+        unsigned int parent = (index - 1) / 2;
+        if (get_timeout_expiry( heap->users[parent] ) <= expiry) break;
+        timeout_heap_set( heap, index, heap->users[parent] );
+        index = parent;
+    }
+    timeout_heap_set( heap, index, user );
+}
+
+/* move an entry towards the leaves until the heap property is restored */
+static void timeout_heap_sift_down( struct timeout_heap *heap, unsigned int index )
+{
+    struct timeout_user *user = heap->users[index];
+    timeout_t expiry = get_timeout_expiry( user );
+
+    for (;;)
+    {
+        unsigned int child = 2 * index + 1;
+
+        if (child >= heap->count) break;
+        if (child + 1 < heap->count &&
+            get_timeout_expiry( heap->users[child + 1] ) < get_timeout_expiry( heap->users[child] ))
+            child++;
+        if (expiry <= get_timeout_expiry( heap->users[child] )) break;
+        timeout_heap_set( heap, index, heap->users[child] );
+        index = child;
+    }
+    timeout_heap_set( heap, index, user );
+}
+
+static int timeout_heap_insert( struct timeout_heap *heap, struct timeout_user *user )
+{
+    if (heap->count == heap->size)
+    {
+        unsigned int new_size = heap->size ? heap->size * 2 : 64;
+        struct timeout_user **new_users;
+
+        if (!(new_users = realloc( heap->users, new_size * sizeof(*new_users) )))
+        {
+            set_error( STATUS_NO_MEMORY );
+            return 0;
+        }
+        heap->users = new_users;
+        heap->size = new_size;
+    }
+    timeout_heap_set( heap, heap->count++, user );
+    timeout_heap_sift_up( heap, user->index );
+    return 1;
+}
+
+static void timeout_heap_remove( struct timeout_heap *heap, struct timeout_user *user )
+{
+    unsigned int index = user->index;
+    struct timeout_user *last = heap->users[--heap->count];
+
+    user->index = TIMEOUT_EXPIRED;
+    if (last == user) return;
+    timeout_heap_set( heap, index, last );
+    if (index && get_timeout_expiry( heap->users[(index - 1) / 2] ) > get_timeout_expiry( last ))
+        timeout_heap_sift_up( heap, index );
+    else
+        timeout_heap_sift_down( heap, index );
+}
+
 /* add a timeout user */
 struct timeout_user *add_timeout_user( timeout_t when, timeout_callback func, void *private )
 {
     struct timeout_user *user;
-    struct list *ptr;
 
     if (!(user = mem_alloc( sizeof(*user) ))) return NULL;
     user->when     = timeout_to_abstime( when );
     user->callback = func;
     user->private  = private;
 
-    /* Now insert it in the linked list */
-
-    if (user->when > 0)
+    if (!timeout_heap_insert( get_timeout_heap( user ), user ))
     {
-        LIST_FOR_EACH( ptr, &abs_timeout_list )
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            if (timeout->when >= user->when) break;
-        }
-    }
-    else
-    {
-        LIST_FOR_EACH( ptr, &rel_timeout_list )
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            if (timeout->when <= user->when) break;
-        }
+        free( user );
+        return NULL;
     }
-    list_add_before( ptr, &user->entry );
     return user;
 }
 
 /* remove a timeout user */
 void remove_timeout_user( struct timeout_user *user )
 {
-    list_remove( &user->entry );
+    if (user->index == TIMEOUT_EXPIRED) list_remove( &user->entry );
+    else timeout_heap_remove( get_timeout_heap( user ), user );
     free( user );
 }
 
@@ -469,6 +554,8 @@ static int active_users;                    /* current number of active users */
 static int allocated_users;                 /* count of allocated entries in the array */
 static struct fd **freelist;                /* list of free entries in the array */
 
+unsigned int poll_syscalls;                 /* number of poll/epoll/kqueue wait calls */
+
 static int get_next_timeout(void);
 
 static inline void fd_poll_event( struct fd *fd, int event )
@@ -535,10 +622,23 @@ static inline void remove_epoll_user( struct fd *fd, int user )
     }
 }
 
+/* make sure the events array can hold an event for every active user */
+static struct epoll_event *grow_epoll_events( struct epoll_event *events, int *size )
+{
+    struct epoll_event *new_events;
+    int new_size = *size;
+
+    while (new_size < active_users) new_size *= 2;
+    if (new_size == *size) return events;
+    if (!(new_events = realloc( events, new_size * sizeof(*new_events) ))) return events;
+    *size = new_size;
+    return new_events;
+}
+
 static inline void main_loop_epoll(void)
 {
-    int i, ret, timeout;
-    struct epoll_event events[128];
+    int i, ret, timeout, nb_events = 128;
+    struct epoll_event *events;
 
     assert( POLLIN == EPOLLIN );
     assert( POLLOUT == EPOLLOUT );
@@ -546,6 +646,7 @@ static inline void main_loop_epoll(void)
     assert( POLLHUP == EPOLLHUP );
 
     if (epoll_fd == -1) return;
+    if (!(events = malloc( nb_events * sizeof(*events) ))) return;
 
     while (active_users)
     {
@@ -554,7 +655,10 @@ static inline void main_loop_epoll(void)
         if (!active_users) break;  /* last user removed by a timeout */
         if (epoll_fd == -1) break;  /* an error occurred with epoll */
 
-        ret = epoll_wait( epoll_fd, events, ARRAY_SIZE( events ), timeout );
+        /* retrieve as many ready fds as possible in a single call */
+        events = grow_epoll_events( events, &nb_events );
+        ret = epoll_wait( epoll_fd, events, nb_events, timeout );
+        poll_syscalls++;
         set_current_time();
 
         /* put the events into the pollfd array first, like poll does */
@@ -571,6 +675,7 @@ static inline void main_loop_epoll(void)
             if (pollfd[user].revents) fd_poll_event( poll_users[user], pollfd[user].revents );
         }
     }
+    free( events );
 }
 
 #elif defined(HAVE_KQUEUE)
@@ -669,6 +774,7 @@ static inline void main_loop_epoll(void)
         }
         else ret = kevent( kqueue_fd, NULL, 0, events, ARRAY_SIZE( events ), NULL );
 
+        poll_syscalls++;
         set_current_time();
 
         /* put the events into the pollfd array first, like poll does */
@@ -772,6 +878,7 @@ static inline void main_loop_epoll(void)
             ret = port_getn( port_fd, events, ARRAY_SIZE( events ), &nget, &ts );
         }
         else ret = port_getn( port_fd, events, ARRAY_SIZE( events ), &nget, NULL );
+        poll_syscalls++;
 
 	if (ret == -1) break;  /* an error occurred with event completion */
 
@@ -862,39 +969,30 @@ static void remove_poll_user( struct fd *fd, int user )
     active_users--;
 }
 
+/* move all the expired entries of a timeout heap to the expired list */
+static void get_expired_timeouts( struct timeout_heap *heap, timeout_t now, struct list *expired_list )
+{
+    while (heap->count && get_timeout_expiry( heap->users[0] ) <= now)
+    {
+        struct timeout_user *timeout = heap->users[0];
+        timeout_heap_remove( heap, timeout );
+        list_add_tail( expired_list, &timeout->entry );
+    }
+}
+
 /* process pending timeouts and return the time until the next timeout, in milliseconds */
 static int get_next_timeout(void)
 {
-    if (!list_empty( &abs_timeout_list ) || !list_empty( &rel_timeout_list ))
+    if (abs_timeouts.count || rel_timeouts.count)
     {
         struct list expired_list, *ptr;
         int ret = -1;
 
-        /* first remove all expired timers from the list */
+        /* first remove all expired timers from the heaps */
 
         list_init( &expired_list );
-        while ((ptr = list_head( &abs_timeout_list )) != NULL)
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-
-            if (timeout->when <= current_time)
-            {
-                list_remove( &timeout->entry );
-                list_add_tail( &expired_list, &timeout->entry );
-            }
-            else break;
-        }
-        while ((ptr = list_head( &rel_timeout_list )) != NULL)
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-
-            if (-timeout->when <= monotonic_time)
-            {
-                list_remove( &timeout->entry );
-                list_add_tail( &expired_list, &timeout->entry );
-            }
-            else break;
-        }
+        get_expired_timeouts( &abs_timeouts, current_time, &expired_list );
+        get_expired_timeouts( &rel_timeouts, monotonic_time, &expired_list );
 
         /* now call the callback for all the removed timers */
 
@@ -906,17 +1004,17 @@ static int get_next_timeout(void)
             free( timeout );
         }
 
-        if ((ptr = list_head( &abs_timeout_list )) != NULL)
+        if (abs_timeouts.count)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = abs_timeouts.users[0];
             int diff = (timeout->when - current_time + 9999) / 10000;
             if (diff < 0) diff = 0;
             ret = diff;
         }
 
-        if ((ptr = list_head( &rel_timeout_list )) != NULL)
+        if (rel_timeouts.count)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = rel_timeouts.users[0];
             int diff = (-timeout->when - monotonic_time + 9999) / 10000;
             if (diff < 0) diff = 0;
             if (ret == -1 || diff < ret) ret = diff;
@@ -944,6 +1042,7 @@ void main_loop(void)
         if (!active_users) break;  /* last user removed by a timeout */
 
         ret = poll( pollfd, nb_users, timeout );
+        poll_syscalls++;
         set_current_time();
 
         if (ret > 0)
@@ -2505,6 +2604,14 @@ void fd_copy_completion( struct fd *src, struct fd *dst )
     dst->comp_flags = src->comp_flags;
 }
 
+/* queue the completion of an I/O that was done on the client side */
+void fd_add_completion( struct fd *fd, apc_param_t cvalue, unsigned int status, apc_param_t information,
+                        int async )
+{
+    if (fd->completion && (async || !(fd->comp_flags & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS)))
+        add_completion( fd->completion, fd->comp_key, cvalue, status, information );
+}
+
 /* flush a file buffers */
 DECL_HANDLER(flush)
 {
@@ -2710,8 +2817,7 @@ DECL_HANDLER(add_fd_completion)
     struct fd *fd = get_handle_fd_obj( current->process, req->handle, 0 );
     if (fd)
     {
-        if (fd->completion && (req->async || !(fd->comp_flags & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS)))
-            add_completion( fd->completion, fd->comp_key, req->cvalue, req->status, req->information );
+        fd_add_completion( fd, req->cvalue, req->status, req->information, req->async );
         release_object( fd );
     }
 }
@@ -121,6 +121,7 @@ extern void no_fd_queue_async( struct fd *fd, struct async *async, int type, int
 extern void default_fd_queue_async( struct fd *fd, struct async *async, int type, int count );
 extern void default_fd_reselect_async( struct fd *fd, struct async_queue *queue );
 extern void main_loop(void);
+extern unsigned int poll_syscalls;
 extern void remove_process_locks( struct process *process );
 
 static inline struct fd *get_obj_fd( struct object *obj ) { return obj->ops->get_fd( obj ); }
@@ -174,6 +175,7 @@ extern void free_mapped_views( struct process *process );
 extern int get_page_size(void);
 
 extern void init_kusd_mapping( struct mapping *mapping );
+extern struct mapping *create_shared_mapping( mem_size_t size, void **ptr );
 
 /* device functions */
 
@@ -214,6 +216,8 @@ extern void async_terminate( struct async *async, unsigned int status );
 extern void async_wake_up( struct async_queue *queue, unsigned int status );
 extern struct completion *fd_get_completion( struct fd *fd, apc_param_t *p_key );
 extern void fd_copy_completion( struct fd *src, struct fd *dst );
+extern void fd_add_completion( struct fd *fd, apc_param_t cvalue, unsigned int status,
+                               apc_param_t information, int async );
 extern struct iosb *create_iosb( const void *in_data, data_size_t in_size, data_size_t out_size );
 extern struct iosb *async_get_iosb( struct async *async );
 extern int async_is_blocking( struct async *async );
@@ -1007,6 +1007,25 @@ void init_kusd_mapping( struct mapping *mapping )
         kusd_set_current_time( NULL );
 }
 
+/* create an anonymous mapping that the server keeps mapped for writing */
+struct mapping *create_shared_mapping( mem_size_t size, void **ptr )
+{
+    struct mapping *mapping;
+
+    if (!(mapping = (struct mapping *)create_mapping( NULL, NULL, 0, size, SEC_COMMIT, 0, 0, NULL )))
+        return NULL;
+
+    if ((*ptr = mmap( NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      get_unix_fd( mapping->fd ), 0 )) == MAP_FAILED)
+    {
+        release_object( mapping );
+        set_error( STATUS_NO_MEMORY );
+        return NULL;
+    }
+    make_object_static( &mapping->obj );
+    return mapping;
+}
+
 /* create a file mapping */
 DECL_HANDLER(create_mapping)
 {
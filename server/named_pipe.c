@@ -24,10 +24,21 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_SYS_FILIO_H
+#include <sys/filio.h>
+#endif
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -60,6 +71,8 @@ struct pipe_end
     unsigned int         state;      /* pipe state */
     struct named_pipe   *pipe;
     struct pipe_end     *connection; /* the other end of the pipe */
+    int                  unix_fd;    /* unix socket of a socket-backed connection, or -1 */
+    struct timeout_user *flush_poll; /* timeout to check if a flushed socket has been read */
     process_id_t         client_pid; /* process that created the client */
     process_id_t         server_pid; /* process that created the server */
     data_size_t          buffer_size;/* size of buffered data that doesn't block caller */
@@ -142,6 +155,8 @@ static int pipe_end_set_sd( struct object *obj, const struct security_descriptor
                             unsigned int set_info );
 static int pipe_end_read( struct fd *fd, struct async *async, file_pos_t pos );
 static int pipe_end_write( struct fd *fd, struct async *async_data, file_pos_t pos );
+static int pipe_end_sock_read( struct fd *fd, struct async *async, file_pos_t pos );
+static int pipe_end_sock_write( struct fd *fd, struct async *async, file_pos_t pos );
 static int pipe_end_flush( struct fd *fd, struct async *async );
 static void pipe_end_get_volume_info( struct fd *fd, unsigned int info_class );
 static void pipe_end_reselect_async( struct fd *fd, struct async_queue *queue );
@@ -190,6 +205,21 @@ static const struct fd_ops pipe_server_fd_ops =
     pipe_end_reselect_async       /* reselect_async */
 };
 
+static const struct fd_ops pipe_server_sock_fd_ops =
+{
+    default_fd_get_poll_events,   /* get_poll_events */
+    default_poll_event,           /* poll_event */
+    pipe_end_get_fd_type,         /* get_fd_type */
+    pipe_end_sock_read,           /* read */
+    pipe_end_sock_write,          /* write */
+    pipe_end_flush,               /* flush */
+    pipe_end_get_file_info,       /* get_file_info */
+    pipe_end_get_volume_info,     /* get_volume_info */
+    pipe_server_ioctl,            /* ioctl */
+    default_fd_queue_async,       /* queue_async */
+    default_fd_reselect_async     /* reselect_async */
+};
+
 /* client end functions */
 static void pipe_client_dump( struct object *obj, int verbose );
 static int pipe_client_ioctl( struct fd *fd, ioctl_code_t code, struct async *async );
@@ -232,6 +262,21 @@ static const struct fd_ops pipe_client_fd_ops =
     pipe_end_reselect_async       /* reselect_async */
 };
 
+static const struct fd_ops pipe_client_sock_fd_ops =
+{
+    default_fd_get_poll_events,   /* get_poll_events */
+    default_poll_event,           /* poll_event */
+    pipe_end_get_fd_type,         /* get_fd_type */
+    pipe_end_sock_read,           /* read */
+    pipe_end_sock_write,          /* write */
+    pipe_end_flush,               /* flush */
+    pipe_end_get_file_info,       /* get_file_info */
+    pipe_end_get_volume_info,     /* get_volume_info */
+    pipe_client_ioctl,            /* ioctl */
+    default_fd_queue_async,       /* queue_async */
+    default_fd_reselect_async     /* reselect_async */
+};
+
 static void named_pipe_device_dump( struct object *obj, int verbose );
 static struct object_type *named_pipe_device_get_type( struct object *obj );
 static struct object *named_pipe_device_lookup_name( struct object *obj,
@@ -390,6 +435,11 @@ static void pipe_end_disconnect( struct pipe_end *pipe_end, unsigned int status
     struct async *async;
 
     pipe_end->connection = NULL;
+    if (pipe_end->flush_poll)
+    {
+        remove_timeout_user( pipe_end->flush_poll );
+        pipe_end->flush_poll = NULL;
+    }
 
     pipe_end->state = status == STATUS_PIPE_DISCONNECTED
         ? FILE_PIPE_DISCONNECTED_STATE : FILE_PIPE_CLOSING_STATE;
@@ -543,6 +593,26 @@ static void named_pipe_device_file_destroy( struct object *obj )
     release_object( file->device );
 }
 
+/* data written to a socket-backed pipe that the other end hasn't read yet */
+static int socket_data_pending( struct pipe_end *pipe_end )
+{
+    int size;
+
+    return pipe_end->connection && !ioctl( pipe_end->connection->unix_fd, FIONREAD, &size ) && size > 0;
+}
+
+/* the reader doesn't tell us when it consumes socket data, poll until it has all been read */
+static void check_socket_flushed( void *private )
+{
+    struct pipe_end *pipe_end = private;
+
+    pipe_end->flush_poll = NULL;
+    if (socket_data_pending( pipe_end ))
+        pipe_end->flush_poll = add_timeout_user( -TICKS_PER_SEC / 100, check_socket_flushed, pipe_end );
+    else
+        fd_async_wake_up( pipe_end->fd, ASYNC_TYPE_WAIT, STATUS_SUCCESS );
+}
+
 static int pipe_end_flush( struct fd *fd, struct async *async )
 {
     struct pipe_end *pipe_end = get_fd_user( fd );
@@ -553,6 +623,16 @@ static int pipe_end_flush( struct fd *fd, struct async *async )
         return 0;
     }
 
+    if (pipe_end->unix_fd != -1)
+    {
+        if (!socket_data_pending( pipe_end )) return 1;
+        fd_queue_async( pipe_end->fd, async, ASYNC_TYPE_WAIT );
+        if (!pipe_end->flush_poll)
+            pipe_end->flush_poll = add_timeout_user( -TICKS_PER_SEC / 100, check_socket_flushed, pipe_end );
+        set_error( STATUS_PENDING );
+        return 1;
+    }
+
     if (pipe_end->connection && !list_empty( &pipe_end->connection->message_queue ))
     {
         fd_queue_async( pipe_end->fd, async, ASYNC_TYPE_WAIT );
@@ -916,6 +996,46 @@ static int pipe_end_write( struct fd *fd, struct async *async, file_pos_t pos )
     return 1;
 }
 
+/* Socket-backed pipe ends are read and written directly by the client, which only
+ * asks the server after the connection has been shut down, to find out why. */
+static int pipe_end_sock_read( struct fd *fd, struct async *async, file_pos_t pos )
+{
+    struct pipe_end *pipe_end = get_fd_user( fd );
+
+    switch (pipe_end->state)
+    {
+    case FILE_PIPE_DISCONNECTED_STATE:
+        set_error( STATUS_PIPE_DISCONNECTED );
+        break;
+    case FILE_PIPE_LISTENING_STATE:
+        set_error( STATUS_PIPE_LISTENING );
+        break;
+    default:
+        set_error( STATUS_PIPE_BROKEN );
+        break;
+    }
+    return 0;
+}
+
+static int pipe_end_sock_write( struct fd *fd, struct async *async, file_pos_t pos )
+{
+    struct pipe_end *pipe_end = get_fd_user( fd );
+
+    switch (pipe_end->state)
+    {
+    case FILE_PIPE_DISCONNECTED_STATE:
+        set_error( STATUS_PIPE_DISCONNECTED );
+        break;
+    case FILE_PIPE_LISTENING_STATE:
+        set_error( STATUS_PIPE_LISTENING );
+        break;
+    default:
+        set_error( STATUS_PIPE_CLOSING );
+        break;
+    }
+    return 0;
+}
+
 static void pipe_end_reselect_async( struct fd *fd, struct async_queue *queue )
 {
     struct pipe_end *pipe_end = get_fd_user( fd );
@@ -940,6 +1060,7 @@ static int pipe_end_peek( struct pipe_end *pipe_end )
     struct pipe_message *message;
     data_size_t avail = 0;
     data_size_t message_length = 0;
+    char *data = NULL;
 
     if (reply_size < offsetof( FILE_PIPE_PEEK_BUFFER, Data ))
     {
@@ -948,12 +1069,23 @@ static int pipe_end_peek( struct pipe_end *pipe_end )
     }
     reply_size -= offsetof( FILE_PIPE_PEEK_BUFFER, Data );
 
+    if (pipe_end->unix_fd != -1)
+    {
+        int size;
+        if (!ioctl( pipe_end->unix_fd, FIONREAD, &size ) && size > 0) avail = size;
+    }
+    else
+    {
+        LIST_FOR_EACH_ENTRY( message, &pipe_end->message_queue, struct pipe_message, entry )
+            avail += message->iosb->in_size - message->read_pos;
+    }
+
     switch (pipe_end->state)
     {
     case FILE_PIPE_CONNECTED_STATE:
         break;
     case FILE_PIPE_CLOSING_STATE:
-        if (!list_empty( &pipe_end->message_queue )) break;
+        if (avail || !list_empty( &pipe_end->message_queue )) break;
         set_error( STATUS_PIPE_BROKEN );
         return 0;
     default:
@@ -961,10 +1093,23 @@ static int pipe_end_peek( struct pipe_end *pipe_end )
         return 0;
     }
 
-    LIST_FOR_EACH_ENTRY( message, &pipe_end->message_queue, struct pipe_message, entry )
-        avail += message->iosb->in_size - message->read_pos;
     reply_size = min( reply_size, avail );
 
+    if (reply_size && pipe_end->unix_fd != -1)
+    {
+        /* the owner of this end may have read some of the data in the meantime */
+        int ret;
+
+        if (!(data = mem_alloc( reply_size ))) return 0;
+        if ((ret = recv( pipe_end->unix_fd, data, reply_size, MSG_PEEK | MSG_DONTWAIT )) == -1)
+        {
+            file_set_error();
+            free( data );
+            return 0;
+        }
+        if (ret < reply_size) avail = reply_size = ret;
+    }
+
     if (avail && pipe_end->pipe->message_mode)
     {
         message = LIST_ENTRY( list_head(&pipe_end->message_queue), struct pipe_message, entry );
@@ -972,13 +1117,22 @@ static int pipe_end_peek( struct pipe_end *pipe_end )
         reply_size = min( reply_size, message_length );
     }
 
-    if (!(buffer = set_reply_data_size( offsetof( FILE_PIPE_PEEK_BUFFER, Data[reply_size] )))) return 0;
+    if (!(buffer = set_reply_data_size( offsetof( FILE_PIPE_PEEK_BUFFER, Data[reply_size] ))))
+    {
+        free( data );
+        return 0;
+    }
     buffer->NamedPipeState    = pipe_end->state;
     buffer->ReadDataAvailable = avail;
     buffer->NumberOfMessages  = 0;  /* FIXME */
     buffer->MessageLength     = message_length;
 
-    if (reply_size)
+    if (data)
+    {
+        memcpy( buffer->Data, data, reply_size );
+        free( data );
+    }
+    else if (reply_size)
     {
         data_size_t write_pos = 0, writing;
         LIST_FOR_EACH_ENTRY( message, &pipe_end->message_queue, struct pipe_message, entry )
@@ -1083,6 +1237,26 @@ static int pipe_end_ioctl( struct pipe_end *pipe_end, ioctl_code_t code, struct
     }
 }
 
+/* replace the fd of a pipe end, keeping its completion port */
+static void set_pipe_end_fd( struct pipe_end *pipe_end, struct fd *fd, int unix_fd )
+{
+    if (pipe_end->fd)
+    {
+        fd_copy_completion( pipe_end->fd, fd );
+        release_object( pipe_end->fd );
+    }
+    pipe_end->fd = fd;
+    pipe_end->unix_fd = unix_fd;
+}
+
+/* all data is lost when the server disconnects the client */
+static void discard_socket_data( int unix_fd )
+{
+    char buffer[4096];
+
+    while (recv( unix_fd, buffer, sizeof(buffer), MSG_DONTWAIT ) > 0);
+}
+
 static int pipe_server_ioctl( struct fd *fd, ioctl_code_t code, struct async *async )
 {
     struct pipe_server *server = get_fd_user( fd );
@@ -1135,6 +1309,21 @@ static int pipe_server_ioctl( struct fd *fd, ioctl_code_t code, struct async *as
             return 0;
         }
 
+        if (server->pipe_end.unix_fd != -1)
+        {
+            /* The client sees the end of the socket. Handles of the server end
+             * look up its fd on every I/O, so they all switch to the new fd. */
+            struct fd *pseudo_fd = alloc_pseudo_fd( &pipe_server_fd_ops, &server->pipe_end.obj,
+                                                    server->options );
+            if (!pseudo_fd) return 0;
+            shutdown( server->pipe_end.unix_fd, SHUT_RDWR );
+            if (server->pipe_end.connection) discard_socket_data( server->pipe_end.connection->unix_fd );
+            pipe_end_disconnect( &server->pipe_end, STATUS_PIPE_DISCONNECTED );
+            set_pipe_end_fd( &server->pipe_end, pseudo_fd, -1 );
+            set_fd_signaled( pseudo_fd, 0 );
+            return 1;
+        }
+
         pipe_end_disconnect( &server->pipe_end, STATUS_PIPE_DISCONNECTED );
         return 1;
 
@@ -1165,12 +1354,22 @@ static void init_pipe_end( struct pipe_end *pipe_end, struct named_pipe *pipe,
     pipe_end->fd = NULL;
     pipe_end->flags = pipe_flags;
     pipe_end->connection = NULL;
+    pipe_end->unix_fd = -1;
+    pipe_end->flush_poll = NULL;
     pipe_end->buffer_size = buffer_size;
     init_async_queue( &pipe_end->read_q );
     init_async_queue( &pipe_end->write_q );
     list_init( &pipe_end->message_queue );
 }
 
+/* Byte-mode pipe instances are connected through a Unix socket pair when both
+ * ends use synchronous I/O, so that data doesn't have to go through the server. */
+static int pipe_server_use_socket( struct pipe_server *server )
+{
+    return !server->pipe_end.pipe->message_mode &&
+           (server->options & (FILE_SYNCHRONOUS_IO_ALERT | FILE_SYNCHRONOUS_IO_NONALERT));
+}
+
 static struct pipe_server *create_pipe_server( struct named_pipe *pipe, unsigned int options,
                                                unsigned int pipe_flags )
 {
@@ -1192,25 +1391,35 @@ static struct pipe_server *create_pipe_server( struct named_pipe *pipe, unsigned
         release_object( server );
         return NULL;
     }
-    allow_fd_caching( server->pipe_end.fd );
+    /* the fd changes when the client connects, so it can't be cached in that case */
+    if (!pipe_server_use_socket( server )) allow_fd_caching( server->pipe_end.fd );
     set_fd_signaled( server->pipe_end.fd, 1 );
     async_wake_up( &pipe->waiters, STATUS_SUCCESS );
     return server;
 }
 
-static struct pipe_end *create_pipe_client( struct named_pipe *pipe, data_size_t buffer_size, unsigned int options )
+static struct pipe_end *create_pipe_client( struct named_pipe *pipe, data_size_t buffer_size,
+                                            unsigned int options, int unix_fd )
 {
     struct pipe_end *client;
 
     client = alloc_object( &pipe_client_ops );
     if (!client)
+    {
+        if (unix_fd != -1) close( unix_fd );
         return NULL;
+    }
 
     init_pipe_end( client, pipe, 0, buffer_size );
     client->state = FILE_PIPE_CONNECTED_STATE;
     client->client_pid = get_process_id( current->process );
 
-    client->fd = alloc_pseudo_fd( &pipe_client_fd_ops, &client->obj, options );
+    if (unix_fd != -1)
+    {
+        client->fd = create_anonymous_fd( &pipe_client_sock_fd_ops, unix_fd, &client->obj, options );
+        if (client->fd) client->unix_fd = unix_fd;
+    }
+    else client->fd = alloc_pseudo_fd( &pipe_client_fd_ops, &client->obj, options );
     if (!client->fd)
     {
         release_object( client );
@@ -1242,7 +1451,9 @@ static struct object *named_pipe_open_file( struct object *obj, unsigned int acc
     struct named_pipe *pipe = (struct named_pipe *)obj;
     struct pipe_server *server;
     struct pipe_end *client;
+    struct fd *server_fd = NULL;
     unsigned int pipe_sharing;
+    int fds[2] = { -1, -1 };
 
     if (list_empty( &pipe->listeners ))
     {
@@ -1259,8 +1470,24 @@ static struct object *named_pipe_open_file( struct object *obj, unsigned int acc
         return NULL;
     }
 
-    if ((client = create_pipe_client( pipe, pipe->outsize, options )))
+    /* overlapped clients need the server to queue their asyncs */
+    if (pipe_server_use_socket( server ) &&
+        (options & (FILE_SYNCHRONOUS_IO_ALERT | FILE_SYNCHRONOUS_IO_NONALERT)) &&
+        !socketpair( PF_UNIX, SOCK_STREAM, 0, fds ))
+    {
+        /* the sockets are blocking, clients get EAGAIN only in non-blocking mode */
+        if (server->pipe_end.flags & NAMED_PIPE_NONBLOCKING_MODE) fcntl( fds[0], F_SETFL, O_NONBLOCK );
+        if (!(server_fd = create_anonymous_fd( &pipe_server_sock_fd_ops, fds[0],
+                                               &server->pipe_end.obj, server->options )))
+        {
+            close( fds[1] );
+            return NULL;
+        }
+    }
+
+    if ((client = create_pipe_client( pipe, pipe->outsize, options, fds[1] )))
     {
+        if (server_fd) set_pipe_end_fd( &server->pipe_end, server_fd, fds[0] );
         async_wake_up( &server->listen_q, STATUS_SUCCESS );
         server->pipe_end.state = FILE_PIPE_CONNECTED_STATE;
         server->pipe_end.connection = client;
@@ -1269,6 +1496,7 @@ static struct object *named_pipe_open_file( struct object *obj, unsigned int acc
         client->server_pid = server->pipe_end.server_pid;
         list_remove( &server->entry );
     }
+    else if (server_fd) release_object( server_fd );
     return &client->obj;
 }
 
@@ -1422,6 +1650,9 @@ DECL_HANDLER(set_named_pipe_info)
     else
     {
         pipe_end->flags = req->flags;
+        /* clients read and write the socket directly and see the mode as EAGAIN */
+        if (pipe_end->unix_fd != -1)
+            fcntl( pipe_end->unix_fd, F_SETFL, (req->flags & NAMED_PIPE_NONBLOCKING_MODE) ? O_NONBLOCK : 0 );
     }
 
     release_object( pipe_end );
@@ -190,6 +190,11 @@ extern struct keyed_event *get_keyed_event_obj( struct process *process, obj_han
 extern void pulse_event( struct event *event );
 extern void set_event( struct event *event );
 extern void reset_event( struct event *event );
+extern unsigned int alloc_sync_state( int state );
+extern void free_sync_state( unsigned int index );
+extern void set_sync_state( unsigned int index, int state );
+extern unsigned int get_sync_state_id( unsigned int index );
+extern unsigned int get_semaphore_state_index( struct object *obj );
 
 /* mutex functions */
 
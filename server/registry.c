@@ -36,6 +36,18 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#ifdef HAVE_SYS_POLL_H
+#include <sys/poll.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -130,6 +142,10 @@ struct save_branch_info
 static int save_branch_count;
 static struct save_branch_info save_branch_info[MAX_SAVE_BRANCH_INFO];
 
+/* state of the background save process */
+static int save_pipe = -1;            /* pipe receiving the mask of saved branches */
+static unsigned int save_pending;     /* mask of branches being saved in the background */
+
 
 /* information about a file being loaded */
 struct file_load_info
@@ -558,6 +574,7 @@ static int grow_subkeys( struct key *key )
     if (key->nb_subkeys)
     {
         nb_subkeys = key->nb_subkeys + (key->nb_subkeys / 2);  /* grow by 50% */
+        if (nb_subkeys < MIN_SUBKEYS) nb_subkeys = MIN_SUBKEYS;  /* array may have been trimmed */
         if (!(new_subkeys = realloc( key->subkeys, nb_subkeys * sizeof(*new_subkeys) )))
         {
             set_error( STATUS_NO_MEMORY );
@@ -1024,6 +1041,7 @@ static int grow_values( struct key *key )
     if (key->nb_values)
     {
         nb_values = key->nb_values + (key->nb_values / 2);  /* grow by 50% */
+        if (nb_values < MIN_VALUES) nb_values = MIN_VALUES;  /* array may have been trimmed */
         if (!(new_val = realloc( key->values, nb_values * sizeof(*new_val) )))
         {
             set_error( STATUS_NO_MEMORY );
@@ -1619,6 +1637,49 @@ static int get_prefix_len( struct key *key, const char *name, struct file_load_i
     return res;
 }
 
+/* release the unused entries of the values array of a key */
+/* keys loaded from a file rarely change afterwards, so this saves a lot of memory for large hives */
+static void trim_values( struct key *key )
+{
+    struct key_value *new_val;
+
+    if (key->last_value + 1 == key->nb_values) return;
+    if (key->last_value == -1)
+    {
+        free( key->values );
+        key->values = NULL;
+        key->nb_values = 0;
+    }
+    else if ((new_val = realloc( key->values, (key->last_value + 1) * sizeof(*new_val) )))
+    {
+        key->values = new_val;
+        key->nb_values = key->last_value + 1;
+    }
+}
+
+/* release the unused entries of the subkeys arrays of a key and its subkeys */
+/* this walks the whole tree, so it is only done once the loading is finished */
+static void trim_subkeys( struct key *key )
+{
+    struct key **new_subkeys;
+    int i;
+
+    if (key->last_subkey + 1 == key->nb_subkeys) goto done;
+    if (key->last_subkey == -1)
+    {
+        free( key->subkeys );
+        key->subkeys = NULL;
+        key->nb_subkeys = 0;
+    }
+    else if ((new_subkeys = realloc( key->subkeys, (key->last_subkey + 1) * sizeof(*new_subkeys) )))
+    {
+        key->subkeys = new_subkeys;
+        key->nb_subkeys = key->last_subkey + 1;
+    }
+done:
+    for (i = 0; i <= key->last_subkey; i++) trim_subkeys( key->subkeys[i] );
+}
+
 /* load all the keys from the input file */
 /* prefix_len is the number of key name prefixes to skip, or -1 for autodetection */
 static void load_keys( struct key *key, const char *filename, FILE *f, int prefix_len )
@@ -1657,6 +1718,7 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
             if (subkey)
             {
                 update_key_time( subkey, modif );
+                trim_values( subkey );
                 release_object( subkey );
             }
             if (prefix_len == -1) prefix_len = get_prefix_len( key, p + 1, &info );
@@ -1685,6 +1747,7 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
     if (subkey)
     {
         update_key_time( subkey, modif );
+        trim_values( subkey );
         release_object( subkey );
     }
     free( info.buffer );
@@ -1707,6 +1770,7 @@ static void load_registry( struct key *key, obj_handle_t handle )
         {
             load_keys( key, NULL, f, -1 );
             fclose( f );
+            trim_subkeys( key );
         }
         else file_set_error();
     }
@@ -1852,6 +1916,9 @@ void init_registry(void)
     release_object( hklm );
     release_object( hkcu );
 
+    /* all the initial keys are loaded */
+    trim_subkeys( root_key );
+
     /* start the periodic save timer */
     set_periodic_save_timer();
 
@@ -1987,16 +2054,114 @@ done:
     return ret;
 }
 
+/* process the result of a background save; wait for it to finish if requested */
+/* returns 0 if it is still running */
+static int finish_background_save( int wait )
+{
+    unsigned char saved = 0;
+    int i, ret;
+
+    if (save_pipe == -1) return 1;
+
+    if (!wait)
+    {
+        struct pollfd pfd;
+
+        pfd.fd = save_pipe;
+        pfd.events = POLLIN;
+        if (poll( &pfd, 1, 0 ) != 1) return 0;
+    }
+    while ((ret = read( save_pipe, &saved, 1 )) == -1 && errno == EINTR);
+    if (ret != 1) saved = 0;  /* the save process died */
+    close( save_pipe );
+    save_pipe = -1;
+
+    for (i = 0; i < save_branch_count; i++)
+    {
+        if (!(save_pending & (1 << i)) || (saved & (1 << i))) continue;
+        fprintf( stderr, "wineserver: could not save registry branch to %s\n", save_branch_info[i].path );
+        /* the branch has been marked clean when the save started, so make sure it gets saved again */
+        make_dirty( save_branch_info[i].key );
+    }
+    save_pending = 0;
+    return 1;
+}
+
+/* close the server file descriptors inherited by the save process */
+static void close_inherited_fds( int keep )
+{
+    int fd, max_fd = sysconf( _SC_OPEN_MAX );
+
+#ifdef __NR_close_range
+    if (!syscall( __NR_close_range, 3, keep - 1, 0 ) && !syscall( __NR_close_range, keep + 1, ~0U, 0 ))
+        return;
+#endif
+    for (fd = 3; fd < max_fd; fd++) if (fd != keep) close( fd );
+}
+
+/* save the dirty branches in a child process, so that the server isn't blocked while writing them */
+/* returns 0 if the branches have to be saved synchronously instead */
+static int start_background_save(void)
+{
+    unsigned int dirty = 0;
+    int i, fds[2];
+    pid_t pid;
+
+    for (i = 0; i < save_branch_count; i++)
+        if (save_branch_info[i].key->flags & KEY_DIRTY) dirty |= 1 << i;
+    if (!dirty) return 1;
+
+    if (pipe( fds ) == -1) return 0;
+    if ((pid = fork()) == -1)
+    {
+        close( fds[0] );
+        close( fds[1] );
+        return 0;
+    }
+    if (!pid)  /* child, save the snapshot of the registry and report the result */
+    {
+        unsigned char saved = 0;
+
+        /* the actual save runs in a grandchild, so that the server never gets a SIGCHLD
+         * for it; the tracing code would take any pid it reaps for one of its threads */
+        if (fork()) _exit( 0 );
+        close_inherited_fds( fds[1] );
+        for (i = 0; i < save_branch_count; i++)
+            if ((dirty & (1 << i)) && save_branch( save_branch_info[i].key, save_branch_info[i].path ))
+                saved |= 1 << i;
+        write( fds[1], &saved, 1 );
+        _exit( 0 );
+    }
+
+    /* reap the intermediate child before the SIGCHLD handler gets a chance to see it */
+    while (waitpid( pid, NULL, 0 ) == -1 && errno == EINTR);
+    if (debug_level > 1) fprintf( stderr, "wineserver: saving registry in the background\n" );
+    close( fds[1] );
+    fcntl( fds[0], F_SETFD, FD_CLOEXEC );
+    save_pipe = fds[0];
+    save_pending = dirty;
+    /* the child has its own copy, further changes will be saved by the next run */
+    for (i = 0; i < save_branch_count; i++)
+        if (dirty & (1 << i)) make_clean( save_branch_info[i].key );
+    return 1;
+}
+
 /* periodic saving of the registry */
 static void periodic_save( void *arg )
 {
     int i;
 
-    if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
-    for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].path );
-    if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
+    if (finish_background_save( 0 ))
+    {
+        if (fchdir( config_dir_fd ) == -1) return;
+        if (!start_background_save())
+        {
+            for (i = 0; i < save_branch_count; i++)
+                save_branch( save_branch_info[i].key, save_branch_info[i].path );
+        }
+        if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
+    }
     set_periodic_save_timer();
 }
 
@@ -2012,6 +2177,7 @@ void flush_registry(void)
 {
     int i;
 
+    finish_background_save( 1 );
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
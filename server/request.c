@@ -74,6 +74,10 @@
 #define SCM_RIGHTS 1
 #endif
 
+/* request statistics, dumped on exit in debug mode */
+static unsigned int request_count;     /* number of requests processed */
+static unsigned int request_syscalls;  /* number of read/write calls on the request pipes */
+
 /* path names for server master Unix socket */
 static const char * const server_socket_name = "socket";   /* name of the socket file */
 static const char * const server_lock_name = "lock";       /* name of the server lock file */
@@ -231,6 +235,7 @@ void write_reply( struct thread *thread )
 {
     int ret;
 
+    request_syscalls++;
     if ((ret = write( get_unix_fd( thread->reply_fd ),
                       (char *)thread->reply_data + thread->reply_size - thread->reply_towrite,
                       thread->reply_towrite )) >= 0)
@@ -256,6 +261,7 @@ static void send_reply( union generic_reply *reply )
 {
     int ret;
 
+    request_syscalls++;
     if (!current->reply_size)
     {
         if ((ret = write( get_unix_fd( current->reply_fd ),
@@ -293,7 +299,14 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
-/* call a request handler */
+/* call a request handler
+ *
+ * Requests are always dispatched from the main loop thread, one at a time. Handlers rely
+ * on the global 'current' and on the error state it carries, object refcounts are not
+ * atomic, and even read-mostly requests like get_handle_fd or get_key_value walk the
+ * handle tables and object lists without any locking. Per-object locking would have
+ * to cover all of that, so clients avoid round trips instead (fd and sync state
+ * caches in ntdll). */
 static void call_req_handler( struct thread *thread )
 {
     union generic_reply reply;
@@ -301,6 +314,7 @@ static void call_req_handler( struct thread *thread )
 
     current = thread;
     current->reply_size = 0;
+    request_count++;
     clear_error();
     memset( &reply, 0, sizeof(reply) );
 
@@ -332,12 +346,29 @@ static void call_req_handler( struct thread *thread )
 /* read a request from a thread */
 void read_request( struct thread *thread )
 {
+    char buffer[1024];
     int ret;
 
     if (!thread->req_toread)  /* no pending request */
     {
-        if ((ret = read( get_unix_fd( thread->request_fd ), &thread->req,
-                         sizeof(thread->req) )) != sizeof(thread->req)) goto error;
+        struct iovec vec[2];
+
+        /* read the header together with the start of the data, to save a syscall for small requests */
+        vec[0].iov_base = &thread->req;
+        vec[0].iov_len  = sizeof(thread->req);
+        vec[1].iov_base = buffer;
+        vec[1].iov_len  = sizeof(buffer);
+
+        request_syscalls++;
+        if ((ret = readv( get_unix_fd( thread->request_fd ), vec, 2 )) < (int)sizeof(thread->req))
+            goto error;
+        ret -= sizeof(thread->req);
+        if ((data_size_t)ret > thread->req.request_header.request_size)
+        {
+            fatal_protocol_error( thread, "extra data %d for request %d\n",
+                                  ret, thread->req.request_header.req );
+            return;
+        }
         if (!(thread->req_toread = thread->req.request_header.request_size))
         {
             /* no data, handle request at once */
@@ -350,11 +381,20 @@ void read_request( struct thread *thread )
                                   thread->req_toread, thread->req.request_header.req );
             return;
         }
+        memcpy( thread->req_data, buffer, ret );
+        if (!(thread->req_toread -= ret))
+        {
+            call_req_handler( thread );
+            free( thread->req_data );
+            thread->req_data = NULL;
+            return;
+        }
     }
 
     /* read the variable sized data */
     for (;;)
     {
+        request_syscalls++;
         ret = read( get_unix_fd( thread->request_fd ),
                     (char *)thread->req_data + thread->req.request_header.request_size
                       - thread->req_toread,
@@ -942,7 +982,12 @@ static void close_socket_timeout( void *arg )
 {
     master_timeout = NULL;
     flush_registry();
-    if (debug_level) fprintf( stderr, "wineserver: exiting (pid=%ld)\n", (long) getpid() );
+    if (debug_level)
+    {
+        fprintf( stderr, "wineserver: %u requests, %u request pipe syscalls, %u poll syscalls\n",
+                 request_count, request_syscalls, poll_syscalls );
+        fprintf( stderr, "wineserver: exiting (pid=%ld)\n", (long) getpid() );
+    }
 
 #ifdef DEBUG_OBJECTS
     close_objects();  /* shut down everything properly */
@@ -150,6 +150,7 @@ DECL_HANDLER(select);
 DECL_HANDLER(create_event);
 DECL_HANDLER(event_op);
 DECL_HANDLER(query_event);
+DECL_HANDLER(get_sync_state);
 DECL_HANDLER(open_event);
 DECL_HANDLER(create_keyed_event);
 DECL_HANDLER(open_keyed_event);
@@ -179,6 +180,7 @@ DECL_HANDLER(set_socket_event);
 DECL_HANDLER(get_socket_event);
 DECL_HANDLER(get_socket_info);
 DECL_HANDLER(enable_socket_event);
+DECL_HANDLER(complete_socket_io);
 DECL_HANDLER(set_socket_deferred);
 DECL_HANDLER(alloc_console);
 DECL_HANDLER(free_console);
@@ -451,6 +453,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_create_event,
     (req_handler)req_event_op,
     (req_handler)req_query_event,
+    (req_handler)req_get_sync_state,
     (req_handler)req_open_event,
     (req_handler)req_create_keyed_event,
     (req_handler)req_open_keyed_event,
@@ -480,6 +483,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_get_socket_event,
     (req_handler)req_get_socket_info,
     (req_handler)req_enable_socket_event,
+    (req_handler)req_complete_socket_io,
     (req_handler)req_set_socket_deferred,
     (req_handler)req_alloc_console,
     (req_handler)req_free_console,
@@ -951,12 +955,25 @@ C_ASSERT( FIELD_OFFSET(struct event_op_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct event_op_request, op) == 16 );
 C_ASSERT( sizeof(struct event_op_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct event_op_reply, state) == 8 );
-C_ASSERT( sizeof(struct event_op_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct event_op_reply, manual_reset) == 12 );
+C_ASSERT( FIELD_OFFSET(struct event_op_reply, access) == 16 );
+C_ASSERT( FIELD_OFFSET(struct event_op_reply, index) == 20 );
+C_ASSERT( FIELD_OFFSET(struct event_op_reply, id) == 24 );
+C_ASSERT( sizeof(struct event_op_reply) == 32 );
 C_ASSERT( FIELD_OFFSET(struct query_event_request, handle) == 12 );
 C_ASSERT( sizeof(struct query_event_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct query_event_reply, manual_reset) == 8 );
 C_ASSERT( FIELD_OFFSET(struct query_event_reply, state) == 12 );
 C_ASSERT( sizeof(struct query_event_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_sync_state_request, handle) == 12 );
+C_ASSERT( FIELD_OFFSET(struct get_sync_state_request, want_mapping) == 16 );
+C_ASSERT( sizeof(struct get_sync_state_request) == 24 );
+C_ASSERT( FIELD_OFFSET(struct get_sync_state_reply, access) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_sync_state_reply, type) == 12 );
+C_ASSERT( FIELD_OFFSET(struct get_sync_state_reply, index) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_sync_state_reply, id) == 20 );
+C_ASSERT( FIELD_OFFSET(struct get_sync_state_reply, mapping) == 24 );
+C_ASSERT( sizeof(struct get_sync_state_reply) == 32 );
 C_ASSERT( FIELD_OFFSET(struct open_event_request, access) == 12 );
 C_ASSERT( FIELD_OFFSET(struct open_event_request, attributes) == 16 );
 C_ASSERT( FIELD_OFFSET(struct open_event_request, rootdir) == 20 );
@@ -1004,7 +1021,10 @@ C_ASSERT( FIELD_OFFSET(struct release_semaphore_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct release_semaphore_request, count) == 16 );
 C_ASSERT( sizeof(struct release_semaphore_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct release_semaphore_reply, prev_count) == 8 );
-C_ASSERT( sizeof(struct release_semaphore_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct release_semaphore_reply, access) == 12 );
+C_ASSERT( FIELD_OFFSET(struct release_semaphore_reply, index) == 16 );
+C_ASSERT( FIELD_OFFSET(struct release_semaphore_reply, id) == 20 );
+C_ASSERT( sizeof(struct release_semaphore_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct query_semaphore_request, handle) == 12 );
 C_ASSERT( sizeof(struct query_semaphore_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct query_semaphore_reply, current) == 8 );
@@ -1121,6 +1141,12 @@ C_ASSERT( FIELD_OFFSET(struct enable_socket_event_request, mask) == 16 );
 C_ASSERT( FIELD_OFFSET(struct enable_socket_event_request, sstate) == 20 );
 C_ASSERT( FIELD_OFFSET(struct enable_socket_event_request, cstate) == 24 );
 C_ASSERT( sizeof(struct enable_socket_event_request) == 32 );
+C_ASSERT( FIELD_OFFSET(struct complete_socket_io_request, handle) == 12 );
+C_ASSERT( FIELD_OFFSET(struct complete_socket_io_request, mask) == 16 );
+C_ASSERT( FIELD_OFFSET(struct complete_socket_io_request, cvalue) == 24 );
+C_ASSERT( FIELD_OFFSET(struct complete_socket_io_request, information) == 32 );
+C_ASSERT( FIELD_OFFSET(struct complete_socket_io_request, status) == 40 );
+C_ASSERT( sizeof(struct complete_socket_io_request) == 48 );
 C_ASSERT( FIELD_OFFSET(struct set_socket_deferred_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct set_socket_deferred_request, deferred) == 16 );
 C_ASSERT( sizeof(struct set_socket_deferred_request) == 24 );
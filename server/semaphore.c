@@ -41,6 +41,7 @@ struct semaphore
     struct object  obj;    /* object header */
     unsigned int   count;  /* current count */
     unsigned int   max;    /* maximum possible count */
+    unsigned int   state_index; /* index of the published state */
 };
 
 static void semaphore_dump( struct object *obj, int verbose );
@@ -49,6 +50,7 @@ static int semaphore_signaled( struct object *obj, struct wait_queue_entry *entr
 static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static unsigned int semaphore_map_access( struct object *obj, unsigned int access );
 static int semaphore_signal( struct object *obj, unsigned int access );
+static void semaphore_destroy( struct object *obj );
 
 static const struct object_ops semaphore_ops =
 {
@@ -70,7 +72,7 @@ static const struct object_ops semaphore_ops =
     no_open_file,                  /* open_file */
     no_kernel_obj_list,            /* get_kernel_obj_list */
     no_close_handle,               /* close_handle */
-    no_destroy                     /* destroy */
+    semaphore_destroy              /* destroy */
 };
 
 
@@ -92,6 +94,7 @@ static struct semaphore *create_semaphore( struct object *root, const struct uni
             /* initialize it if it didn't already exist */
             sem->count = initial;
             sem->max   = max;
+            sem->state_index = alloc_sync_state( initial );
         }
     }
     return sem;
@@ -116,6 +119,7 @@ static int release_semaphore( struct semaphore *sem, unsigned int count,
         sem->count = count;
         wake_up( &sem->obj, count );
     }
+    set_sync_state( sem->state_index, sem->count );
     return 1;
 }
 
@@ -146,6 +150,7 @@ static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *en
     assert( obj->ops == &semaphore_ops );
     assert( sem->count );
     sem->count--;
+    set_sync_state( sem->state_index, sem->count );
 }
 
 static unsigned int semaphore_map_access( struct object *obj, unsigned int access )
@@ -170,6 +175,19 @@ static int semaphore_signal( struct object *obj, unsigned int access )
     return release_semaphore( sem, 1, NULL );
 }
 
+static void semaphore_destroy( struct object *obj )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    free_sync_state( sem->state_index );
+}
+
+unsigned int get_semaphore_state_index( struct object *obj )
+{
+    if (obj->ops != &semaphore_ops) return 0;
+    return ((struct semaphore *)obj)->state_index;
+}
+
 /* create a semaphore */
 DECL_HANDLER(create_semaphore)
 {
@@ -212,6 +230,9 @@ DECL_HANDLER(release_semaphore)
                                                    SEMAPHORE_MODIFY_STATE, &semaphore_ops )))
     {
         release_semaphore( sem, req->count, &reply->prev_count );
+        reply->access = get_handle_access( current->process, req->handle );
+        reply->index  = sem->state_index;
+        reply->id     = get_sync_state_id( sem->state_index );
         release_object( sem );
     }
 }
@@ -1303,6 +1303,27 @@ DECL_HANDLER(enable_socket_event)
     release_object( &sock->obj );
 }
 
+DECL_HANDLER(complete_socket_io)
+{
+    struct sock *sock;
+
+    if (!(sock = (struct sock *)get_handle_obj( current->process, req->handle,
+                                                FILE_WRITE_ATTRIBUTES, &sock_ops )))
+        return;
+
+    if (req->cvalue) fd_add_completion( sock->fd, req->cvalue, req->status, req->information, 0 );
+
+    if (req->mask)
+    {
+        sock->pmask &= ~req->mask;
+        sock->hmask &= ~req->mask;
+        if ( sock->type != SOCK_STREAM ) sock->state &= ~STREAM_FLAG_MASK;
+        sock_reselect( sock );
+    }
+
+    release_object( &sock->obj );
+}
+
 DECL_HANDLER(set_socket_deferred)
 {
     struct sock *sock, *acceptsock;
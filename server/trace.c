@@ -1625,6 +1625,10 @@ static void dump_event_op_request( const struct event_op_request *req )
 static void dump_event_op_reply( const struct event_op_reply *req )
 {
     fprintf( stderr, " state=%d", req->state );
+    fprintf( stderr, ", manual_reset=%d", req->manual_reset );
+    fprintf( stderr, ", access=%08x", req->access );
+    fprintf( stderr, ", index=%08x", req->index );
+    fprintf( stderr, ", id=%08x", req->id );
 }
 
 static void dump_query_event_request( const struct query_event_request *req )
@@ -1638,6 +1642,21 @@ static void dump_query_event_reply( const struct query_event_reply *req )
     fprintf( stderr, ", state=%d", req->state );
 }
 
+static void dump_get_sync_state_request( const struct get_sync_state_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", want_mapping=%d", req->want_mapping );
+}
+
+static void dump_get_sync_state_reply( const struct get_sync_state_reply *req )
+{
+    fprintf( stderr, " access=%08x", req->access );
+    fprintf( stderr, ", type=%08x", req->type );
+    fprintf( stderr, ", index=%08x", req->index );
+    fprintf( stderr, ", id=%08x", req->id );
+    fprintf( stderr, ", mapping=%04x", req->mapping );
+}
+
 static void dump_open_event_request( const struct open_event_request *req )
 {
     fprintf( stderr, " access=%08x", req->access );
@@ -1744,6 +1763,9 @@ static void dump_release_semaphore_request( const struct release_semaphore_reque
 static void dump_release_semaphore_reply( const struct release_semaphore_reply *req )
 {
     fprintf( stderr, " prev_count=%08x", req->prev_count );
+    fprintf( stderr, ", access=%08x", req->access );
+    fprintf( stderr, ", index=%08x", req->index );
+    fprintf( stderr, ", id=%08x", req->id );
 }
 
 static void dump_query_semaphore_request( const struct query_semaphore_request *req )
@@ -1979,6 +2001,15 @@ static void dump_enable_socket_event_request( const struct enable_socket_event_r
     fprintf( stderr, ", cstate=%08x", req->cstate );
 }
 
+static void dump_complete_socket_io_request( const struct complete_socket_io_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", mask=%08x", req->mask );
+    dump_uint64( ", cvalue=", &req->cvalue );
+    dump_uint64( ", information=", &req->information );
+    fprintf( stderr, ", status=%08x", req->status );
+}
+
 static void dump_set_socket_deferred_request( const struct set_socket_deferred_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
@@ -4628,6 +4659,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_create_event_request,
     (dump_func)dump_event_op_request,
     (dump_func)dump_query_event_request,
+    (dump_func)dump_get_sync_state_request,
     (dump_func)dump_open_event_request,
     (dump_func)dump_create_keyed_event_request,
     (dump_func)dump_open_keyed_event_request,
@@ -4657,6 +4689,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_socket_event_request,
     (dump_func)dump_get_socket_info_request,
     (dump_func)dump_enable_socket_event_request,
+    (dump_func)dump_complete_socket_io_request,
     (dump_func)dump_set_socket_deferred_request,
     (dump_func)dump_alloc_console_request,
     (dump_func)dump_free_console_request,
@@ -4926,6 +4959,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_create_event_reply,
     (dump_func)dump_event_op_reply,
     (dump_func)dump_query_event_reply,
+    (dump_func)dump_get_sync_state_reply,
     (dump_func)dump_open_event_reply,
     (dump_func)dump_create_keyed_event_reply,
     (dump_func)dump_open_keyed_event_reply,
@@ -4956,6 +4990,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_socket_info_reply,
     NULL,
     NULL,
+    NULL,
     (dump_func)dump_alloc_console_reply,
     NULL,
     (dump_func)dump_get_console_renderer_events_reply,
@@ -5224,6 +5259,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "create_event",
     "event_op",
     "query_event",
+    "get_sync_state",
     "open_event",
     "create_keyed_event",
     "open_keyed_event",
@@ -5253,6 +5289,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "get_socket_event",
     "get_socket_info",
     "enable_socket_event",
+    "complete_socket_io",
     "set_socket_deferred",
     "alloc_console",
     "free_console",